@@ -0,0 +1,685 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <curl/curl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+
+#include "../src/db.h"
+#include "../src/game_list_model.h"
+#include "../src/http.h"
+#include "../src/http_cache.h"
+#include "../src/json_stream.h"
+#include "../src/search.h"
+#include "../src/steam.h"
+#include "fake_steam.h"
+
+#define BENCH_MAX_ITERATIONS 32
+#define BENCH_MAX_SAMPLES 256
+#define BENCH_DEFAULT_ITERATIONS 5
+#define BENCH_DEFAULT_LATENCY_MS 50
+#define BENCH_DEFAULT_SIZES "100,10000,100000"
+#define BENCH_DEFAULT_OUTPUT "bench.json"
+#define BENCH_CHUNK_SIZE (16 * 1024)  // roughly what curl hands the write callback
+
+// Well-formed but fake, the stub doesn't check them
+#define BENCH_API_KEY "0123456789ABCDEF0123456789ABCDEF"
+#define BENCH_STEAM_ID "76561197960287930"
+
+static const char *title_words[] = {
+    "The", "Dark", "Souls", "Witcher", "Grand", "Theft", "Auto", "Counter", "Strike", "Half", "Life",
+    "Portal", "Legend", "Star", "Wars", "Knights", "Old", "Republic", "Civilization", "Age", "Empires",
+    "Total", "War", "Fallout", "Elder", "Scrolls", "Mass", "Effect", "Dragon", "Age", "Hollow", "Knight",
+    "Stardew", "Valley", "Terraria", "Factorio", "Rimworld", "Tomb", "Raider", "Résistance", "Pokémon",
+    "Space", "Station", "Simulator", "Tycoon", "Racing", "Football", "Manager", "Chronicles", "Origins",
+};
+
+static const char *queries[] = { "witcher", "gta", "star wars", "wticher", "sim", "the legend", "zzqx" };
+
+typedef struct {
+    size_t count;
+    SteamGame *games;
+    char *payload;          // GetOwnedGames response for the games
+    size_t payload_size;
+} Library;
+
+typedef struct {
+    double samples[BENCH_MAX_SAMPLES];
+    int count;
+} Samples;
+
+typedef struct {
+    FILE *out;
+    int results;
+    int iterations;
+    int latency_ms;
+    char *db_path;
+    char *cache_dir;
+} Bench;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void add_sample(Samples *samples, double ms)
+{
+    if (samples->count < BENCH_MAX_SAMPLES) {
+        samples->samples[samples->count++] = ms;
+    }
+}
+
+// Writes one result object; items is what a second of work gets through
+static void report(Bench *bench, const char *name, size_t games, Samples *samples, size_t items)
+{
+    double sum = 0;
+    double median;
+    int i;
+
+    if (samples->count == 0) {
+        return;
+    }
+    qsort(samples->samples, samples->count, sizeof(double), compare_doubles);
+    for (i = 0; i < samples->count; i++) {
+        sum += samples->samples[i];
+    }
+    median = samples->count % 2 ? samples->samples[samples->count / 2]
+                                : (samples->samples[samples->count / 2 - 1] + samples->samples[samples->count / 2]) / 2;
+
+    fprintf(bench->out, "%s\n    {\"name\": \"%s\", \"games\": %zu, \"iterations\": %d, "
+            "\"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, \"max_ms\": %.3f, \"items_per_sec\": %.0f}",
+            bench->results++ ? "," : "", name, games, samples->count,
+            samples->samples[0], median, sum / samples->count, samples->samples[samples->count - 1],
+            median > 0 ? items / (median / 1000) : 0);
+    fprintf(stderr, "%-22s %7zu games  median %10.3f ms  min %10.3f ms\n", name, games, median, samples->samples[0]);
+}
+
+// Deterministic, so runs are comparable across builds
+static guint32 next_random(guint32 *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static void library_init(Library *library, size_t count)
+{
+    guint32 state = 2463534242u;
+    GString *payload = g_string_sized_new(count * 96 + 64);
+    size_t i;
+
+    library->count = count;
+    library->games = g_new(SteamGame, count);
+
+    g_string_append_printf(payload, "{\"response\":{\"game_count\":%zu,\"games\":[", count);
+    for (i = 0; i < count; i++) {
+        GString *name = g_string_new(NULL);
+        guint words = 1 + next_random(&state) % 4;
+        guint w;
+
+        for (w = 0; w < words; w++) {
+            g_string_append_printf(name, "%s%s", w ? " " : "", title_words[next_random(&state) % G_N_ELEMENTS(title_words)]);
+        }
+        if (next_random(&state) % 3 == 0) {
+            g_string_append_printf(name, " %u", 2 + next_random(&state) % 8);
+        }
+
+        library->games[i].game_id = (int)(10 + i * 10);
+        library->games[i].playtime = (int)(next_random(&state) % 5000);
+        // Most of a library is never played
+        library->games[i].last_played = next_random(&state) % 4 ? 0 : 1500000000 + next_random(&state) % 200000000;
+        library->games[i].playtime_2weeks = library->games[i].last_played ? (int)(next_random(&state) % 600) : 0;
+        library->games[i].game_name = g_string_free(name, FALSE);
+        library->games[i].icon_hash = g_strdup_printf("%08x%08x%08x%08x%08x", next_random(&state), next_random(&state),
+                                                      next_random(&state), next_random(&state), next_random(&state));
+
+        g_string_append_printf(payload,
+                               "%s{\"appid\":%d,\"name\":\"%s\",\"playtime_forever\":%d,\"img_icon_url\":\"%s\","
+                               "\"has_community_visible_stats\":true,\"playtime_linux_forever\":0,"
+                               "\"rtime_last_played\":%lld,\"playtime_2weeks\":%d}",
+                               i ? "," : "", library->games[i].game_id, library->games[i].game_name,
+                               library->games[i].playtime, library->games[i].icon_hash,
+                               (long long)library->games[i].last_played, library->games[i].playtime_2weeks);
+    }
+    g_string_append(payload, "]}}");
+
+    library->payload_size = payload->len;
+    library->payload = g_string_free(payload, FALSE);
+}
+
+static void library_clear(Library *library)
+{
+    size_t i;
+
+    for (i = 0; i < library->count; i++) {
+        g_free((char *)library->games[i].game_name);
+        g_free((char *)library->games[i].icon_hash);
+    }
+    g_free(library->games);
+    g_free(library->payload);
+}
+
+static void remove_database(const char *db_path)
+{
+    char *wal = g_strconcat(db_path, "-wal", NULL);
+    char *shm = g_strconcat(db_path, "-shm", NULL);
+
+    g_remove(db_path);
+    g_remove(wal);
+    g_remove(shm);
+    g_free(wal);
+    g_free(shm);
+}
+
+static void clear_directory(const char *path)
+{
+    GDir *dir = g_dir_open(path, 0, NULL);
+    const char *name;
+
+    if (!dir) {
+        return;
+    }
+    while ((name = g_dir_read_name(dir))) {
+        char *file = g_build_filename(path, name, NULL);
+        g_remove(file);
+        g_free(file);
+    }
+    g_dir_close(dir);
+}
+
+static sqlite3 *open_empty_database(Bench *bench)
+{
+    sqlite3 *db;
+
+    remove_database(bench->db_path);
+    db = db_open(bench->db_path);
+    if (db && !db_migrate(db)) {
+        db_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+static int count_event(JsonEvent event, const char *text, size_t len, int depth, void *user_data)
+{
+    if (event == JSON_EVENT_OBJECT_END && depth == 3) {
+        (*(size_t *)user_data)++;
+    }
+    return 0;
+}
+
+static void bench_json_parse(Bench *bench, Library *library)
+{
+    Samples samples = {0};
+    int i;
+
+    for (i = 0; i < bench->iterations; i++) {
+        size_t games = 0;
+        size_t offset;
+        double start = now_ms();
+        JsonStream *json = json_stream_new(count_event, &games);
+
+        for (offset = 0; offset < library->payload_size; offset += BENCH_CHUNK_SIZE) {
+            json_stream_feed(json, library->payload + offset, MIN(BENCH_CHUNK_SIZE, library->payload_size - offset));
+        }
+        if (!json_stream_finish(json) || games != library->count) {
+            fprintf(stderr, "json_parse: %s\n", json_stream_error(json));
+        }
+        json_stream_free(json);
+        add_sample(&samples, now_ms() - start);
+    }
+    report(bench, "json_parse", library->count, &samples, library->count);
+}
+
+// Leaves the imported library in the database for the read benchmarks
+static sqlite3 *bench_insert_games(Bench *bench, Library *library)
+{
+    Samples samples = {0};
+    sqlite3 *db = NULL;
+    int i;
+
+    for (i = 0; i < bench->iterations; i++) {
+        double start;
+
+        db_close(db);
+        db = open_empty_database(bench);
+        if (!db) {
+            return NULL;
+        }
+        start = now_ms();
+        if (!insert_games(db, library->games, library->count)) {
+            fprintf(stderr, "insert_games failed\n");
+        }
+        add_sample(&samples, now_ms() - start);
+    }
+    report(bench, "insert_games", library->count, &samples, library->count);
+    return db;
+}
+
+static void count_row(int game_id, const char *game_name, const char *install_path, int playtime, void *user_data)
+{
+    (*(size_t *)user_data)++;
+}
+
+static void bench_fetch_all_games(Bench *bench, sqlite3 *db, Library *library)
+{
+    Samples samples = {0};
+    int i;
+
+    for (i = 0; i < bench->iterations; i++) {
+        size_t rows = 0;
+        double start = now_ms();
+
+        db_fetch_all_games(db, count_row, &rows);
+        add_sample(&samples, now_ms() - start);
+        if (rows != library->count) {
+            fprintf(stderr, "db_fetch_all_games returned %zu rows\n", rows);
+        }
+    }
+    report(bench, "db_fetch_all_games", library->count, &samples, library->count);
+}
+
+// The first screen of the recently and most played views, read from their
+// covering indexes
+static void bench_played_views(Bench *bench, sqlite3 *db, Library *library)
+{
+    Samples recent = {0};
+    Samples most = {0};
+    int i;
+
+    for (i = 0; i < bench->iterations; i++) {
+        size_t rows = 0;
+        double start = now_ms();
+
+        db_fetch_recently_played(db, 50, count_row, &rows);
+        add_sample(&recent, now_ms() - start);
+        start = now_ms();
+        db_fetch_most_played(db, 50, count_row, &rows);
+        add_sample(&most, now_ms() - start);
+    }
+    report(bench, "db_recently_played", library->count, &recent, 50);
+    report(bench, "db_most_played", library->count, &most, 50);
+}
+
+static const char *store_genres[] = { "Action", "Adventure", "RPG", "Strategy", "Simulation", "Indie", "Racing", "Sports" };
+static const char *store_categories[] = { "Single-player", "Multi-player", "Co-op", "Steam Achievements", "Controller Support" };
+static const char *store_queries[] = { "witcher", "star wars", "genre:rpg", "tag:co-op dark", "dev:studio 1" };
+
+static void count_match(int game_id, void *user_data)
+{
+    (*(size_t *)user_data)++;
+}
+
+// Store details for every game, then searches over them the way the search
+// entry does: plain words, and words limited to a field
+static void bench_store_search(Bench *bench, sqlite3 *db, Library *library)
+{
+    Samples samples = {0};
+    size_t i, rows = 0;
+    int q;
+
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    for (i = 0; i < library->count; i++) {
+        char developers[32];
+        char description[256];
+        StoreDetails details = {0};
+
+        snprintf(developers, sizeof(developers), "Studio %zu", i % 97);
+        snprintf(description, sizeof(description), "%s is a %s game about %s.", library->games[i].game_name,
+                 store_genres[i % G_N_ELEMENTS(store_genres)], title_words[i % G_N_ELEMENTS(title_words)]);
+        details.game_id = library->games[i].game_id;
+        details.name = library->games[i].game_name;
+        details.genres = store_genres[i % G_N_ELEMENTS(store_genres)];
+        details.categories = store_categories[i % G_N_ELEMENTS(store_categories)];
+        details.developers = developers;
+        details.publishers = developers;
+        details.description = description;
+        db_set_store_details(db, &details, 1700000000);
+    }
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+
+    for (i = 0; i < (size_t)bench->iterations; i++) {
+        double start = now_ms();
+
+        for (q = 0; q < (int)G_N_ELEMENTS(store_queries); q++) {
+            SearchTerms terms;
+
+            search_terms_parse(&terms, store_queries[q]);
+            db_search_store(db, terms.match, count_match, &rows);
+            search_terms_clear(&terms);
+        }
+        add_sample(&samples, (now_ms() - start) / G_N_ELEMENTS(store_queries));
+    }
+    report(bench, "db_store_search", library->count, &samples, library->count);
+}
+
+static void append_row(int game_id, const char *game_name, const char *install_path, int playtime, void *user_data)
+{
+    game_list_model_append((GameListModel *)user_data, game_id, game_name, install_path, playtime);
+}
+
+static void set_last_played(DBGameSource source, int game_id, sqlite3_int64 last_played, void *user_data)
+{
+    game_list_model_set_last_played((GameListModel *)user_data, source == DB_SOURCE_NON_STEAM, game_id, last_played);
+}
+
+static gint score_game(const GameRecord *record, gpointer data)
+{
+    return search_query_score((const SearchQuery *)data, record->folded_name, record->search_mask);
+}
+
+// What a reload of the list does, minus the view: the games alone, then
+// with when the played ones were last played, looked up one by one
+static GameListModel *bench_list_populate(Bench *bench, sqlite3 *db, Library *library)
+{
+    GameListModel *model = game_list_model_new();
+    Samples samples = {0};
+    Samples played = {0};
+    int i;
+
+    for (i = 0; i < bench->iterations; i++) {
+        double start = now_ms();
+
+        game_list_model_clear(model);
+        db_fetch_all_games(db, append_row, model);
+        game_list_model_set_filter(model, NULL, NULL, NULL);
+        add_sample(&samples, now_ms() - start);
+    }
+    report(bench, "list_populate", library->count, &samples, library->count);
+
+    for (i = 0; i < bench->iterations; i++) {
+        double start = now_ms();
+
+        game_list_model_clear(model);
+        db_fetch_all_games(db, append_row, model);
+        db_fetch_last_played(db, set_last_played, model);
+        game_list_model_set_filter(model, NULL, NULL, NULL);
+        add_sample(&played, now_ms() - start);
+    }
+    report(bench, "list_populate_played", library->count, &played, library->count);
+    return model;
+}
+
+static void bench_search(Bench *bench, GameListModel *model, Library *library)
+{
+    Samples first = {0};
+    Samples samples = {0};
+    Samples typing = {0};
+    int i;
+    guint q;
+
+    // The first search folds every title
+    for (i = 0; i < bench->iterations; i++) {
+        double start;
+
+        game_list_model_clear(model);
+        for (q = 0; q < library->count; q++) {
+            const SteamGame *game = &library->games[q];
+            game_list_model_append(model, game->game_id, game->game_name, NULL, game->playtime);
+        }
+        start = now_ms();
+        game_list_model_set_filter(model, score_game, search_query_new(queries[0]), (GDestroyNotify)search_query_free);
+        add_sample(&first, now_ms() - start);
+    }
+    report(bench, "search_first", library->count, &first, library->count);
+
+    for (i = 0; i < bench->iterations; i++) {
+        for (q = 0; q < G_N_ELEMENTS(queries); q++) {
+            double start = now_ms();
+            game_list_model_set_filter(model, score_game, search_query_new(queries[q]), (GDestroyNotify)search_query_free);
+            add_sample(&samples, now_ms() - start);
+        }
+    }
+    report(bench, "search", library->count, &samples, library->count);
+
+    // Typing a query key by key, refining while the query only narrows
+    for (i = 0; i < bench->iterations; i++) {
+        const char *text = "witcher 3";
+        double start = now_ms();
+        size_t len;
+
+        game_list_model_set_filter(model, NULL, NULL, NULL);
+        for (len = 1; len <= strlen(text); len++) {
+            char *prefix = g_strndup(text, len);
+            SearchQuery *query = search_query_new(prefix);
+            SearchQuery *previous = game_list_model_get_filter_data(model);
+
+            if (!query) {
+                game_list_model_set_filter(model, NULL, NULL, NULL);
+            } else if (previous && search_query_narrows(query, previous)) {
+                game_list_model_refine(model, score_game, query, (GDestroyNotify)search_query_free);
+            } else {
+                game_list_model_set_filter(model, score_game, query, (GDestroyNotify)search_query_free);
+            }
+            g_free(prefix);
+        }
+        add_sample(&typing, now_ms() - start);
+    }
+    report(bench, "search_typing", library->count, &typing, library->count);
+}
+
+// Switching between the orders the catalog keeps, with and without a filter
+static void bench_sort(Bench *bench, GameListModel *model, Library *library)
+{
+    Samples samples = {0};
+    Samples filtered = {0};
+    int i;
+    int sort;
+
+    game_list_model_set_filter(model, NULL, NULL, NULL);
+    for (i = 0; i < bench->iterations; i++) {
+        double start = now_ms();
+
+        for (sort = 0; sort < CATALOG_N_SORTS; sort++) {
+            game_list_model_set_sort(model, (CatalogSort)sort);
+        }
+        add_sample(&samples, (now_ms() - start) / CATALOG_N_SORTS);
+    }
+    report(bench, "sort_switch", library->count, &samples, library->count);
+
+    game_list_model_set_filter(model, score_game, search_query_new(queries[4]), (GDestroyNotify)search_query_free);
+    for (i = 0; i < bench->iterations; i++) {
+        double start = now_ms();
+
+        for (sort = 0; sort < CATALOG_N_SORTS; sort++) {
+            game_list_model_set_sort(model, (CatalogSort)sort);
+        }
+        add_sample(&filtered, (now_ms() - start) / CATALOG_N_SORTS);
+    }
+    report(bench, "sort_switch_filtered", library->count, &filtered, library->count);
+    game_list_model_set_sort(model, CATALOG_SORT_NAME);
+}
+
+static void report_requests(const char *name, size_t requests, int syncs)
+{
+    if (syncs > 0) {
+        fprintf(stderr, "%-22s %7.1f requests per sync\n", name, (double)requests / syncs);
+    }
+}
+
+// One sync against the stub, adding the requests it made to *requests
+static double timed_sync(FakeSteam *server, HttpClient *client, HttpCache *cache, sqlite3 *db, size_t *requests)
+{
+    size_t before = fake_steam_request_count(server);
+    double start = now_ms();
+    SteamFetchResult result = fetch_data_from_steam_api(client, cache, BENCH_API_KEY, BENCH_STEAM_ID, db, NULL, NULL);
+    double elapsed = now_ms() - start;
+
+    if (result != STEAM_FETCH_OK && result != STEAM_FETCH_UNCHANGED) {
+        fprintf(stderr, "sync against %s failed\n", fake_steam_base_url(server));
+    }
+    *requests += fake_steam_request_count(server) - before;
+    return elapsed;
+}
+
+// Full syncs against the stub: into an empty database, then again with the
+// library already stored, and once more answered from a fresh HTTP cache
+static void bench_sync(Bench *bench, Library *library)
+{
+    FakeSteam *server = fake_steam_start(library->payload, library->payload_size, bench->latency_ms);
+    HttpClient *client;
+    HttpCache *cache;
+    Samples cold = {0};
+    Samples warm = {0};
+    Samples cached = {0};
+    size_t cold_requests = 0;
+    size_t warm_requests = 0;
+    size_t cached_requests = 0;
+    size_t priming_requests = 0;
+    int i;
+
+    if (!server) {
+        return;
+    }
+    g_setenv("LVL_STEAM_API_BASE", fake_steam_base_url(server), TRUE);
+    client = http_client_new();
+    cache = http_cache_new(bench->cache_dir);
+
+    for (i = 0; i < bench->iterations; i++) {
+        sqlite3 *db = open_empty_database(bench);
+
+        if (!db) {
+            break;
+        }
+        clear_directory(bench->cache_dir);
+        add_sample(&cold, timed_sync(server, client, NULL, db, &cold_requests));
+        add_sample(&warm, timed_sync(server, client, NULL, db, &warm_requests));
+
+        // Fills the cache, which the measured sync then finds fresh
+        timed_sync(server, client, cache, db, &priming_requests);
+        add_sample(&cached, timed_sync(server, client, cache, db, &cached_requests));
+        db_close(db);
+    }
+    report(bench, "sync", library->count, &cold, library->count);
+    report_requests("sync", cold_requests, cold.count);
+    report(bench, "resync", library->count, &warm, library->count);
+    report_requests("resync", warm_requests, warm.count);
+    report(bench, "resync_cached", library->count, &cached, library->count);
+    report_requests("resync_cached", cached_requests, cached.count);
+
+    clear_directory(bench->cache_dir);
+    http_cache_free(cache);
+    http_client_free(client);
+    fake_steam_stop(server);
+    g_unsetenv("LVL_STEAM_API_BASE");
+}
+
+static void run_size(Bench *bench, size_t count)
+{
+    Library library;
+    GameListModel *model;
+    sqlite3 *db;
+
+    library_init(&library, count);
+
+    bench_json_parse(bench, &library);
+    db = bench_insert_games(bench, &library);
+    if (db) {
+        bench_fetch_all_games(bench, db, &library);
+        bench_played_views(bench, db, &library);
+        bench_store_search(bench, db, &library);
+        model = bench_list_populate(bench, db, &library);
+        bench_search(bench, model, &library);
+        bench_sort(bench, model, &library);
+        g_object_unref(model);
+        db_close(db);
+    }
+    bench_sync(bench, &library);
+
+    library_clear(&library);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-o FILE] [-n SIZES] [-i ITERATIONS] [-l LATENCY_MS]\n"
+            "  -o FILE        where to write the JSON results (default " BENCH_DEFAULT_OUTPUT ", - for stdout)\n"
+            "  -n SIZES       comma separated library sizes (default " BENCH_DEFAULT_SIZES ")\n"
+            "  -i ITERATIONS  runs per benchmark (default %d)\n"
+            "  -l LATENCY_MS  delay of every fake Steam API response (default %d)\n",
+            name, BENCH_DEFAULT_ITERATIONS, BENCH_DEFAULT_LATENCY_MS);
+}
+
+int main(int argc, char *argv[])
+{
+    Bench bench = {0};
+    const char *output = BENCH_DEFAULT_OUTPUT;
+    const char *sizes = BENCH_DEFAULT_SIZES;
+    char **size_list;
+    char *db_dir;
+    int i;
+
+    bench.iterations = BENCH_DEFAULT_ITERATIONS;
+    bench.latency_ms = BENCH_DEFAULT_LATENCY_MS;
+    for (i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-o") == 0) {
+            output = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            sizes = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "-i") == 0) {
+            bench.iterations = CLAMP(atoi(argv[++i]), 1, BENCH_MAX_ITERATIONS);
+        } else if (i + 1 < argc && strcmp(argv[i], "-l") == 0) {
+            bench.latency_ms = MAX(atoi(argv[++i]), 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    db_dir = g_dir_make_tmp("lvl-bench-XXXXXX", NULL);
+    if (!db_dir) {
+        fprintf(stderr, "Can't create a temporary directory\n");
+        return 1;
+    }
+    bench.db_path = g_build_filename(db_dir, "games.db", NULL);
+    bench.cache_dir = g_build_filename(db_dir, "http", NULL);
+    g_mkdir(bench.cache_dir, 0700);
+
+    // The database code reports progress on stdout, so results only go there on request
+    bench.out = strcmp(output, "-") == 0 ? stdout : fopen(output, "w");
+    if (!bench.out) {
+        fprintf(stderr, "Can't write %s\n", output);
+        return 1;
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    fprintf(bench.out, "{\n  \"suite\": \"lvl\",\n  \"sqlite\": \"%s\",\n  \"iterations\": %d,\n  \"latency_ms\": %d,\n  \"results\": [",
+            sqlite3_libversion(), bench.iterations, bench.latency_ms);
+
+    size_list = g_strsplit(sizes, ",", -1);
+    for (i = 0; size_list[i]; i++) {
+        size_t count = strtoul(size_list[i], NULL, 10);
+        if (count > 0) {
+            run_size(&bench, count);
+        }
+    }
+    g_strfreev(size_list);
+
+    fprintf(bench.out, "\n  ]\n}\n");
+    if (bench.out != stdout) {
+        fclose(bench.out);
+        fprintf(stderr, "Wrote %s\n", output);
+    }
+    curl_global_cleanup();
+
+    remove_database(bench.db_path);
+    g_rmdir(bench.cache_dir);
+    g_rmdir(db_dir);
+    g_free(bench.db_path);
+    g_free(bench.cache_dir);
+    g_free(db_dir);
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "fake_steam.h"
+
+#define FAKE_STEAM_MAX_CONNECTIONS 64
+#define FAKE_STEAM_REQUEST_MAX 8192
+
+static const char player_summary[] =
+    "{\"response\":{\"players\":[{\"steamid\":\"76561197960287930\",\"personaname\":\"bench\"}]}}";
+
+struct FakeSteam {
+    const char *owned_games;
+    size_t owned_games_size;
+    int latency_ms;
+    int listen_fd;
+    char base_url[64];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    int connections[FAKE_STEAM_MAX_CONNECTIONS];  // -1 for free slots
+    int active;
+    int stopping;
+    size_t requests;
+};
+
+typedef struct {
+    FakeSteam *server;
+    int slot;
+} Connection;
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static int send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return 0;
+        }
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 1;
+}
+
+static int respond(FakeSteam *server, int fd, const char *request)
+{
+    const char *body;
+    size_t body_size;
+    const char *status = "200 OK";
+    char header[256];
+
+    if (strstr(request, "/GetOwnedGames/")) {
+        body = server->owned_games;
+        body_size = server->owned_games_size;
+    } else if (strstr(request, "/GetPlayerSummaries/")) {
+        body = player_summary;
+        body_size = sizeof(player_summary) - 1;
+    } else {
+        status = "404 Not Found";
+        body = "";
+        body_size = 0;
+    }
+
+    if (server->latency_ms > 0) {
+        sleep_ms(server->latency_ms);
+    }
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n\r\n", status, body_size);
+    return send_all(fd, header, strlen(header)) && send_all(fd, body, body_size);
+}
+
+// Serves keep-alive requests on one connection until the client closes it.
+// Requests are GETs, so they end with the blank line after the headers.
+static void *connection_thread(void *data)
+{
+    Connection *connection = (Connection *)data;
+    FakeSteam *server = connection->server;
+    int fd = server->connections[connection->slot];
+    char buffer[FAKE_STEAM_REQUEST_MAX + 1];
+    size_t len = 0;
+
+    for (;;) {
+        char *end;
+        ssize_t received = recv(fd, buffer + len, FAKE_STEAM_REQUEST_MAX - len, 0);
+
+        if (received <= 0) {
+            break;
+        }
+        len += (size_t)received;
+        buffer[len] = '\0';
+
+        while ((end = strstr(buffer, "\r\n\r\n"))) {
+            size_t request_len = (size_t)(end - buffer) + 4;
+
+            *end = '\0';
+            pthread_mutex_lock(&server->lock);
+            server->requests++;
+            pthread_mutex_unlock(&server->lock);
+            if (!respond(server, fd, buffer)) {
+                goto done;
+            }
+            memmove(buffer, buffer + request_len, len - request_len + 1);
+            len -= request_len;
+        }
+        if (len == FAKE_STEAM_REQUEST_MAX) {
+            break;  // Not a request we would ever get
+        }
+    }
+
+done:
+    close(fd);
+    pthread_mutex_lock(&server->lock);
+    server->connections[connection->slot] = -1;
+    server->active--;
+    pthread_cond_signal(&server->idle);
+    pthread_mutex_unlock(&server->lock);
+    free(connection);
+    return NULL;
+}
+
+static void *accept_thread(void *data)
+{
+    FakeSteam *server = (FakeSteam *)data;
+
+    for (;;) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        Connection *connection;
+        pthread_t thread;
+        int slot;
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;  // The listening socket was shut down
+        }
+
+        pthread_mutex_lock(&server->lock);
+        for (slot = 0; slot < FAKE_STEAM_MAX_CONNECTIONS && server->connections[slot] != -1; slot++) {
+        }
+        if (server->stopping || slot == FAKE_STEAM_MAX_CONNECTIONS) {
+            pthread_mutex_unlock(&server->lock);
+            close(fd);
+            continue;
+        }
+        server->connections[slot] = fd;
+        server->active++;
+        pthread_mutex_unlock(&server->lock);
+
+        connection = malloc(sizeof(Connection));
+        connection->server = server;
+        connection->slot = slot;
+        if (pthread_create(&thread, NULL, connection_thread, connection) != 0) {
+            free(connection);
+            close(fd);
+            pthread_mutex_lock(&server->lock);
+            server->connections[slot] = -1;
+            server->active--;
+            pthread_mutex_unlock(&server->lock);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+FakeSteam *fake_steam_start(const char *owned_games, size_t owned_games_size, int latency_ms)
+{
+    FakeSteam *server = calloc(1, sizeof(FakeSteam));
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int i;
+
+    server->owned_games = owned_games;
+    server->owned_games_size = owned_games_size;
+    server->latency_ms = latency_ms;
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->idle, NULL);
+    for (i = 0; i < FAKE_STEAM_MAX_CONNECTIONS; i++) {
+        server->connections[i] = -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;  // Any free port
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->listen_fd < 0 ||
+        bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->listen_fd, 16) != 0 ||
+        getsockname(server->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        fprintf(stderr, "Can't start the fake Steam API: %s\n", strerror(errno));
+        if (server->listen_fd >= 0) {
+            close(server->listen_fd);
+        }
+        free(server);
+        return NULL;
+    }
+    snprintf(server->base_url, sizeof(server->base_url), "http://127.0.0.1:%d", ntohs(addr.sin_port));
+
+    if (pthread_create(&server->thread, NULL, accept_thread, server) != 0) {
+        fprintf(stderr, "Can't start the fake Steam API thread\n");
+        close(server->listen_fd);
+        free(server);
+        return NULL;
+    }
+    return server;
+}
+
+const char *fake_steam_base_url(const FakeSteam *server)
+{
+    return server->base_url;
+}
+
+size_t fake_steam_request_count(FakeSteam *server)
+{
+    size_t requests;
+
+    pthread_mutex_lock(&server->lock);
+    requests = server->requests;
+    pthread_mutex_unlock(&server->lock);
+    return requests;
+}
+
+void fake_steam_stop(FakeSteam *server)
+{
+    int i;
+
+    if (!server) {
+        return;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = 1;
+    pthread_mutex_unlock(&server->lock);
+    shutdown(server->listen_fd, SHUT_RDWR);  // Wakes up accept
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+
+    // Kept-alive connections are waiting in recv; end them
+    pthread_mutex_lock(&server->lock);
+    for (i = 0; i < FAKE_STEAM_MAX_CONNECTIONS; i++) {
+        if (server->connections[i] != -1) {
+            shutdown(server->connections[i], SHUT_RDWR);
+        }
+    }
+    while (server->active > 0) {
+        pthread_cond_wait(&server->idle, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->idle);
+    free(server);
+}
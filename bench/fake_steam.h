@@ -0,0 +1,18 @@
+#ifndef __FAKE_STEAM_H__
+#define __FAKE_STEAM_H__
+
+#include <stddef.h>
+
+// A minimal HTTP/1.1 server on 127.0.0.1 answering GetPlayerSummaries and
+// GetOwnedGames with canned bodies, so a sync can be measured without the
+// network. Every response is delayed by latency_ms to model the round trip.
+typedef struct FakeSteam FakeSteam;
+
+// Serves owned_games (not copied, must outlive the server) on a free port
+FakeSteam *fake_steam_start(const char *owned_games, size_t owned_games_size, int latency_ms);
+// Base URL to put in LVL_STEAM_API_BASE, e.g. http://127.0.0.1:40123
+const char *fake_steam_base_url(const FakeSteam *server);
+size_t fake_steam_request_count(FakeSteam *server);
+void fake_steam_stop(FakeSteam *server);
+
+#endif /* __FAKE_STEAM_H__ */
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "artwork.h"
+#include "http.h"
+#include "http_cache.h"
+#include "trace.h"
+
+#define ICON_URL "https://media.steampowered.com/steamcommunity/public/images/apps/%d/%s.jpg"
+#define CAPSULE_URL "https://cdn.cloudflare.steamstatic.com/steam/apps/%d/capsule_184x69.jpg"
+
+// Downloads and decodes running at once
+#define ARTWORK_MAX_WORKERS 4
+// A queued request this many requests older than the newest one is dropped
+#define ARTWORK_MAX_BACKLOG 256
+
+// Icons and capsules of one game get neighbouring keys
+#define ART_KEY(game_id, kind) GINT_TO_POINTER(((game_id) << 1) | (kind))
+
+typedef struct {
+    char *icon_hash;
+    char *capsule_hash;
+} GameArt;
+
+typedef enum {
+    ART_LOADING = 1,
+    ART_MISSING         // failed this session; not asked for again
+} ArtState;
+
+typedef struct {
+    gpointer key;
+    GdkPixbuf *pixbuf;
+    gsize size;
+} LruEntry;
+
+struct ArtworkCache {
+    gint ref_count;
+    gint stopping;
+    gint latest;            // sequence number of the newest request
+    char *dir;
+    GMainContext *context;
+    GThreadPool *pool;
+    ArtworkReadyCallback callback;
+    gpointer user_data;
+    GHashTable *games;      // game id -> GameArt
+    GHashTable *states;     // key -> ArtState, for art that isn't in memory
+    GHashTable *entries;    // key -> link in lru
+    GQueue lru;             // LruEntries, most recently used first
+    gsize memory_used;
+    gsize memory_limit;
+};
+
+typedef struct {
+    ArtworkCache *cache;    // holds a reference
+    int game_id;
+    ArtworkKind kind;
+    char *hash;             // content hash of the file, NULL if not known yet
+    gint seq;
+    // Filled in by the worker
+    gboolean skipped;
+    GdkPixbuf *pixbuf;
+    char *new_hash;
+} ArtworkJob;
+
+// Each worker thread keeps its own connections to the image hosts
+static GPrivate worker_client = G_PRIVATE_INIT((GDestroyNotify)http_client_free);
+
+static ArtworkCache *artwork_cache_ref(ArtworkCache *cache)
+{
+    g_atomic_int_inc(&cache->ref_count);
+    return cache;
+}
+
+static void game_art_free(gpointer p)
+{
+    GameArt *art = (GameArt *)p;
+    g_free(art->icon_hash);
+    g_free(art->capsule_hash);
+    g_free(art);
+}
+
+static void lru_entry_free(gpointer p)
+{
+    LruEntry *entry = (LruEntry *)p;
+    g_object_unref(entry->pixbuf);
+    g_free(entry);
+}
+
+static void artwork_cache_unref(ArtworkCache *cache)
+{
+    if (!g_atomic_int_dec_and_test(&cache->ref_count)) {
+        return;
+    }
+    g_queue_clear_full(&cache->lru, lru_entry_free);
+    g_hash_table_destroy(cache->entries);
+    g_hash_table_destroy(cache->states);
+    g_hash_table_destroy(cache->games);
+    g_main_context_unref(cache->context);
+    g_free(cache->dir);
+    g_free(cache);
+}
+
+static void artwork_job_free(gpointer p)
+{
+    ArtworkJob *job = (ArtworkJob *)p;
+
+    if (job->pixbuf) {
+        g_object_unref(job->pixbuf);
+    }
+    g_free(job->hash);
+    g_free(job->new_hash);
+    artwork_cache_unref(job->cache);
+    g_free(job);
+}
+
+static const char *game_art_hash(const GameArt *art, ArtworkKind kind)
+{
+    return kind == ARTWORK_ICON ? art->icon_hash : art->capsule_hash;
+}
+
+static void lru_remove(ArtworkCache *cache, GList *link)
+{
+    LruEntry *entry = (LruEntry *)link->data;
+
+    cache->memory_used -= entry->size;
+    g_hash_table_remove(cache->entries, entry->key);
+    g_queue_delete_link(&cache->lru, link);
+    lru_entry_free(entry);
+}
+
+// Keeps the newest thumbnails within the memory limit, but always the one
+// just added
+static void lru_insert(ArtworkCache *cache, gpointer key, GdkPixbuf *pixbuf)
+{
+    LruEntry *entry = g_new(LruEntry, 1);
+
+    entry->key = key;
+    entry->pixbuf = g_object_ref(pixbuf);
+    entry->size = gdk_pixbuf_get_byte_length(pixbuf);
+    g_queue_push_head(&cache->lru, entry);
+    g_hash_table_insert(cache->entries, key, cache->lru.head);
+    cache->memory_used += entry->size;
+
+    while (cache->memory_used > cache->memory_limit && cache->lru.length > 1) {
+        lru_remove(cache, cache->lru.tail);
+    }
+}
+
+// Drops what is known about one piece of art, so it is loaded again
+static void forget_art(ArtworkCache *cache, gpointer key)
+{
+    GList *link = g_hash_table_lookup(cache->entries, key);
+
+    if (link) {
+        lru_remove(cache, link);
+    }
+    g_hash_table_remove(cache->states, key);
+}
+
+static int abort_if_stopping(void *user_data)
+{
+    ArtworkCache *cache = (ArtworkCache *)user_data;
+    return g_atomic_int_get(&cache->stopping);
+}
+
+static gboolean download(ArtworkCache *cache, const char *url, MemoryStruct *body)
+{
+    HttpClient *client = g_private_get(&worker_client);
+    HttpRequest request;
+    gboolean ok;
+
+    if (!client) {
+        client = http_client_new();
+        g_private_set(&worker_client, client);
+    }
+
+    http_request_init(&request, url);
+    ok = http_client_add(client, &request) &&
+         http_client_run(client, abort_if_stopping, cache) &&
+         request.result == CURLE_OK && request.status == 200 && request.body.size > 0;
+    if (ok) {
+        *body = request.body;
+        request.body.memory = NULL;
+    } else if (request.result == CURLE_OK && request.status != 404) {
+        // Plenty of games have no capsule; don't report those
+        fprintf(stderr, "Failed to download %s: HTTP %ld\n", url, request.status);
+    }
+    http_request_clear(&request);
+    return ok;
+}
+
+// Takes a finished job in on the main context. Results for art that changed
+// while the job ran are dropped.
+static gboolean deliver_artwork(gpointer data)
+{
+    ArtworkJob *job = (ArtworkJob *)data;
+    ArtworkCache *cache = job->cache;
+    gpointer key = ART_KEY(job->game_id, job->kind);
+    GameArt *art;
+
+    if (g_atomic_int_get(&cache->stopping)) {
+        return G_SOURCE_REMOVE;
+    }
+    art = g_hash_table_lookup(cache->games, GINT_TO_POINTER(job->game_id));
+    if (!art || g_strcmp0(game_art_hash(art, job->kind), job->hash) != 0) {
+        return G_SOURCE_REMOVE;  // set_game already forgot the request
+    }
+    if (job->skipped) {
+        g_hash_table_remove(cache->states, key);  // Asked for again when drawn again
+        return G_SOURCE_REMOVE;
+    }
+    if (!job->pixbuf) {
+        g_hash_table_insert(cache->states, key, GINT_TO_POINTER(ART_MISSING));
+        return G_SOURCE_REMOVE;
+    }
+
+    if (job->new_hash) {
+        g_free(art->capsule_hash);
+        art->capsule_hash = g_strdup(job->new_hash);
+    }
+    g_hash_table_remove(cache->states, key);
+    lru_insert(cache, key, job->pixbuf);
+    if (cache->callback) {
+        cache->callback(job->game_id, job->kind, job->new_hash, cache->user_data);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Fetches the file unless it is already on disk, then decodes it straight
+// to thumbnail size. Runs on a worker thread.
+static void load_artwork(gpointer data, gpointer pool_data)
+{
+    TRACE_SCOPE("load_artwork");
+    ArtworkJob *job = (ArtworkJob *)data;
+    ArtworkCache *cache = job->cache;
+    const char *hash = job->hash;
+    char *path = NULL;
+    GError *error = NULL;
+
+    if (g_atomic_int_get(&cache->stopping)) {
+        artwork_job_free(job);
+        return;
+    }
+    if (g_atomic_int_get(&cache->latest) - job->seq > ARTWORK_MAX_BACKLOG) {
+        job->skipped = TRUE;
+        goto done;
+    }
+
+    if (hash) {
+        char name[HTTP_CACHE_HASH_SIZE + 64];
+        snprintf(name, sizeof(name), "%s.jpg", hash);
+        path = g_build_filename(cache->dir, name, NULL);
+    }
+    if (!path || !g_file_test(path, G_FILE_TEST_EXISTS)) {
+        char url[256];
+        MemoryStruct body = { NULL, 0 };
+
+        if (job->kind == ARTWORK_ICON) {
+            snprintf(url, sizeof(url), ICON_URL, job->game_id, hash);
+        } else {
+            snprintf(url, sizeof(url), CAPSULE_URL, job->game_id);
+        }
+        if (!download(cache, url, &body)) {
+            goto done;
+        }
+        if (!path) {
+            char content_hash[HTTP_CACHE_HASH_SIZE];
+            char name[HTTP_CACHE_HASH_SIZE + 4];
+
+            http_cache_hash(body.memory, body.size, content_hash);
+            snprintf(name, sizeof(name), "%s.jpg", content_hash);
+            path = g_build_filename(cache->dir, name, NULL);
+            job->new_hash = g_strdup(content_hash);
+        }
+        // Written to a temporary file and renamed, so a file is either
+        // complete or absent
+        if (!g_file_set_contents(path, body.memory, (gssize)body.size, &error)) {
+            fprintf(stderr, "Failed to store artwork: %s\n", error->message);
+            g_clear_error(&error);
+        }
+        free(body.memory);
+    }
+
+    if (job->kind == ARTWORK_ICON) {
+        job->pixbuf = gdk_pixbuf_new_from_file_at_scale(path, ARTWORK_ICON_SIZE, ARTWORK_ICON_SIZE, TRUE, &error);
+    } else {
+        job->pixbuf = gdk_pixbuf_new_from_file_at_scale(path, ARTWORK_CAPSULE_WIDTH, ARTWORK_CAPSULE_HEIGHT, TRUE, &error);
+    }
+    if (!job->pixbuf) {
+        fprintf(stderr, "Failed to load artwork %s: %s\n", path, error->message);
+        g_clear_error(&error);
+    }
+
+done:
+    g_free(path);
+    // Below redraw priority, so arriving art never delays a frame
+    g_main_context_invoke_full(cache->context, G_PRIORITY_DEFAULT_IDLE, deliver_artwork, job, artwork_job_free);
+}
+
+// Newest requests first: those are the rows on screen now
+static gint compare_jobs(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    const ArtworkJob *job_a = (const ArtworkJob *)a;
+    const ArtworkJob *job_b = (const ArtworkJob *)b;
+
+    return job_b->seq - job_a->seq;
+}
+
+ArtworkCache *artwork_cache_new(const char *dir, gsize memory_limit, ArtworkReadyCallback callback, gpointer user_data)
+{
+    ArtworkCache *cache = g_new0(ArtworkCache, 1);
+
+    cache->ref_count = 1;
+    cache->dir = g_strdup(dir);
+    cache->context = g_main_context_ref_thread_default();
+    cache->callback = callback;
+    cache->user_data = user_data;
+    cache->games = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, game_art_free);
+    cache->states = g_hash_table_new(g_direct_hash, g_direct_equal);
+    cache->entries = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&cache->lru);
+    cache->memory_limit = memory_limit;
+
+    // Threads are shared with GLib's pool and only started once needed
+    cache->pool = g_thread_pool_new(load_artwork, NULL, ARTWORK_MAX_WORKERS, FALSE, NULL);
+    g_thread_pool_set_sort_function(cache->pool, compare_jobs, NULL);
+    return cache;
+}
+
+// Queued jobs see the flag and end right away, and running downloads are
+// aborted. Results already on their way to the main context keep the cache
+// alive until they arrive.
+void artwork_cache_free(ArtworkCache *cache)
+{
+    if (!cache) {
+        return;
+    }
+    g_atomic_int_set(&cache->stopping, 1);
+    g_thread_pool_free(cache->pool, FALSE, TRUE);
+    artwork_cache_unref(cache);
+}
+
+void artwork_cache_set_game(ArtworkCache *cache, int game_id, const char *icon_hash, const char *capsule_hash)
+{
+    GameArt *art = g_hash_table_lookup(cache->games, GINT_TO_POINTER(game_id));
+
+    if (!art) {
+        art = g_new0(GameArt, 1);
+        g_hash_table_insert(cache->games, GINT_TO_POINTER(game_id), art);
+    }
+    if (g_strcmp0(art->icon_hash, icon_hash) != 0) {
+        g_free(art->icon_hash);
+        art->icon_hash = g_strdup(icon_hash);
+        forget_art(cache, ART_KEY(game_id, ARTWORK_ICON));
+    }
+    if (g_strcmp0(art->capsule_hash, capsule_hash) != 0) {
+        g_free(art->capsule_hash);
+        art->capsule_hash = g_strdup(capsule_hash);
+        forget_art(cache, ART_KEY(game_id, ARTWORK_CAPSULE));
+    }
+}
+
+GdkPixbuf *artwork_cache_get(ArtworkCache *cache, int game_id, ArtworkKind kind)
+{
+    gpointer key = ART_KEY(game_id, kind);
+    GList *link = g_hash_table_lookup(cache->entries, key);
+    GameArt *art;
+    ArtworkJob *job;
+
+    if (link) {
+        g_queue_unlink(&cache->lru, link);
+        g_queue_push_head_link(&cache->lru, link);
+        return ((LruEntry *)link->data)->pixbuf;
+    }
+    if (g_hash_table_contains(cache->states, key)) {
+        return NULL;  // On its way, or there is none
+    }
+    art = g_hash_table_lookup(cache->games, GINT_TO_POINTER(game_id));
+    if (!art || (kind == ARTWORK_ICON && !art->icon_hash)) {
+        return NULL;
+    }
+
+    job = g_new0(ArtworkJob, 1);
+    job->cache = artwork_cache_ref(cache);
+    job->game_id = game_id;
+    job->kind = kind;
+    job->hash = g_strdup(game_art_hash(art, kind));
+    job->seq = g_atomic_int_add(&cache->latest, 1) + 1;
+    g_hash_table_insert(cache->states, key, GINT_TO_POINTER(ART_LOADING));
+    g_thread_pool_push(cache->pool, job, NULL);
+    TRACE_COUNTER("artwork queued", g_thread_pool_unprocessed(cache->pool));
+    return NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef __ARTWORK_H__
+#define __ARTWORK_H__
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#define ARTWORK_ICON_SIZE 24          // pixels, square
+#define ARTWORK_CAPSULE_WIDTH 184
+#define ARTWORK_CAPSULE_HEIGHT 69
+
+typedef enum {
+    ARTWORK_ICON,
+    ARTWORK_CAPSULE
+} ArtworkKind;
+
+// Steam game artwork, downloaded and decoded on worker threads and kept as
+// ready-to-draw thumbnails in a size-bounded LRU.
+//
+// Files on disk are named by the hash of their content: an icon by the hash
+// Steam gives as its img_icon_url, a capsule by the hash of the downloaded
+// bytes, which the ready callback hands back so it can be stored. A file is
+// therefore never revalidated, and games sharing art share the file.
+//
+// Art is only loaded when asked for, so callers ask for what they are about
+// to draw. Recent requests are served first, and requests that many newer
+// ones have overtaken are dropped: rows that scrolled past don't hold up the
+// rows on screen. Everything but the workers runs on the main context.
+typedef struct ArtworkCache ArtworkCache;
+
+// A thumbnail is ready. new_hash is the content hash of a capsule that was
+// downloaded for the first time, otherwise NULL.
+typedef void (*ArtworkReadyCallback)(int game_id, ArtworkKind kind, const char *new_hash, gpointer user_data);
+
+ArtworkCache *artwork_cache_new(const char *dir, gsize memory_limit, ArtworkReadyCallback callback, gpointer user_data);
+void artwork_cache_free(ArtworkCache *cache);
+// Tells the cache about a Steam game and the art stored for it; hashes may be
+// NULL. Art that changed is loaded again on the next get.
+void artwork_cache_set_game(ArtworkCache *cache, int game_id, const char *icon_hash, const char *capsule_hash);
+// Returns the thumbnail if it is in memory, owned by the cache. Otherwise
+// starts loading it and returns NULL; the ready callback follows.
+GdkPixbuf *artwork_cache_get(ArtworkCache *cache, int game_id, ArtworkKind kind);
+
+#endif /* __ARTWORK_H__ */
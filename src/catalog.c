@@ -0,0 +1,333 @@
+#include <string.h>
+
+#include <glib.h>
+
+#include "catalog.h"
+
+typedef struct {
+    const Catalog *catalog;
+    CatalogSort sort;
+} SortContext;
+
+Catalog *catalog_new(void)
+{
+    Catalog *catalog = g_new0(Catalog, 1);
+
+    catalog->strings = g_string_chunk_new(64 * 1024);
+    catalog->by_id[0] = g_hash_table_new(g_direct_hash, g_direct_equal);
+    catalog->by_id[1] = g_hash_table_new(g_direct_hash, g_direct_equal);
+    catalog->sorted = TRUE;
+    return catalog;
+}
+
+void catalog_free(Catalog *catalog)
+{
+    int s;
+
+    if (!catalog) {
+        return;
+    }
+    g_free(catalog->game_id);
+    g_free(catalog->playtime);
+    g_free(catalog->last_played);
+    g_free(catalog->name);
+    g_free(catalog->install_path);
+    g_free(catalog->folded_name);
+    g_free(catalog->search_mask);
+    for (s = 0; s < CATALOG_N_SORTS; s++) {
+        g_free(catalog->order[s]);
+        g_free(catalog->rank[s]);
+    }
+    g_string_chunk_free(catalog->strings);
+    g_hash_table_destroy(catalog->by_id[0]);
+    g_hash_table_destroy(catalog->by_id[1]);
+    g_free(catalog);
+}
+
+// Keeps the arrays, so loading the library again doesn't grow them again
+void catalog_clear(Catalog *catalog)
+{
+    catalog->len = 0;
+    catalog->sorted = TRUE;
+    g_string_chunk_clear(catalog->strings);
+    g_hash_table_remove_all(catalog->by_id[0]);
+    g_hash_table_remove_all(catalog->by_id[1]);
+}
+
+static void reserve(Catalog *catalog, guint len)
+{
+    guint capacity = catalog->capacity ? catalog->capacity : 256;
+    int s;
+
+    if (len <= catalog->capacity) {
+        return;
+    }
+    while (capacity < len) {
+        capacity *= 2;
+    }
+    catalog->game_id = g_renew(int, catalog->game_id, capacity);
+    catalog->playtime = g_renew(int, catalog->playtime, capacity);
+    catalog->last_played = g_renew(gint64, catalog->last_played, capacity);
+    catalog->name = g_renew(const char *, catalog->name, capacity);
+    catalog->install_path = g_renew(const char *, catalog->install_path, capacity);
+    catalog->folded_name = g_renew(const char *, catalog->folded_name, capacity);
+    catalog->search_mask = g_renew(guint64, catalog->search_mask, capacity);
+    for (s = 0; s < CATALOG_N_SORTS; s++) {
+        catalog->order[s] = g_renew(guint, catalog->order[s], capacity);
+        catalog->rank[s] = g_renew(guint, catalog->rank[s], capacity);
+    }
+    catalog->capacity = capacity;
+}
+
+// Replaced strings stay in the chunk until the next clear
+const char *catalog_intern(Catalog *catalog, const char *old, const char *str)
+{
+    if (!str) {
+        return NULL;
+    }
+    if (old && strcmp(old, str) == 0) {
+        return old;
+    }
+    return g_string_chunk_insert(catalog->strings, str);
+}
+
+void catalog_get(const Catalog *catalog, guint index, GameRecord *record)
+{
+    record->name = catalog->name[index];
+    record->install_path = catalog->install_path[index];
+    record->folded_name = catalog->folded_name[index];
+    record->search_mask = catalog->search_mask[index];
+    record->last_played = catalog->last_played[index];
+    record->game_id = catalog->game_id[index];
+    record->playtime = catalog->playtime[index];
+}
+
+static GHashTable *id_index(const Catalog *catalog, const char *install_path)
+{
+    return catalog->by_id[install_path != NULL];
+}
+
+// Also points the game's id in the index at index
+static void set_columns(Catalog *catalog, guint index, const GameRecord *record)
+{
+    g_hash_table_insert(id_index(catalog, record->install_path), GINT_TO_POINTER(record->game_id),
+                        GUINT_TO_POINTER(index));
+    catalog->name[index] = record->name;
+    catalog->install_path[index] = record->install_path;
+    catalog->folded_name[index] = record->folded_name;
+    catalog->search_mask[index] = record->search_mask;
+    catalog->last_played[index] = record->last_played;
+    catalog->game_id[index] = record->game_id;
+    catalog->playtime[index] = record->playtime;
+}
+
+gint catalog_find(const Catalog *catalog, gboolean non_steam, int game_id)
+{
+    gpointer index;
+
+    if (!g_hash_table_lookup_extended(catalog->by_id[non_steam != FALSE], GINT_TO_POINTER(game_id), NULL, &index)) {
+        return -1;
+    }
+    return (gint)GPOINTER_TO_UINT(index);
+}
+
+static void forget_id(Catalog *catalog, guint index)
+{
+    g_hash_table_remove(id_index(catalog, catalog->install_path[index]), GINT_TO_POINTER(catalog->game_id[index]));
+}
+
+// A sort's own key, before the name. Larger numbers come first.
+static gint compare_keys(const Catalog *catalog, CatalogSort sort, guint a, guint b)
+{
+    switch (sort) {
+    case CATALOG_SORT_PLAYTIME:
+        return (catalog->playtime[a] < catalog->playtime[b]) - (catalog->playtime[a] > catalog->playtime[b]);
+    case CATALOG_SORT_LAST_PLAYED:
+        return (catalog->last_played[a] < catalog->last_played[b]) - (catalog->last_played[a] > catalog->last_played[b]);
+    case CATALOG_SORT_SOURCE:
+        return (catalog->install_path[a] != NULL) - (catalog->install_path[b] != NULL);
+    default:
+        return 0;
+    }
+}
+
+// g_ascii_strcasecmp orders like the NOCASE collation the database sorts by
+static gint compare_games(const Catalog *catalog, CatalogSort sort, guint a, guint b)
+{
+    gint cmp = compare_keys(catalog, sort, a, b);
+
+    return cmp ? cmp : g_ascii_strcasecmp(catalog->name[a], catalog->name[b]);
+}
+
+static gint compare_by_name(gconstpointer a, gconstpointer b, gpointer data)
+{
+    guint index_a = *(const guint *)a;
+    guint index_b = *(const guint *)b;
+    gint cmp = compare_games((const Catalog *)data, CATALOG_SORT_NAME, index_a, index_b);
+
+    return cmp ? cmp : (index_a > index_b) - (index_a < index_b);
+}
+
+static gint compare_by_key(gconstpointer a, gconstpointer b, gpointer data)
+{
+    const SortContext *context = (const SortContext *)data;
+
+    return compare_keys(context->catalog, context->sort, *(const guint *)a, *(const guint *)b);
+}
+
+void catalog_sort(Catalog *catalog)
+{
+    guint i;
+    int s;
+
+    for (i = 0; i < catalog->len; i++) {
+        catalog->order[CATALOG_SORT_NAME][i] = i;
+    }
+    g_qsort_with_data(catalog->order[CATALOG_SORT_NAME], (gint)catalog->len, sizeof(guint), compare_by_name, catalog);
+
+    // Names are the slow key, so they are only compared once. The other
+    // orders start out by name and are sorted stably by their own key.
+    for (s = CATALOG_SORT_NAME + 1; s < CATALOG_N_SORTS; s++) {
+        SortContext context = { catalog, (CatalogSort)s };
+
+        memcpy(catalog->order[s], catalog->order[CATALOG_SORT_NAME], catalog->len * sizeof(guint));
+        g_qsort_with_data(catalog->order[s], (gint)catalog->len, sizeof(guint), compare_by_key, &context);
+    }
+    for (s = 0; s < CATALOG_N_SORTS; s++) {
+        for (i = 0; i < catalog->len; i++) {
+            catalog->rank[s][catalog->order[s][i]] = i;
+        }
+    }
+    catalog->sorted = TRUE;
+}
+
+void catalog_append(Catalog *catalog, const GameRecord *record)
+{
+    reserve(catalog, catalog->len + 1);
+    set_columns(catalog, catalog->len++, record);
+    catalog->sorted = FALSE;
+}
+
+// Adds the game at index to an order of len other games, after the games
+// it ties with
+static void place(Catalog *catalog, CatalogSort sort, guint index, guint len)
+{
+    guint *order = catalog->order[sort];
+    guint lo = 0;
+    guint hi = len;
+    guint i;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (compare_games(catalog, sort, order[mid], index) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    memmove(order + lo + 1, order + lo, (len - lo) * sizeof(guint));
+    order[lo] = index;
+    for (i = lo; i <= len; i++) {
+        catalog->rank[sort][order[i]] = i;
+    }
+}
+
+// Takes the game at index out of an order of len games
+static void unplace(Catalog *catalog, CatalogSort sort, guint index, guint len)
+{
+    guint *order = catalog->order[sort];
+    guint position = catalog->rank[sort][index];
+    guint i;
+
+    memmove(order + position, order + position + 1, (len - position - 1) * sizeof(guint));
+    for (i = position; i + 1 < len; i++) {
+        catalog->rank[sort][order[i]] = i;
+    }
+}
+
+gboolean catalog_keys_differ(CatalogSort sort, const GameRecord *a, const GameRecord *b)
+{
+    switch (sort) {
+    case CATALOG_SORT_PLAYTIME:
+        if (a->playtime != b->playtime) {
+            return TRUE;
+        }
+        break;
+    case CATALOG_SORT_LAST_PLAYED:
+        if (a->last_played != b->last_played) {
+            return TRUE;
+        }
+        break;
+    case CATALOG_SORT_SOURCE:
+        if ((a->install_path != NULL) != (b->install_path != NULL)) {
+            return TRUE;
+        }
+        break;
+    default:
+        break;
+    }
+    return a->name != b->name && g_ascii_strcasecmp(a->name, b->name) != 0;
+}
+
+guint catalog_insert(Catalog *catalog, const GameRecord *record)
+{
+    guint index = catalog->len;
+    int s;
+
+    reserve(catalog, catalog->len + 1);
+    set_columns(catalog, index, record);
+    for (s = 0; s < CATALOG_N_SORTS; s++) {
+        place(catalog, (CatalogSort)s, index, catalog->len);
+    }
+    catalog->len++;
+    return index;
+}
+
+// Only the orders the change affects are touched
+void catalog_replace(Catalog *catalog, guint index, const GameRecord *record)
+{
+    gboolean moved[CATALOG_N_SORTS];
+    GameRecord old;
+    int s;
+
+    forget_id(catalog, index);
+    if (!catalog->sorted) {
+        set_columns(catalog, index, record);
+        return;
+    }
+
+    catalog_get(catalog, index, &old);
+    for (s = 0; s < CATALOG_N_SORTS; s++) {
+        moved[s] = catalog_keys_differ((CatalogSort)s, &old, record);
+        if (moved[s]) {
+            unplace(catalog, (CatalogSort)s, index, catalog->len);
+        }
+    }
+    set_columns(catalog, index, record);
+    for (s = 0; s < CATALOG_N_SORTS; s++) {
+        if (moved[s]) {
+            place(catalog, (CatalogSort)s, index, catalog->len - 1);
+        }
+    }
+}
+
+void catalog_remove(Catalog *catalog, guint index)
+{
+    guint last = catalog->len - 1;
+    GameRecord record;
+    int s;
+
+    for (s = 0; s < CATALOG_N_SORTS; s++) {
+        unplace(catalog, (CatalogSort)s, index, catalog->len);
+    }
+    forget_id(catalog, index);
+    if (index != last) {
+        catalog_get(catalog, last, &record);
+        set_columns(catalog, index, &record);
+        for (s = 0; s < CATALOG_N_SORTS; s++) {
+            catalog->rank[s][index] = catalog->rank[s][last];
+            catalog->order[s][catalog->rank[s][index]] = index;
+        }
+    }
+    catalog->len--;
+}
@@ -0,0 +1,76 @@
+#ifndef __CATALOG_H__
+#define __CATALOG_H__
+
+#include <glib.h>
+
+typedef enum {
+    CATALOG_SORT_NAME,
+    CATALOG_SORT_PLAYTIME,     // most played first
+    CATALOG_SORT_LAST_PLAYED,  // most recently played first
+    CATALOG_SORT_SOURCE,       // Steam games, then non-Steam games
+    CATALOG_N_SORTS
+} CatalogSort;
+
+// One game, copied out of or into the catalog's columns. Strings belong to
+// the catalog.
+typedef struct {
+    const char *name;
+    const char *install_path;  // NULL for Steam games
+    const char *folded_name;   // search_fold()ed name, NULL until a filter needs it
+    guint64 search_mask;       // search_mask() of folded_name
+    gint64 last_played;        // Unix seconds, 0 if LVL never saw it played
+    int game_id;
+    int playtime;              // minutes
+} GameRecord;
+
+// The library in memory, as one array per field. Games are stored in no
+// particular order; order[sort] lists their indexes in each sort order, and
+// rank[sort] is its inverse. Ties in any order fall back to the name, so
+// every order also groups equal keys by name.
+//
+// Strings are copied into one string chunk and stay there until the next
+// clear, so the columns only hold pointers. Growing the arrays and the id
+// index is the only allocation; reading an order, or changing a game,
+// allocates nothing.
+typedef struct {
+    guint len;
+    guint capacity;
+    int *game_id;
+    int *playtime;
+    gint64 *last_played;
+    const char **name;
+    const char **install_path;
+    const char **folded_name;
+    guint64 *search_mask;
+    guint *order[CATALOG_N_SORTS];
+    guint *rank[CATALOG_N_SORTS];
+    gboolean sorted;           // order and rank cover every game
+    GStringChunk *strings;
+    GHashTable *by_id[2];      // game_id -> index, of Steam and non-Steam games
+} Catalog;
+
+Catalog *catalog_new(void);
+void catalog_free(Catalog *catalog);
+void catalog_clear(Catalog *catalog);
+// Copies str into the catalog unless it equals old, which is reused
+const char *catalog_intern(Catalog *catalog, const char *old, const char *str);
+void catalog_get(const Catalog *catalog, guint index, GameRecord *record);
+// Non-Steam games have their own id sequence, so the id alone isn't unique.
+// Returns -1 if the game isn't there.
+gint catalog_find(const Catalog *catalog, gboolean non_steam, int game_id);
+
+// Bulk loading: append leaves the catalog unsorted, and sort orders
+// everything at once. The record's strings are kept as they are.
+void catalog_append(Catalog *catalog, const GameRecord *record);
+void catalog_sort(Catalog *catalog);
+
+// Single changes to a sorted catalog, which keep it sorted. insert returns
+// the new game's index. replace keeps the index. remove moves the last game
+// into the freed index.
+guint catalog_insert(Catalog *catalog, const GameRecord *record);
+void catalog_replace(Catalog *catalog, guint index, const GameRecord *record);
+void catalog_remove(Catalog *catalog, guint index);
+// Whether a and b sort differently in the given order
+gboolean catalog_keys_differ(CatalogSort sort, const GameRecord *a, const GameRecord *b);
+
+#endif /* __CATALOG_H__ */
@@ -0,0 +1,413 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <sqlite3.h>
+
+#include "cli.h"
+#include "config.h"
+#include "db.h"
+#include "http.h"
+#include "http_cache.h"
+#include "launcher.h"
+#include "steam.h"
+#include "steam_local.h"
+#include "sync_scheduler.h"
+
+typedef enum {
+    LIST_BY_NAME,
+    LIST_RECENTLY_PLAYED,
+    LIST_MOST_PLAYED
+} ListOrder;
+
+typedef struct {
+    int json;
+    ListOrder order;
+} ListOptions;
+
+typedef struct {
+    int count;
+    DBGameSource source;
+    int game_id;
+    char *game_name;
+    char *command;      // a non-Steam game's launch command
+} GameMatch;
+
+typedef struct {
+    GMainLoop *loop;
+    sqlite3 *db;
+} LaunchWait;
+
+static void print_usage(FILE *out)
+{
+    fputs("Usage: lvl [COMMAND]\n"
+          "Without a command, the library window opens.\n"
+          "\n"
+          "  list [--json] [--recent|--most-played]\n"
+          "                    Print the library, one game per line:\n"
+          "                    id, source, playtime in minutes and name, tab separated,\n"
+          "                    or one JSON object per line with --json. By name, or\n"
+          "                    only the played games, most recent first, or by playtime\n"
+          "  sync [--force]    Sync the saved Steam accounts and the local Steam library.\n"
+          "                    The accounts are skipped until the next sync is due,\n"
+          "                    unless forced\n"
+          "  launch ID|NAME    Start a game; a non-Steam game is waited for so its\n"
+          "                    session counts towards its playtime\n"
+          "  help              Show this help\n", out);
+}
+
+static void get_db_path(char *out)
+{
+    get_config_path(out);
+    strcat(out, "/games.db");
+}
+
+// Opens the database the GUI created, without creating one, and brings its
+// schema up to date in case this build is newer than the GUI that last ran
+static sqlite3 *open_existing_database(int *failed)
+{
+    char db_path[PATH_MAX];
+    sqlite3 *db;
+
+    *failed = 0;
+    get_db_path(db_path);
+    if (access(db_path, F_OK) != 0) {
+        return NULL;
+    }
+    if ((db = db_open(db_path)) && !db_migrate(db)) {
+        db_close(db);
+        db = NULL;
+    }
+    if (!db) {
+        fprintf(stderr, "Failed to open the database at %s\n", db_path);
+        *failed = 1;
+    }
+    return db;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+
+        if (c == '"' || c == '\\') {
+            putchar('\\');
+            putchar(c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+// Written as the rows come out of SQLite, so a reader sees the first games
+// before the last are read
+static void print_game_row(int id, const char *name, const char *install_path, int playtime, void *user_data)
+{
+    const ListOptions *options = (const ListOptions *)user_data;
+    const char *source = install_path ? "non-steam" : "steam";
+
+    if (!options->json) {
+        printf("%d\t%s\t%d\t%s\n", id, source, playtime, name);
+        return;
+    }
+    printf("{\"id\":%d,\"source\":\"%s\",\"name\":", id, source);
+    print_json_string(name);
+    printf(",\"playtime\":%d", playtime);
+    if (install_path) {
+        fputs(",\"command\":", stdout);
+        print_json_string(install_path);
+    }
+    fputs("}\n", stdout);
+}
+
+static int cli_list(int argc, char *argv[])
+{
+    ListOptions options = {0};
+    sqlite3 *db;
+    int failed, i;
+
+    for (i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            options.json = 1;
+        } else if (strcmp(argv[i], "--recent") == 0) {
+            options.order = LIST_RECENTLY_PLAYED;
+        } else if (strcmp(argv[i], "--most-played") == 0) {
+            options.order = LIST_MOST_PLAYED;
+        } else {
+            fprintf(stderr, "Unknown option for list: %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    db = open_existing_database(&failed);
+    if (!db) {
+        return failed;  // Or nothing was synced or added yet
+    }
+    switch (options.order) {
+    case LIST_RECENTLY_PLAYED:
+        failed = db_fetch_recently_played(db, -1, print_game_row, &options) < 0;
+        break;
+    case LIST_MOST_PLAYED:
+        failed = db_fetch_most_played(db, -1, print_game_row, &options) < 0;
+        break;
+    default:
+        db_fetch_all_games(db, print_game_row, &options);
+        break;
+    }
+    db_close(db);
+    return fflush(stdout) == 0 && !failed ? 0 : 1;
+}
+
+static SyncOutcome fetch_outcome(SteamFetchResult result)
+{
+    switch (result) {
+    case STEAM_FETCH_OK:
+    case STEAM_FETCH_UNCHANGED:
+        return SYNC_OUTCOME_OK;
+    case STEAM_FETCH_INVALID_CREDENTIALS:
+        return SYNC_OUTCOME_REJECTED;
+    case STEAM_FETCH_ABORTED:
+        return SYNC_OUTCOME_CANCELLED;
+    case STEAM_FETCH_RATE_LIMITED:
+        return SYNC_OUTCOME_RATE_LIMITED;
+    case STEAM_FETCH_UNAVAILABLE:
+        return SYNC_OUTCOME_UNAVAILABLE;
+    default:
+        return SYNC_OUTCOME_FAILED;
+    }
+}
+
+static void on_account_synced(size_t index, SteamFetchResult result, const SteamSyncDelta *delta, void *user_data)
+{
+    const SteamAccount *account = &g_array_index((GArray *)user_data, SteamAccount, index);
+
+    switch (result) {
+    case STEAM_FETCH_OK:
+        printf("%s: %zu added, %zu updated, %zu removed\n", account->steam_id, delta->added, delta->updated, delta->removed);
+        break;
+    case STEAM_FETCH_UNCHANGED:
+        printf("%s: unchanged\n", account->steam_id);
+        break;
+    case STEAM_FETCH_INVALID_CREDENTIALS:
+        fprintf(stderr, "%s: invalid Steam API Key or Steam ID\n", account->steam_id);
+        break;
+    case STEAM_FETCH_RATE_LIMITED:
+        fprintf(stderr, "%s: too many requests to the Steam API\n", account->steam_id);
+        break;
+    case STEAM_FETCH_UNAVAILABLE:
+        fprintf(stderr, "%s: the Steam API can't be reached\n", account->steam_id);
+        break;
+    default:
+        fprintf(stderr, "%s: sync failed\n", account->steam_id);
+        break;
+    }
+}
+
+static int cli_sync(int argc, char *argv[])
+{
+    GArray *accounts = read_saved_accounts();
+    char config_path[PATH_MAX], db_path[PATH_MAX], cache_path[PATH_MAX], steam_root[PATH_MAX];
+    SteamFetchResult *results;
+    SyncOutcome outcome = SYNC_OUTCOME_OK;
+    int synced = 0;
+    HttpClient *client;
+    HttpCache *cache;
+    sqlite3 *db;
+    gboolean force = FALSE;
+    gint64 due_in;
+    guint i;
+
+    for (i = 2; i < (guint)argc; i++) {
+        if (strcmp(argv[i], "--force") == 0) {
+            force = TRUE;
+        } else {
+            print_usage(stderr);
+            g_array_unref(accounts);
+            return 2;
+        }
+    }
+
+    get_db_path(db_path);
+    db = init_database(db_path);
+    if (!db) {
+        g_array_unref(accounts);
+        return 1;
+    }
+    if (steam_local_find_root(steam_root, sizeof(steam_root))) {
+        steam_local_import(db, steam_root);
+    }
+    if (accounts->len == 0) {
+        fprintf(stderr, "No Steam account saved; add one on the settings page\n");
+        g_array_unref(accounts);
+        db_close(db);
+        return 1;
+    }
+    // Keeps a sync run from cron to the interval, and away from an API that
+    // just failed or refused requests
+    if (!force && (due_in = sync_schedule_due_in(db)) > 0) {
+        fprintf(stderr, "The next Steam sync is due in %" G_GINT64_FORMAT " s; use --force to sync now\n", due_in);
+        g_array_unref(accounts);
+        db_close(db);
+        return 0;
+    }
+
+    get_config_path(config_path);
+    snprintf(cache_path, sizeof(cache_path), "%s/cache/http", config_path);
+    mkdir_p(cache_path, 0700);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    client = http_client_new();
+    cache = http_cache_new(cache_path);
+
+    results = g_new(SteamFetchResult, accounts->len);
+    fetch_steam_accounts(client, cache, (const SteamAccount *)accounts->data, accounts->len, db,
+                         NULL, on_account_synced, accounts, results);
+    for (i = 0; i < accounts->len; i++) {
+        outcome = MAX(outcome, fetch_outcome(results[i]));
+        synced |= fetch_outcome(results[i]) == SYNC_OUTCOME_OK;
+    }
+    // The GUI's scheduler counts from this sync, and backs off if it failed
+    sync_schedule_record(db, outcome);
+
+    g_free(results);
+    http_cache_free(cache);
+    http_client_free(client);
+    curl_global_cleanup();
+    db_close(db);
+    g_array_unref(accounts);
+    return synced ? 0 : 1;
+}
+
+static void match_game(int id, const char *name, const char *install_path, int playtime, void *user_data)
+{
+    GameMatch *match = (GameMatch *)user_data;
+
+    if (match->count++ == 0) {
+        match->source = install_path ? DB_SOURCE_NON_STEAM : DB_SOURCE_STEAM;
+        match->game_id = id;
+        match->game_name = g_strdup(name);
+        match->command = g_strdup(install_path);
+    }
+}
+
+static void print_candidate(int id, const char *name, const char *install_path, int playtime, void *user_data)
+{
+    fprintf(stderr, "  %d\t%s\t%s\n", id, install_path ? "non-steam" : "steam", name);
+}
+
+// A number is a Steam app id first, then a non-Steam game id; anything else
+// is a name
+static int find_game(sqlite3 *db, const char *game, GameMatch *match)
+{
+    char *end;
+    long id = strtol(game, &end, 10);
+
+    if (*game && *end == '\0' && id > 0 && id <= INT_MAX) {
+        if (db_fetch_game(db, DB_SOURCE_STEAM, (int)id, match_game, match) ||
+            db_fetch_game(db, DB_SOURCE_NON_STEAM, (int)id, match_game, match)) {
+            return 1;
+        }
+    }
+
+    db_find_games_by_name(db, game, match_game, match);
+    if (match->count > 1) {
+        fprintf(stderr, "Several games are named %s; launch one by id:\n", game);
+        db_find_games_by_name(db, game, print_candidate, NULL);
+        return 0;
+    }
+    if (match->count == 0) {
+        fprintf(stderr, "No game %s in the library\n", game);
+        return 0;
+    }
+    return 1;
+}
+
+static void on_launched_game_exited(int game_id, gint64 started_at, gint64 ended_at, gpointer data)
+{
+    LaunchWait *wait = (LaunchWait *)data;
+
+    printf("Game %d exited after %" G_GINT64_FORMAT " seconds\n", game_id, ended_at - started_at);
+    db_record_play_session(wait->db, DB_SOURCE_NON_STEAM, game_id, started_at, ended_at);
+    g_main_loop_quit(wait->loop);
+}
+
+static int cli_launch(const char *game)
+{
+    GameMatch match = {0};
+    GError *error = NULL;
+    int status = 1;
+    int failed;
+    sqlite3 *db = open_existing_database(&failed);
+
+    if (!db) {
+        if (!failed) {
+            fprintf(stderr, "No game %s in the library\n", game);
+        }
+        return 1;
+    }
+    if (!find_game(db, game, &match)) {
+        // Already reported
+    } else if (match.source == DB_SOURCE_STEAM) {
+        char uri[64];
+
+        snprintf(uri, sizeof(uri), "steam://rungameid/%d", match.game_id);
+        printf("Opening %s (%s)\n", match.game_name, uri);
+        if (g_app_info_launch_default_for_uri(uri, NULL, &error)) {
+            status = 0;
+        } else {
+            fprintf(stderr, "Failed to open %s: %s\n", uri, error->message);
+            g_error_free(error);
+        }
+    } else {
+        LaunchWait wait = { g_main_loop_new(NULL, FALSE), db };
+        Launcher *launcher = launcher_new(on_launched_game_exited, &wait);
+
+        printf("Starting %s\n", match.game_name);
+        if (launcher_run(launcher, match.game_id, match.command, &error)) {
+            fflush(stdout);
+            g_main_loop_run(wait.loop);
+            status = 0;
+        } else {
+            fprintf(stderr, "Failed to start %s: %s\n", match.game_name, error->message);
+            g_error_free(error);
+        }
+        launcher_free(launcher);
+        g_main_loop_unref(wait.loop);
+    }
+
+    g_free(match.game_name);
+    g_free(match.command);
+    db_close(db);
+    return status;
+}
+
+int cli_run(int argc, char *argv[], int *status)
+{
+    const char *command = argc > 1 ? argv[1] : NULL;
+
+    if (!command) {
+        return 0;
+    }
+    if (strcmp(command, "list") == 0) {
+        *status = cli_list(argc, argv);
+    } else if (strcmp(command, "sync") == 0) {
+        *status = cli_sync(argc, argv);
+    } else if (strcmp(command, "launch") == 0 && argc == 3) {
+        *status = cli_launch(argv[2]);
+    } else if (strcmp(command, "help") == 0 || strcmp(command, "--help") == 0 || strcmp(command, "-h") == 0) {
+        print_usage(stdout);
+        *status = 0;
+    } else if (strcmp(command, "launch") == 0) {
+        print_usage(stderr);
+        *status = 2;
+    } else {
+        return 0;  // GTK's own options, or not ours to judge
+    }
+    return 1;
+}
@@ -0,0 +1,15 @@
+#ifndef __CLI_H__
+#define __CLI_H__
+
+// Subcommands for scripts, hotkey daemons and timers, run without GTK:
+//
+//   lvl list [--json] [--recent|--most-played]
+//                         the library, one game per line as it is read
+//   lvl sync              sync the saved Steam accounts and local installs
+//   lvl launch <id|name>  start a game
+//
+// Returns 0 if argv holds no subcommand, leaving it to the GUI; otherwise
+// runs it and sets *status to the process exit status.
+int cli_run(int argc, char *argv[], int *status);
+
+#endif /* __CLI_H__ */
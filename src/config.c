@@ -0,0 +1,111 @@
+#include <limits.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "trace.h"
+
+// Function to create necessary directories for the app configuration
+void mkdir_p(const char *dir, __mode_t permissions)
+{
+    char tmp[256] = {0};
+    char *p = NULL;
+    size_t len;
+
+    snprintf(tmp, sizeof(tmp),"%s",dir);
+    len = strlen(tmp);
+    if (tmp[len - 1] == '/')
+        tmp[len - 1] = 0;
+    for (p = tmp + 1; *p; p++)
+    {
+        if (*p == '/') {
+            *p = 0;
+            mkdir(tmp, permissions);
+            *p = '/';
+        }
+    }
+    mkdir(tmp, permissions);
+}
+
+static void clear_steam_account(gpointer p)
+{
+    SteamAccount *account = (SteamAccount *)p;
+    g_free(account->api_key);
+    g_free(account->steam_id);
+}
+
+// A GArray of SteamAccounts that frees their strings
+GArray *steam_account_array_new(void)
+{
+    GArray *accounts = g_array_new(FALSE, TRUE, sizeof(SteamAccount));
+    g_array_set_clear_func(accounts, clear_steam_account);
+    return accounts;
+}
+
+void steam_account_array_add(GArray *accounts, const char *api_key, const char *steam_id)
+{
+    SteamAccount account = { g_strdup(api_key), g_strdup(steam_id) };
+    g_array_append_val(accounts, account);
+}
+
+// Function to write the Steam accounts to the configuration file: an API key
+// line and a Steam ID line per account
+void write_config(const char *config_path, const SteamAccount *accounts, size_t count)
+{
+    FILE *file = fopen(config_path, "w");
+    if (file) {
+        for (size_t i = 0; i < count; i++) {
+            fprintf(file, "%s\n%s\n", accounts[i].api_key, accounts[i].steam_id);
+        }
+        fclose(file);
+    }
+}
+
+// Function to read the Steam accounts from the configuration file. A file
+// from before multiple accounts holds just the one pair and reads the same.
+int read_config(const char *config_path, GArray *accounts)
+{
+    char api_key[256], steam_id[256];
+    FILE *file = fopen(config_path, "r");
+    if (file) {
+        while (fscanf(file, "%255s\n%255s\n", api_key, steam_id) == 2) {
+            steam_account_array_add(accounts, api_key, steam_id);
+        }
+        fclose(file);
+    }
+    return accounts->len > 0;
+}
+
+// Retrieves or sets up the path to the configuration directory
+void get_config_path(char *out_path)
+{
+    TRACE_SCOPE("get_config_path");
+    struct passwd *pw = getpwuid(getuid());
+    const char *XDG_CONFIG_HOME = getenv("XDG_CONFIG_HOME");
+    if (XDG_CONFIG_HOME) {
+        strcpy(out_path, XDG_CONFIG_HOME);
+        strcat(out_path, "/LVL");
+    } else {
+        strcpy(out_path, pw->pw_dir);
+        strcat(out_path, "/.config/LVL");
+    }
+    mkdir_p(out_path, 0700);
+}
+
+// The Steam accounts saved in the configuration directory
+GArray *read_saved_accounts(void)
+{
+    GArray *accounts = steam_account_array_new();
+    char config_path[PATH_MAX];
+
+    get_config_path(config_path);
+    strcat(config_path, "/config.txt");
+    read_config(config_path, accounts);
+    return accounts;
+}
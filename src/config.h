@@ -0,0 +1,26 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <glib.h>
+
+#include "steam.h"
+
+// Where LVL keeps its settings, database and caches: $XDG_CONFIG_HOME/LVL
+// or ~/.config/LVL. Shared by the GUI and the command line.
+
+void mkdir_p(const char *dir, __mode_t permissions);
+// Writes the path of the configuration directory, creating it if needed
+void get_config_path(char *out_path);
+
+// A GArray of SteamAccounts that frees their strings
+GArray *steam_account_array_new(void);
+void steam_account_array_add(GArray *accounts, const char *api_key, const char *steam_id);
+void write_config(const char *config_path, const SteamAccount *accounts, size_t count);
+int read_config(const char *config_path, GArray *accounts);
+// The accounts in config.txt in the configuration directory
+GArray *read_saved_accounts(void);
+
+#endif /* __CONFIG_H__ */
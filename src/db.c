@@ -6,6 +6,7 @@
 #include <sqlite3.h>
 
 #include "db.h"
+#include "trace.h"
 
 int callback(void *NotUsed, int argc, char **argv, char **azColName)
 {
@@ -17,27 +18,184 @@ int callback(void *NotUsed, int argc, char **argv, char **azColName)
     return 0;
 }
 
-void create_table(sqlite3 *db)
+// Opens the application's long-lived connection. WAL lets the sync worker
+// write while the UI reads, and with it synchronous=NORMAL only risks the
+// last transactions on power loss, never corruption.
+sqlite3 *db_open(const char *db_path)
+{
+    TRACE_SCOPE("db_open");
+    sqlite3 *db;
+    char *zErrMsg = 0;
+    const char *pragmas = "PRAGMA journal_mode = WAL;"
+                          "PRAGMA synchronous = NORMAL;"
+                          "PRAGMA temp_store = MEMORY;"
+                          "PRAGMA cache_size = -8192;"       // KiB
+                          "PRAGMA mmap_size = 67108864;";
+
+    if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    // The other thread's connection may briefly hold the write lock
+    sqlite3_busy_timeout(db, 5000);
+
+    if (sqlite3_exec(db, pragmas, NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+    }
+    return db;
+}
+
+// Marks the statements db_prepare_cached keeps on a connection, apart from
+// those virtual tables such as FTS5 prepare on it for themselves
+#define CACHED_STMT_TAG "-- cached\n"
+
+static int is_cached_statement(sqlite3_stmt *stmt)
+{
+    return strncmp(sqlite3_sql(stmt), CACHED_STMT_TAG, strlen(CACHED_STMT_TAG)) == 0;
+}
+
+static sqlite3_stmt *first_cached_statement(sqlite3 *db)
+{
+    sqlite3_stmt *stmt = NULL;
+
+    while ((stmt = sqlite3_next_stmt(db, stmt)) && !is_cached_statement(stmt)) {
+        continue;
+    }
+    return stmt;
+}
+
+void db_close(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+
+    if (!db) {
+        return;  // Like sqlite3_close, which sqlite3_next_stmt isn't
+    }
+    // Finalize the cached statements, or the close would fail. Finalizing
+    // one may release a virtual table together with its own statements, so
+    // every search starts over from the head of the list. The virtual
+    // tables finalize theirs as the connection closes them.
+    while ((stmt = first_cached_statement(db))) {
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+}
+
+// Statements are kept prepared on their connection after use, and the
+// connection's own statement list is the cache. A statement is handed out
+// again once released, so bind and step it right away.
+sqlite3_stmt *db_prepare_cached(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *stmt = NULL;
+    char *tagged;
+    int rc;
+
+    while ((stmt = sqlite3_next_stmt(db, stmt))) {
+        if (!sqlite3_stmt_busy(stmt) && is_cached_statement(stmt) &&
+            strcmp(sqlite3_sql(stmt) + strlen(CACHED_STMT_TAG), sql) == 0) {
+            return stmt;
+        }
+    }
+    tagged = sqlite3_mprintf("%s%s", CACHED_STMT_TAG, sql);
+    if (!tagged) {
+        return NULL;
+    }
+    rc = sqlite3_prepare_v3(db, tagged, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+    sqlite3_free(tagged);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        return NULL;
+    }
+    return stmt;
+}
+
+void db_release_statement(sqlite3_stmt *stmt)
+{
+    if (stmt) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+}
+
+// Adds a column that databases created before it was introduced lack;
+// ALTER TABLE has no IF NOT EXISTS
+static int add_missing_column(sqlite3 *db, const char *table, const char *column, const char *definition)
+{
+    sqlite3_stmt *stmt;
+    char *sql = sqlite3_mprintf("SELECT 1 FROM pragma_table_info(%Q) WHERE name = %Q;", table, column);
+    char *zErrMsg = 0;
+    int rc;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_free(sql);
+        return 0;
+    }
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    sqlite3_free(sql);
+    if (rc == SQLITE_ROW) {
+        return 1;
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 0;
+    }
+
+    sql = sqlite3_mprintf("ALTER TABLE %s ADD COLUMN %s %s;", table, column, definition);
+    rc = sqlite3_exec(db, sql, NULL, 0, &zErrMsg);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+    return 1;
+}
+
+int create_table(sqlite3 *db)
 {
     char *zErrMsg = 0;
     int rc;
     char *sql;
 
+    // With accounts recorded in steam_game_owners, a game's playtime is the
+    // sum over the accounts owning it. steam_game_art holds the content hashes
+    // of a game's artwork files, and goes when the game does.
+    // steam_accounts counts each account's sync generations.
     sql = "CREATE TABLE IF NOT EXISTS steam_games(" \
           "game_id INTEGER PRIMARY KEY," \
           "game_name TEXT NOT NULL," \
-          "playtime INTEGER DEFAULT 0);";  // playtime in minutes
+          "playtime INTEGER DEFAULT 0);"  // playtime in minutes
+          "CREATE TABLE IF NOT EXISTS steam_game_owners(" \
+          "game_id INTEGER NOT NULL," \
+          "steam_id TEXT NOT NULL," \
+          "playtime INTEGER DEFAULT 0," \
+          "PRIMARY KEY (game_id, steam_id)) WITHOUT ROWID;" \
+          "CREATE TABLE IF NOT EXISTS steam_accounts(" \
+          "steam_id TEXT PRIMARY KEY," \
+          "generation INTEGER NOT NULL DEFAULT 0);" \
+          "CREATE INDEX IF NOT EXISTS steam_game_owners_account ON steam_game_owners(steam_id);" \
+          "CREATE TABLE IF NOT EXISTS steam_game_art(" \
+          "game_id INTEGER PRIMARY KEY," \
+          "icon_hash TEXT," \
+          "capsule_hash TEXT);" \
+          "CREATE TRIGGER IF NOT EXISTS steam_game_art_drop AFTER DELETE ON steam_games BEGIN " \
+          "DELETE FROM steam_game_art WHERE game_id = old.game_id; END;";
 
     rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
     if (rc != SQLITE_OK) {
         fprintf(stderr, "SQL error: %s\n", zErrMsg);
         sqlite3_free(zErrMsg);
-    } else {
-        fprintf(stdout, "Table created successfully\n");
+        return 0;
     }
+    fprintf(stderr, "Table created successfully\n");
+    return 1;
 }
 
-void create_non_steam_table(sqlite3 *db)
+int create_non_steam_table(sqlite3 *db)
 {
     char *zErrMsg = 0;
     int rc;
@@ -51,103 +209,1903 @@ void create_non_steam_table(sqlite3 *db)
     if (rc != SQLITE_OK) {
         fprintf(stderr, "SQL error: %s\n", zErrMsg);
         sqlite3_free(zErrMsg);
-    } else {
-        fprintf(stdout, "Non-Steam games table created successfully\n");
+        return 0;
     }
+    fprintf(stderr, "Non-Steam games table created successfully\n");
+    return 1;
 }
 
-void insert_game(sqlite3 *db, int game_id, const char *game_name, int playtime)
+// Remembers which cached response body each import came from, in the same
+// database as the games, so a fresh database never looks up to date
+int create_applied_responses_table(sqlite3 *db)
 {
     char *zErrMsg = 0;
     int rc;
-    sqlite3_stmt *stmt;
-    const char *sql = "INSERT OR IGNORE INTO steam_games (game_id, game_name, playtime) VALUES (?, ?, ?);";
+    char *sql = "CREATE TABLE IF NOT EXISTS applied_responses(" \
+                "cache_key TEXT PRIMARY KEY," \
+                "body_hash TEXT NOT NULL);";
 
-    // Prepare the statement
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        return;
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
     }
+    return 1;
+}
 
-    // Bind integer game_id to the first placeholder
-    sqlite3_bind_int(stmt, 1, game_id);
-    // Bind string game_name to the second placeholder
-    sqlite3_bind_text(stmt, 2, game_name, -1, SQLITE_TRANSIENT);
-    // Bind integer playtime to the third placeholder
-    sqlite3_bind_int(stmt, 3, playtime);
+// Case-insensitive name indexes, so the library streams out of both tables
+// in order and the union is merged instead of sorted
+int create_indexes(sqlite3 *db)
+{
+    char *zErrMsg = 0;
+    int rc;
+    char *sql = "CREATE INDEX IF NOT EXISTS steam_games_name ON steam_games(game_name COLLATE NOCASE);" \
+                "CREATE INDEX IF NOT EXISTS non_steam_games_name ON non_steam_games(game_name COLLATE NOCASE);";
 
-    // Execute the statement
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-    } else {
-        // Check if a record was inserted
-        if (sqlite3_changes(db) > 0) {
-            fprintf(stdout, "Record inserted successfully\n");
-        } else {
-            fprintf(stdout, "Record already exists: ID: %d, Name: %s\n", game_id, game_name);
-        }
+    rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
     }
+    return 1;
+}
 
-    // Finalize the statement to prevent memory leaks
-    sqlite3_finalize(stmt);
+// One row per game session LVL watched from launch to exit. Times are Unix
+// seconds.
+int create_play_sessions_table(sqlite3 *db)
+{
+    char *zErrMsg = 0;
+    int rc;
+    char *sql = "CREATE TABLE IF NOT EXISTS play_sessions(" \
+                "session_id INTEGER PRIMARY KEY," \
+                "source INTEGER NOT NULL," \
+                "game_id INTEGER NOT NULL," \
+                "started_at INTEGER NOT NULL," \
+                "ended_at INTEGER NOT NULL);" \
+                "CREATE INDEX IF NOT EXISTS play_sessions_game ON play_sessions(source, game_id, started_at);";
+
+    rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+    return 1;
 }
 
-void insert_non_steam_game(sqlite3 *db, const char *game_name, const char *install_path, int playtime)
+// What the local Steam library folders hold, as of the last scan
+int create_steam_installs_table(sqlite3 *db)
+{
+    char *zErrMsg = 0;
+    int rc;
+    char *sql = "CREATE TABLE IF NOT EXISTS steam_installs(" \
+                "game_id INTEGER PRIMARY KEY," \
+                "install_dir TEXT NOT NULL," \
+                "size_on_disk INTEGER DEFAULT 0," \
+                "installed INTEGER DEFAULT 0);";
+
+    rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+    return 1;
+}
+
+// One row per scheduled job, keyed by name
+int create_sync_schedule_table(sqlite3 *db)
+{
+    char *zErrMsg = 0;
+    int rc;
+    char *sql = "CREATE TABLE IF NOT EXISTS sync_schedule(" \
+                "name TEXT PRIMARY KEY," \
+                "last_success INTEGER DEFAULT 0," \
+                "next_attempt INTEGER DEFAULT 0," \
+                "failures INTEGER DEFAULT 0);";
+
+    rc = sqlite3_exec(db, sql, callback, 0, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+    return 1;
+}
+
+static int exec_sql(sqlite3 *db, const char *sql)
+{
+    char *zErrMsg = 0;
+
+    if (sqlite3_exec(db, sql, NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+    return 1;
+}
+
+// The schema as it was before databases were versioned. Databases from then
+// are at version 0 with any part of it, so this only creates what's missing.
+static int migrate_base_schema(sqlite3 *db)
+{
+    return create_table(db) &&
+           create_non_steam_table(db) &&
+           create_applied_responses_table(db) &&
+           create_indexes(db) &&
+           create_play_sessions_table(db) &&
+           create_steam_installs_table(db) &&
+           create_sync_schedule_table(db);
+}
+
+// When games were last played and how much in the last two weeks, as
+// GetOwnedGames reports them per account; steam_games holds the latest and
+// the sum over the owners. Non-Steam games take theirs from the sessions.
+// The indexes cover what the recently and most played views read, so those
+// are index scans rather than sorts.
+static int migrate_played_columns(sqlite3 *db)
+{
+    return exec_sql(db,
+        "ALTER TABLE steam_game_owners ADD COLUMN rtime_last_played INTEGER DEFAULT 0;"
+        "ALTER TABLE steam_game_owners ADD COLUMN playtime_2weeks INTEGER DEFAULT 0;"
+        "ALTER TABLE steam_games ADD COLUMN rtime_last_played INTEGER DEFAULT 0;"
+        "ALTER TABLE steam_games ADD COLUMN playtime_2weeks INTEGER DEFAULT 0;"
+        "ALTER TABLE non_steam_games ADD COLUMN last_played INTEGER DEFAULT 0;"
+        "UPDATE non_steam_games SET last_played = COALESCE((SELECT MAX(ended_at) FROM play_sessions "
+        "WHERE source = 1 AND play_sessions.game_id = non_steam_games.game_id), 0);"  // DB_SOURCE_NON_STEAM
+        "CREATE INDEX steam_games_recent ON steam_games(rtime_last_played DESC, game_name, playtime);"
+        "CREATE INDEX steam_games_most_played ON steam_games(playtime DESC, game_name);"
+        "CREATE INDEX non_steam_games_recent ON non_steam_games(last_played DESC, game_name, install_path, playtime);"
+        "CREATE INDEX non_steam_games_most_played ON non_steam_games(playtime DESC, game_name, install_path);"
+        // Responses imported before this didn't keep the new fields
+        "DELETE FROM applied_responses;");
+}
+
+// Store page details per Steam app, and an FTS5 index over them kept in
+// step by triggers. The index has no copy of the text; it reads store_apps.
+// Apps stay when their game is dropped, so searches join against the library.
+static int migrate_store_details(sqlite3 *db)
+{
+    return exec_sql(db,
+        "CREATE TABLE store_apps ("
+        "game_id INTEGER PRIMARY KEY, "
+        "fetched_at INTEGER NOT NULL, "
+        "name TEXT, genres TEXT, categories TEXT, developers TEXT, publishers TEXT, "
+        "release_date TEXT, description TEXT);"
+        "CREATE INDEX store_apps_fetched ON store_apps(fetched_at);"
+        "CREATE VIRTUAL TABLE store_search USING fts5("
+        "name, genres, categories, developers, publishers, description, "
+        "content = 'store_apps', content_rowid = 'game_id', "
+        "tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3');"
+        "CREATE TRIGGER store_apps_insert AFTER INSERT ON store_apps BEGIN "
+        "INSERT INTO store_search (rowid, name, genres, categories, developers, publishers, description) "
+        "VALUES (new.game_id, new.name, new.genres, new.categories, new.developers, new.publishers, new.description); "
+        "END;"
+        "CREATE TRIGGER store_apps_delete AFTER DELETE ON store_apps BEGIN "
+        "INSERT INTO store_search (store_search, rowid, name, genres, categories, developers, publishers, description) "
+        "VALUES ('delete', old.game_id, old.name, old.genres, old.categories, old.developers, old.publishers, old.description); "
+        "END;"
+        "CREATE TRIGGER store_apps_update AFTER UPDATE ON store_apps BEGIN "
+        "INSERT INTO store_search (store_search, rowid, name, genres, categories, developers, publishers, description) "
+        "VALUES ('delete', old.game_id, old.name, old.genres, old.categories, old.developers, old.publishers, old.description); "
+        "INSERT INTO store_search (rowid, name, genres, categories, developers, publishers, description) "
+        "VALUES (new.game_id, new.name, new.genres, new.categories, new.developers, new.publishers, new.description); "
+        "END;");
+}
+
+// Every launch started from the library and how long it took to get going,
+// so a game's launch times can be compared across game and driver updates.
+// A phase that wasn't seen is NULL.
+static int migrate_launch_history(sqlite3 *db)
+{
+    return exec_sql(db,
+        "CREATE TABLE launch_history ("
+        "source INTEGER NOT NULL, "
+        "game_id INTEGER NOT NULL, "
+        "launched_at INTEGER NOT NULL, "
+        "exec_ms INTEGER NOT NULL, "
+        "process_ms INTEGER, "
+        "window_ms INTEGER);"
+        "CREATE INDEX launch_history_game ON launch_history(source, game_id, launched_at);");
+}
+
+// What games launched from the library used while they ran: a row per
+// session with its totals and peaks, and the samples it was summed up from.
+// The samples are keyed by session and time, without a rowid, as they are
+// only ever read a session at a time.
+static int migrate_resource_samples(sqlite3 *db)
+{
+    return exec_sql(db,
+        "CREATE TABLE resource_sessions ("
+        "session_id INTEGER PRIMARY KEY, "
+        "source INTEGER NOT NULL, "
+        "game_id INTEGER NOT NULL, "
+        "started_at INTEGER NOT NULL, "
+        "ended_at INTEGER NOT NULL, "
+        "interval_ms INTEGER NOT NULL, "
+        "cpu_ms INTEGER NOT NULL, "
+        "peak_rss_kb INTEGER NOT NULL, "
+        "peak_threads INTEGER NOT NULL, "
+        "read_kb INTEGER NOT NULL, "
+        "write_kb INTEGER NOT NULL);"
+        "CREATE INDEX resource_sessions_game ON resource_sessions(source, game_id);"
+        "CREATE TABLE resource_samples ("
+        "session_id INTEGER NOT NULL, "
+        "at_ms INTEGER NOT NULL, "
+        "cpu_ms INTEGER NOT NULL, "
+        "rss_kb INTEGER NOT NULL, "
+        "threads INTEGER NOT NULL, "
+        "read_kb INTEGER NOT NULL, "
+        "write_kb INTEGER NOT NULL, "
+        "PRIMARY KEY (session_id, at_ms)) WITHOUT ROWID;");
+}
+
+// An owner row keeps a hash of what the account last reported for the game
+// and the account's sync generation that wrote it; a game the account stopped
+// listing leaves a tombstone with the generation it went in. Databases that
+// opened before this step have the columns already.
+static int migrate_owner_generations(sqlite3 *db)
+{
+    return add_missing_column(db, "steam_game_owners", "row_hash", "INTEGER DEFAULT 0") &&
+           add_missing_column(db, "steam_game_owners", "generation", "INTEGER DEFAULT 0") &&
+           add_missing_column(db, "steam_game_owners", "removed_generation", "INTEGER");
+}
+
+// Migration n takes a database from schema version n to n + 1, as kept in
+// PRAGMA user_version. Only ever append to this.
+static const struct {
+    const char *name;
+    int (*apply)(sqlite3 *db);
+} migrations[] = {
+    { "base schema", migrate_base_schema },
+    { "last played and recent playtime", migrate_played_columns },
+    { "store details", migrate_store_details },
+    { "launch history", migrate_launch_history },
+    { "resource samples", migrate_resource_samples },
+    { "owner generations", migrate_owner_generations },
+};
+
+static int get_user_version(sqlite3 *db)
 {
     sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO non_steam_games (game_name, install_path, playtime) VALUES (?, ?, ?);";
+    int version = -1;
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, game_name, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, install_path, -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int(stmt, 3, playtime);
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
 
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            fprintf(stderr, "SQL error while inserting non-Steam game: %s\n", sqlite3_errmsg(db));
-        } else {
-            fprintf(stdout, "Non-Steam game inserted successfully\n");
+// Each migration commits together with its version, so an interrupted one
+// is simply run again. The version is read under the write lock, in case
+// another process is migrating the same database.
+int db_migrate(sqlite3 *db)
+{
+    TRACE_SCOPE("db_migrate");
+    int latest = (int)(sizeof(migrations) / sizeof(migrations[0]));
+
+    for (;;) {
+        int version, ok;
+        char *sql;
+
+        if (!exec_sql(db, "BEGIN IMMEDIATE;")) {
+            return 0;
+        }
+        version = get_user_version(db);
+        if (version < 0 || version >= latest) {
+            exec_sql(db, "COMMIT;");
+            if (version > latest) {
+                fprintf(stderr, "Database schema version %d is newer than this build's %d\n", version, latest);
+            }
+            return version >= 0;
         }
 
-        sqlite3_finalize(stmt);
-    } else {
+        sql = sqlite3_mprintf("PRAGMA user_version = %d;", version + 1);
+        ok = migrations[version].apply(db) && exec_sql(db, sql);
+        sqlite3_free(sql);
+        if (!ok || !exec_sql(db, "COMMIT;")) {
+            sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+            fprintf(stderr, "Failed to migrate the database to schema version %d (%s)\n",
+                    version + 1, migrations[version].name);
+            return 0;
+        }
+        fprintf(stderr, "Migrated the database to schema version %d (%s)\n", version + 1, migrations[version].name);
+    }
+}
+
+// Open the database and bring its schema up to date
+sqlite3 *init_database(const char *db_path)
+{
+    TRACE_SCOPE("init_database");
+    sqlite3 *db = db_open(db_path);
+    if (!db) {
+        return NULL;
+    }
+    if (!db_migrate(db)) {
+        db_close(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+int db_get_applied_hash(sqlite3 *db, const char *cache_key, char *out, size_t out_size)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT body_hash FROM applied_responses WHERE cache_key = ?;";
+    int found = 0;
+
+    out[0] = '\0';
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, cache_key, -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        snprintf(out, out_size, "%s", (const char *)sqlite3_column_text(stmt, 0));
+        found = 1;
+    }
+    db_release_statement(stmt);
+
+    return found;
+}
+
+int db_set_applied_hash(sqlite3 *db, const char *cache_key, const char *body_hash)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO applied_responses (cache_key, body_hash) VALUES (?, ?) "
+                      "ON CONFLICT(cache_key) DO UPDATE SET body_hash = excluded.body_hash;";
+    int ok;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, cache_key, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, body_hash, -1, SQLITE_TRANSIENT);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    db_release_statement(stmt);
+
+    return ok;
+}
+
+// Returns 0 and a zeroed schedule if the job never ran
+int db_get_sync_schedule(sqlite3 *db, const char *name, SyncSchedule *schedule)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT last_success, next_attempt, failures FROM sync_schedule WHERE name = ?;";
+    int found = 0;
+
+    memset(schedule, 0, sizeof(SyncSchedule));
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        schedule->last_success = sqlite3_column_int64(stmt, 0);
+        schedule->next_attempt = sqlite3_column_int64(stmt, 1);
+        schedule->failures = sqlite3_column_int(stmt, 2);
+        found = 1;
+    }
+    db_release_statement(stmt);
+
+    return found;
+}
+
+int db_set_sync_schedule(sqlite3 *db, const char *name, const SyncSchedule *schedule)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO sync_schedule (name, last_success, next_attempt, failures) VALUES (?, ?, ?, ?) "
+                      "ON CONFLICT(name) DO UPDATE SET last_success = excluded.last_success, "
+                      "next_attempt = excluded.next_attempt, failures = excluded.failures;";
+    int ok;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, schedule->last_success);
+    sqlite3_bind_int64(stmt, 3, schedule->next_attempt);
+    sqlite3_bind_int(stmt, 4, schedule->failures);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
         fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
     }
+    db_release_statement(stmt);
+
+    return ok;
 }
 
-void db_fetch_all_games(const char *db_path, DBRowCallback callback, void *user_data) {
+// Only rows where something actually changed are touched, so re-importing
+// an unchanged library doesn't dirty any pages
+#define SQL_UPSERT_GAME "INSERT INTO steam_games (game_id, game_name, playtime, rtime_last_played, playtime_2weeks) " \
+                        "VALUES (?, ?, ?, ?, ?) ON CONFLICT(game_id) DO UPDATE SET " \
+                        "game_name = excluded.game_name, playtime = excluded.playtime, " \
+                        "rtime_last_played = excluded.rtime_last_played, playtime_2weeks = excluded.playtime_2weeks " \
+                        "WHERE game_name IS NOT excluded.game_name OR playtime IS NOT excluded.playtime " \
+                        "OR rtime_last_played IS NOT excluded.rtime_last_played " \
+                        "OR playtime_2weeks IS NOT excluded.playtime_2weeks;"
+#define SQL_UPSERT_OWNED_GAME "INSERT INTO steam_games (game_id, game_name, playtime) VALUES (?, ?, ?) " \
+                              "ON CONFLICT(game_id) DO UPDATE SET game_name = excluded.game_name " \
+                              "WHERE game_name IS NOT excluded.game_name;"
+#define SQL_UPSERT_OWNER "INSERT INTO steam_game_owners (game_id, steam_id, playtime, row_hash, generation, " \
+                         "rtime_last_played, playtime_2weeks) VALUES (?, ?, ?, ?, ?, ?, ?) " \
+                         "ON CONFLICT(game_id, steam_id) DO UPDATE SET " \
+                         "playtime = excluded.playtime, row_hash = excluded.row_hash, " \
+                         "generation = excluded.generation, removed_generation = NULL, " \
+                         "rtime_last_played = excluded.rtime_last_played, playtime_2weeks = excluded.playtime_2weeks;"
+// A new icon usually comes with new store art, so the capsule is fetched again
+#define SQL_UPSERT_ART "INSERT INTO steam_game_art (game_id, icon_hash) VALUES (?, ?) " \
+                       "ON CONFLICT(game_id) DO UPDATE SET icon_hash = excluded.icon_hash, capsule_hash = NULL " \
+                       "WHERE icon_hash IS NOT excluded.icon_hash;"
+#define SQL_NEXT_GENERATION "INSERT INTO steam_accounts (steam_id, generation) VALUES (?, 1) " \
+                            "ON CONFLICT(steam_id) DO UPDATE SET generation = generation + 1 RETURNING generation;"
+#define SQL_ACCOUNT_ROWS "SELECT game_id, row_hash, removed_generation IS NOT NULL FROM steam_game_owners " \
+                         "WHERE steam_id = ? ORDER BY game_id;"
+#define SQL_TOMBSTONE_OWNER "UPDATE steam_game_owners SET removed_generation = ?3 WHERE game_id = ?1 AND steam_id = ?2;"
+// Tombstones neither count towards the playtime nor keep a game. The game
+// was last played when any owner last played it.
+#define SQL_SUM_OWNERS "UPDATE steam_games SET playtime = owners.total, playtime_2weeks = owners.recent, " \
+                       "rtime_last_played = owners.last_played " \
+                       "FROM (SELECT COALESCE(SUM(playtime), 0) AS total, COALESCE(SUM(playtime_2weeks), 0) AS recent, " \
+                       "COALESCE(MAX(rtime_last_played), 0) AS last_played FROM steam_game_owners " \
+                       "WHERE game_id = ?1 AND removed_generation IS NULL) AS owners " \
+                       "WHERE game_id = ?1 AND (playtime IS NOT owners.total OR playtime_2weeks IS NOT owners.recent " \
+                       "OR rtime_last_played IS NOT owners.last_played);"
+#define SQL_DROP_UNOWNED "DELETE FROM steam_games WHERE game_id = ?1 " \
+                         "AND NOT EXISTS (SELECT 1 FROM steam_game_owners WHERE game_id = ?1 AND removed_generation IS NULL);"
+
+// What the account held before the import, to diff the response against
+typedef struct {
+    int game_id;
+    sqlite3_int64 row_hash;
+    int tombstone;
+    int seen;
+} StoredOwnerRow;
+
+struct SteamGameWriter {
     sqlite3 *db;
     sqlite3_stmt *stmt;
-    const char *sql = "SELECT game_id, game_name, install_path, playtime FROM non_steam_games "
-                      "UNION ALL "
-                      "SELECT game_id, game_name, NULL AS install_path, playtime FROM steam_games "
-                      "ORDER BY game_name ASC";
-    int rc;
+    char *steam_id;     // the account being imported, NULL to record no owner
+    sqlite3_int64 generation;
+    StoredOwnerRow *rows;  // sorted by game_id
+    size_t row_count;
+    SteamSyncDelta delta;
+    size_t count;
+    int failed;
+};
 
-    rc = sqlite3_open(db_path, &db);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+static int step_done(sqlite3 *db, sqlite3_stmt *stmt)
+{
+    int ok = stmt && sqlite3_step(stmt) == SQLITE_DONE;
+
+    if (stmt && !ok) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
     }
+    db_release_statement(stmt);
+    return ok;
+}
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+// FNV-1a over what the API reports for a game, NUL separated. Playtime
+// the local client records doesn't touch it, so that stands until the API
+// reports something new. SQLite integers are signed, hence the cast.
+static sqlite3_int64 owner_row_hash(const SteamGame *game)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    char playtime_text[16];
+    char last_played_text[24];
+    char recent_text[16];
+    const char *fields[5];
+    size_t i;
+    const char *p;
+
+    snprintf(playtime_text, sizeof(playtime_text), "%d", game->playtime);
+    snprintf(last_played_text, sizeof(last_played_text), "%lld", (long long)game->last_played);
+    snprintf(recent_text, sizeof(recent_text), "%d", game->playtime_2weeks);
+    fields[0] = game->game_name ? game->game_name : "";
+    fields[1] = playtime_text;
+    fields[2] = game->icon_hash ? game->icon_hash : "";
+    fields[3] = last_played_text;
+    fields[4] = recent_text;
+    for (i = 0; i < 5; i++) {
+        for (p = fields[i]; ; p++) {
+            hash ^= (unsigned char)*p;
+            hash *= 1099511628211ULL;
+            if (!*p) {
+                break;
+            }
+        }
     }
+    return (sqlite3_int64)hash;
+}
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        int game_id = sqlite3_column_int(stmt, 0);
-        const char *game_name = (const char *)sqlite3_column_text(stmt, 1);
-        const char *install_path = (const char *)sqlite3_column_text(stmt, 2);
-        int playtime = sqlite3_column_int(stmt, 3);
+static int compare_owner_rows(const void *a, const void *b)
+{
+    int x = ((const StoredOwnerRow *)a)->game_id, y = ((const StoredOwnerRow *)b)->game_id;
+    return (x > y) - (x < y);
+}
 
-        callback(game_id, game_name, install_path, playtime, user_data);
+static StoredOwnerRow *find_owner_row(SteamGameWriter *writer, int game_id)
+{
+    StoredOwnerRow key;
+
+    key.game_id = game_id;
+    return bsearch(&key, writer->rows, writer->row_count, sizeof(StoredOwnerRow), compare_owner_rows);
+}
+
+// Starts the account's next generation and reads the hashes of its rows
+static int load_account_rows(SteamGameWriter *writer)
+{
+    sqlite3_stmt *stmt = db_prepare_cached(writer->db, SQL_NEXT_GENERATION);
+    size_t cap = 0;
+    int rc;
+
+    if (!stmt) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, writer->steam_id, -1, SQLITE_TRANSIENT);
+    if ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        writer->generation = sqlite3_column_int64(stmt, 0);
+        rc = sqlite3_step(stmt);
+    }
+    db_release_statement(stmt);
+    if (rc != SQLITE_DONE || !(stmt = db_prepare_cached(writer->db, SQL_ACCOUNT_ROWS))) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(writer->db));
+        return 0;
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_bind_text(stmt, 1, writer->steam_id, -1, SQLITE_TRANSIENT);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        StoredOwnerRow *row;
+
+        if (writer->row_count == cap) {
+            StoredOwnerRow *rows = realloc(writer->rows, (cap = cap ? cap * 2 : 256) * sizeof(StoredOwnerRow));
+            if (!rows) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            writer->rows = rows;
+        }
+        row = &writer->rows[writer->row_count++];
+        row->game_id = sqlite3_column_int(stmt, 0);
+        row->row_hash = sqlite3_column_int64(stmt, 1);
+        row->tombstone = sqlite3_column_int(stmt, 2);
+        row->seen = 0;
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(writer->db));
+    }
+    db_release_statement(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// Recomputes a game's playtime from its owners, or drops the game once no
+// account owns it any more
+static int settle_game(sqlite3 *db, int game_id, int drop_unowned)
+{
+    sqlite3_stmt *stmt;
+
+    if (drop_unowned) {
+        stmt = db_prepare_cached(db, SQL_DROP_UNOWNED);
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, game_id);
+        }
+        if (!step_done(db, stmt)) {
+            return 0;
+        }
+    }
+    stmt = db_prepare_cached(db, SQL_SUM_OWNERS);
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, game_id);
+    }
+    return step_done(db, stmt);
+}
+
+// Tombstones the games the account listed before but not this time
+static int drop_unseen_games(SteamGameWriter *writer)
+{
+    size_t i;
+
+    for (i = 0; i < writer->row_count; i++) {
+        const StoredOwnerRow *row = &writer->rows[i];
+        sqlite3_stmt *stmt;
+
+        if (row->seen || row->tombstone) {
+            continue;
+        }
+        stmt = db_prepare_cached(writer->db, SQL_TOMBSTONE_OWNER);
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, row->game_id);
+            sqlite3_bind_text(stmt, 2, writer->steam_id, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, 3, writer->generation);
+        }
+        if (!step_done(writer->db, stmt) || !settle_game(writer->db, row->game_id, 1)) {
+            return 0;
+        }
+        writer->delta.removed++;
+    }
+    return 1;
+}
+
+SteamGameWriter *steam_game_writer_begin(sqlite3 *db, const char *steam_id)
+{
+    SteamGameWriter *writer;
+    char *zErrMsg = 0;
+
+    // Take the write lock up front so the busy handler applies instead of
+    // failing halfway through when upgrading from a read lock
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return NULL;
+    }
+
+    writer = calloc(1, sizeof(SteamGameWriter));
+    writer->db = db;
+    if (steam_id) {
+        writer->steam_id = strdup(steam_id);
+        writer->failed = !load_account_rows(writer);
+    } else {
+        writer->stmt = db_prepare_cached(db, SQL_UPSERT_GAME);
+        if (!writer->stmt) {
+            writer->failed = 1;
+        }
+    }
+
+    return writer;
+}
+
+static int add_owned_game(SteamGameWriter *writer, const SteamGame *game, sqlite3_int64 row_hash)
+{
+    sqlite3_stmt *stmt;
+
+    stmt = db_prepare_cached(writer->db, SQL_UPSERT_OWNED_GAME);
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, game->game_id);
+        sqlite3_bind_text(stmt, 2, game->game_name, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 3, game->playtime);  // only used for a new game
+    }
+    if (!step_done(writer->db, stmt)) {
+        return 0;
+    }
+
+    stmt = db_prepare_cached(writer->db, SQL_UPSERT_OWNER);
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, game->game_id);
+        sqlite3_bind_text(stmt, 2, writer->steam_id, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 3, game->playtime);
+        sqlite3_bind_int64(stmt, 4, row_hash);
+        sqlite3_bind_int64(stmt, 5, writer->generation);
+        sqlite3_bind_int64(stmt, 6, game->last_played);
+        sqlite3_bind_int(stmt, 7, game->playtime_2weeks);
+    }
+    return step_done(writer->db, stmt) && settle_game(writer->db, game->game_id, 0);
+}
+
+static int set_game_icon(SteamGameWriter *writer, int game_id, const char *icon_hash)
+{
+    sqlite3_stmt *stmt;
+
+    if (!icon_hash || !*icon_hash) {
+        return 1;
+    }
+    stmt = db_prepare_cached(writer->db, SQL_UPSERT_ART);
+    if (stmt) {
+        sqlite3_bind_int(stmt, 1, game_id);
+        sqlite3_bind_text(stmt, 2, icon_hash, -1, SQLITE_TRANSIENT);
+    }
+    return step_done(writer->db, stmt);
+}
+
+int steam_game_writer_add(SteamGameWriter *writer, const SteamGame *game)
+{
+    if (writer->failed) {
+        return 0;
+    }
+
+    if (writer->steam_id) {
+        sqlite3_int64 row_hash = owner_row_hash(game);
+        StoredOwnerRow *row = find_owner_row(writer, game->game_id);
+
+        if (row && row->seen) {
+            return 1;  // Listed twice; the first one counts
+        }
+        if (row) {
+            row->seen = 1;
+        }
+        // The account reports the game exactly as before: nothing to write
+        if (row && !row->tombstone && row->row_hash == row_hash) {
+            writer->delta.unchanged++;
+            writer->count++;
+            return 1;
+        }
+        writer->failed = !add_owned_game(writer, game, row_hash);
+        if (row && !row->tombstone) {
+            writer->delta.updated++;
+        } else {
+            writer->delta.added++;
+        }
+    } else {
+        sqlite3_bind_int(writer->stmt, 1, game->game_id);
+        sqlite3_bind_text(writer->stmt, 2, game->game_name, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(writer->stmt, 3, game->playtime);
+        sqlite3_bind_int64(writer->stmt, 4, game->last_played);
+        sqlite3_bind_int(writer->stmt, 5, game->playtime_2weeks);
+
+        if (sqlite3_step(writer->stmt) != SQLITE_DONE) {
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(writer->db));
+            writer->failed = 1;
+        }
+        sqlite3_reset(writer->stmt);
+    }
+    if (!writer->failed) {
+        writer->failed = !set_game_icon(writer, game->game_id, game->icon_hash);
+    }
+
+    if (writer->failed) {
+        return 0;
+    }
+    writer->count++;
+    return 1;
+}
+
+int steam_game_writer_end(SteamGameWriter *writer, int commit, SteamSyncDelta *delta)
+{
+    TRACE_SCOPE("steam_game_writer_end");
+    char *zErrMsg = 0;
+    int ok = commit && !writer->failed;
+
+    db_release_statement(writer->stmt);
+    // Only a complete import says which games the account no longer owns
+    if (ok && writer->steam_id) {
+        ok = drop_unseen_games(writer);
+    }
+
+    if (sqlite3_exec(writer->db, ok ? "COMMIT;" : "ROLLBACK;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        sqlite3_exec(writer->db, "ROLLBACK;", NULL, 0, NULL);
+        ok = 0;
+    }
+    if (ok) {
+        fprintf(stderr, "Imported %zu Steam games\n", writer->count);
+        TRACE_COUNTER("steam games imported", writer->count);
+        if (writer->steam_id) {
+            fprintf(stderr, "Steam account %s, generation %lld: %zu added, %zu updated, %zu removed, %zu unchanged\n",
+                    writer->steam_id, (long long)writer->generation, writer->delta.added, writer->delta.updated,
+                    writer->delta.removed, writer->delta.unchanged);
+        }
+    }
+    if (delta) {
+        *delta = writer->delta;
+        delta->generation = writer->generation;
+        if (!ok) {
+            memset(delta, 0, sizeof(SteamSyncDelta));
+        }
+    }
+
+    free(writer->rows);
+    free(writer->steam_id);
+    free(writer);
+    return ok;
+}
+
+#define SQL_KNOWN_ACCOUNTS "SELECT steam_id FROM steam_accounts UNION SELECT steam_id FROM steam_game_owners;"
+#define SQL_ACCOUNT_GAMES "SELECT game_id FROM steam_game_owners WHERE steam_id = ? AND removed_generation IS NULL;"
+#define SQL_DELETE_ACCOUNT_OWNERS "DELETE FROM steam_game_owners WHERE steam_id = ?;"
+#define SQL_DELETE_ACCOUNT "DELETE FROM steam_accounts WHERE steam_id = ?;"
+
+static int is_kept_account(const char *steam_id, const char *const *kept, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (strcmp(kept[i], steam_id) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Removes one account's owner rows, then settles the games it owned
+static int forget_account(sqlite3 *db, const char *steam_id)
+{
+    sqlite3_stmt *stmt = db_prepare_cached(db, SQL_ACCOUNT_GAMES);
+    int *game_ids = NULL;
+    size_t count = 0, cap = 0, i;
+    int rc, ok;
+
+    if (!stmt) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, steam_id, -1, SQLITE_TRANSIENT);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (count == cap) {
+            int *grown = realloc(game_ids, (cap = cap ? cap * 2 : 256) * sizeof(int));
+            if (!grown) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            game_ids = grown;
+        }
+        game_ids[count++] = sqlite3_column_int(stmt, 0);
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    db_release_statement(stmt);
+    ok = rc == SQLITE_DONE;
+
+    if (ok && (stmt = db_prepare_cached(db, SQL_DELETE_ACCOUNT_OWNERS))) {
+        sqlite3_bind_text(stmt, 1, steam_id, -1, SQLITE_TRANSIENT);
+    }
+    ok = ok && step_done(db, stmt);
+    if (ok && (stmt = db_prepare_cached(db, SQL_DELETE_ACCOUNT))) {
+        sqlite3_bind_text(stmt, 1, steam_id, -1, SQLITE_TRANSIENT);
+    }
+    ok = ok && step_done(db, stmt);
+    for (i = 0; ok && i < count; i++) {
+        ok = settle_game(db, game_ids[i], 1);
+    }
+    if (ok) {
+        fprintf(stdout, "Forgot Steam account %s and its %zu games\n", steam_id, count);
+    }
+    free(game_ids);
+    return ok;
+}
+
+int db_forget_steam_accounts(sqlite3 *db, const char *const *kept, size_t count)
+{
+    TRACE_SCOPE("db_forget_steam_accounts");
+    sqlite3_stmt *stmt;
+    char **gone = NULL;
+    size_t gone_count = 0, i;
+    char *zErrMsg = 0;
+    int rc, ok;
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+
+    // Collected first, as forgetting them changes the tables being read
+    if (!(stmt = db_prepare_cached(db, SQL_KNOWN_ACCOUNTS))) {
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        return 0;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *steam_id = (const char *)sqlite3_column_text(stmt, 0);
+        char **grown;
+
+        if (!steam_id || is_kept_account(steam_id, kept, count)) {
+            continue;
+        }
+        if (!(grown = realloc(gone, (gone_count + 1) * sizeof(char *)))) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        gone = grown;
+        gone[gone_count++] = strdup(steam_id);
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    db_release_statement(stmt);
+    ok = rc == SQLITE_DONE;
+
+    for (i = 0; ok && i < gone_count; i++) {
+        ok = forget_account(db, gone[i]);
+    }
+    for (i = 0; i < gone_count; i++) {
+        free(gone[i]);
+    }
+    free(gone);
+
+    if (sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        ok = 0;
+    }
+    return ok;
+}
+
+int insert_games(sqlite3 *db, const SteamGame *games, size_t count)
+{
+    SteamGameWriter *writer = steam_game_writer_begin(db, NULL);
+    size_t i;
+
+    if (!writer) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (!steam_game_writer_add(writer, &games[i])) {
+            break;
+        }
+    }
+
+    return steam_game_writer_end(writer, 1, NULL);
+}
+
+void insert_game(sqlite3 *db, int game_id, const char *game_name, int playtime)
+{
+    SteamGame game = { game_id, game_name, playtime, NULL, 0, 0 };
+
+    insert_games(db, &game, 1);
+}
+
+void insert_non_steam_game(sqlite3 *db, const char *game_name, const char *install_path, int playtime)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO non_steam_games (game_name, install_path, playtime) VALUES (?, ?, ?);";
+
+    if ((stmt = db_prepare_cached(db, sql))) {
+        sqlite3_bind_text(stmt, 1, game_name, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, install_path, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt, 3, playtime);
+
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            fprintf(stderr, "SQL error while inserting non-Steam game: %s\n", sqlite3_errmsg(db));
+        } else {
+            fprintf(stdout, "Non-Steam game inserted successfully\n");
+        }
+
+        db_release_statement(stmt);
+    }
+}
+
+#define SQL_ADD_LOCAL_GAME "INSERT INTO steam_games (game_id, game_name) VALUES (?, ?) ON CONFLICT(game_id) DO NOTHING;"
+#define SQL_UPSERT_INSTALL "INSERT INTO steam_installs (game_id, install_dir, size_on_disk, installed) VALUES (?, ?, ?, ?) " \
+                           "ON CONFLICT(game_id) DO UPDATE SET install_dir = excluded.install_dir, " \
+                           "size_on_disk = excluded.size_on_disk, installed = excluded.installed " \
+                           "WHERE install_dir IS NOT excluded.install_dir OR size_on_disk IS NOT excluded.size_on_disk " \
+                           "OR installed IS NOT excluded.installed;"
+#define SQL_MARK_INSTALLED "INSERT OR IGNORE INTO temp.install_seen (game_id) VALUES (?);"
+#define SQL_DROP_UNINSTALLED "DELETE FROM steam_installs WHERE game_id NOT IN (SELECT game_id FROM temp.install_seen);"
+
+static int add_install(sqlite3 *db, const SteamInstall *install)
+{
+    sqlite3_stmt *stmt;
+    int ok;
+
+    // Games the API hasn't told us about yet appear under their local name;
+    // the API's name and playtime win once it does
+    if (!(stmt = db_prepare_cached(db, SQL_ADD_LOCAL_GAME))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, install->game_id);
+    sqlite3_bind_text(stmt, 2, install->game_name, -1, SQLITE_TRANSIENT);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    db_release_statement(stmt);
+    if (!ok || !(stmt = db_prepare_cached(db, SQL_UPSERT_INSTALL))) {
+        return 0;
+    }
+
+    sqlite3_bind_int(stmt, 1, install->game_id);
+    sqlite3_bind_text(stmt, 2, install->install_dir, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, install->size_on_disk);
+    sqlite3_bind_int(stmt, 4, install->installed);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    db_release_statement(stmt);
+    return ok;
+}
+
+static int mark_installed(sqlite3 *db, int game_id)
+{
+    sqlite3_stmt *stmt;
+    int ok;
+
+    if (!(stmt = db_prepare_cached(db, SQL_MARK_INSTALLED))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    db_release_statement(stmt);
+    return ok;
+}
+
+// Replaces the recorded installs with the result of a complete scan, in one
+// transaction. Uninstalled games stay in steam_games: they are still owned.
+int db_replace_steam_installs(sqlite3 *db, const SteamInstall *installs, size_t count)
+{
+    TRACE_SCOPE("db_replace_steam_installs");
+    char *zErrMsg = 0;
+    size_t i;
+    int ok;
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+
+    ok = sqlite3_exec(db, "CREATE TEMP TABLE IF NOT EXISTS install_seen(game_id INTEGER PRIMARY KEY);"
+                          "DELETE FROM temp.install_seen;", NULL, 0, NULL) == SQLITE_OK;
+    for (i = 0; ok && i < count; i++) {
+        ok = add_install(db, &installs[i]) && mark_installed(db, installs[i].game_id);
+    }
+    ok = ok && sqlite3_exec(db, SQL_DROP_UNINSTALLED, NULL, 0, NULL) == SQLITE_OK;
+    if (!ok) {
+        fprintf(stderr, "SQL error while storing Steam installs: %s\n", sqlite3_errmsg(db));
+    }
+
+    if (sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        ok = 0;
+    }
+    if (ok) {
+        TRACE_COUNTER("steam installs", count);
+    }
+    return ok;
+}
+
+// Records one game's install, as its manifest now reads. Both statements
+// commit together, so the game never shows without its install.
+int db_set_steam_install(sqlite3 *db, const SteamInstall *install)
+{
+    char *zErrMsg = 0;
+    int ok;
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+    ok = add_install(db, install);
+    if (!ok) {
+        fprintf(stderr, "SQL error while storing a Steam install: %s\n", sqlite3_errmsg(db));
+    }
+    if (sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        ok = 0;
+    }
+    return ok;
+}
+
+int db_remove_steam_install(sqlite3 *db, int game_id)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "DELETE FROM steam_installs WHERE game_id = ?;";
+    int ok;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    db_release_statement(stmt);
+    return ok;
+}
+
+// Only existing rows are updated: localconfig.vdf also lists tools and games
+// that are no longer owned
+#define SQL_SET_OWNER_PLAYTIME "UPDATE steam_game_owners SET playtime = ?3 " \
+                               "WHERE game_id = ?1 AND steam_id = ?2 AND removed_generation IS NULL AND playtime IS NOT ?3;"
+#define SQL_SET_UNOWNED_PLAYTIME "UPDATE steam_games SET playtime = ?2 WHERE game_id = ?1 AND playtime IS NOT ?2 " \
+                                 "AND NOT EXISTS (SELECT 1 FROM steam_game_owners WHERE game_id = ?1 AND removed_generation IS NULL);"
+
+static int update_playtime(sqlite3 *db, const char *steam_id, const SteamPlaytime *playtime)
+{
+    sqlite3_stmt *stmt;
+    int changed, ok;
+
+    if (!(stmt = db_prepare_cached(db, SQL_SET_OWNER_PLAYTIME))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, playtime->game_id);
+    sqlite3_bind_text(stmt, 2, steam_id, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 3, playtime->playtime);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    changed = sqlite3_changes(db) > 0;
+    db_release_statement(stmt);
+    if (!ok) {
+        return 0;
+    }
+
+    // An owned game's playtime is the sum over its owners; one only found
+    // locally takes the local playtime as is
+    stmt = db_prepare_cached(db, changed ? SQL_SUM_OWNERS : SQL_SET_UNOWNED_PLAYTIME);
+    if (!stmt) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, playtime->game_id);
+    if (!changed) {
+        sqlite3_bind_int(stmt, 2, playtime->playtime);
+    }
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    db_release_statement(stmt);
+    return ok;
+}
+
+// Applies the playtimes the Steam client recorded for one account, in one
+// transaction. Rows that already match are left alone.
+int db_update_steam_playtimes(sqlite3 *db, const char *steam_id, const SteamPlaytime *playtimes, size_t count)
+{
+    TRACE_SCOPE("db_update_steam_playtimes");
+    char *zErrMsg = 0;
+    size_t i;
+    int ok = 1;
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+    for (i = 0; ok && i < count; i++) {
+        ok = update_playtime(db, steam_id, &playtimes[i]);
+    }
+    if (!ok) {
+        fprintf(stderr, "SQL error while updating playtime: %s\n", sqlite3_errmsg(db));
+    }
+    if (sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        ok = 0;
+    }
+    return ok;
+}
+
+// Looks up where a Steam game is installed; returns 0 if it isn't
+int db_fetch_steam_install(sqlite3 *db, int game_id, DBInstallCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT install_dir, size_on_disk, installed FROM steam_installs WHERE game_id = ?;";
+    int found = 0;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        callback(game_id, (const char *)sqlite3_column_text(stmt, 0), sqlite3_column_int64(stmt, 1),
+                 sqlite3_column_int(stmt, 2), user_data);
+        found = 1;
+    }
+    db_release_statement(stmt);
+    return found;
+}
+
+// Stores a finished session and adds it to the game's playtime and last
+// played time in one transaction. Steam keeps those for its own games, so
+// for them only the session is stored.
+int db_record_play_session(sqlite3 *db, DBGameSource source, int game_id, sqlite3_int64 started_at, sqlite3_int64 ended_at)
+{
+    sqlite3_stmt *stmt;
+    char *zErrMsg = 0;
+    const char *insert_sql = "INSERT INTO play_sessions (source, game_id, started_at, ended_at) VALUES (?, ?, ?, ?);";
+    // Rounded to the nearest minute, the unit playtime is kept in
+    const char *playtime_sql = "UPDATE non_steam_games SET playtime = playtime + (?1 + 30) / 60, "
+                               "last_played = MAX(last_played, ?3) WHERE game_id = ?2;";
+    int ok = 0;
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+
+    if ((stmt = db_prepare_cached(db, insert_sql))) {
+        sqlite3_bind_int(stmt, 1, source);
+        sqlite3_bind_int(stmt, 2, game_id);
+        sqlite3_bind_int64(stmt, 3, started_at);
+        sqlite3_bind_int64(stmt, 4, ended_at);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        db_release_statement(stmt);
+    }
+    if (ok && source == DB_SOURCE_NON_STEAM) {
+        ok = 0;
+        if ((stmt = db_prepare_cached(db, playtime_sql))) {
+            sqlite3_bind_int64(stmt, 1, ended_at - started_at);
+            sqlite3_bind_int(stmt, 2, game_id);
+            sqlite3_bind_int64(stmt, 3, ended_at);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            db_release_statement(stmt);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "SQL error while recording a play session: %s\n", sqlite3_errmsg(db));
+    }
+
+    if (sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        ok = 0;
+    }
+    return ok;
+}
+
+int db_record_launch(sqlite3 *db, const LaunchTiming *timing)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO launch_history (source, game_id, launched_at, exec_ms, process_ms, window_ms) "
+                      "VALUES (?, ?, ?, ?, ?, ?);";
+    int ok = 0;
+    int p;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, timing->source);
+    sqlite3_bind_int(stmt, 2, timing->game_id);
+    sqlite3_bind_int64(stmt, 3, timing->launched_at);
+    for (p = 0; p < DB_LAUNCH_N_PHASES; p++) {
+        if (timing->phase_ms[p] >= 0) {
+            sqlite3_bind_int(stmt, 4 + p, timing->phase_ms[p]);
+        } else {
+            sqlite3_bind_null(stmt, 4 + p);
+        }
+    }
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        fprintf(stderr, "SQL error while recording a launch: %s\n", sqlite3_errmsg(db));
+    }
+    db_release_statement(stmt);
+    return ok;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest rank: the smallest of the sorted values that p percent of them
+// are at or below
+static int percentile(const int *sorted, int count, int p)
+{
+    int rank = (p * count + 99) / 100;
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+int db_fetch_launch_stats(sqlite3 *db, DBGameSource source, int game_id, int limit, LaunchStats *stats)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT exec_ms, process_ms, window_ms FROM launch_history "
+                      "WHERE source = ? AND game_id = ? ORDER BY launched_at DESC, rowid DESC LIMIT ?;";
+    int *values;  // limit values per phase
+    int p;
+
+    memset(stats, 0, sizeof(*stats));
+    for (p = 0; p < DB_LAUNCH_N_PHASES; p++) {
+        stats->last_ms[p] = -1;
+    }
+    if (limit <= 0 || !(values = malloc((size_t)limit * DB_LAUNCH_N_PHASES * sizeof(int)))) {
+        return 0;
+    }
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        free(values);
+        return 0;
+    }
+
+    sqlite3_bind_int(stmt, 1, source);
+    sqlite3_bind_int(stmt, 2, game_id);
+    sqlite3_bind_int(stmt, 3, limit);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        for (p = 0; p < DB_LAUNCH_N_PHASES; p++) {
+            if (sqlite3_column_type(stmt, p) == SQLITE_NULL) {
+                continue;
+            }
+            values[p * limit + stats->count[p]++] = sqlite3_column_int(stmt, p);
+            if (stats->launches == 0) {
+                stats->last_ms[p] = sqlite3_column_int(stmt, p);
+            }
+        }
+        stats->launches++;
+    }
+    db_release_statement(stmt);
+
+    for (p = 0; p < DB_LAUNCH_N_PHASES; p++) {
+        if (stats->count[p] > 0) {
+            qsort(values + p * limit, stats->count[p], sizeof(int), compare_ints);
+            stats->p50_ms[p] = percentile(values + p * limit, stats->count[p], 50);
+            stats->p90_ms[p] = percentile(values + p * limit, stats->count[p], 90);
+        }
+    }
+    free(values);
+    return stats->launches > 0;
+}
+
+static int write_resource_session(sqlite3 *db, ResourceSession *session)
+{
+    sqlite3_stmt *stmt;
+    const char *insert_sql = "INSERT INTO resource_sessions (source, game_id, started_at, ended_at, interval_ms, "
+                             "cpu_ms, peak_rss_kb, peak_threads, read_kb, write_kb) "
+                             "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10);";
+    const char *update_sql = "UPDATE resource_sessions SET ended_at = ?4, cpu_ms = ?6, peak_rss_kb = ?7, "
+                             "peak_threads = ?8, read_kb = ?9, write_kb = ?10 WHERE session_id = ?11;";
+    int ok;
+
+    if (!(stmt = db_prepare_cached(db, session->session_id ? update_sql : insert_sql))) {
+        return 0;
+    }
+    if (session->session_id) {
+        sqlite3_bind_int64(stmt, 11, session->session_id);
+    } else {
+        sqlite3_bind_int(stmt, 1, session->source);
+        sqlite3_bind_int(stmt, 2, session->game_id);
+        sqlite3_bind_int64(stmt, 3, session->started_at);
+        sqlite3_bind_int(stmt, 5, session->interval_ms);
+    }
+    sqlite3_bind_int64(stmt, 4, session->ended_at);
+    sqlite3_bind_int64(stmt, 6, session->cpu_ms);
+    sqlite3_bind_int64(stmt, 7, session->peak_rss_kb);
+    sqlite3_bind_int(stmt, 8, session->peak_threads);
+    sqlite3_bind_int64(stmt, 9, session->read_kb);
+    sqlite3_bind_int64(stmt, 10, session->write_kb);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (ok && !session->session_id) {
+        session->session_id = sqlite3_last_insert_rowid(db);
+    }
+    db_release_statement(stmt);
+    return ok;
+}
+
+int db_add_resource_samples(sqlite3 *db, ResourceSession *session, const ResourceSample *samples, size_t count)
+{
+    TRACE_SCOPE("db_add_resource_samples");
+    sqlite3_stmt *stmt;
+    char *zErrMsg = 0;
+    const char *sql = "INSERT INTO resource_samples (session_id, at_ms, cpu_ms, rss_kb, threads, read_kb, write_kb) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?);";
+    sqlite3_int64 session_id = session->session_id;
+    size_t i;
+    int ok;
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        return 0;
+    }
+
+    ok = write_resource_session(db, session);
+    if (ok && count > 0 && (stmt = db_prepare_cached(db, sql))) {
+        for (i = 0; ok && i < count; i++) {
+            sqlite3_bind_int64(stmt, 1, session->session_id);
+            sqlite3_bind_int(stmt, 2, samples[i].at_ms);
+            sqlite3_bind_int64(stmt, 3, samples[i].cpu_ms);
+            sqlite3_bind_int64(stmt, 4, samples[i].rss_kb);
+            sqlite3_bind_int(stmt, 5, samples[i].threads);
+            sqlite3_bind_int64(stmt, 6, samples[i].read_kb);
+            sqlite3_bind_int64(stmt, 7, samples[i].write_kb);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+        }
+        db_release_statement(stmt);
+    } else if (count > 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "SQL error while storing resource samples: %s\n", sqlite3_errmsg(db));
+    }
+
+    if (sqlite3_exec(db, ok ? "COMMIT;" : "ROLLBACK;", NULL, 0, &zErrMsg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, 0, NULL);
+        ok = 0;
+    }
+    if (!ok) {
+        session->session_id = session_id;  // The insert was rolled back
+    }
+    return ok;
+}
+
+int db_fetch_resource_summary(sqlite3 *db, DBGameSource source, int game_id, ResourceSummary *summary)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT COUNT(*), TOTAL(ended_at - started_at), TOTAL(cpu_ms), MAX(peak_rss_kb), "
+                      "MAX(peak_threads), TOTAL(read_kb), TOTAL(write_kb) "
+                      "FROM resource_sessions WHERE source = ? AND game_id = ?;";
+
+    memset(summary, 0, sizeof(*summary));
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, source);
+    sqlite3_bind_int(stmt, 2, game_id);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        summary->sessions = sqlite3_column_int(stmt, 0);
+        summary->seconds = (sqlite3_int64)sqlite3_column_double(stmt, 1);
+        summary->cpu_ms = (sqlite3_int64)sqlite3_column_double(stmt, 2);
+        summary->peak_rss_kb = sqlite3_column_int64(stmt, 3);
+        summary->peak_threads = sqlite3_column_int(stmt, 4);
+        summary->read_kb = (sqlite3_int64)sqlite3_column_double(stmt, 5);
+        summary->write_kb = (sqlite3_int64)sqlite3_column_double(stmt, 6);
+    }
+    db_release_statement(stmt);
+    return summary->sessions > 0;
+}
+
+void db_fetch_all_games(sqlite3 *db, DBRowCallback callback, void *user_data) {
+    TRACE_SCOPE("db_fetch_all_games");
+    sqlite3_stmt *stmt;
+    int64_t rows = 0;
+    const char *sql = "SELECT game_id, game_name, install_path, playtime FROM non_steam_games "
+                      "UNION ALL "
+                      "SELECT game_id, game_name, NULL AS install_path, playtime FROM steam_games "
+                      "ORDER BY game_name COLLATE NOCASE ASC";
+
+    stmt = db_prepare_cached(db, sql);
+    if (!stmt) {
+        return;
+    }
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int game_id = sqlite3_column_int(stmt, 0);
+        const char *game_name = (const char *)sqlite3_column_text(stmt, 1);
+        const char *install_path = (const char *)sqlite3_column_text(stmt, 2);
+        int playtime = sqlite3_column_int(stmt, 3);
+
+        callback(game_id, game_name, install_path, playtime, user_data);
+        rows++;
+    }
+
+    db_release_statement(stmt);
+    TRACE_COUNTER("games fetched", rows);
+}
+
+// Every game with the given name, ignoring ASCII case, through the name
+// indexes; returns how many there are
+int db_find_games_by_name(sqlite3 *db, const char *game_name, DBRowCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT game_id, game_name, install_path, playtime FROM non_steam_games "
+                      "WHERE game_name = ?1 COLLATE NOCASE "
+                      "UNION ALL "
+                      "SELECT game_id, game_name, NULL AS install_path, playtime FROM steam_games "
+                      "WHERE game_name = ?1 COLLATE NOCASE;";
+    int found = 0;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, game_name, -1, SQLITE_TRANSIENT);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        callback(sqlite3_column_int(stmt, 0), (const char *)sqlite3_column_text(stmt, 1),
+                 (const char *)sqlite3_column_text(stmt, 2), sqlite3_column_int(stmt, 3), user_data);
+        found++;
+    }
+    db_release_statement(stmt);
+
+    return found;
+}
+
+// Looks up one game; returns 0 if it no longer exists
+int db_fetch_game(sqlite3 *db, DBGameSource source, int game_id, DBRowCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = source == DB_SOURCE_NON_STEAM
+        ? "SELECT game_id, game_name, install_path, playtime FROM non_steam_games WHERE game_id = ?;"
+        : "SELECT game_id, game_name, NULL AS install_path, playtime FROM steam_games WHERE game_id = ?;";
+    int found = 0;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *game_name = (const char *)sqlite3_column_text(stmt, 1);
+        const char *install_path = (const char *)sqlite3_column_text(stmt, 2);
+        int playtime = sqlite3_column_int(stmt, 3);
+
+        callback(game_id, game_name, install_path, playtime, user_data);
+        found = 1;
+    }
+
+    db_release_statement(stmt);
+    return found;
+}
+
+static void emit_game_art(sqlite3_stmt *stmt, DBArtCallback callback, void *user_data)
+{
+    callback(sqlite3_column_int(stmt, 0),
+             (const char *)sqlite3_column_text(stmt, 1),
+             (const char *)sqlite3_column_text(stmt, 2),
+             user_data);
+}
+
+// Every Steam game, including those no artwork is known for yet
+void db_fetch_all_game_art(sqlite3 *db, DBArtCallback callback, void *user_data)
+{
+    TRACE_SCOPE("db_fetch_all_game_art");
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT g.game_id, a.icon_hash, a.capsule_hash FROM steam_games g "
+                      "LEFT JOIN steam_game_art a ON a.game_id = g.game_id;";
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        emit_game_art(stmt, callback, user_data);
+    }
+    db_release_statement(stmt);
+}
+
+// Steam reports when its games were last played; non-Steam games were last
+// played when their last session through LVL ended. Unplayed games are
+// skipped through the recent indexes.
+void db_fetch_last_played(sqlite3 *db, DBLastPlayedCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT 1, game_id, last_played FROM non_steam_games WHERE last_played > 0 "
+                      "UNION ALL "
+                      "SELECT 0, game_id, rtime_last_played FROM steam_games WHERE rtime_last_played > 0;";
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        callback((DBGameSource)sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1),
+                 sqlite3_column_int64(stmt, 2), user_data);
+    }
+    db_release_statement(stmt);
+}
+
+// 0 if the game was never played or no longer exists
+sqlite3_int64 db_get_last_played(sqlite3 *db, DBGameSource source, int game_id)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = source == DB_SOURCE_NON_STEAM
+        ? "SELECT last_played FROM non_steam_games WHERE game_id = ?;"
+        : "SELECT rtime_last_played FROM steam_games WHERE game_id = ?;";
+    sqlite3_int64 last_played = 0;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        last_played = sqlite3_column_int64(stmt, 0);
+    }
+    db_release_statement(stmt);
+    return last_played;
+}
+
+static int fetch_game_rows(sqlite3 *db, const char *sql, int limit, DBRowCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    int rows = 0;
+    int rc;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, limit);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        callback(sqlite3_column_int(stmt, 0), (const char *)sqlite3_column_text(stmt, 1),
+                 (const char *)sqlite3_column_text(stmt, 2), sqlite3_column_int(stmt, 3), user_data);
+        rows++;
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        rows = -1;
+    }
+    db_release_statement(stmt);
+    return rows;
+}
+
+// Played games, most recent first. Both halves come out of their covering
+// index in order, so the union is merged instead of sorted, and a limit
+// stops the scans early.
+int db_fetch_recently_played(sqlite3 *db, int limit, DBRowCallback callback, void *user_data)
+{
+    TRACE_SCOPE("db_fetch_recently_played");
+    const char *sql = "SELECT game_id, game_name, install_path, playtime, last_played FROM non_steam_games "
+                      "WHERE last_played > 0 "
+                      "UNION ALL "
+                      "SELECT game_id, game_name, NULL, playtime, rtime_last_played FROM steam_games "
+                      "WHERE rtime_last_played > 0 "
+                      "ORDER BY 5 DESC LIMIT ?;";
+
+    return fetch_game_rows(db, sql, limit, callback, user_data);
+}
+
+// Games by playtime, most played first, the same way
+int db_fetch_most_played(sqlite3 *db, int limit, DBRowCallback callback, void *user_data)
+{
+    TRACE_SCOPE("db_fetch_most_played");
+    const char *sql = "SELECT game_id, game_name, install_path, playtime FROM non_steam_games "
+                      "UNION ALL "
+                      "SELECT game_id, game_name, NULL, playtime FROM steam_games "
+                      "ORDER BY 4 DESC LIMIT ?;";
+
+    return fetch_game_rows(db, sql, limit, callback, user_data);
+}
+
+int db_set_store_details(sqlite3 *db, const StoreDetails *details, sqlite3_int64 fetched_at)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO store_apps (game_id, fetched_at, name, genres, categories, developers, publishers, "
+                      "release_date, description) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?) "
+                      "ON CONFLICT(game_id) DO UPDATE SET fetched_at = excluded.fetched_at, name = excluded.name, "
+                      "genres = excluded.genres, categories = excluded.categories, developers = excluded.developers, "
+                      "publishers = excluded.publishers, release_date = excluded.release_date, "
+                      "description = excluded.description;";
+    int ok;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, details->game_id);
+    sqlite3_bind_int64(stmt, 2, fetched_at);
+    sqlite3_bind_text(stmt, 3, details->name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, details->genres, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, details->categories, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 6, details->developers, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 7, details->publishers, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 8, details->release_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 9, details->description, -1, SQLITE_STATIC);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        fprintf(stderr, "SQL error while storing store details: %s\n", sqlite3_errmsg(db));
+    }
+    db_release_statement(stmt);
+    return ok;
+}
+
+int db_fetch_store_pending(sqlite3 *db, sqlite3_int64 stale_before, int limit, DBGameIdCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT g.game_id FROM steam_games g LEFT JOIN store_apps s ON s.game_id = g.game_id "
+                      "WHERE s.game_id IS NULL OR s.fetched_at < ?1 "
+                      "ORDER BY s.fetched_at IS NOT NULL, s.fetched_at, g.game_id LIMIT ?2;";
+    int rows = 0;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int64(stmt, 1, stale_before);
+    sqlite3_bind_int(stmt, 2, limit);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        callback(sqlite3_column_int(stmt, 0), user_data);
+        rows++;
+    }
+    db_release_statement(stmt);
+    return rows;
+}
+
+int db_fetch_store_details(sqlite3 *db, int game_id, DBStoreDetailsCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name, genres, categories, developers, publishers, release_date, description "
+                      "FROM store_apps WHERE game_id = ?;";
+    int found = 0;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        StoreDetails details;
+
+        details.game_id = game_id;
+        details.name = (const char *)sqlite3_column_text(stmt, 0);
+        details.genres = (const char *)sqlite3_column_text(stmt, 1);
+        details.categories = (const char *)sqlite3_column_text(stmt, 2);
+        details.developers = (const char *)sqlite3_column_text(stmt, 3);
+        details.publishers = (const char *)sqlite3_column_text(stmt, 4);
+        details.release_date = (const char *)sqlite3_column_text(stmt, 5);
+        details.description = (const char *)sqlite3_column_text(stmt, 6);
+        callback(&details, user_data);
+        found = 1;
+    }
+    db_release_statement(stmt);
+    return found;
+}
+
+// Ranked by bm25 with the name weighing most, then what kind of game it is
+// and who made it, and the description least
+int db_search_store(sqlite3 *db, const char *match, DBGameIdCallback callback, void *user_data)
+{
+    TRACE_SCOPE("db_search_store");
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT store_search.rowid FROM store_search "
+                      "JOIN steam_games ON steam_games.game_id = store_search.rowid "
+                      "WHERE store_search MATCH ? "
+                      "ORDER BY bm25(store_search, 10.0, 4.0, 2.0, 4.0, 2.0, 1.0);";
+    int rows = 0;
+    int rc;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, match, -1, SQLITE_STATIC);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        callback(sqlite3_column_int(stmt, 0), user_data);
+        rows++;
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Store search for %s failed: %s\n", match, sqlite3_errmsg(db));
+        rows = -1;
+    }
+    db_release_statement(stmt);
+    return rows;
+}
+
+// Looks up one Steam game's artwork; returns 0 if the game no longer exists
+int db_fetch_game_art(sqlite3 *db, int game_id, DBArtCallback callback, void *user_data)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT g.game_id, a.icon_hash, a.capsule_hash FROM steam_games g "
+                      "LEFT JOIN steam_game_art a ON a.game_id = g.game_id WHERE g.game_id = ?;";
+    int found = 0;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        emit_game_art(stmt, callback, user_data);
+        found = 1;
+    }
+    db_release_statement(stmt);
+    return found;
+}
+
+// Remembers the file a downloaded capsule was stored as, unless the game
+// was dropped meanwhile
+int db_set_capsule_hash(sqlite3 *db, int game_id, const char *capsule_hash)
+{
+    sqlite3_stmt *stmt;
+    const char *sql = "INSERT INTO steam_game_art (game_id, capsule_hash) "
+                      "SELECT ?1, ?2 WHERE EXISTS (SELECT 1 FROM steam_games WHERE game_id = ?1) "
+                      "ON CONFLICT(game_id) DO UPDATE SET capsule_hash = excluded.capsule_hash "
+                      "WHERE capsule_hash IS NOT excluded.capsule_hash;";
+    int ok;
+
+    if (!(stmt = db_prepare_cached(db, sql))) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, game_id);
+    sqlite3_bind_text(stmt, 2, capsule_hash, -1, SQLITE_TRANSIENT);
+    ok = sqlite3_step(stmt) == SQLITE_DONE;
+    if (!ok) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+    db_release_statement(stmt);
+
+    return ok;
+}
+
+struct DBChangeLog {
+    sqlite3 *db;
+    DBChange *changes;
+    size_t count;      // committed changes come first
+    size_t pending;    // followed by those of the open transaction
+    size_t cap;
+};
+
+static void change_log_update(void *user_data, int op, const char *db_name, const char *table, sqlite3_int64 rowid)
+{
+    DBChangeLog *log = (DBChangeLog *)user_data;
+    DBGameSource source;
+    DBChange *change;
+    int details = 0;   // a table describing a game rather than holding it
+
+    if (strcmp(db_name, "main") != 0) {
+        return;
+    }
+    if (strcmp(table, "steam_games") == 0) {
+        source = DB_SOURCE_STEAM;
+    } else if (strcmp(table, "non_steam_games") == 0) {
+        source = DB_SOURCE_NON_STEAM;
+    } else if (strcmp(table, "steam_game_art") == 0 || strcmp(table, "steam_installs") == 0) {
+        // These rows share their game's id. Whatever happened to them, the
+        // game itself was only updated: a new icon should redraw its row,
+        // and an uninstalled game stays in the library.
+        source = DB_SOURCE_STEAM;
+        details = 1;
+    } else {
+        return;
+    }
+
+    if (log->count + log->pending == log->cap) {
+        size_t new_cap = log->cap ? log->cap * 2 : 64;
+        DBChange *ptr = realloc(log->changes, new_cap * sizeof(DBChange));
+        if (!ptr) {
+            fprintf(stderr, "not enough memory to record database changes\n");
+            return;
+        }
+        log->changes = ptr;
+        log->cap = new_cap;
+    }
+
+    change = &log->changes[log->count + log->pending];
+    if (details) {
+        change->type = DB_CHANGE_UPDATE;
+    } else {
+        change->type = op == SQLITE_INSERT ? DB_CHANGE_INSERT : op == SQLITE_DELETE ? DB_CHANGE_DELETE : DB_CHANGE_UPDATE;
+    }
+    change->source = source;
+    change->game_id = (int)rowid;
+    log->pending++;
+}
+
+static int change_log_commit(void *user_data)
+{
+    DBChangeLog *log = (DBChangeLog *)user_data;
+
+    log->count += log->pending;
+    log->pending = 0;
+    return 0;
+}
+
+static void change_log_rollback(void *user_data)
+{
+    DBChangeLog *log = (DBChangeLog *)user_data;
+
+    log->pending = 0;
+}
+
+DBChangeLog *db_change_log_attach(sqlite3 *db)
+{
+    DBChangeLog *log = calloc(1, sizeof(DBChangeLog));
+
+    if (!log) {
+        return NULL;
+    }
+    log->db = db;
+    sqlite3_update_hook(db, change_log_update, log);
+    sqlite3_commit_hook(db, change_log_commit, log);
+    sqlite3_rollback_hook(db, change_log_rollback, log);
+    return log;
+}
+
+// Hands out the committed changes in the order they were made. The caller
+// frees the array; NULL means nothing changed.
+DBChange *db_change_log_take(DBChangeLog *log, size_t *count)
+{
+    DBChange *changes = NULL;
+
+    *count = log->count;
+    if (log->count == 0) {
+        return NULL;
+    }
+    if (log->pending == 0) {
+        changes = log->changes;
+        log->changes = NULL;
+        log->cap = 0;
+    } else {
+        changes = malloc(log->count * sizeof(DBChange));
+        if (!changes) {
+            *count = 0;
+            return NULL;
+        }
+        memcpy(changes, log->changes, log->count * sizeof(DBChange));
+        memmove(log->changes, log->changes + log->count, log->pending * sizeof(DBChange));
+    }
+    log->count = 0;
+    return changes;
+}
+
+void db_change_log_detach(DBChangeLog *log)
+{
+    if (!log) {
+        return;
+    }
+    sqlite3_update_hook(log->db, NULL, NULL);
+    sqlite3_commit_hook(log->db, NULL, NULL);
+    sqlite3_rollback_hook(log->db, NULL, NULL);
+    free(log->changes);
+    free(log);
 }
@@ -1,13 +1,237 @@
 #ifndef __DB_H__
 #define __DB_H__
 
+#include <stddef.h>
+
 #include <sqlite3.h>
 
+typedef struct {
+    int game_id;
+    const char *game_name;
+    int playtime;  // minutes
+    const char *icon_hash;  // img_icon_url, NULL when the game has no icon
+    sqlite3_int64 last_played;  // rtime_last_played, Unix seconds, 0 if never
+    int playtime_2weeks;        // minutes
+} SteamGame;
+
+// A game found in a local Steam library folder
+typedef struct {
+    int game_id;
+    const char *game_name;
+    const char *install_dir;
+    sqlite3_int64 size_on_disk;  // bytes
+    int installed;               // fully installed rather than partly downloaded
+} SteamInstall;
+
+// An account's playtime of a game as the local Steam client recorded it
+typedef struct {
+    int game_id;
+    int playtime;  // minutes
+} SteamPlaytime;
+
+// A Steam app's store page as appdetails describes it, with lists joined
+// by ", ". Everything but game_id is NULL for an app the store has no page
+// for, such as a delisted game or a tool.
+typedef struct {
+    int game_id;
+    const char *name;
+    const char *genres;
+    const char *categories;    // the store's feature tags: Co-op, Controller Support, ...
+    const char *developers;
+    const char *publishers;
+    const char *release_date;  // as the store words it
+    const char *description;   // short_description
+} StoreDetails;
+
+// The phases of a launch, in the order they happen
+typedef enum {
+    DB_LAUNCH_EXEC,       // the launch command or steam:// URI was handed off
+    DB_LAUNCH_PROCESS,    // the game's first process showed up
+    DB_LAUNCH_WINDOW,     // the game's first toplevel window showed up
+    DB_LAUNCH_N_PHASES
+} DBLaunchPhase;
+
+// When a background job last succeeded and when it may run next, in Unix
+// seconds, so a restart doesn't retry early or sync again right away
+typedef struct {
+    sqlite3_int64 last_success;  // 0 if it never has
+    sqlite3_int64 next_attempt;
+    int failures;                // in a row, for the backoff
+} SyncSchedule;
+
+// Streams Steam games into a single transaction through prepared UPSERTs,
+// updating the name and playtime of games that are already stored. Given the
+// Steam ID they came from, the writer imports one account's complete library
+// as the account's next sync generation: the account is recorded as an owner
+// of every game, and only games whose name, playtime or icon differ from what
+// it last reported are written. On commit the games it no longer lists keep
+// a tombstone owner row marked with the generation, and are dropped once no
+// live owner is left.
+typedef struct SteamGameWriter SteamGameWriter;
+
+// What one account's import changed
+typedef struct {
+    sqlite3_int64 generation;
+    size_t added;
+    size_t updated;
+    size_t removed;
+    size_t unchanged;
+} SteamSyncDelta;
+
+typedef enum {
+    DB_CHANGE_INSERT,
+    DB_CHANGE_UPDATE,
+    DB_CHANGE_DELETE
+} DBChangeType;
+
+typedef enum {
+    DB_SOURCE_STEAM,
+    DB_SOURCE_NON_STEAM
+} DBGameSource;
+
+// One launch: when it reached each phase, in milliseconds after Play was
+// clicked, or -1 for a phase that wasn't seen
+typedef struct {
+    DBGameSource source;
+    int game_id;
+    sqlite3_int64 launched_at;  // Unix seconds
+    int phase_ms[DB_LAUNCH_N_PHASES];
+} LaunchTiming;
+
+// A game's latest launches. Per phase, over the launches that reached it.
+typedef struct {
+    int launches;
+    int count[DB_LAUNCH_N_PHASES];
+    int last_ms[DB_LAUNCH_N_PHASES];  // the latest launch's, -1 if it didn't get there
+    int p50_ms[DB_LAUNCH_N_PHASES];
+    int p90_ms[DB_LAUNCH_N_PHASES];
+} LaunchStats;
+
+// One sample of a game's processes. The counters count from the start of
+// the session.
+typedef struct {
+    int at_ms;               // after the session started
+    sqlite3_int64 cpu_ms;    // user and system time so far
+    sqlite3_int64 rss_kb;    // resident memory of the processes running, summed
+    int threads;
+    sqlite3_int64 read_kb;   // from storage so far
+    sqlite3_int64 write_kb;  // to storage so far
+} ResourceSample;
+
+// A session of a game as it was sampled, with its totals and peaks up to
+// the latest sample
+typedef struct {
+    sqlite3_int64 session_id;  // 0 until first written
+    DBGameSource source;
+    int game_id;
+    sqlite3_int64 started_at;  // Unix seconds
+    sqlite3_int64 ended_at;    // as of the latest sample
+    int interval_ms;
+    sqlite3_int64 cpu_ms;
+    sqlite3_int64 peak_rss_kb;
+    int peak_threads;
+    sqlite3_int64 read_kb;
+    sqlite3_int64 write_kb;
+} ResourceSession;
+
+// Every sampled session of a game: sums, and the highest peaks
+typedef struct {
+    int sessions;
+    sqlite3_int64 seconds;
+    sqlite3_int64 cpu_ms;
+    sqlite3_int64 peak_rss_kb;
+    int peak_threads;
+    sqlite3_int64 read_kb;
+    sqlite3_int64 write_kb;
+} ResourceSummary;
+
+typedef struct {
+    DBChangeType type;
+    DBGameSource source;
+    int game_id;
+} DBChange;
+
+// Records which games a connection changed. Changes are only handed out
+// once their transaction has committed; rolled back ones are dropped.
+typedef struct DBChangeLog DBChangeLog;
+
 typedef void (*DBRowCallback)(int game_id, const char *game_name, const char *install_path, int playtime, void *user_data);
-void create_table(sqlite3 *db);
-void create_non_steam_table(sqlite3 *db);
+// Either hash may be NULL: no icon, or a capsule that was never downloaded
+typedef void (*DBArtCallback)(int game_id, const char *icon_hash, const char *capsule_hash, void *user_data);
+typedef void (*DBInstallCallback)(int game_id, const char *install_dir, sqlite3_int64 size_on_disk, int installed, void *user_data);
+typedef void (*DBLastPlayedCallback)(DBGameSource source, int game_id, sqlite3_int64 last_played, void *user_data);
+typedef void (*DBGameIdCallback)(int game_id, void *user_data);
+typedef void (*DBStoreDetailsCallback)(const StoreDetails *details, void *user_data);
+sqlite3 *db_open(const char *db_path);
+void db_close(sqlite3 *db);
+sqlite3_stmt *db_prepare_cached(sqlite3 *db, const char *sql);
+void db_release_statement(sqlite3_stmt *stmt);
+int create_table(sqlite3 *db);
+int create_non_steam_table(sqlite3 *db);
+int create_applied_responses_table(sqlite3 *db);
+int create_indexes(sqlite3 *db);
+int create_play_sessions_table(sqlite3 *db);
+int create_steam_installs_table(sqlite3 *db);
+int create_sync_schedule_table(sqlite3 *db);
+// Brings the schema up to the latest version; 0 if that failed
+int db_migrate(sqlite3 *db);
+// Opens the database and brings its schema up to date
+sqlite3 *init_database(const char *db_path);
+int db_get_applied_hash(sqlite3 *db, const char *cache_key, char *out, size_t out_size);
+int db_set_applied_hash(sqlite3 *db, const char *cache_key, const char *body_hash);
+int db_get_sync_schedule(sqlite3 *db, const char *name, SyncSchedule *schedule);
+int db_set_sync_schedule(sqlite3 *db, const char *name, const SyncSchedule *schedule);
 void insert_game(sqlite3 *db, int game_id, const char *game_name, int playtime);
+int insert_games(sqlite3 *db, const SteamGame *games, size_t count);
+SteamGameWriter *steam_game_writer_begin(sqlite3 *db, const char *steam_id);
+int steam_game_writer_add(SteamGameWriter *writer, const SteamGame *game);
+// delta may be NULL; it is zeroed unless the import committed
+int steam_game_writer_end(SteamGameWriter *writer, int commit, SteamSyncDelta *delta);
+// Forgets every account not in kept, the Steam IDs of the saved accounts, in
+// one transaction: their owner rows and generations go, and the games they
+// owned are summed over the remaining owners or dropped if none is left
+int db_forget_steam_accounts(sqlite3 *db, const char *const *kept, size_t count);
 void insert_non_steam_game(sqlite3 *db, const char *game_name, const char *install_path, int playtime);
-void db_fetch_all_games(const char *db_path, DBRowCallback callback, void *user_data);
+int db_replace_steam_installs(sqlite3 *db, const SteamInstall *installs, size_t count);
+int db_set_steam_install(sqlite3 *db, const SteamInstall *install);
+int db_remove_steam_install(sqlite3 *db, int game_id);
+int db_update_steam_playtimes(sqlite3 *db, const char *steam_id, const SteamPlaytime *playtimes, size_t count);
+int db_fetch_steam_install(sqlite3 *db, int game_id, DBInstallCallback callback, void *user_data);
+int db_record_play_session(sqlite3 *db, DBGameSource source, int game_id, sqlite3_int64 started_at, sqlite3_int64 ended_at);
+int db_record_launch(sqlite3 *db, const LaunchTiming *timing);
+// Over the game's last limit launches; returns 0 if it has none
+int db_fetch_launch_stats(sqlite3 *db, DBGameSource source, int game_id, int limit, LaunchStats *stats);
+// Stores a batch of a session's samples along with its totals so far. The
+// first batch also creates the session, setting session->session_id.
+int db_add_resource_samples(sqlite3 *db, ResourceSession *session, const ResourceSample *samples, size_t count);
+// Returns 0 if the game was never sampled
+int db_fetch_resource_summary(sqlite3 *db, DBGameSource source, int game_id, ResourceSummary *summary);
+// Rows come in case-insensitive name order
+void db_fetch_all_games(sqlite3 *db, DBRowCallback callback, void *user_data);
+int db_fetch_game(sqlite3 *db, DBGameSource source, int game_id, DBRowCallback callback, void *user_data);
+int db_find_games_by_name(sqlite3 *db, const char *game_name, DBRowCallback callback, void *user_data);
+void db_fetch_all_game_art(sqlite3 *db, DBArtCallback callback, void *user_data);
+// When each game that was ever played was last played, in Unix seconds
+void db_fetch_last_played(sqlite3 *db, DBLastPlayedCallback callback, void *user_data);
+sqlite3_int64 db_get_last_played(sqlite3 *db, DBGameSource source, int game_id);
+// Return how many rows there were, or -1 on failure; a negative limit
+// means no limit
+int db_fetch_recently_played(sqlite3 *db, int limit, DBRowCallback callback, void *user_data);
+int db_fetch_most_played(sqlite3 *db, int limit, DBRowCallback callback, void *user_data);
+int db_fetch_game_art(sqlite3 *db, int game_id, DBArtCallback callback, void *user_data);
+int db_set_capsule_hash(sqlite3 *db, int game_id, const char *capsule_hash);
+// Replaces an app's store details and their entry in the search index
+int db_set_store_details(sqlite3 *db, const StoreDetails *details, sqlite3_int64 fetched_at);
+// Steam games without store details, then those fetched before stale_before,
+// oldest first
+int db_fetch_store_pending(sqlite3 *db, sqlite3_int64 stale_before, int limit, DBGameIdCallback callback, void *user_data);
+// Returns 0 if the game has no store details yet
+int db_fetch_store_details(sqlite3 *db, int game_id, DBStoreDetailsCallback callback, void *user_data);
+// Steam games whose store details match an FTS5 query, best match first.
+// Returns how many there were, or -1 if the query is invalid.
+int db_search_store(sqlite3 *db, const char *match, DBGameIdCallback callback, void *user_data);
+DBChangeLog *db_change_log_attach(sqlite3 *db);
+DBChange *db_change_log_take(DBChangeLog *log, size_t *count);
+void db_change_log_detach(DBChangeLog *log);
 
 #endif /* __DB_H__ */
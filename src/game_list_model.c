@@ -0,0 +1,584 @@
+#include <gtk/gtk.h>
+
+#include "catalog.h"
+#include "game_list_model.h"
+#include "search.h"
+
+// A game that passes the filter. Rows are ordered best score first and
+// keep the sort order among equal scores.
+typedef struct {
+    guint index;             // into the catalog
+    gint score;
+} VisibleRow;
+
+struct _GameListModel {
+    GObject parent_instance;
+    Catalog *catalog;
+    CatalogSort sort;
+    GArray *visible;         // VisibleRow, kept between filters so refiltering doesn't allocate
+    gboolean filtered;       // visible holds the rows; otherwise every game is shown
+    GameListScoreFunc filter;
+    gpointer filter_data;
+    GDestroyNotify filter_destroy;
+    gint stamp;
+};
+
+static void game_list_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(GameListModel, game_list_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, game_list_model_tree_model_init))
+
+// Nothing is shown while a bulk load has left the catalog unsorted
+static guint n_visible(GameListModel *model)
+{
+    if (model->filtered) {
+        return model->visible->len;
+    }
+    return model->catalog->sorted ? model->catalog->len : 0;
+}
+
+static guint visible_index(GameListModel *model, guint position)
+{
+    if (model->filtered) {
+        return g_array_index(model->visible, VisibleRow, position).index;
+    }
+    return model->catalog->order[model->sort][position];
+}
+
+static gboolean set_iter(GameListModel *model, GtkTreeIter *iter, gint position)
+{
+    if (position < 0 || (guint)position >= n_visible(model)) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    iter->stamp = model->stamp;
+    iter->user_data = GINT_TO_POINTER(position);
+    return TRUE;
+}
+
+static GtkTreeModelFlags game_list_model_get_flags(GtkTreeModel *tree_model)
+{
+    return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint game_list_model_get_n_columns(GtkTreeModel *tree_model)
+{
+    return GAME_LIST_N_COLUMNS;
+}
+
+static GType game_list_model_get_column_type(GtkTreeModel *tree_model, gint column)
+{
+    switch (column) {
+    case GAME_LIST_COLUMN_GAME_ID:
+    case GAME_LIST_COLUMN_PLAYTIME:
+        return G_TYPE_INT;
+    default:
+        return G_TYPE_STRING;
+    }
+}
+
+static gboolean game_list_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+    if (gtk_tree_path_get_depth(path) != 1) {
+        return FALSE;
+    }
+    return set_iter(GAME_LIST_MODEL(tree_model), iter, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath *game_list_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+    return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
+}
+
+static void game_list_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+    GameListModel *model = GAME_LIST_MODEL(tree_model);
+    const Catalog *catalog = model->catalog;
+    guint index = visible_index(model, GPOINTER_TO_INT(iter->user_data));
+
+    g_value_init(value, game_list_model_get_column_type(tree_model, column));
+    switch (column) {
+    case GAME_LIST_COLUMN_NAME:
+        g_value_set_static_string(value, catalog->name[index]);
+        break;
+    case GAME_LIST_COLUMN_GAME_ID:
+        g_value_set_int(value, catalog->game_id[index]);
+        break;
+    case GAME_LIST_COLUMN_PLAYTIME:
+        g_value_set_int(value, catalog->playtime[index]);
+        break;
+    case GAME_LIST_COLUMN_INSTALL_PATH:
+        g_value_set_static_string(value, catalog->install_path[index]);
+        break;
+    }
+}
+
+static gboolean game_list_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+    return set_iter(GAME_LIST_MODEL(tree_model), iter, GPOINTER_TO_INT(iter->user_data) + 1);
+}
+
+static gboolean game_list_model_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+    return set_iter(GAME_LIST_MODEL(tree_model), iter, GPOINTER_TO_INT(iter->user_data) - 1);
+}
+
+static gboolean game_list_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+    if (parent) {
+        return FALSE;
+    }
+    return set_iter(GAME_LIST_MODEL(tree_model), iter, 0);
+}
+
+static gboolean game_list_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+    return FALSE;
+}
+
+static gint game_list_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+    return iter ? 0 : (gint)n_visible(GAME_LIST_MODEL(tree_model));
+}
+
+static gboolean game_list_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+    if (parent) {
+        return FALSE;
+    }
+    return set_iter(GAME_LIST_MODEL(tree_model), iter, n);
+}
+
+static gboolean game_list_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+    return FALSE;
+}
+
+static void game_list_model_tree_model_init(GtkTreeModelIface *iface)
+{
+    iface->get_flags = game_list_model_get_flags;
+    iface->get_n_columns = game_list_model_get_n_columns;
+    iface->get_column_type = game_list_model_get_column_type;
+    iface->get_iter = game_list_model_get_iter;
+    iface->get_path = game_list_model_get_path;
+    iface->get_value = game_list_model_get_value;
+    iface->iter_next = game_list_model_iter_next;
+    iface->iter_previous = game_list_model_iter_previous;
+    iface->iter_children = game_list_model_iter_children;
+    iface->iter_has_child = game_list_model_iter_has_child;
+    iface->iter_n_children = game_list_model_iter_n_children;
+    iface->iter_nth_child = game_list_model_iter_nth_child;
+    iface->iter_parent = game_list_model_iter_parent;
+}
+
+static void game_list_model_finalize(GObject *object)
+{
+    GameListModel *model = GAME_LIST_MODEL(object);
+
+    catalog_free(model->catalog);
+    g_array_unref(model->visible);
+    if (model->filter_destroy) {
+        model->filter_destroy(model->filter_data);
+    }
+
+    G_OBJECT_CLASS(game_list_model_parent_class)->finalize(object);
+}
+
+static void game_list_model_class_init(GameListModelClass *klass)
+{
+    G_OBJECT_CLASS(klass)->finalize = game_list_model_finalize;
+}
+
+static void game_list_model_init(GameListModel *model)
+{
+    model->catalog = catalog_new();
+    model->sort = CATALOG_SORT_NAME;
+    model->visible = g_array_new(FALSE, FALSE, sizeof(VisibleRow));
+    model->stamp = g_random_int();
+}
+
+GameListModel *game_list_model_new(void)
+{
+    return g_object_new(GAME_LIST_TYPE_MODEL, NULL);
+}
+
+static void make_record(GameListModel *model, GameRecord *record, const GameRecord *old,
+                        int game_id, const char *name, const char *install_path, int playtime)
+{
+    record->name = catalog_intern(model->catalog, old ? old->name : NULL, name ? name : "");
+    if (old && old->name == record->name) {
+        record->folded_name = old->folded_name;
+        record->search_mask = old->search_mask;
+    } else {
+        record->folded_name = NULL;
+        record->search_mask = 0;
+    }
+    record->install_path = catalog_intern(model->catalog, old ? old->install_path : NULL, install_path);
+    record->last_played = old ? old->last_played : 0;
+    record->game_id = game_id;
+    record->playtime = playtime;
+}
+
+// The search key is computed once per game, the first time a filter needs
+// it, so loading the list doesn't pay for it
+static void prepare_search_key(GameListModel *model, guint index)
+{
+    Catalog *catalog = model->catalog;
+    char *folded;
+
+    if (catalog->folded_name[index]) {
+        return;
+    }
+    folded = search_fold(catalog->name[index]);
+    catalog->folded_name[index] = g_string_chunk_insert_const(catalog->strings, folded);
+    catalog->search_mask[index] = search_mask(folded);
+    g_free(folded);
+}
+
+void game_list_model_append(GameListModel *model, int game_id, const char *name, const char *install_path, int playtime)
+{
+    GameRecord record;
+
+    make_record(model, &record, NULL, game_id, name, install_path, playtime);
+    catalog_append(model->catalog, &record);
+}
+
+void game_list_model_append_static(GameListModel *model, int game_id, const char *name, const char *install_path, int playtime)
+{
+    GameRecord record = { name ? name : "", install_path, NULL, 0, 0, game_id, playtime };
+
+    catalog_append(model->catalog, &record);
+}
+
+// Drops the games together with the filter
+void game_list_model_clear(GameListModel *model)
+{
+    catalog_clear(model->catalog);
+    game_list_model_set_filter(model, NULL, NULL, NULL);
+}
+
+static gint score_record(GameListModel *model, guint index)
+{
+    GameRecord record;
+
+    if (!model->filter) {
+        return 0;
+    }
+    prepare_search_key(model, index);
+    catalog_get(model->catalog, index, &record);
+    return model->filter(&record, model->filter_data);
+}
+
+static gint compare_rows(gconstpointer a, gconstpointer b, gpointer data)
+{
+    const GameListModel *model = (const GameListModel *)data;
+    const guint *rank = model->catalog->rank[model->sort];
+    const VisibleRow *row_a = (const VisibleRow *)a;
+    const VisibleRow *row_b = (const VisibleRow *)b;
+
+    if (row_a->score != row_b->score) {
+        return row_a->score > row_b->score ? -1 : 1;
+    }
+    return rank[row_a->index] < rank[row_b->index] ? -1 : rank[row_a->index] > rank[row_b->index];
+}
+
+static void replace_filter(GameListModel *model, GameListScoreFunc func, gpointer user_data, GDestroyNotify destroy)
+{
+    if (model->filter_destroy) {
+        model->filter_destroy(model->filter_data);
+    }
+    model->filter = func;
+    model->filter_data = user_data;
+    model->filter_destroy = destroy;
+    model->stamp++;
+}
+
+void game_list_model_set_filter(GameListModel *model, GameListScoreFunc func, gpointer user_data, GDestroyNotify destroy)
+{
+    const Catalog *catalog = model->catalog;
+    guint i;
+
+    replace_filter(model, func, user_data, destroy);
+    if (!catalog->sorted) {
+        catalog_sort(model->catalog);
+    }
+    g_array_set_size(model->visible, 0);
+    model->filtered = func != NULL;
+    if (!func) {
+        return;
+    }
+
+    // Scored in sort order, so only the scores move rows around
+    for (i = 0; i < catalog->len; i++) {
+        guint index = catalog->order[model->sort][i];
+        VisibleRow row = { index, score_record(model, index) };
+        if (row.score >= 0) {
+            g_array_append_val(model->visible, row);
+        }
+    }
+    g_array_sort_with_data(model->visible, compare_rows, model);
+}
+
+void game_list_model_refine(GameListModel *model, GameListScoreFunc func, gpointer user_data, GDestroyNotify destroy)
+{
+    guint i;
+    guint kept = 0;
+
+    if (!model->filtered || !func) {
+        game_list_model_set_filter(model, func, user_data, destroy);
+        return;
+    }
+
+    replace_filter(model, func, user_data, destroy);
+    for (i = 0; i < model->visible->len; i++) {
+        VisibleRow row = g_array_index(model->visible, VisibleRow, i);
+        row.score = score_record(model, row.index);
+        if (row.score >= 0) {
+            g_array_index(model->visible, VisibleRow, kept++) = row;
+        }
+    }
+    g_array_set_size(model->visible, kept);
+    g_array_sort_with_data(model->visible, compare_rows, model);
+}
+
+gpointer game_list_model_get_filter_data(GameListModel *model)
+{
+    return model->filter_data;
+}
+
+// The catalog keeps every order sorted, so without a filter this is free;
+// with one, only the shown rows are sorted again
+void game_list_model_set_sort(GameListModel *model, CatalogSort sort)
+{
+    model->sort = sort;
+    model->stamp++;
+    if (model->filtered) {
+        g_array_sort_with_data(model->visible, compare_rows, model);
+    }
+}
+
+CatalogSort game_list_model_get_sort(GameListModel *model)
+{
+    return model->sort;
+}
+
+// Where the row for a game with the given score goes among the visible rows
+static guint visible_position(GameListModel *model, guint index, gint score)
+{
+    VisibleRow key = { index, score };
+    guint lo = 0;
+    guint hi = model->visible->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (compare_rows(&g_array_index(model->visible, VisibleRow, mid), &key, model) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// The catalog moved the game at index from to index to
+static void renumber_visible(GameListModel *model, guint from, guint to)
+{
+    guint i;
+
+    for (i = 0; i < model->visible->len; i++) {
+        VisibleRow *row = &g_array_index(model->visible, VisibleRow, i);
+        if (row->index == from) {
+            row->index = to;
+            return;
+        }
+    }
+}
+
+static void emit_row(GameListModel *model, guint position, gboolean inserted)
+{
+    GtkTreePath *path = gtk_tree_path_new_from_indices((gint)position, -1);
+    GtkTreeIter iter;
+
+    set_iter(model, &iter, (gint)position);
+    if (inserted) {
+        gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+    } else {
+        gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+    }
+    gtk_tree_path_free(path);
+}
+
+static void emit_row_deleted(GameListModel *model, guint position)
+{
+    GtkTreePath *path = gtk_tree_path_new_from_indices((gint)position, -1);
+
+    gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+    gtk_tree_path_free(path);
+}
+
+static void remove_record(GameListModel *model, guint index)
+{
+    guint last = model->catalog->len - 1;
+    guint position = model->catalog->rank[model->sort][index];
+    gboolean shown = TRUE;
+
+    if (model->filtered) {
+        gint score = score_record(model, index);
+
+        shown = score >= 0;
+        if (shown) {
+            position = visible_position(model, index, score);
+            g_array_remove_index(model->visible, position);
+        }
+    }
+    catalog_remove(model->catalog, index);
+    if (model->filtered && index != last) {
+        renumber_visible(model, last, index);
+    }
+    model->stamp++;
+
+    if (shown) {
+        emit_row_deleted(model, position);
+    }
+}
+
+static void insert_record(GameListModel *model, const GameRecord *record)
+{
+    guint index = catalog_insert(model->catalog, record);
+    guint position = model->catalog->rank[model->sort][index];
+    gboolean shown = TRUE;
+
+    if (model->filtered) {
+        VisibleRow row = { index, score_record(model, index) };
+
+        shown = row.score >= 0;
+        if (shown) {
+            position = visible_position(model, index, row.score);
+            g_array_insert_val(model->visible, position, row);
+        }
+    }
+    model->stamp++;
+
+    if (shown) {
+        emit_row(model, position, TRUE);
+    }
+}
+
+static void replace_record(GameListModel *model, guint index, const GameRecord *record)
+{
+    GameRecord old;
+    gint old_score;
+    gint score;
+
+    catalog_get(model->catalog, index, &old);
+    if (catalog_keys_differ(model->sort, &old, record)) {
+        remove_record(model, index);
+        insert_record(model, record);
+        return;
+    }
+
+    // The row keeps its place, so it's changed in place and the view keeps
+    // its selection on it. Only the filter can still move it.
+    old_score = score_record(model, index);
+    catalog_replace(model->catalog, index, record);
+    score = score_record(model, index);
+    if (!model->filtered) {
+        emit_row(model, model->catalog->rank[model->sort][index], FALSE);
+        return;
+    }
+    if (score == old_score) {
+        if (score >= 0) {
+            emit_row(model, visible_position(model, index, score), FALSE);
+        }
+        return;
+    }
+    if (old_score >= 0) {
+        guint position = visible_position(model, index, old_score);
+
+        g_array_remove_index(model->visible, position);
+        model->stamp++;
+        emit_row_deleted(model, position);
+    }
+    if (score >= 0) {
+        VisibleRow row = { index, score };
+        guint position = visible_position(model, index, score);
+
+        g_array_insert_val(model->visible, position, row);
+        model->stamp++;
+        emit_row(model, position, TRUE);
+    }
+}
+
+void game_list_model_update(GameListModel *model, int game_id, const char *name, const char *install_path, int playtime)
+{
+    gint index = catalog_find(model->catalog, install_path != NULL, game_id);
+    GameRecord old;
+    GameRecord record;
+
+    if (index >= 0) {
+        catalog_get(model->catalog, (guint)index, &old);
+    }
+    make_record(model, &record, index >= 0 ? &old : NULL, game_id, name, install_path, playtime);
+    if (index >= 0) {
+        replace_record(model, (guint)index, &record);
+    } else {
+        insert_record(model, &record);
+    }
+}
+
+void game_list_model_set_last_played(GameListModel *model, gboolean non_steam, int game_id, gint64 last_played)
+{
+    gint index = catalog_find(model->catalog, non_steam, game_id);
+    GameRecord record;
+
+    if (index < 0) {
+        return;
+    }
+    catalog_get(model->catalog, (guint)index, &record);
+    if (record.last_played == last_played) {
+        return;
+    }
+    record.last_played = last_played;
+    if (!model->catalog->sorted) {
+        catalog_replace(model->catalog, (guint)index, &record);  // Sorted with the rest of the load
+    } else {
+        replace_record(model, (guint)index, &record);
+    }
+}
+
+void game_list_model_remove(GameListModel *model, gboolean non_steam, int game_id)
+{
+    gint index = catalog_find(model->catalog, non_steam, game_id);
+
+    if (index >= 0) {
+        remove_record(model, (guint)index);
+    }
+}
+
+gboolean game_list_model_find(GameListModel *model, gboolean non_steam, int game_id, GtkTreeIter *iter)
+{
+    gint index = catalog_find(model->catalog, non_steam, game_id);
+    guint position;
+
+    if (index < 0 || !model->catalog->sorted) {
+        return FALSE;
+    }
+    position = model->catalog->rank[model->sort][index];
+    if (model->filtered) {
+        gint score = score_record(model, (guint)index);
+        if (score < 0) {
+            return FALSE;
+        }
+        position = visible_position(model, (guint)index, score);
+    }
+    return set_iter(model, iter, (gint)position);
+}
+
+gboolean game_list_model_get_record(GameListModel *model, GtkTreeIter *iter, GameRecord *record)
+{
+    if (iter->stamp != model->stamp) {
+        return FALSE;
+    }
+    catalog_get(model->catalog, visible_index(model, GPOINTER_TO_INT(iter->user_data)), record);
+    return TRUE;
+}
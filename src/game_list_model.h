@@ -0,0 +1,57 @@
+#ifndef __GAME_LIST_MODEL_H__
+#define __GAME_LIST_MODEL_H__
+
+#include <gtk/gtk.h>
+
+#include "catalog.h"
+
+#define GAME_LIST_TYPE_MODEL (game_list_model_get_type())
+G_DECLARE_FINAL_TYPE(GameListModel, game_list_model, GAME_LIST, MODEL, GObject)
+
+enum {
+    GAME_LIST_COLUMN_NAME,
+    GAME_LIST_COLUMN_GAME_ID,
+    GAME_LIST_COLUMN_PLAYTIME,
+    GAME_LIST_COLUMN_INSTALL_PATH,
+    GAME_LIST_N_COLUMNS
+};
+
+// Returns the rank of a record, higher first, or a negative value to hide it
+typedef gint (*GameListScoreFunc)(const GameRecord *record, gpointer user_data);
+
+// A flat GtkTreeModel over a Catalog. Views only ask for the rows they draw,
+// so nothing per row exists beyond the catalog's columns.
+//
+// Without a filter all games are shown in the sort order, by name unless
+// set_sort says otherwise; with one, the matching games are shown best score
+// first and in the sort order among equal scores.
+//
+// Bulk operations (append, clear, set_filter, refine, set_sort) don't emit
+// per-row signals; detach the model from its view around them. update,
+// set_last_played and remove keep the catalog sorted and emit row signals,
+// so an attached view keeps its selection and scroll position. Games are
+// identified by their id together with whether they have an install path
+// (non-Steam games).
+GameListModel *game_list_model_new(void);
+// Appended games are sorted and filtered on the next set_filter
+void game_list_model_append(GameListModel *model, int game_id, const char *name, const char *install_path, int playtime);
+// Like append, but keeps the strings instead of copying them. They have to
+// stay valid until the next clear.
+void game_list_model_append_static(GameListModel *model, int game_id, const char *name, const char *install_path, int playtime);
+void game_list_model_clear(GameListModel *model);
+void game_list_model_set_filter(GameListModel *model, GameListScoreFunc func, gpointer user_data, GDestroyNotify destroy);
+// Like set_filter, but only rescores the rows that are currently shown. Only
+// valid when func can't match anything the current filter rejects.
+void game_list_model_refine(GameListModel *model, GameListScoreFunc func, gpointer user_data, GDestroyNotify destroy);
+gpointer game_list_model_get_filter_data(GameListModel *model);
+void game_list_model_set_sort(GameListModel *model, CatalogSort sort);
+CatalogSort game_list_model_get_sort(GameListModel *model);
+void game_list_model_update(GameListModel *model, int game_id, const char *name, const char *install_path, int playtime);
+// Also takes part in a bulk load, before its set_filter
+void game_list_model_set_last_played(GameListModel *model, gboolean non_steam, int game_id, gint64 last_played);
+void game_list_model_remove(GameListModel *model, gboolean non_steam, int game_id);
+gboolean game_list_model_find(GameListModel *model, gboolean non_steam, int game_id, GtkTreeIter *iter);
+// Copies the game at iter; FALSE if the iter is out of date
+gboolean game_list_model_get_record(GameListModel *model, GtkTreeIter *iter, GameRecord *record);
+
+#endif /* __GAME_LIST_MODEL_H__ */
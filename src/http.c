@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <curl/curl.h>
+
+#include "http.h"
+
+#define HTTP_POLL_TIMEOUT_MS 100
+#define HTTP_MAX_HOST_CONNECTIONS 6
+#define HTTP_CONNECT_TIMEOUT 15L
+// A transfer that moves less than a byte a second for this long has stalled
+#define HTTP_STALL_TIMEOUT 30L
+
+struct HttpClient {
+    CURLM *multi;
+    CURL **idle;             // finished easy handles kept for reuse
+    size_t idle_count;
+    size_t idle_cap;
+    HttpRequest **active;
+    size_t active_count;
+    size_t active_cap;
+};
+
+size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t real_size = size * nmemb;
+    MemoryStruct *mem = (MemoryStruct *)userp;
+
+    char *ptr = realloc(mem->memory, mem->size + real_size + 1);
+    if(ptr == NULL) {
+        printf("not enough memory (realloc returned NULL)\n");
+        return 0;
+    }
+
+    mem->memory = ptr;
+    memcpy(&(mem->memory[mem->size]), contents, real_size);
+    mem->size += real_size;
+    mem->memory[mem->size] = 0;
+
+    return real_size;
+}
+
+static int grow(void **array, size_t *cap, size_t needed, size_t item_size)
+{
+    if (needed > *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 8;
+        void *ptr = realloc(*array, new_cap * item_size);
+        if (!ptr) {
+            return 0;
+        }
+        *array = ptr;
+        *cap = new_cap;
+    }
+    return 1;
+}
+
+void http_request_init(HttpRequest *request, const char *url)
+{
+    memset(request, 0, sizeof(HttpRequest));
+    request->url = url;
+    request->result = CURLE_OK;
+    request->max_age = -1;
+}
+
+static void clear_response_headers(HttpRequest *request)
+{
+    free(request->etag);
+    free(request->last_modified);
+    request->etag = NULL;
+    request->last_modified = NULL;
+    request->max_age = -1;
+}
+
+void http_request_clear(HttpRequest *request)
+{
+    free(request->body.memory);
+    request->body.memory = NULL;
+    request->body.size = 0;
+    curl_slist_free_all(request->headers);
+    request->headers = NULL;
+    clear_response_headers(request);
+}
+
+// Returns a copy of the header value if the line is the named header
+static char *header_value(const char *line, size_t len, const char *name)
+{
+    size_t name_len = strlen(name);
+    const char *value;
+    const char *end = line + len;
+
+    if (len <= name_len || strncasecmp(line, name, name_len) != 0 || line[name_len] != ':') {
+        return NULL;
+    }
+    value = line + name_len + 1;
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) {
+        end--;
+    }
+    return strndup(value, (size_t)(end - value));
+}
+
+static size_t header_callback(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    size_t len = size * nitems;
+    HttpRequest *request = (HttpRequest *)userdata;
+    char *value;
+
+    // Every response in a redirect chain starts over with its status line
+    if (len >= 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        clear_response_headers(request);
+    } else if ((value = header_value(buffer, len, "ETag"))) {
+        free(request->etag);
+        request->etag = value;
+    } else if ((value = header_value(buffer, len, "Last-Modified"))) {
+        free(request->last_modified);
+        request->last_modified = value;
+    } else if ((value = header_value(buffer, len, "Cache-Control"))) {
+        const char *max_age = strstr(value, "max-age=");
+        if (strstr(value, "no-store") || strstr(value, "no-cache")) {
+            request->max_age = 0;
+        } else if (max_age) {
+            request->max_age = strtol(max_age + strlen("max-age="), NULL, 10);
+        }
+        free(value);
+    }
+    return len;
+}
+
+int http_request_progress(HttpRequest *request, size_t *received, size_t *expected)
+{
+    curl_off_t now = 0;
+    curl_off_t total = -1;
+
+    if (!request->handle) {
+        return 0;
+    }
+    curl_easy_getinfo(request->handle, CURLINFO_SIZE_DOWNLOAD_T, &now);
+    curl_easy_getinfo(request->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &total);
+    *received = (size_t)now;
+    *expected = total > 0 ? (size_t)total : 0;
+    return 1;
+}
+
+HttpClient *http_client_new(void)
+{
+    HttpClient *client = calloc(1, sizeof(HttpClient));
+
+    if (!client) {
+        return NULL;
+    }
+    client->multi = curl_multi_init();
+    if (!client->multi) {
+        free(client);
+        return NULL;
+    }
+    curl_multi_setopt(client->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(client->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)HTTP_MAX_HOST_CONNECTIONS);
+
+    return client;
+}
+
+static CURL *acquire_handle(HttpClient *client)
+{
+    if (client->idle_count > 0) {
+        return client->idle[--client->idle_count];
+    }
+    return curl_easy_init();
+}
+
+// Detaches a finished request from the client and keeps its handle for reuse
+static void release_request(HttpClient *client, HttpRequest *request)
+{
+    size_t i;
+
+    curl_multi_remove_handle(client->multi, request->handle);
+    curl_easy_reset(request->handle);
+    if (grow((void **)&client->idle, &client->idle_cap, client->idle_count + 1, sizeof(CURL *))) {
+        client->idle[client->idle_count++] = request->handle;
+    } else {
+        curl_easy_cleanup(request->handle);
+    }
+    request->handle = NULL;
+
+    for (i = 0; i < client->active_count; i++) {
+        if (client->active[i] == request) {
+            client->active[i] = client->active[--client->active_count];
+            break;
+        }
+    }
+}
+
+int http_client_add(HttpClient *client, HttpRequest *request)
+{
+    CURL *curl;
+
+    if (!grow((void **)&client->active, &client->active_cap, client->active_count + 1, sizeof(HttpRequest *))) {
+        return 0;
+    }
+    curl = acquire_handle(client);
+    if (!curl) {
+        return 0;
+    }
+
+    request->handle = curl;
+    request->status = 0;
+    request->result = CURLE_OK;
+
+    curl_easy_setopt(curl, CURLOPT_URL, request->url);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)request);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void *)request);
+    if (request->headers) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+    }
+    if (request->write) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, request->write);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, request->write_data);
+    } else {
+        if (!request->body.memory) {
+            request->body.memory = calloc(1, 1);
+            request->body.size = 0;
+        }
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&request->body);
+    }
+    // Accept every encoding curl can decode and prefer HTTP/2, waiting for an
+    // existing connection to multiplex on rather than opening a new one
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, HTTP_CONNECT_TIMEOUT);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, HTTP_STALL_TIMEOUT);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "LVL");
+    // Curl may be driven from a worker thread, so never let it raise SIGALRM
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+    if (curl_multi_add_handle(client->multi, curl) != CURLM_OK) {
+        curl_easy_cleanup(curl);
+        request->handle = NULL;
+        return 0;
+    }
+    client->active[client->active_count++] = request;
+    return 1;
+}
+
+static void collect_finished(HttpClient *client)
+{
+    CURLMsg *msg;
+    int left;
+
+    while ((msg = curl_multi_info_read(client->multi, &left))) {
+        HttpRequest *request = NULL;
+
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&request);
+        request->result = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &request->status);
+        if (request->result != CURLE_OK) {
+            fprintf(stderr, "HTTP request failed: %s\n", curl_easy_strerror(request->result));
+        }
+
+        release_request(client, request);
+        // May add follow-up requests, which this run picks up as well
+        if (request->done) {
+            request->done(request, request->done_data);
+        }
+    }
+}
+
+static void abort_all(HttpClient *client, CURLcode result, int notify)
+{
+    while (client->active_count > 0) {
+        HttpRequest *request = client->active[client->active_count - 1];
+
+        request->result = result;
+        release_request(client, request);
+        if (notify && request->done) {
+            request->done(request, request->done_data);
+        }
+    }
+}
+
+int http_client_run(HttpClient *client, HttpTickCallback tick, void *user_data)
+{
+    int running;
+
+    while (client->active_count > 0) {
+        CURLMcode mc = curl_multi_perform(client->multi, &running);
+        if (mc != CURLM_OK) {
+            fprintf(stderr, "curl_multi_perform() failed: %s\n", curl_multi_strerror(mc));
+            abort_all(client, CURLE_FAILED_INIT, 1);
+            return 0;
+        }
+
+        collect_finished(client);
+        if (client->active_count == 0) {
+            break;
+        }
+
+        if (tick && tick(user_data)) {
+            abort_all(client, CURLE_ABORTED_BY_CALLBACK, 1);
+            return 0;
+        }
+
+        curl_multi_poll(client->multi, NULL, 0, HTTP_POLL_TIMEOUT_MS, NULL);
+    }
+
+    return 1;
+}
+
+void http_client_free(HttpClient *client)
+{
+    if (!client) {
+        return;
+    }
+    abort_all(client, CURLE_ABORTED_BY_CALLBACK, 0);
+    while (client->idle_count > 0) {
+        curl_easy_cleanup(client->idle[--client->idle_count]);
+    }
+    curl_multi_cleanup(client->multi);
+    free(client->idle);
+    free(client->active);
+    free(client);
+}
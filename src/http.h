@@ -0,0 +1,55 @@
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+typedef struct {
+    char *memory;
+    size_t size;
+} MemoryStruct;
+
+typedef struct HttpRequest HttpRequest;
+
+// Called from http_client_run once the request has finished, successfully or not
+typedef void (*HttpDoneCallback)(HttpRequest *request, void *user_data);
+// Called regularly while requests are running; return non-zero to abort them all
+typedef int (*HttpTickCallback)(void *user_data);
+
+struct HttpRequest {
+    const char *url;                // must stay valid until the request is done
+    struct curl_slist *headers;     // optional extra request headers, freed by http_request_clear
+    curl_write_callback write;      // NULL collects the body into `body`
+    void *write_data;
+    HttpDoneCallback done;
+    void *done_data;
+
+    // Filled in by the client
+    MemoryStruct body;
+    long status;
+    CURLcode result;
+    char *etag;                     // response validators, NULL when absent
+    char *last_modified;
+    long max_age;                   // from Cache-Control, -1 when absent
+    CURL *handle;
+};
+
+// A set of requests sharing one curl multi handle, so connections, DNS and
+// TLS sessions are kept alive between requests and runs. Requests run
+// concurrently and are multiplexed over HTTP/2 where the server allows it.
+// A client may be used from any thread, but only from one at a time.
+typedef struct HttpClient HttpClient;
+
+size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp);
+
+void http_request_init(HttpRequest *request, const char *url);
+void http_request_clear(HttpRequest *request);
+int http_request_progress(HttpRequest *request, size_t *received, size_t *expected);
+
+HttpClient *http_client_new(void);
+void http_client_free(HttpClient *client);
+int http_client_add(HttpClient *client, HttpRequest *request);
+int http_client_run(HttpClient *client, HttpTickCallback tick, void *user_data);
+
+#endif /* __HTTP_H__ */
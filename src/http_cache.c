@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "http_cache.h"
+
+#define HTTP_CACHE_MAGIC "LVL-HTTP-CACHE 1"
+// Used when the server doesn't say how long a response stays fresh
+#define HTTP_CACHE_DEFAULT_MAX_AGE 60L
+// Every fetch or revalidation rewrites an entry's metadata and store details
+// are fetched again after 30 days, so an entry older than this is one nothing
+// asks for any more, such as an app that left the library
+#define HTTP_CACHE_MAX_UNUSED (45L * 24 * 60 * 60)
+// A temp file this old belongs to a writer that never committed
+#define HTTP_CACHE_MAX_TEMP_AGE (60L * 60)
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+struct HttpCache {
+    char *dir;
+};
+
+struct HttpCacheWriter {
+    HttpCache *cache;
+    char key[HTTP_CACHE_HASH_SIZE];
+    char hash[HTTP_CACHE_HASH_SIZE];
+    char tmp_path[PATH_MAX];
+    FILE *file;
+    uint64_t state;
+    int failed;
+};
+
+static uint64_t fnv1a_update(uint64_t state, const void *data, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        state ^= bytes[i];
+        state *= FNV_PRIME;
+    }
+    return state;
+}
+
+static void format_hash(uint64_t state, char out[HTTP_CACHE_HASH_SIZE])
+{
+    snprintf(out, HTTP_CACHE_HASH_SIZE, "%016llx", (unsigned long long)state);
+}
+
+void http_cache_hash(const void *data, size_t len, char out[HTTP_CACHE_HASH_SIZE])
+{
+    format_hash(fnv1a_update(FNV_OFFSET_BASIS, data, len), out);
+}
+
+static void entry_path(HttpCache *cache, const char *key, const char *suffix, char *out, size_t out_size)
+{
+    snprintf(out, out_size, "%s/%s%s", cache->dir, key, suffix);
+}
+
+// Creates a temporary file of its own for the entry, so writers of the same
+// URL in different processes don't clobber each other's before the rename
+static FILE *open_temp(HttpCache *cache, const char *key, const char *suffix, const char *mode,
+                       char *out, size_t out_size)
+{
+    FILE *file;
+    int fd;
+
+    snprintf(out, out_size, "%s/%s%s.XXXXXX", cache->dir, key, suffix);
+    if ((fd = mkstemp(out)) < 0) {
+        return NULL;
+    }
+    if (!(file = fdopen(fd, mode))) {
+        close(fd);
+        remove(out);
+    }
+    return file;
+}
+
+static int is_older(const char *path, time_t before)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && st.st_mtime < before;
+}
+
+// Drops unused entries and the leftovers of interrupted writers, which would
+// otherwise pile up one per URL ever fetched
+static void prune(HttpCache *cache)
+{
+    DIR *dir = opendir(cache->dir);
+    struct dirent *ent;
+    char path[PATH_MAX];
+    char key[HTTP_CACHE_HASH_SIZE];
+    time_t now = time(NULL);
+    const char *suffix;
+
+    if (!dir) {
+        return;
+    }
+    while ((ent = readdir(dir))) {
+        if (strlen(ent->d_name) < HTTP_CACHE_HASH_SIZE - 1) {
+            continue;
+        }
+        suffix = ent->d_name + HTTP_CACHE_HASH_SIZE - 1;
+        memcpy(key, ent->d_name, HTTP_CACHE_HASH_SIZE - 1);
+        key[HTTP_CACHE_HASH_SIZE - 1] = '\0';
+        entry_path(cache, ent->d_name, "", path, sizeof(path));
+
+        if (strncmp(suffix, ".body.tmp.", 10) == 0 || strncmp(suffix, ".meta.tmp.", 10) == 0) {
+            if (is_older(path, now - HTTP_CACHE_MAX_TEMP_AGE)) {
+                remove(path);
+            }
+        } else if (strcmp(suffix, ".meta") == 0) {
+            // The body keeps its mtime across revalidations, so the metadata
+            // decides for both
+            if (is_older(path, now - HTTP_CACHE_MAX_UNUSED)) {
+                remove(path);
+                entry_path(cache, key, ".body", path, sizeof(path));
+                remove(path);
+            }
+        } else if (strcmp(suffix, ".body") == 0 && is_older(path, now - HTTP_CACHE_MAX_TEMP_AGE)) {
+            // A writer stopped between renaming the body and writing its metadata
+            entry_path(cache, key, ".meta", path, sizeof(path));
+            if (access(path, F_OK) != 0) {
+                entry_path(cache, key, ".body", path, sizeof(path));
+                remove(path);
+            }
+        }
+    }
+    closedir(dir);
+}
+
+HttpCache *http_cache_new(const char *dir)
+{
+    HttpCache *cache = calloc(1, sizeof(HttpCache));
+
+    if (cache) {
+        cache->dir = strdup(dir);
+        prune(cache);
+    }
+    return cache;
+}
+
+void http_cache_free(HttpCache *cache)
+{
+    if (cache) {
+        free(cache->dir);
+        free(cache);
+    }
+}
+
+void http_cache_entry_clear(HttpCacheEntry *entry)
+{
+    free(entry->etag);
+    free(entry->last_modified);
+    entry->etag = NULL;
+    entry->last_modified = NULL;
+}
+
+// Reads one line without its newline; an empty line yields NULL
+static char *read_line(FILE *file)
+{
+    char line[1024];
+    size_t len;
+
+    if (!fgets(line, sizeof(line), file)) {
+        return NULL;
+    }
+    len = strcspn(line, "\r\n");
+    line[len] = '\0';
+    return len > 0 ? strdup(line) : NULL;
+}
+
+int http_cache_lookup(HttpCache *cache, const char *url, HttpCacheEntry *entry)
+{
+    char path[PATH_MAX];
+    char line[64];
+    char *fetched_at = NULL;
+    char *max_age = NULL;
+    char *body_hash = NULL;
+    FILE *file;
+    int found = 0;
+
+    memset(entry, 0, sizeof(HttpCacheEntry));
+    http_cache_hash(url, strlen(url), entry->key);
+
+    entry_path(cache, entry->key, ".meta", path, sizeof(path));
+    file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    if (fgets(line, sizeof(line), file) && strncmp(line, HTTP_CACHE_MAGIC, strlen(HTTP_CACHE_MAGIC)) == 0) {
+        fetched_at = read_line(file);
+        max_age = read_line(file);
+        body_hash = read_line(file);
+        if (fetched_at && max_age && body_hash && strlen(body_hash) == HTTP_CACHE_HASH_SIZE - 1) {
+            entry->fetched_at = (time_t)strtoll(fetched_at, NULL, 10);
+            entry->max_age = strtol(max_age, NULL, 10);
+            memcpy(entry->body_hash, body_hash, HTTP_CACHE_HASH_SIZE);
+            entry->etag = read_line(file);
+            entry->last_modified = read_line(file);
+            found = 1;
+        }
+    }
+    free(fetched_at);
+    free(max_age);
+    free(body_hash);
+    fclose(file);
+
+    // An entry is only usable together with its body
+    entry_path(cache, entry->key, ".body", path, sizeof(path));
+    file = found ? fopen(path, "rb") : NULL;
+    if (!file) {
+        http_cache_entry_clear(entry);
+        entry->body_hash[0] = '\0';
+        return 0;
+    }
+    fclose(file);
+
+    return 1;
+}
+
+int http_cache_is_fresh(const HttpCacheEntry *entry, time_t now)
+{
+    return entry->body_hash[0] && now >= entry->fetched_at && now - entry->fetched_at < entry->max_age;
+}
+
+int http_cache_add_validators(const HttpCacheEntry *entry, HttpRequest *request)
+{
+    char header[1100];
+    int added = 0;
+
+    if (entry->etag) {
+        snprintf(header, sizeof(header), "If-None-Match: %s", entry->etag);
+        request->headers = curl_slist_append(request->headers, header);
+        added = 1;
+    }
+    if (entry->last_modified) {
+        snprintf(header, sizeof(header), "If-Modified-Since: %s", entry->last_modified);
+        request->headers = curl_slist_append(request->headers, header);
+        added = 1;
+    }
+    return added;
+}
+
+// Writes the metadata next to the body, replacing the old file atomically
+static int write_meta(HttpCache *cache, const HttpCacheEntry *entry)
+{
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    FILE *file;
+    int ok;
+
+    entry_path(cache, entry->key, ".meta", path, sizeof(path));
+    file = open_temp(cache, entry->key, ".meta.tmp", "w", tmp_path, sizeof(tmp_path));
+    if (!file) {
+        fprintf(stderr, "Can't write HTTP cache entry %s\n", path);
+        return 0;
+    }
+    fprintf(file, "%s\n%lld\n%ld\n%s\n%s\n%s\n", HTTP_CACHE_MAGIC, (long long)entry->fetched_at, entry->max_age,
+            entry->body_hash, entry->etag ? entry->etag : "", entry->last_modified ? entry->last_modified : "");
+    ok = fclose(file) == 0;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+static void apply_response(HttpCacheEntry *entry, const HttpRequest *response)
+{
+    entry->fetched_at = time(NULL);
+    entry->max_age = response->max_age >= 0 ? response->max_age : HTTP_CACHE_DEFAULT_MAX_AGE;
+    if (response->etag) {
+        free(entry->etag);
+        entry->etag = strdup(response->etag);
+    }
+    if (response->last_modified) {
+        free(entry->last_modified);
+        entry->last_modified = strdup(response->last_modified);
+    }
+}
+
+// Records a 304 revalidation; the cached body stays as it is
+int http_cache_touch(HttpCache *cache, HttpCacheEntry *entry, const HttpRequest *response)
+{
+    apply_response(entry, response);
+    return write_meta(cache, entry);
+}
+
+FILE *http_cache_open_body(HttpCache *cache, const HttpCacheEntry *entry)
+{
+    char path[PATH_MAX];
+
+    entry_path(cache, entry->key, ".body", path, sizeof(path));
+    return fopen(path, "rb");
+}
+
+HttpCacheWriter *http_cache_writer_new(HttpCache *cache, const char *url)
+{
+    HttpCacheWriter *writer = calloc(1, sizeof(HttpCacheWriter));
+
+    if (!writer) {
+        return NULL;
+    }
+    writer->cache = cache;
+    writer->state = FNV_OFFSET_BASIS;
+    http_cache_hash(url, strlen(url), writer->key);
+
+    writer->file = open_temp(cache, writer->key, ".body.tmp", "wb", writer->tmp_path, sizeof(writer->tmp_path));
+    if (!writer->file) {
+        // Still hash the body, so unchanged responses are recognised without a cache
+        fprintf(stderr, "Can't write HTTP cache entry %s/%s.body\n", cache->dir, writer->key);
+        writer->tmp_path[0] = '\0';
+        writer->failed = 1;
+    }
+    return writer;
+}
+
+int http_cache_writer_write(HttpCacheWriter *writer, const void *data, size_t len)
+{
+    writer->state = fnv1a_update(writer->state, data, len);
+    if (writer->file && !writer->failed && fwrite(data, 1, len, writer->file) != len) {
+        writer->failed = 1;
+    }
+    return !writer->failed;
+}
+
+const char *http_cache_writer_hash(HttpCacheWriter *writer)
+{
+    format_hash(writer->state, writer->hash);
+    return writer->hash;
+}
+
+int http_cache_writer_commit(HttpCacheWriter *writer, const HttpRequest *response)
+{
+    HttpCacheEntry entry = {0};
+    char path[PATH_MAX];
+    int ok = 0;
+
+    if (writer->file) {
+        ok = fclose(writer->file) == 0 && !writer->failed;
+        writer->file = NULL;
+    }
+
+    memcpy(entry.key, writer->key, sizeof(entry.key));
+    memcpy(entry.body_hash, http_cache_writer_hash(writer), sizeof(entry.body_hash));
+    apply_response(&entry, response);
+
+    entry_path(writer->cache, writer->key, ".body", path, sizeof(path));
+    if (ok && rename(writer->tmp_path, path) == 0) {
+        ok = write_meta(writer->cache, &entry);
+        if (!ok) {
+            remove(path);  // A body without matching metadata is useless
+        }
+    } else {
+        ok = 0;
+    }
+
+    http_cache_entry_clear(&entry);
+    http_cache_writer_discard(writer);
+    return ok;
+}
+
+void http_cache_writer_discard(HttpCacheWriter *writer)
+{
+    if (!writer) {
+        return;
+    }
+    if (writer->file) {
+        fclose(writer->file);
+    }
+    if (writer->tmp_path[0]) {
+        remove(writer->tmp_path);
+    }
+    free(writer);
+}
@@ -0,0 +1,47 @@
+#ifndef __HTTP_CACHE_H__
+#define __HTTP_CACHE_H__
+
+#include <stddef.h>
+#include <time.h>
+
+#include "http.h"
+
+#define HTTP_CACHE_HASH_SIZE 17  // 64-bit hash as hex plus NUL
+
+// Response cache kept as <key>.body / <key>.meta file pairs in one directory.
+// The key is a hash of the full request URL, so every endpoint and parameter
+// combination gets its own entry. Opening the cache drops entries that were
+// neither fetched nor revalidated for 45 days.
+typedef struct HttpCache HttpCache;
+typedef struct HttpCacheWriter HttpCacheWriter;
+
+typedef struct {
+    char key[HTTP_CACHE_HASH_SIZE];
+    char body_hash[HTTP_CACHE_HASH_SIZE];
+    char *etag;
+    char *last_modified;
+    time_t fetched_at;
+    long max_age;  // seconds the entry is fresh for without revalidation
+} HttpCacheEntry;
+
+HttpCache *http_cache_new(const char *dir);
+void http_cache_free(HttpCache *cache);
+
+void http_cache_hash(const void *data, size_t len, char out[HTTP_CACHE_HASH_SIZE]);
+
+int http_cache_lookup(HttpCache *cache, const char *url, HttpCacheEntry *entry);
+int http_cache_is_fresh(const HttpCacheEntry *entry, time_t now);
+int http_cache_add_validators(const HttpCacheEntry *entry, HttpRequest *request);
+int http_cache_touch(HttpCache *cache, HttpCacheEntry *entry, const HttpRequest *response);
+FILE *http_cache_open_body(HttpCache *cache, const HttpCacheEntry *entry);
+void http_cache_entry_clear(HttpCacheEntry *entry);
+
+// Tees a response body into the cache while hashing it. Nothing replaces the
+// current entry until http_cache_writer_commit.
+HttpCacheWriter *http_cache_writer_new(HttpCache *cache, const char *url);
+int http_cache_writer_write(HttpCacheWriter *writer, const void *data, size_t len);
+const char *http_cache_writer_hash(HttpCacheWriter *writer);
+int http_cache_writer_commit(HttpCacheWriter *writer, const HttpRequest *response);
+void http_cache_writer_discard(HttpCacheWriter *writer);
+
+#endif /* __HTTP_CACHE_H__ */
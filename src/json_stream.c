@@ -0,0 +1,470 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_stream.h"
+
+#define JSON_MAX_DEPTH 64
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+typedef enum {
+    STATE_VALUE,        // expecting a value
+    STATE_KEY,          // expecting an object key
+    STATE_COLON,
+    STATE_AFTER_VALUE,  // expecting ',' or the end of the current container
+    STATE_STRING,
+    STATE_STRING_ESCAPE,
+    STATE_STRING_UNICODE,
+    STATE_NUMBER,
+    STATE_LITERAL,
+    STATE_DONE,
+    STATE_ERROR
+} ParserState;
+
+struct JsonStream {
+    JsonEventCallback callback;
+    void *user_data;
+    ParserState state;
+    char stack[JSON_MAX_DEPTH];  // '{' or '[' for every open container
+    int depth;
+    int first;                   // nothing seen yet in the container just opened
+    int string_is_key;
+    char *token;
+    size_t token_len;
+    size_t token_cap;
+    unsigned int unicode;
+    int unicode_digits;
+    unsigned int high_surrogate;
+    const char *error;
+};
+
+static int fail(JsonStream *stream, const char *error)
+{
+    stream->state = STATE_ERROR;
+    stream->error = error;
+    return 0;
+}
+
+static int token_push(JsonStream *stream, char c)
+{
+    if (stream->token_len + 1 >= stream->token_cap) {
+        size_t cap = stream->token_cap ? stream->token_cap * 2 : 64;
+        char *token = realloc(stream->token, cap);
+        if (!token) {
+            return fail(stream, "out of memory");
+        }
+        stream->token = token;
+        stream->token_cap = cap;
+    }
+    stream->token[stream->token_len++] = c;
+    return 1;
+}
+
+static int token_push_codepoint(JsonStream *stream, unsigned int cp)
+{
+    if (cp < 0x80) {
+        return token_push(stream, (char)cp);
+    } else if (cp < 0x800) {
+        return token_push(stream, (char)(0xC0 | (cp >> 6))) &&
+               token_push(stream, (char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        return token_push(stream, (char)(0xE0 | (cp >> 12))) &&
+               token_push(stream, (char)(0x80 | ((cp >> 6) & 0x3F))) &&
+               token_push(stream, (char)(0x80 | (cp & 0x3F)));
+    }
+    return token_push(stream, (char)(0xF0 | (cp >> 18))) &&
+           token_push(stream, (char)(0x80 | ((cp >> 12) & 0x3F))) &&
+           token_push(stream, (char)(0x80 | ((cp >> 6) & 0x3F))) &&
+           token_push(stream, (char)(0x80 | (cp & 0x3F)));
+}
+
+// A high surrogate that isn't followed by a low one decodes as U+FFFD
+static int flush_surrogate(JsonStream *stream)
+{
+    if (stream->high_surrogate) {
+        stream->high_surrogate = 0;
+        return token_push_codepoint(stream, REPLACEMENT_CHARACTER);
+    }
+    return 1;
+}
+
+static int emit(JsonStream *stream, JsonEvent event, int depth)
+{
+    const char *text = "";
+    size_t len = 0;
+
+    if (stream->token_len > 0 || event == JSON_EVENT_KEY || event == JSON_EVENT_STRING) {
+        if (!token_push(stream, '\0')) {
+            return 0;
+        }
+        text = stream->token;
+        len = stream->token_len - 1;
+    }
+    stream->token_len = 0;
+
+    if (stream->callback(event, text, len, depth, stream->user_data)) {
+        return fail(stream, "aborted by callback");
+    }
+    return 1;
+}
+
+static void value_done(JsonStream *stream)
+{
+    stream->state = stream->depth == 0 ? STATE_DONE : STATE_AFTER_VALUE;
+}
+
+static int open_container(JsonStream *stream, char bracket)
+{
+    if (stream->depth == JSON_MAX_DEPTH) {
+        return fail(stream, "nesting too deep");
+    }
+    if (!emit(stream, bracket == '{' ? JSON_EVENT_OBJECT_START : JSON_EVENT_ARRAY_START, stream->depth)) {
+        return 0;
+    }
+    stream->stack[stream->depth++] = bracket;
+    stream->state = bracket == '{' ? STATE_KEY : STATE_VALUE;
+    stream->first = 1;
+    return 1;
+}
+
+static int close_container(JsonStream *stream, char bracket)
+{
+    if (stream->depth == 0 || stream->stack[stream->depth - 1] != bracket) {
+        return fail(stream, "mismatched bracket");
+    }
+    stream->depth--;
+    if (!emit(stream, bracket == '{' ? JSON_EVENT_OBJECT_END : JSON_EVENT_ARRAY_END, stream->depth)) {
+        return 0;
+    }
+    value_done(stream);
+    return 1;
+}
+
+static const char *skip_digits(const char *p)
+{
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?, checked by hand as strtod
+// follows the locale's decimal point, and takes hex, inf and nan besides
+static int is_number(const char *text)
+{
+    const char *p = text;
+    const char *digits;
+
+    if (*p == '-') {
+        p++;
+    }
+    if (*p == '0') {
+        p++;
+    } else if (*p >= '1' && *p <= '9') {
+        p = skip_digits(p);
+    } else {
+        return 0;
+    }
+    if (*p == '.') {
+        digits = ++p;
+        if ((p = skip_digits(p)) == digits) {
+            return 0;
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') {
+            p++;
+        }
+        digits = p;
+        if ((p = skip_digits(p)) == digits) {
+            return 0;
+        }
+    }
+    return *p == '\0';
+}
+
+static int finish_number(JsonStream *stream)
+{
+    if (!token_push(stream, '\0')) {
+        return 0;
+    }
+    if (!is_number(stream->token)) {
+        return fail(stream, "invalid number");
+    }
+    stream->token_len--;
+    if (!emit(stream, JSON_EVENT_NUMBER, stream->depth)) {
+        return 0;
+    }
+    value_done(stream);
+    return 1;
+}
+
+static int finish_literal(JsonStream *stream)
+{
+    JsonEvent event;
+
+    if (stream->token_len == 4 && memcmp(stream->token, "true", 4) == 0) {
+        event = JSON_EVENT_TRUE;
+    } else if (stream->token_len == 5 && memcmp(stream->token, "false", 5) == 0) {
+        event = JSON_EVENT_FALSE;
+    } else if (stream->token_len == 4 && memcmp(stream->token, "null", 4) == 0) {
+        event = JSON_EVENT_NULL;
+    } else {
+        return fail(stream, "invalid literal");
+    }
+    stream->token_len = 0;
+    if (!emit(stream, event, stream->depth)) {
+        return 0;
+    }
+    value_done(stream);
+    return 1;
+}
+
+static int finish_string(JsonStream *stream)
+{
+    if (!flush_surrogate(stream)) {
+        return 0;
+    }
+    if (stream->string_is_key) {
+        if (!emit(stream, JSON_EVENT_KEY, stream->depth)) {
+            return 0;
+        }
+        stream->state = STATE_COLON;
+        return 1;
+    }
+    if (!emit(stream, JSON_EVENT_STRING, stream->depth)) {
+        return 0;
+    }
+    value_done(stream);
+    return 1;
+}
+
+static int unicode_escape_done(JsonStream *stream)
+{
+    unsigned int cp = stream->unicode;
+
+    stream->state = STATE_STRING;
+    if (stream->high_surrogate) {
+        if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            cp = 0x10000 + ((stream->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+            stream->high_surrogate = 0;
+            return token_push_codepoint(stream, cp);
+        }
+        if (!flush_surrogate(stream)) {
+            return 0;
+        }
+    }
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        stream->high_surrogate = cp;
+        return 1;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        cp = REPLACEMENT_CHARACTER;
+    }
+    return token_push_codepoint(stream, cp);
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int is_whitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Handles one character while outside of any string, number or literal
+static int structural_char(JsonStream *stream, char c)
+{
+    if (is_whitespace(c)) {
+        return 1;
+    }
+
+    switch (stream->state) {
+    case STATE_VALUE:
+        if (c == '{' || c == '[') {
+            return open_container(stream, c);
+        }
+        if (c == ']' && stream->first) {
+            return close_container(stream, '[');
+        }
+        stream->first = 0;
+        if (c == '"') {
+            stream->string_is_key = 0;
+            stream->state = STATE_STRING;
+            return 1;
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            stream->state = STATE_NUMBER;
+            return token_push(stream, c);
+        }
+        if (c == 't' || c == 'f' || c == 'n') {
+            stream->state = STATE_LITERAL;
+            return token_push(stream, c);
+        }
+        return fail(stream, "unexpected character, expected a value");
+    case STATE_KEY:
+        if (c == '}' && stream->first) {
+            return close_container(stream, '{');
+        }
+        if (c == '"') {
+            stream->first = 0;
+            stream->string_is_key = 1;
+            stream->state = STATE_STRING;
+            return 1;
+        }
+        return fail(stream, "unexpected character, expected a key");
+    case STATE_COLON:
+        if (c == ':') {
+            stream->state = STATE_VALUE;
+            stream->first = 0;
+            return 1;
+        }
+        return fail(stream, "expected ':'");
+    case STATE_AFTER_VALUE:
+        if (c == ',') {
+            stream->state = stream->stack[stream->depth - 1] == '{' ? STATE_KEY : STATE_VALUE;
+            stream->first = 0;
+            return 1;
+        }
+        if (c == '}' || c == ']') {
+            return close_container(stream, c == '}' ? '{' : '[');
+        }
+        return fail(stream, "expected ',' or end of container");
+    case STATE_DONE:
+        return fail(stream, "trailing data after the document");
+    default:
+        return fail(stream, "invalid parser state");
+    }
+}
+
+JsonStream *json_stream_new(JsonEventCallback callback, void *user_data)
+{
+    JsonStream *stream = calloc(1, sizeof(JsonStream));
+
+    if (stream) {
+        stream->callback = callback;
+        stream->user_data = user_data;
+        stream->state = STATE_VALUE;
+    }
+    return stream;
+}
+
+int json_stream_feed(JsonStream *stream, const char *data, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len) {
+        char c = data[i];
+        int digit;
+
+        switch (stream->state) {
+        case STATE_ERROR:
+            return 0;
+        case STATE_STRING:
+            if (c == '"') {
+                if (!finish_string(stream)) return 0;
+            } else if (c == '\\') {
+                stream->state = STATE_STRING_ESCAPE;
+            } else if ((unsigned char)c < 0x20) {
+                return fail(stream, "control character in string");
+            } else {
+                // Copy the whole run of plain characters in one go
+                size_t run = i + 1;
+                while (run < len && data[run] != '"' && data[run] != '\\' && (unsigned char)data[run] >= 0x20) {
+                    run++;
+                }
+                if (!flush_surrogate(stream)) return 0;
+                while (i < run) {
+                    if (!token_push(stream, data[i++])) return 0;
+                }
+                continue;
+            }
+            break;
+        case STATE_STRING_ESCAPE:
+            stream->state = STATE_STRING;
+            if (c == 'u') {
+                stream->state = STATE_STRING_UNICODE;
+                stream->unicode = 0;
+                stream->unicode_digits = 0;
+                break;
+            }
+            if (!flush_surrogate(stream)) return 0;
+            switch (c) {
+            case '"': case '\\': case '/': if (!token_push(stream, c)) return 0; break;
+            case 'b': if (!token_push(stream, '\b')) return 0; break;
+            case 'f': if (!token_push(stream, '\f')) return 0; break;
+            case 'n': if (!token_push(stream, '\n')) return 0; break;
+            case 'r': if (!token_push(stream, '\r')) return 0; break;
+            case 't': if (!token_push(stream, '\t')) return 0; break;
+            default: return fail(stream, "invalid escape sequence");
+            }
+            break;
+        case STATE_STRING_UNICODE:
+            digit = hex_value(c);
+            if (digit < 0) {
+                return fail(stream, "invalid unicode escape");
+            }
+            stream->unicode = (stream->unicode << 4) | (unsigned int)digit;
+            if (++stream->unicode_digits == 4 && !unicode_escape_done(stream)) {
+                return 0;
+            }
+            break;
+        case STATE_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                if (!token_push(stream, c)) return 0;
+                break;
+            }
+            // The terminating character still has to be handled
+            if (!finish_number(stream)) return 0;
+            continue;
+        case STATE_LITERAL:
+            if (c >= 'a' && c <= 'z') {
+                if (!token_push(stream, c)) return 0;
+                break;
+            }
+            if (!finish_literal(stream)) return 0;
+            continue;
+        default:
+            if (!structural_char(stream, c)) return 0;
+            break;
+        }
+        i++;
+    }
+
+    return stream->state != STATE_ERROR;
+}
+
+int json_stream_finish(JsonStream *stream)
+{
+    if (stream->state == STATE_NUMBER && stream->depth == 0 && !finish_number(stream)) {
+        return 0;
+    }
+    if (stream->state == STATE_LITERAL && stream->depth == 0 && !finish_literal(stream)) {
+        return 0;
+    }
+    if (stream->state == STATE_ERROR) {
+        return 0;
+    }
+    if (stream->state != STATE_DONE) {
+        return fail(stream, "unexpected end of input");
+    }
+    return 1;
+}
+
+const char *json_stream_error(const JsonStream *stream)
+{
+    return stream->error ? stream->error : "no error";
+}
+
+void json_stream_free(JsonStream *stream)
+{
+    if (stream) {
+        free(stream->token);
+        free(stream);
+    }
+}
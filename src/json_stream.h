@@ -0,0 +1,34 @@
+#ifndef __JSON_STREAM_H__
+#define __JSON_STREAM_H__
+
+#include <stddef.h>
+
+typedef enum {
+    JSON_EVENT_OBJECT_START,
+    JSON_EVENT_OBJECT_END,
+    JSON_EVENT_ARRAY_START,
+    JSON_EVENT_ARRAY_END,
+    JSON_EVENT_KEY,
+    JSON_EVENT_STRING,
+    JSON_EVENT_NUMBER,  // text holds the number literal as it appeared
+    JSON_EVENT_TRUE,
+    JSON_EVENT_FALSE,
+    JSON_EVENT_NULL
+} JsonEvent;
+
+// text is NUL terminated and only valid for the duration of the call.
+// depth is the nesting level the event occurs at: 0 for the root value,
+// 1 for members of the root container and so on. Return non-zero to abort.
+typedef int (*JsonEventCallback)(JsonEvent event, const char *text, size_t len, int depth, void *user_data);
+
+// Incremental (push) JSON parser. Input may be split at any byte, and memory
+// use is bounded by the longest single token rather than the document size.
+typedef struct JsonStream JsonStream;
+
+JsonStream *json_stream_new(JsonEventCallback callback, void *user_data);
+int json_stream_feed(JsonStream *stream, const char *data, size_t len);
+int json_stream_finish(JsonStream *stream);
+const char *json_stream_error(const JsonStream *stream);
+void json_stream_free(JsonStream *stream);
+
+#endif /* __JSON_STREAM_H__ */
@@ -0,0 +1,294 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include "launch_timer.h"
+#include "procfs.h"
+#include "trace.h"
+
+// Often enough to time a launch to a tenth of a second. Until its first
+// process shows up, each poll reads the command line or stat of every
+// process, a few microseconds apiece.
+#define LAUNCH_TIMER_POLL_MS 100
+
+typedef struct {
+    LaunchTimer *timer;
+    LaunchTiming timing;
+    gint64 clicked_at;        // monotonic, us
+    GPid pgid;                // a non-Steam game's process group, 0 for Steam
+    pid_t root;               // the game's first process, 0 until it shows up
+    char app_arg[32];         // AppId=<id>
+    char wm_class[32];        // steam_app_<id>
+    GHashTable *windows;      // windows seen that aren't the game's
+    guint poll;
+} TrackedLaunch;
+
+struct LaunchTimer {
+    LaunchTimerStartCallback started;
+    LaunchTimerCallback callback;
+    gpointer user_data;
+    GPtrArray *launches;      // TrackedLaunch
+    // A connection of our own rather than GDK's, which is a Wayland one
+    // under Wayland. Open only while a launch waits for its window.
+    Display *display;
+    gboolean no_display;      // the X server couldn't be reached
+    Atom client_list_atom;
+    Atom wm_pid_atom;
+};
+
+static void tracked_launch_free(gpointer p)
+{
+    TrackedLaunch *launch = (TrackedLaunch *)p;
+
+    if (launch->poll) {
+        g_source_remove(launch->poll);
+    }
+    g_hash_table_destroy(launch->windows);
+    g_free(launch);
+}
+
+LaunchTimer *launch_timer_new(LaunchTimerStartCallback started, LaunchTimerCallback callback, gpointer user_data)
+{
+    LaunchTimer *timer = g_new0(LaunchTimer, 1);
+
+    timer->started = started;
+    timer->callback = callback;
+    timer->user_data = user_data;
+    timer->launches = g_ptr_array_new_with_free_func(tracked_launch_free);
+    return timer;
+}
+
+static void close_display(LaunchTimer *timer)
+{
+    if (timer->display) {
+        XCloseDisplay(timer->display);
+        timer->display = NULL;
+    }
+    timer->no_display = FALSE;
+}
+
+void launch_timer_free(LaunchTimer *timer)
+{
+    if (timer) {
+        g_ptr_array_unref(timer->launches);
+        close_display(timer);
+        g_free(timer);
+    }
+}
+
+static Display *get_display(LaunchTimer *timer)
+{
+    if (!timer->display && !timer->no_display) {
+        timer->display = XOpenDisplay(NULL);
+        if (!timer->display) {
+            fprintf(stderr, "Can't reach the X server; launches are timed up to their first process\n");
+            timer->no_display = TRUE;
+            return NULL;
+        }
+        timer->client_list_atom = XInternAtom(timer->display, "_NET_CLIENT_LIST", False);
+        timer->wm_pid_atom = XInternAtom(timer->display, "_NET_WM_PID", False);
+    }
+    return timer->display;
+}
+
+static int is_first_process(pid_t pid, void *user_data)
+{
+    TrackedLaunch *launch = (TrackedLaunch *)user_data;
+    char cmdline[4096];
+    ProcStat stat;
+    ssize_t len;
+    char *arg;
+
+    if (launch->pgid) {
+        return proc_read_stat(pid, &stat) && stat.pgrp == launch->pgid &&
+               !(pid == launch->pgid && strcmp(stat.comm, "sh") == 0);
+    }
+    // The arguments are NUL separated; AppId= comes right after the
+    // launch wrapper's own
+    if ((len = proc_read_file(pid, "cmdline", cmdline, sizeof(cmdline))) <= 0) {
+        return 0;
+    }
+    for (arg = cmdline; arg < cmdline + len; arg += strlen(arg) + 1) {
+        if (strcmp(arg, launch->app_arg) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static gboolean is_game_process(TrackedLaunch *launch, pid_t pid)
+{
+    ProcStat stat;
+
+    if (launch->pgid && proc_read_stat(pid, &stat) && stat.pgrp == launch->pgid) {
+        return TRUE;
+    }
+    return proc_descends_from(pid, launch->root);
+}
+
+static gboolean is_game_window(TrackedLaunch *launch, Display *display, Window window)
+{
+    Atom type;
+    int format;
+    unsigned long count, after;
+    unsigned char *data = NULL;
+    XClassHint hint = { NULL, NULL };
+    gboolean found = FALSE;
+
+    if (XGetWindowProperty(display, window, launch->timer->wm_pid_atom, 0, 1, False, XA_CARDINAL,
+                           &type, &format, &count, &after, &data) == Success && data) {
+        // Format 32 properties come as longs
+        if (format == 32 && count == 1) {
+            found = is_game_process(launch, (pid_t)*(unsigned long *)data);
+        }
+        XFree(data);
+    }
+    if (!found && !launch->pgid && XGetClassHint(display, window, &hint)) {
+        found = hint.res_class && g_ascii_strcasecmp(hint.res_class, launch->wm_class) == 0;
+        XFree(hint.res_name);
+        XFree(hint.res_class);
+    }
+    return found;
+}
+
+static int ignore_x_error(Display *display, XErrorEvent *event)
+{
+    return 0;
+}
+
+// Windows can be destroyed while they are looked at. The errors that causes
+// are ignored here rather than reaching GDK's handler, which would abort.
+static gboolean find_game_window(TrackedLaunch *launch, Display *display)
+{
+    TRACE_SCOPE("find_game_window");
+    int (*previous)(Display *, XErrorEvent *) = XSetErrorHandler(ignore_x_error);
+    Atom type;
+    int format;
+    unsigned long count, after, i;
+    unsigned char *data = NULL;
+    gboolean found = FALSE;
+
+    if (XGetWindowProperty(display, DefaultRootWindow(display), launch->timer->client_list_atom, 0, 16384, False,
+                           XA_WINDOW, &type, &format, &count, &after, &data) == Success && data) {
+        const unsigned long *windows = (const unsigned long *)data;
+
+        for (i = 0; !found && format == 32 && i < count; i++) {
+            gpointer key = GSIZE_TO_POINTER(windows[i]);
+
+            if (g_hash_table_contains(launch->windows, key)) {
+                continue;
+            }
+            found = is_game_window(launch, display, (Window)windows[i]);
+            g_hash_table_add(launch->windows, key);
+        }
+        XFree(data);
+    }
+    XSync(display, False);
+    XSetErrorHandler(previous);
+    return found;
+}
+
+static gboolean game_alive(const TrackedLaunch *launch)
+{
+    pid_t pid = launch->pgid ? -launch->pgid : launch->root;
+
+    if (!pid) {
+        return TRUE;  // A Steam game that hasn't shown up yet
+    }
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+static int elapsed_ms(const TrackedLaunch *launch)
+{
+    return (int)((g_get_monotonic_time() - launch->clicked_at) / 1000);
+}
+
+static void finish_launch(TrackedLaunch *launch)
+{
+    LaunchTimer *timer = launch->timer;
+    LaunchTiming timing = launch->timing;
+
+    launch->poll = 0;  // Removed by returning G_SOURCE_REMOVE
+    g_ptr_array_remove(timer->launches, launch);
+    if (timer->launches->len == 0) {
+        close_display(timer);
+    }
+    if (timing.phase_ms[DB_LAUNCH_PROCESS] >= 0) {
+        timer->callback(&timing, timer->user_data);
+    }
+}
+
+static gboolean poll_launch(gpointer data)
+{
+    TrackedLaunch *launch = (TrackedLaunch *)data;
+
+    if (!launch->root && (launch->root = proc_find(is_first_process, launch))) {
+        launch->timing.phase_ms[DB_LAUNCH_PROCESS] = elapsed_ms(launch);
+        if (launch->timer->started) {
+            launch->timer->started(launch->timing.source, launch->timing.game_id, launch->root, launch->pgid,
+                                   launch->timer->user_data);
+        }
+    }
+    if (launch->root) {
+        Display *display = get_display(launch->timer);
+
+        if (display && find_game_window(launch, display)) {
+            launch->timing.phase_ms[DB_LAUNCH_WINDOW] = elapsed_ms(launch);
+        }
+        if (!display || launch->timing.phase_ms[DB_LAUNCH_WINDOW] >= 0) {
+            finish_launch(launch);
+            return G_SOURCE_REMOVE;
+        }
+    }
+    if (!game_alive(launch) || elapsed_ms(launch) >= LAUNCH_TIMER_TIMEOUT_S * 1000) {
+        finish_launch(launch);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void launch_timer_track(LaunchTimer *timer, DBGameSource source, int game_id, gint64 clicked_at, GPid pgid)
+{
+    TrackedLaunch *launch;
+    guint i;
+    int p;
+
+    for (i = 0; i < timer->launches->len; i++) {
+        launch = (TrackedLaunch *)g_ptr_array_index(timer->launches, i);
+        if (launch->timing.source == source && launch->timing.game_id == game_id) {
+            return;  // Clicked again while it starts
+        }
+    }
+    if (source == DB_SOURCE_NON_STEAM && !pgid) {
+        return;
+    }
+
+    launch = g_new0(TrackedLaunch, 1);
+    launch->timer = timer;
+    launch->timing.source = source;
+    launch->timing.game_id = game_id;
+    launch->timing.launched_at = g_get_real_time() / G_USEC_PER_SEC;
+    for (p = 0; p < DB_LAUNCH_N_PHASES; p++) {
+        launch->timing.phase_ms[p] = -1;
+    }
+    launch->clicked_at = clicked_at;
+    launch->timing.phase_ms[DB_LAUNCH_EXEC] = elapsed_ms(launch);
+    launch->pgid = source == DB_SOURCE_NON_STEAM ? pgid : 0;
+    snprintf(launch->app_arg, sizeof(launch->app_arg), "AppId=%d", game_id);
+    snprintf(launch->wm_class, sizeof(launch->wm_class), "steam_app_%d", game_id);
+    launch->windows = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    // What is already running wasn't started by this click
+    if (!launch->pgid && proc_find(is_first_process, launch)) {
+        tracked_launch_free(launch);
+        return;
+    }
+    launch->poll = g_timeout_add(LAUNCH_TIMER_POLL_MS, poll_launch, launch);
+    g_ptr_array_add(timer->launches, launch);
+}
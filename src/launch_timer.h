@@ -0,0 +1,45 @@
+#ifndef __LAUNCH_TIMER_H__
+#define __LAUNCH_TIMER_H__
+
+#include <glib.h>
+
+#include "db.h"
+
+// Launches still waiting for their window after this long are reported as
+// they are
+#define LAUNCH_TIMER_TIMEOUT_S 120
+
+// Times a launch from the click on Play through the phases in DBLaunchPhase,
+// polling from the main loop:
+//
+// - A Steam game's first process is the one the Steam client starts it
+//   under, whose command line holds AppId=<id>. A non-Steam game's is the
+//   first process in its process group other than the shell running its
+//   launch command.
+// - Its first window is the first client of the window manager whose
+//   _NET_WM_PID is that process or was started under it, or for a Steam
+//   game, whose WM_CLASS is steam_app_<id> as Proton names them. Windows are
+//   looked for through the X server, so under Wayland only games running on
+//   XWayland are seen, and without an X server launches end at the process.
+typedef struct LaunchTimer LaunchTimer;
+
+// Invoked on the main context once a launch's window shows up, its
+// processes are gone or LAUNCH_TIMER_TIMEOUT_S have passed. Launches whose
+// first process never showed up, like one cancelled in the Steam client,
+// are dropped.
+typedef void (*LaunchTimerCallback)(const LaunchTiming *timing, gpointer user_data);
+// Invoked on the main context as a launch's first process shows up. pgid is
+// as passed to launch_timer_track.
+typedef void (*LaunchTimerStartCallback)(DBGameSource source, int game_id, GPid pid, GPid pgid, gpointer user_data);
+
+// started may be NULL
+LaunchTimer *launch_timer_new(LaunchTimerStartCallback started, LaunchTimerCallback callback, gpointer user_data);
+// Launches still being timed aren't reported
+void launch_timer_free(LaunchTimer *timer);
+// Call right after the launch was handed off. clicked_at is the
+// g_get_monotonic_time() of the click, and pgid the process group of a
+// non-Steam game (see launcher_get_pgid); 0 for a Steam game. A Steam game
+// that is already running isn't timed.
+void launch_timer_track(LaunchTimer *timer, DBGameSource source, int game_id, gint64 clicked_at, GPid pgid);
+
+#endif /* __LAUNCH_TIMER_H__ */
@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "launcher.h"
+
+// How often a process group whose leader has exited is checked again
+#define LAUNCHER_POLL_INTERVAL_S 1
+
+typedef struct {
+    Launcher *launcher;
+    int game_id;
+    GPid pid;                 // also the process group id
+    gint64 started_at;        // Unix seconds
+    gint64 started_monotonic; // us, so clock changes don't skew the duration
+    guint watch;              // child watch, then the group poll
+} RunningGame;
+
+struct Launcher {
+    LauncherExitCallback callback;
+    gpointer user_data;
+    GHashTable *running;      // game id -> RunningGame
+};
+
+static void running_game_free(gpointer p)
+{
+    RunningGame *game = (RunningGame *)p;
+
+    if (game->watch) {
+        g_source_remove(game->watch);
+    }
+    g_free(game);
+}
+
+Launcher *launcher_new(LauncherExitCallback callback, gpointer user_data)
+{
+    Launcher *launcher = g_new0(Launcher, 1);
+
+    launcher->callback = callback;
+    launcher->user_data = user_data;
+    launcher->running = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, running_game_free);
+    return launcher;
+}
+
+void launcher_free(Launcher *launcher)
+{
+    if (launcher) {
+        g_hash_table_destroy(launcher->running);
+        g_free(launcher);
+    }
+}
+
+static void finish_game(RunningGame *game)
+{
+    Launcher *launcher = game->launcher;
+    int game_id = game->game_id;
+    gint64 started_at = game->started_at;
+    gint64 ended_at = started_at + (g_get_monotonic_time() - game->started_monotonic) / G_USEC_PER_SEC;
+
+    game->watch = 0;  // Removed by returning G_SOURCE_REMOVE or by firing
+    g_hash_table_remove(launcher->running, GINT_TO_POINTER(game_id));
+    launcher->callback(game_id, started_at, ended_at, launcher->user_data);
+}
+
+static gboolean group_alive(GPid pgid)
+{
+    return kill(-pgid, 0) == 0 || errno == EPERM;
+}
+
+static gboolean poll_group(gpointer data)
+{
+    RunningGame *game = (RunningGame *)data;
+
+    if (group_alive(game->pid)) {
+        return G_SOURCE_CONTINUE;
+    }
+    finish_game(game);
+    return G_SOURCE_REMOVE;
+}
+
+static void on_child_exited(GPid pid, gint status, gpointer data)
+{
+    RunningGame *game = (RunningGame *)data;
+
+    game->watch = 0;  // A child watch only fires once
+    g_spawn_close_pid(pid);
+    // The game may still be running under a process the launch command
+    // started; follow the group until it is empty
+    if (group_alive(game->pid)) {
+        game->watch = g_timeout_add_seconds(LAUNCHER_POLL_INTERVAL_S, poll_group, game);
+        return;
+    }
+    finish_game(game);
+}
+
+// Runs in the child between fork and exec
+static void start_process_group(gpointer data)
+{
+    setsid();
+}
+
+gboolean launcher_run(Launcher *launcher, int game_id, const char *command, GError **error)
+{
+    gchar *argv[] = { "/bin/sh", "-c", (gchar *)command, NULL };
+    RunningGame *game;
+    GPid pid;
+
+    if (launcher_is_running(launcher, game_id)) {
+        g_set_error(error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED, "The game is already running");
+        return FALSE;
+    }
+    if (!g_spawn_async(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, start_process_group, NULL, &pid, error)) {
+        return FALSE;
+    }
+
+    game = g_new0(RunningGame, 1);
+    game->launcher = launcher;
+    game->game_id = game_id;
+    game->pid = pid;
+    game->started_at = g_get_real_time() / G_USEC_PER_SEC;
+    game->started_monotonic = g_get_monotonic_time();
+    game->watch = g_child_watch_add(pid, on_child_exited, game);
+    g_hash_table_insert(launcher->running, GINT_TO_POINTER(game_id), game);
+    return TRUE;
+}
+
+gboolean launcher_is_running(Launcher *launcher, int game_id)
+{
+    return g_hash_table_contains(launcher->running, GINT_TO_POINTER(game_id));
+}
+
+GPid launcher_get_pgid(Launcher *launcher, int game_id)
+{
+    RunningGame *game = g_hash_table_lookup(launcher->running, GINT_TO_POINTER(game_id));
+
+    return game ? game->pid : 0;
+}
+
+guint launcher_running_count(Launcher *launcher)
+{
+    return g_hash_table_size(launcher->running);
+}
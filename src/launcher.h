@@ -0,0 +1,27 @@
+#ifndef __LAUNCHER_H__
+#define __LAUNCHER_H__
+
+#include <glib.h>
+
+// Runs game commands without blocking the main loop and tells when each game
+// has exited. A game is started in its own process group, and it only counts
+// as exited once every process in that group is gone, so launch scripts that
+// fork the actual game and return are followed to the end.
+//
+// Games still running when the launcher is freed keep running, but their
+// sessions are not reported.
+typedef struct Launcher Launcher;
+
+// Invoked on the main context; times are Unix seconds
+typedef void (*LauncherExitCallback)(int game_id, gint64 started_at, gint64 ended_at, gpointer user_data);
+
+Launcher *launcher_new(LauncherExitCallback callback, gpointer user_data);
+void launcher_free(Launcher *launcher);
+// Runs command through the shell, as system() would
+gboolean launcher_run(Launcher *launcher, int game_id, const char *command, GError **error);
+gboolean launcher_is_running(Launcher *launcher, int game_id);
+// The process group a running game was started in; 0 if it isn't running
+GPid launcher_get_pgid(Launcher *launcher, int game_id);
+guint launcher_running_count(Launcher *launcher);
+
+#endif /* __LAUNCHER_H__ */
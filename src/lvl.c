@@ -1,177 +1,567 @@
 #include <stdlib.h>
-#include <pwd.h>
 #include <string.h>
-#include <sys/stat.h>
 
 #include <gtk/gtk.h>
 #include <sqlite3.h>
 
+#include "artwork.h"
+#include "config.h"
 #include "db.h"
+#include "game_list_model.h"
+#include "launch_timer.h"
+#include "launcher.h"
+#include "search.h"
+#include "session_sampler.h"
+#include "snapshot.h"
+#include "trace.h"
 #include "steam.h"
-#include "validation.h"
+#include "steam_local.h"
+#include "steam_watch.h"
+#include "sync.h"
+#include "sync_scheduler.h"
 
 #define VERSION "1.0.0"
+#define GAME_LIST_MAX_DELTA 512
+#define ARTWORK_MEMORY_LIMIT (16 * 1024 * 1024)
+// Store details fetched per run, and the pause between runs while apps are
+// left, which keeps a large library well within the store's rate limit
+#define STORE_SYNC_BATCH 150
+#define STORE_SYNC_PAUSE (5 * 60)
+#define STORE_SYNC_RETRY (15 * 60)
+// Launch times are summed up over a game's latest launches, so the
+// percentiles follow game and driver updates
+#define LAUNCH_STATS_WINDOW 20
 
 typedef struct {
     GtkWidget *window;
     GtkWidget *stack;
-    GtkWidget *game_list_box;
+    GtkWidget *game_list_view;
+    GameListModel *game_list_model;
     GtkWidget *game_info_label;
+    GtkWidget *game_art_image;
     GtkWidget *game_title_label;
     GtkWidget *playtime_label;
+    GtkWidget *install_label;
+    GtkWidget *store_label;
+    GtkWidget *launch_label;
+    GtkWidget *resource_label;
     GtkWidget *run_command_button;
-    GtkWidget *api_key_entry;
-    GtkWidget *steam_id_entry;
+    GtkWidget *accounts_box;     // one row of entries per Steam account
+    GtkWidget *save_settings_button;
+    GtkWidget *sync_progress_bar;
+    GtkWidget *sync_cancel_button;
     GtkWidget *game_name_entry;
     GtkWidget *install_path_entry;
     GtkWidget *playtime_entry;
     GtkWidget *search_entry;
-    GtkListBoxRow *selected_game_row;
+    GtkWidget *sort_combo;
+    GCancellable *sync_cancellable;
+    GPtrArray *sync_rejected;    // Steam IDs refused by the running sync
+    SyncOutcome sync_outcome;    // the worst account result of the running sync
 } AppWidgets;
 
+typedef struct {
+    AppWidgets *widgets;
+    GArray *accounts;            // SteamAccounts being synced
+    gboolean manual;             // from the settings page rather than the saved config
+} SyncRequest;
+
 typedef struct {
     sqlite3 *db;
     char db_path[PATH_MAX];
+    char snapshot_path[PATH_MAX];
 } DB_Config;
 
+typedef struct {
+    AppWidgets *widgets;
+    gboolean has_snapshot;
+    guint64 snapshot_hash;
+    gboolean snapshot_written;   // the worker replaced the snapshot
+    gboolean snapshot_stale;     // it differs from the database but couldn't be replaced
+    GArray *game_art;            // GameArtRow for every Steam game
+    GArray *last_played;         // LastPlayedRow for every game played through LVL
+} OpenDatabaseRequest;
+
+typedef struct {
+    int game_id;
+    char *icon_hash;
+    char *capsule_hash;
+} GameArtRow;
+
+typedef struct {
+    DBGameSource source;
+    int game_id;
+    gint64 last_played;
+} LastPlayedRow;
+
 DB_Config db_config;
 
+// Shared by every Steam sync so connections to the API stay warm
+HttpClient *http_client;
+HttpCache *http_cache;
+// Changes made through db_config.db, applied to the list as they commit
+DBChangeLog *db_changes;
+// The snapshot the list was drawn from; its strings back the list model
+Snapshot *library_snapshot;
+// Whether the list has moved on from the snapshot on disk
+gboolean snapshot_stale;
+// Non-Steam games started from the library
+Launcher *launcher;
+// How long games started from the library take to come up
+LaunchTimer *launch_timer;
+// What they use while they run; NULL if sampling is turned off
+SessionSampler *session_sampler;
+// Icons for the rows on screen and the selected game's capsule
+ArtworkCache *artwork;
+// Installs and playtime the Steam client records while we run
+SteamWatch *steam_watch;
+// Decides when the Steam library is synced
+SyncScheduler *sync_scheduler;
+// Store details are fetched on their own client, a batch at a time
+HttpClient *store_client;
+GCancellable *store_sync_cancellable;
+guint store_sync_source;
+gint64 store_sync_started;       // monotonic time the last batch started
+
 const gchar *selected_game_id = NULL;
 
-// Function to create necessary directories for the app configuration
-static void mkdir_p(const char *dir, __mode_t permissions)
-{
-    char tmp[256] = {0};
-    char *p = NULL;
-    size_t len;
-
-    snprintf(tmp, sizeof(tmp),"%s",dir);
-    len = strlen(tmp);
-    if (tmp[len - 1] == '/')
-        tmp[len - 1] = 0;
-    for (p = tmp + 1; *p; p++)
-    {
-        if (*p == '/') {
-            *p = 0;
-            mkdir(tmp, permissions);
-            *p = '/';
-        }
+// Hands the URI to its default handler without waiting for it
+gboolean open_uri(const char *action)
+{
+    GError *error = NULL;
+
+    printf("Opening %s\n", action);
+    if (!g_app_info_launch_default_for_uri(action, NULL, &error)) {
+        fprintf(stderr, "Failed to open %s: %s\n", action, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Write the library as stored in the database to the snapshot file
+static int write_snapshot(sqlite3 *db, const char *snapshot_path)
+{
+    TRACE_SCOPE("write_snapshot");
+    SnapshotWriter *writer = snapshot_writer_new();
+    int ok;
+
+    db_fetch_all_games(db, snapshot_writer_add, writer);
+    ok = snapshot_writer_commit(writer, snapshot_path);
+    snapshot_writer_free(writer);
+    return ok;
+}
+
+// Append a single game to the list model
+void create_game_row(int id, const char *name, const char *install_path, int playtime, void *user_data)
+{
+    GameListModel *model = (GameListModel *)user_data;
+    game_list_model_append(model, id, name, install_path, playtime);
+}
+
+static void set_game_last_played(DBGameSource source, int game_id, sqlite3_int64 last_played, void *user_data)
+{
+    GameListModel *model = (GameListModel *)user_data;
+    game_list_model_set_last_played(model, source == DB_SOURCE_NON_STEAM, game_id, last_played);
+}
+
+// What the search entry asks for. Title matches are scored by the fuzzy
+// title search; Steam games whose store details match come after them, in
+// bm25 order.
+typedef struct {
+    char *text;
+    SearchQuery *title;          // NULL without plain words
+    GHashTable *store_matches;   // game id -> position + 1, NULL without a store query
+    gint store_count;
+    GHashTable *field_matches;   // game ids matching the field:word terms, NULL without any
+} LibraryFilter;
+
+static void add_store_match(int game_id, void *user_data)
+{
+    LibraryFilter *filter = (LibraryFilter *)user_data;
+    g_hash_table_insert(filter->store_matches, GINT_TO_POINTER(game_id), GINT_TO_POINTER(++filter->store_count));
+}
+
+static void add_field_match(int game_id, void *user_data)
+{
+    g_hash_table_add((GHashTable *)user_data, GINT_TO_POINTER(game_id));
+}
+
+static void library_filter_free(gpointer p)
+{
+    LibraryFilter *filter = (LibraryFilter *)p;
+
+    g_free(filter->text);
+    search_query_free(filter->title);
+    if (filter->store_matches) {
+        g_hash_table_destroy(filter->store_matches);
     }
-    mkdir(tmp, permissions);
+    if (filter->field_matches) {
+        g_hash_table_destroy(filter->field_matches);
+    }
+    g_free(filter);
 }
 
-void open_uri(const char *action)
+// NULL for a blank query. The store details are searched right away, so
+// scoring a game is a lookup.
+static LibraryFilter *library_filter_new(const char *text)
 {
-    char command[256];
+    LibraryFilter *filter;
+    SearchTerms terms;
 
-    snprintf(command, sizeof(command), "xdg-open %s", action);
+    search_terms_parse(&terms, text);
+    if (!terms.title && !terms.match) {
+        search_terms_clear(&terms);
+        return NULL;
+    }
 
-    printf("Executing command: %s\n", command);
-    if (system(command) == -1) {
-        fprintf(stderr, "Failed to execute command\n");
+    filter = g_new0(LibraryFilter, 1);
+    filter->text = g_strdup(text);
+    filter->title = terms.title ? search_query_new(terms.title) : NULL;
+    if (terms.match) {
+        filter->store_matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+        if (db_config.db) {
+            db_search_store(db_config.db, terms.match, add_store_match, filter);
+        }
     }
+    if (terms.filter) {
+        filter->field_matches = g_hash_table_new(g_direct_hash, g_direct_equal);
+        if (db_config.db) {
+            db_search_store(db_config.db, terms.filter, add_field_match, filter->field_matches);
+        }
+    }
+    search_terms_clear(&terms);
+    return filter;
 }
 
-// Function to write the Steam API key and Steam ID to the configuration file
-void write_config(const char *config_path, const char *api_key, const char *steam_id)
+// Whether filter can only match games previous matches
+static gboolean library_filter_narrows(const LibraryFilter *filter, const LibraryFilter *previous)
 {
-    FILE *file = fopen(config_path, "w");
-    if (file) {
-        fprintf(file, "%s\n%s\n", api_key, steam_id);
-        fclose(file);
+    if (!search_terms_extend(filter->text, previous->text)) {
+        return FALSE;
     }
+    return !previous->title || (filter->title && search_query_narrows(filter->title, previous->title));
 }
 
-// Function to read the Steam API key and Steam ID from the configuration file
-int read_config(const char *config_path, char *api_key, char *steam_id)
+// Rank a game against the search query. Names were folded when the list was
+// loaded, so this doesn't allocate.
+static gint score_game(const GameRecord *record, gpointer data)
 {
-    FILE *file = fopen(config_path, "r");
-    if (file) {
-        if (fscanf(file, "%255s\n%255s\n", api_key, steam_id) == 2) {
-            fclose(file);
-            return 1;
+    const LibraryFilter *filter = (const LibraryFilter *)data;
+    gboolean steam = record->install_path == NULL;
+    gpointer key = GINT_TO_POINTER(record->game_id);
+    gint position;
+
+    if (filter->field_matches && (!steam || !g_hash_table_contains(filter->field_matches, key))) {
+        return -1;
+    }
+    if (filter->title) {
+        gint score = search_query_score(filter->title, record->folded_name, record->search_mask);
+        if (score >= 0) {
+            return filter->store_count + score;
         }
-        fclose(file);
     }
-    return 0;
+    position = steam && filter->store_matches ? GPOINTER_TO_INT(g_hash_table_lookup(filter->store_matches, key)) : 0;
+    return position > 0 ? filter->store_count - position : -1;
+}
+
+// Identifies the selected and the topmost visible game across a reload
+typedef struct {
+    gboolean selected;
+    gboolean selected_non_steam;
+    int selected_id;
+    gboolean top;
+    gboolean top_non_steam;
+    int top_id;
+} ListPosition;
+
+static void save_list_position(AppWidgets *widgets, ListPosition *pos)
+{
+    GtkTreeView *view = GTK_TREE_VIEW(widgets->game_list_view);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(view);
+    GameRecord record;
+    GtkTreePath *start = NULL;
+    GtkTreeIter iter;
+
+    memset(pos, 0, sizeof(ListPosition));
+    if (gtk_tree_selection_get_selected(selection, NULL, &iter) &&
+        game_list_model_get_record(widgets->game_list_model, &iter, &record)) {
+        pos->selected = TRUE;
+        pos->selected_non_steam = record.install_path != NULL;
+        pos->selected_id = record.game_id;
+    }
+    if (gtk_tree_view_get_visible_range(view, &start, NULL)) {
+        if (gtk_tree_model_get_iter(GTK_TREE_MODEL(widgets->game_list_model), &iter, start) &&
+            game_list_model_get_record(widgets->game_list_model, &iter, &record)) {
+            pos->top = TRUE;
+            pos->top_non_steam = record.install_path != NULL;
+            pos->top_id = record.game_id;
+        }
+        gtk_tree_path_free(start);
+    }
+}
+
+static void restore_list_position(AppWidgets *widgets, const ListPosition *pos)
+{
+    GtkTreeView *view = GTK_TREE_VIEW(widgets->game_list_view);
+    GtkTreeIter iter;
+
+    if (pos->top && game_list_model_find(widgets->game_list_model, pos->top_non_steam, pos->top_id, &iter)) {
+        GtkTreePath *path = gtk_tree_model_get_path(GTK_TREE_MODEL(widgets->game_list_model), &iter);
+        gtk_tree_view_scroll_to_cell(view, path, NULL, TRUE, 0.0, 0.0);
+        gtk_tree_path_free(path);
+    }
+    if (pos->selected && game_list_model_find(widgets->game_list_model, pos->selected_non_steam, pos->selected_id, &iter)) {
+        gtk_tree_selection_select_iter(gtk_tree_view_get_selection(view), &iter);
+    }
 }
 
-// Retrieves or sets up the path to the configuration directory
-void get_config_path(char *out_path)
+// Apply the search entry text to the model. The model doesn't emit per-row
+// signals for bulk changes, so it's detached from the view meanwhile.
+static void apply_game_filter(AppWidgets *widgets)
 {
-    struct passwd *pw = getpwuid(getuid());
-    const char *XDG_CONFIG_HOME = getenv("XDG_CONFIG_HOME");
-    if (XDG_CONFIG_HOME) {
-        strcpy(out_path, XDG_CONFIG_HOME);
-        strcat(out_path, "/LVL");
+    TRACE_SCOPE("apply_game_filter");
+    const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(widgets->search_entry));
+    GtkTreeView *view = GTK_TREE_VIEW(widgets->game_list_view);
+
+    LibraryFilter *filter = library_filter_new(search_text);
+    LibraryFilter *previous = game_list_model_get_filter_data(widgets->game_list_model);
+
+    gtk_tree_view_set_model(view, NULL);
+    if (!filter) {
+        game_list_model_set_filter(widgets->game_list_model, NULL, NULL, NULL);  // Show all rows if search text is empty
+    } else if (previous && library_filter_narrows(filter, previous)) {
+        // Typing on only narrows the results, so search the previous ones
+        game_list_model_refine(widgets->game_list_model, score_game, filter, library_filter_free);
     } else {
-        strcpy(out_path, pw->pw_dir);
-        strcat(out_path, "/.config/LVL");
+        game_list_model_set_filter(widgets->game_list_model, score_game, filter, library_filter_free);
     }
-    mkdir_p(out_path, 0700);
+    gtk_tree_view_set_model(view, GTK_TREE_MODEL(widgets->game_list_model));
+    TRACE_COUNTER("games shown", gtk_tree_model_iter_n_children(GTK_TREE_MODEL(widgets->game_list_model), NULL));
 }
 
-// Initialize the database and load data
-int init_database(DB_Config *db_config)
+// Reload every game from the database into the list
+static void reload_game_list(AppWidgets *widgets)
 {
-    get_config_path(db_config->db_path);
-    strcat(db_config->db_path, "/games.db");
-    if (sqlite3_open(db_config->db_path, &db_config->db)) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db_config->db));
-        return 0;
+    TRACE_SCOPE("reload_game_list");
+    ListPosition pos;
+
+    save_list_position(widgets, &pos);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(widgets->game_list_view), NULL);
+    game_list_model_clear(widgets->game_list_model);
+    db_fetch_all_games(db_config.db, create_game_row, widgets->game_list_model);
+    db_fetch_last_played(db_config.db, set_game_last_played, widgets->game_list_model);
+    apply_game_filter(widgets);
+    restore_list_position(widgets, &pos);
+
+    // Nothing in the list points into the old snapshot any more
+    snapshot_close(library_snapshot);
+    library_snapshot = NULL;
+    snapshot_stale = TRUE;
+}
+
+// Append a game whose strings live in the mapped snapshot
+static void create_snapshot_row(int id, const char *name, const char *install_path, int playtime, void *user_data)
+{
+    GameListModel *model = (GameListModel *)user_data;
+    game_list_model_append_static(model, id, name, install_path, playtime);
+}
+
+// Show the games of a snapshot, which the list then keeps mapped
+static void load_game_list_snapshot(AppWidgets *widgets, Snapshot *snapshot)
+{
+    TRACE_SCOPE("load_game_list_snapshot");
+    ListPosition pos;
+
+    save_list_position(widgets, &pos);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(widgets->game_list_view), NULL);
+    game_list_model_clear(widgets->game_list_model);
+    snapshot_foreach(snapshot, create_snapshot_row, widgets->game_list_model);
+    apply_game_filter(widgets);
+    restore_list_position(widgets, &pos);
+
+    if (library_snapshot != snapshot) {
+        snapshot_close(library_snapshot);
+        library_snapshot = snapshot;
     }
-    create_table(db_config->db);
-    create_non_steam_table(db_config->db);
+    snapshot_stale = FALSE;
+}
 
-    return 1;
+static void collect_game_art(int game_id, const char *icon_hash, const char *capsule_hash, void *user_data)
+{
+    GameArtRow row = { game_id, g_strdup(icon_hash), g_strdup(capsule_hash) };
+    g_array_append_val((GArray *)user_data, row);
 }
 
-// Create a single row in the game list
-void create_game_row(int id, const char *name, const char *install_path, int playtime, void *user_data)
+static void clear_game_art_row(gpointer p)
 {
-    GtkWidget *game_list_box = (GtkWidget *)user_data;
-    GtkWidget *row = gtk_list_box_row_new();
-    GtkWidget *label = gtk_label_new(name);
+    GameArtRow *row = (GameArtRow *)p;
+    g_free(row->icon_hash);
+    g_free(row->capsule_hash);
+}
 
-    gtk_label_set_xalign(GTK_LABEL(label), 0.0); // Align text to the left
-    gtk_widget_set_hexpand(label, FALSE); // Do not expand horizontally
-    gtk_widget_set_halign(label, GTK_ALIGN_FILL); // Fill the horizontal space without expanding
-    gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END); // Ellipsize text at the end if it does not fit
+static void collect_last_played(DBGameSource source, int game_id, sqlite3_int64 last_played, void *user_data)
+{
+    LastPlayedRow row = { source, game_id, last_played };
+    g_array_append_val((GArray *)user_data, row);
+}
 
-    gtk_container_add(GTK_CONTAINER(row), label);
-    gtk_list_box_insert(GTK_LIST_BOX(game_list_box), row, -1);
-    g_object_set_data(G_OBJECT(row), "game_id", GINT_TO_POINTER(id));
-    g_object_set_data(G_OBJECT(row), "playtime", GINT_TO_POINTER(playtime));
-    g_object_set_data_full(G_OBJECT(row), "install_path", g_strdup(install_path), g_free);
+static void open_database_request_free(gpointer p)
+{
+    OpenDatabaseRequest *request = (OpenDatabaseRequest *)p;
+    g_array_unref(request->game_art);
+    g_array_unref(request->last_played);
+    g_free(request);
 }
 
-void clear_game_list(GtkWidget *game_list_box) {
-    gtk_container_foreach(GTK_CONTAINER(game_list_box), (GtkCallback)gtk_widget_destroy, NULL);
+// Runs off the GTK thread so the first frame doesn't wait for SQLite. The
+// snapshot is only rewritten when the database holds something else.
+static void open_database_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    TRACE_SCOPE("open_database_thread");
+    OpenDatabaseRequest *request = (OpenDatabaseRequest *)task_data;
+    SnapshotWriter *writer;
+    sqlite3 *db = init_database(db_config.db_path);
+
+    if (!db) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "Can't open database %s", db_config.db_path);
+        return;
+    }
+
+    // Installed games are known without the network, and before the first
+    // sync; the snapshot below picks them up
+    char steam_root[PATH_MAX];
+    if (steam_local_find_root(steam_root, sizeof(steam_root))) {
+        steam_local_import(db, steam_root);
+    }
+
+    writer = snapshot_writer_new();
+    db_fetch_all_games(db, snapshot_writer_add, writer);
+    if (!request->has_snapshot || snapshot_writer_hash(writer) != request->snapshot_hash) {
+        request->snapshot_written = snapshot_writer_commit(writer, db_config.snapshot_path);
+        request->snapshot_stale = !request->snapshot_written;
+    }
+    snapshot_writer_free(writer);
+
+    db_fetch_all_game_art(db, collect_game_art, request->game_art);
+    db_fetch_last_played(db, collect_last_played, request->last_played);
+
+    g_task_return_pointer(task, db, NULL);
 }
 
-// Function to filter game list based on search input
-static gboolean filter_games(GtkListBoxRow *row, gpointer data)
+static void on_steam_files_changed(const DBChange *changes, size_t count, gpointer data);
+static guint start_scheduled_sync(gboolean manual, gpointer data);
+static void schedule_store_sync(AppWidgets *widgets, guint delay);
+
+static void on_database_opened(GObject *source_object, GAsyncResult *result, gpointer data)
 {
-    const gchar *search_text = (const gchar *)data;
-    if (!search_text || g_strcmp0(search_text, "") == 0) {
-        return TRUE;  // Show all rows if search text is empty
+    OpenDatabaseRequest *request = g_task_get_task_data(G_TASK(result));
+    AppWidgets *widgets = request->widgets;
+    GError *error = NULL;
+    char steam_root[PATH_MAX];
+
+    db_config.db = g_task_propagate_pointer(G_TASK(result), &error);
+    if (!db_config.db) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return;
+    }
+    db_changes = db_change_log_attach(db_config.db);
+    if (steam_local_find_root(steam_root, sizeof(steam_root))) {
+        steam_watch = steam_watch_new(steam_root, db_config.db_path, on_steam_files_changed, widgets);
     }
+    sync_scheduler = sync_scheduler_new(db_config.db, start_scheduled_sync, widgets);
+    schedule_store_sync(widgets, 0);
 
-    GtkWidget *label = gtk_bin_get_child(GTK_BIN(row));
-    const gchar *game_name = gtk_label_get_text(GTK_LABEL(label));
-    if (!game_name) {
-        return FALSE;
+    // The rows drawn so far had no art to ask for
+    for (guint i = 0; i < request->game_art->len; i++) {
+        const GameArtRow *row = &g_array_index(request->game_art, GameArtRow, i);
+        artwork_cache_set_game(artwork, row->game_id, row->icon_hash, row->capsule_hash);
+    }
+    gtk_widget_queue_draw(widgets->game_list_view);
+
+    // Reconcile the list with the database if the snapshot was out of date
+    if (request->snapshot_written) {
+        Snapshot *snapshot = snapshot_open(db_config.snapshot_path);
+        if (snapshot) {
+            load_game_list_snapshot(widgets, snapshot);
+        } else {
+            request->snapshot_stale = TRUE;
+        }
+    }
+    if (request->snapshot_stale) {
+        reload_game_list(widgets);
+        return;
+    }
+
+    // The snapshot doesn't know when games were played
+    for (guint i = 0; i < request->last_played->len; i++) {
+        const LastPlayedRow *row = &g_array_index(request->last_played, LastPlayedRow, i);
+        game_list_model_set_last_played(widgets->game_list_model, row->source == DB_SOURCE_NON_STEAM,
+                                        row->game_id, row->last_played);
     }
+}
 
-    // Use case-insensitive comparison
-    gchar *lower_game_name = g_utf8_strdown(game_name, -1);
-    gchar *lower_search_text = g_utf8_strdown(search_text, -1);
-    gboolean contains = strstr(lower_game_name, lower_search_text) != NULL;
+static void open_database_async(AppWidgets *widgets)
+{
+    OpenDatabaseRequest *request = g_new0(OpenDatabaseRequest, 1);
+    GTask *task = g_task_new(NULL, NULL, on_database_opened, NULL);
+
+    request->widgets = widgets;
+    request->has_snapshot = library_snapshot != NULL;
+    request->snapshot_hash = library_snapshot ? snapshot_hash(library_snapshot) : 0;
+    request->game_art = g_array_new(FALSE, FALSE, sizeof(GameArtRow));
+    g_array_set_clear_func(request->game_art, clear_game_art_row);
+    request->last_played = g_array_new(FALSE, FALSE, sizeof(LastPlayedRow));
+
+    g_task_set_task_data(task, request, open_database_request_free);
+    g_task_run_in_thread(task, open_database_thread);
+    g_object_unref(task);
+}
 
-    g_free(lower_game_name);
-    g_free(lower_search_text);
+// Move a changed game to its current state in the list
+static void update_game_row(int id, const char *name, const char *install_path, int playtime, void *user_data)
+{
+    GameListModel *model = (GameListModel *)user_data;
+    game_list_model_update(model, id, name, install_path, playtime);
+}
 
-    return contains;
+static void set_game_art(int game_id, const char *icon_hash, const char *capsule_hash, void *user_data)
+{
+    artwork_cache_set_game((ArtworkCache *)user_data, game_id, icon_hash, capsule_hash);
+}
+
+// Apply committed database changes to the list one row at a time. Each
+// change is looked up again, so repeated or stale entries are harmless.
+static void apply_game_changes(AppWidgets *widgets, const DBChange *changes, size_t count)
+{
+    TRACE_SCOPE("apply_game_changes");
+    size_t i;
+
+    if (count > 0) {
+        snapshot_stale = TRUE;
+    }
+    // Past this, one reload is cheaper than moving rows around one by one
+    if (count > GAME_LIST_MAX_DELTA) {
+        reload_game_list(widgets);
+        db_fetch_all_game_art(db_config.db, set_game_art, artwork);
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        const DBChange *change = &changes[i];
+
+        if (change->type == DB_CHANGE_DELETE ||
+            !db_fetch_game(db_config.db, change->source, change->game_id, update_game_row, widgets->game_list_model)) {
+            game_list_model_remove(widgets->game_list_model, change->source == DB_SOURCE_NON_STEAM, change->game_id);
+            continue;
+        }
+        game_list_model_set_last_played(widgets->game_list_model, change->source == DB_SOURCE_NON_STEAM, change->game_id,
+                                        db_get_last_played(db_config.db, change->source, change->game_id));
+        if (change->source == DB_SOURCE_STEAM) {
+            db_fetch_game_art(db_config.db, change->game_id, set_game_art, artwork);
+        }
+    }
 }
 
 // Callback to quit GTK main loop
@@ -184,16 +574,33 @@ void on_window_destroy(GtkWidget *widget, gpointer data)
 static void on_search_entry_text_changed(GtkEntry *entry, gpointer data)
 {
     AppWidgets *appWidgets = (AppWidgets *)data;
-    if (!GTK_IS_SEARCH_ENTRY(entry) || !GTK_IS_LIST_BOX(appWidgets->game_list_box)) {
+    if (!GTK_IS_SEARCH_ENTRY(entry) || !GTK_IS_TREE_VIEW(appWidgets->game_list_view)) {
         g_warning("Invalid widget types or null pointers in search entry callback");
         return;
     }
 
-    const gchar *text = gtk_entry_get_text(entry); // Use 'entry' instead of 'widget'
-    gtk_list_box_set_filter_func(GTK_LIST_BOX(appWidgets->game_list_box), filter_games, (gpointer)text, NULL);
-    gtk_list_box_invalidate_filter(GTK_LIST_BOX(appWidgets->game_list_box));
+    apply_game_filter(appWidgets);
 }
 
+// Show the list in another order. The catalog keeps every order sorted, so
+// the view only has to be told to read it again.
+static void on_sort_changed(GtkComboBox *combo, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GtkTreeView *view = GTK_TREE_VIEW(widgets->game_list_view);
+    ListPosition pos;
+
+    save_list_position(widgets, &pos);
+    // Whatever was on top moved away; the selection is what to keep in view
+    pos.top = pos.selected;
+    pos.top_non_steam = pos.selected_non_steam;
+    pos.top_id = pos.selected_id;
+
+    gtk_tree_view_set_model(view, NULL);
+    game_list_model_set_sort(widgets->game_list_model, (CatalogSort)gtk_combo_box_get_active(combo));
+    gtk_tree_view_set_model(view, GTK_TREE_MODEL(widgets->game_list_model));
+    restore_list_position(widgets, &pos);
+}
 
 // Navigation button callback
 void on_button_clicked(GtkWidget *widget, gpointer data)
@@ -203,29 +610,182 @@ void on_button_clicked(GtkWidget *widget, gpointer data)
     gtk_stack_set_visible_child_name(stack, page_name);
 }
 
+static void show_steam_install(int game_id, const char *install_dir, sqlite3_int64 size_on_disk, int installed, void *data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    char *size = g_format_size((guint64)size_on_disk);
+    char *text = g_strdup_printf(installed ? "Installed, %s\n%s" : "Partly installed, %s\n%s", size, install_dir);
+
+    gtk_label_set_text(GTK_LABEL(widgets->install_label), text);
+    g_free(text);
+    g_free(size);
+}
+
+static void show_store_details(const StoreDetails *details, void *data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GString *text = g_string_new(NULL);
+
+    if (details->genres) {
+        g_string_append_printf(text, "%s\n", details->genres);
+    }
+    if (details->developers) {
+        g_string_append_printf(text, "By %s\n", details->developers);
+    }
+    if (details->release_date && *details->release_date) {
+        g_string_append_printf(text, "Released %s\n", details->release_date);
+    }
+    if (details->description) {
+        g_string_append_printf(text, "\n%s", details->description);
+    }
+    gtk_label_set_text(GTK_LABEL(widgets->store_label), g_strchomp(text->str));
+    g_string_free(text, TRUE);
+}
+
+static void append_launch_duration(GString *text, int ms)
+{
+    if (ms < 1000) {
+        g_string_append_printf(text, "%d ms", ms);
+    } else {
+        g_string_append_printf(text, "%.1f s", ms / 1000.0);
+    }
+}
+
+static void show_launch_stats(AppWidgets *widgets, DBGameSource source, int game_id)
+{
+    static const char *phase_names[DB_LAUNCH_N_PHASES] = { "Started", "First process", "First window" };
+    LaunchStats stats;
+    GString *text;
+    int p;
+
+    gtk_label_set_text(GTK_LABEL(widgets->launch_label), "");
+    if (!db_config.db || !db_fetch_launch_stats(db_config.db, source, game_id, LAUNCH_STATS_WINDOW, &stats)) {
+        return;
+    }
+    text = g_string_new(NULL);
+    g_string_append_printf(text, "Launch times over the last %d launches:", stats.launches);
+    for (p = 0; p < DB_LAUNCH_N_PHASES; p++) {
+        if (stats.count[p] == 0) {
+            continue;
+        }
+        g_string_append_printf(text, "\n%s: median ", phase_names[p]);
+        append_launch_duration(text, stats.p50_ms[p]);
+        g_string_append(text, ", 90% ");
+        append_launch_duration(text, stats.p90_ms[p]);
+        g_string_append(text, ", last ");
+        if (stats.last_ms[p] >= 0) {
+            append_launch_duration(text, stats.last_ms[p]);
+        } else {
+            g_string_append(text, "not seen");
+        }
+    }
+    gtk_label_set_text(GTK_LABEL(widgets->launch_label), text->str);
+    g_string_free(text, TRUE);
+}
+
+static void show_resource_summary(AppWidgets *widgets, DBGameSource source, int game_id)
+{
+    ResourceSummary summary;
+    char *memory, *read, *written, *text;
+
+    gtk_label_set_text(GTK_LABEL(widgets->resource_label), "");
+    if (!db_config.db || !db_fetch_resource_summary(db_config.db, source, game_id, &summary)) {
+        return;
+    }
+    memory = g_format_size((guint64)summary.peak_rss_kb * 1024);
+    read = g_format_size((guint64)summary.read_kb * 1024);
+    written = g_format_size((guint64)summary.write_kb * 1024);
+    text = g_strdup_printf("Over %d sampled sessions, %.1f hours:\n"
+                           "%.2f cores busy on average, up to %s of memory and %d threads\n"
+                           "%s read and %s written",
+                           summary.sessions, summary.seconds / 3600.0,
+                           summary.seconds > 0 ? summary.cpu_ms / 1000.0 / summary.seconds : 0.0,
+                           memory, summary.peak_threads, read, written);
+    gtk_label_set_text(GTK_LABEL(widgets->resource_label), text);
+    g_free(text);
+    g_free(written);
+    g_free(read);
+    g_free(memory);
+}
+
 // Game selection callback
-void on_game_selected(GtkListBox *box, GtkListBoxRow *row, gpointer data)
+void on_game_selected(GtkTreeSelection *selection, gpointer data)
 {
-    if (!row) return;
     AppWidgets *widgets = (AppWidgets *)data;
-    gpointer game_id_ptr = g_object_get_data(G_OBJECT(row), "game_id");
-    gpointer playtime_ptr = g_object_get_data(G_OBJECT(row), "playtime");
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    GameRecord game;
+    const GameRecord *record = game_list_model_get_record(widgets->game_list_model, &iter, &game) ? &game : NULL;
 
-    if (game_id_ptr != NULL) {
-        int game_id = GPOINTER_TO_INT(game_id_ptr); // Convert back from pointer to integer
-        int playtime = GPOINTER_TO_INT(playtime_ptr);
-        g_print("Selected game ID: %d\n", game_id);
+    if (record != NULL) {
+        g_print("Selected game ID: %d\n", record->game_id);
         g_free((gchar*)selected_game_id);
-        selected_game_id = g_strdup_printf("%d", game_id); // Store game ID as a string for other uses
+        selected_game_id = g_strdup_printf("%d", record->game_id); // Store game ID as a string for other uses
 
-        const char *game_title_text = gtk_label_get_text(GTK_LABEL(gtk_bin_get_child(GTK_BIN(row))));
-        char *formatted_title = g_markup_printf_escaped("<span font='16'>%s</span>", game_title_text);
+        char *formatted_title = g_markup_printf_escaped("<span font='16'>%s</span>", record->name);
         gtk_label_set_markup(GTK_LABEL(widgets->game_title_label), formatted_title);
         g_free(formatted_title);
 
-        char *formatted_playtime = g_strdup_printf("Playtime: %d minutes", playtime);
+        // Shown once loaded, through on_artwork_ready
+        GdkPixbuf *capsule = record->install_path ? NULL : artwork_cache_get(artwork, record->game_id, ARTWORK_CAPSULE);
+        gtk_image_set_from_pixbuf(GTK_IMAGE(widgets->game_art_image), capsule);
+
+        char *formatted_playtime = g_strdup_printf("Playtime: %d minutes", record->playtime);
         gtk_label_set_text(GTK_LABEL(widgets->playtime_label), formatted_playtime);
         g_free(formatted_playtime);
+
+        gtk_label_set_text(GTK_LABEL(widgets->install_label), "");
+        if (!record->install_path && db_config.db &&
+            !db_fetch_steam_install(db_config.db, record->game_id, show_steam_install, widgets)) {
+            gtk_label_set_text(GTK_LABEL(widgets->install_label), "Not installed");
+        }
+        gtk_label_set_text(GTK_LABEL(widgets->store_label), "");
+        if (!record->install_path && db_config.db) {
+            db_fetch_store_details(db_config.db, record->game_id, show_store_details, widgets);
+        }
+        show_launch_stats(widgets, record->install_path ? DB_SOURCE_NON_STEAM : DB_SOURCE_STEAM, record->game_id);
+        show_resource_summary(widgets, record->install_path ? DB_SOURCE_NON_STEAM : DB_SOURCE_STEAM, record->game_id);
+
+        // A non-Steam game can only run once at a time
+        gboolean running = record->install_path && launcher_is_running(launcher, record->game_id);
+        gtk_button_set_label(GTK_BUTTON(widgets->run_command_button), running ? "Running" : "Play");
+        gtk_widget_set_sensitive(widgets->run_command_button, !running);
+    }
+}
+
+// Art finished loading: redraw its row, or show it if it's the selected
+// game's capsule
+static void on_artwork_ready(int game_id, ArtworkKind kind, const char *new_hash, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GtkTreeModel *model = GTK_TREE_MODEL(widgets->game_list_model);
+    GtkTreeSelection *selection;
+    GameRecord record;
+    GtkTreeIter iter;
+
+    if (kind == ARTWORK_ICON) {
+        if (game_list_model_find(widgets->game_list_model, FALSE, game_id, &iter)) {
+            GtkTreePath *path = gtk_tree_model_get_path(model, &iter);
+            gtk_tree_model_row_changed(model, path, &iter);
+            gtk_tree_path_free(path);
+        }
+        return;
+    }
+
+    // Remember which file the capsule went to, so it isn't downloaded again
+    if (new_hash && db_config.db && db_set_capsule_hash(db_config.db, game_id, new_hash)) {
+        size_t count;
+        DBChange *changes = db_change_log_take(db_changes, &count);
+        apply_game_changes(widgets, changes, count);
+        free(changes);
+    }
+    selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widgets->game_list_view));
+    if (gtk_tree_selection_get_selected(selection, NULL, &iter) &&
+        game_list_model_get_record(widgets->game_list_model, &iter, &record) &&
+        !record.install_path && record.game_id == game_id) {
+        gtk_image_set_from_pixbuf(GTK_IMAGE(widgets->game_art_image), artwork_cache_get(artwork, game_id, ARTWORK_CAPSULE));
     }
 }
 
@@ -233,22 +793,42 @@ void on_game_selected(GtkListBox *box, GtkListBoxRow *row, gpointer data)
 void on_run_command_clicked(GtkWidget *widget, gpointer data)
 {
     AppWidgets *widgets = (AppWidgets *)data;
-    GtkListBoxRow *selected_row = gtk_list_box_get_selected_row(GTK_LIST_BOX(widgets->game_list_box));
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widgets->game_list_view));
+    gint64 clicked_at = g_get_monotonic_time();
+    const GameRecord *record = NULL;
+    GameRecord game;
+    GtkTreeIter iter;
+
+    if (gtk_tree_selection_get_selected(selection, NULL, &iter) &&
+        game_list_model_get_record(widgets->game_list_model, &iter, &game)) {
+        record = &game;
+    }
 
-    if (selected_row) {
-        int game_id = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(selected_row), "game_id"));
-        char *install_path_ptr = g_object_get_data(G_OBJECT(selected_row), "install_path");
+    if (record) {
+        int game_id = record->game_id;
+        const char *install_path_ptr = record->install_path;
 
         if (install_path_ptr && strlen(install_path_ptr) > 0) {
-            // Non-Steam game with a path
+            // Non-Steam game with a path; its session is recorded once it exits
+            GError *error = NULL;
+
             g_print("Running non-Steam game with command: %s\n", install_path_ptr);
-            system(install_path_ptr);
+            if (launcher_run(launcher, game_id, install_path_ptr, &error)) {
+                launch_timer_track(launch_timer, DB_SOURCE_NON_STEAM, game_id, clicked_at,
+                                   launcher_get_pgid(launcher, game_id));
+                on_game_selected(selection, widgets);
+            } else {
+                fprintf(stderr, "Failed to run %s: %s\n", record->name, error->message);
+                g_error_free(error);
+            }
         } else if (game_id) {
             // It's a Steam game, execute the Steam URI
             char command[256];
             snprintf(command, sizeof(command), "steam://rungameid/%d", game_id);
             g_print("Opening Steam game with ID: %d\n", game_id);
-            open_uri(command);
+            if (open_uri(command)) {
+                launch_timer_track(launch_timer, DB_SOURCE_STEAM, game_id, clicked_at, 0);
+            }
         } else {
             g_print("No valid command or game ID found!\n");
         }
@@ -257,38 +837,428 @@ void on_run_command_clicked(GtkWidget *widget, gpointer data)
     }
 }
 
-void on_save_settings_clicked(GtkWidget *widget, gpointer data)
+// A non-Steam game has exited: store the session and show the new playtime
+static void on_game_exited(int game_id, gint64 started_at, gint64 ended_at, gpointer data)
 {
     AppWidgets *widgets = (AppWidgets *)data;
-    const char *api_key = gtk_entry_get_text(GTK_ENTRY(widgets->api_key_entry));
-    const char *steam_id = gtk_entry_get_text(GTK_ENTRY(widgets->steam_id_entry));
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widgets->game_list_view));
+
+    g_print("Game %d exited after %" G_GINT64_FORMAT " seconds\n", game_id, ended_at - started_at);
+    if (db_config.db && db_record_play_session(db_config.db, DB_SOURCE_NON_STEAM, game_id, started_at, ended_at)) {
+        size_t count;
+        DBChange *changes = db_change_log_take(db_changes, &count);
+        apply_game_changes(widgets, changes, count);
+        free(changes);
+    }
+    on_game_selected(selection, widgets);
+}
 
-    if (!validate_steam_credentials(api_key, steam_id)) {
-        // If validation fails, show an error message
-        GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(widgets->window),
-                                                   GTK_DIALOG_DESTROY_WITH_PARENT,
-                                                   GTK_MESSAGE_ERROR,
-                                                   GTK_BUTTONS_CLOSE,
-                                                   "Invalid Steam API Key or Steam ID. Please check your input.");
-        gtk_dialog_run(GTK_DIALOG(dialog));
-        gtk_widget_destroy(dialog);
-        return; // Stop further processing
+// A game launched from the library has its first process: sample it
+static void on_launch_started(DBGameSource source, int game_id, GPid pid, GPid pgid, gpointer data)
+{
+    if (session_sampler) {
+        session_sampler_start(session_sampler, source, game_id, pid, pgid);
     }
+}
+
+static gboolean is_selected_game(AppWidgets *widgets, DBGameSource source, int game_id)
+{
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widgets->game_list_view));
+    GameRecord record;
+    GtkTreeIter iter;
+
+    return gtk_tree_selection_get_selected(selection, NULL, &iter) &&
+           game_list_model_get_record(widgets->game_list_model, &iter, &record) &&
+           record.game_id == game_id && (record.install_path ? DB_SOURCE_NON_STEAM : DB_SOURCE_STEAM) == source;
+}
+
+// Samples of a running game, a batch at a time; without a database they
+// are dropped
+static void on_resource_samples(ResourceSession *session, const ResourceSample *samples, size_t count,
+                                gboolean ended, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+
+    if (!db_config.db || !db_add_resource_samples(db_config.db, session, samples, count)) {
+        return;
+    }
+    if (ended && is_selected_game(widgets, session->source, session->game_id)) {
+        show_resource_summary(widgets, session->source, session->game_id);
+    }
+}
 
+// A launch from the library came up, or gave up waiting for its window
+static void on_launch_timed(const LaunchTiming *timing, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+
+    if (timing->phase_ms[DB_LAUNCH_WINDOW] >= 0) {
+        g_print("Game %d showed its window after %d ms\n", timing->game_id, timing->phase_ms[DB_LAUNCH_WINDOW]);
+    } else {
+        g_print("Game %d started after %d ms; no window seen\n", timing->game_id, timing->phase_ms[DB_LAUNCH_PROCESS]);
+    }
+    if (!db_config.db || !db_record_launch(db_config.db, timing)) {
+        return;
+    }
+    if (is_selected_game(widgets, timing->source, timing->game_id)) {
+        show_launch_stats(widgets, timing->source, timing->game_id);
+    }
+}
+
+// The Steam client installed, removed or played something
+static void on_steam_files_changed(const DBChange *changes, size_t count, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widgets->game_list_view));
+
+    apply_game_changes(widgets, changes, count);
+    on_game_selected(selection, widgets);
+}
+
+// Sync progress reported from the worker thread through the main context
+static void on_sync_progress(SteamStage stage, size_t done, size_t total, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GtkProgressBar *bar = GTK_PROGRESS_BAR(widgets->sync_progress_bar);
+    char *text;
+
+    if (!widgets->sync_cancellable) {
+        return;  // Late update from a sync that already finished
+    }
+
+    if (stage == STEAM_STAGE_DOWNLOAD) {
+        if (total > 0) {
+            gtk_progress_bar_set_fraction(bar, (double)done / total);
+        } else {
+            gtk_progress_bar_pulse(bar);
+        }
+        text = g_strdup_printf("Downloading library... %zu KB", done / 1024);
+    } else {
+        gtk_progress_bar_set_fraction(bar, total > 0 ? (double)done / total : 1.0);
+        text = g_strdup_printf("Importing games (%zu/%zu)", done, total);
+    }
+    gtk_progress_bar_set_text(bar, text);
+    g_free(text);
+}
+
+// What a sync error means for when to try again
+static SyncOutcome sync_error_outcome(const GError *error)
+{
+    if (!error) {
+        return SYNC_OUTCOME_OK;
+    } else if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        return SYNC_OUTCOME_CANCELLED;
+    } else if (g_error_matches(error, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_INVALID_CREDENTIALS)) {
+        return SYNC_OUTCOME_REJECTED;
+    } else if (g_error_matches(error, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_RATE_LIMITED)) {
+        return SYNC_OUTCOME_RATE_LIMITED;
+    } else if (g_error_matches(error, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_UNAVAILABLE)) {
+        return SYNC_OUTCOME_UNAVAILABLE;
+    }
+    return SYNC_OUTCOME_FAILED;
+}
+
+// One account of the running sync is done; its games are already committed
+static void on_sync_account_done(const SteamAccount *account, const GError *error, const SteamSyncDelta *delta,
+                                 const DBChange *changes, size_t count, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+
+    widgets->sync_outcome = MAX(widgets->sync_outcome, sync_error_outcome(error));
+    if (g_error_matches(error, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_INVALID_CREDENTIALS)) {
+        if (widgets->sync_rejected) {
+            g_ptr_array_add(widgets->sync_rejected, g_strdup(account->steam_id));
+        }
+    } else if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        fprintf(stderr, "Steam sync of %s failed: %s\n", account->steam_id, error->message);
+    } else if (!error && widgets->sync_cancellable) {
+        char *text = g_strdup_printf("%zu added, %zu updated, %zu removed", delta->added, delta->updated, delta->removed);
+        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(widgets->sync_progress_bar), text);
+        g_free(text);
+    }
+
+    apply_game_changes(widgets, changes, count);
+}
+
+static gboolean is_rejected(GPtrArray *rejected, const char *steam_id)
+{
+    for (guint i = 0; i < rejected->len; i++) {
+        if (strcmp(g_ptr_array_index(rejected, i), steam_id) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// The saved accounts changed: drop the games and playtime of those that are gone
+static void forget_removed_accounts(AppWidgets *widgets, GArray *accounts)
+{
+    const char **kept = g_new(const char *, accounts->len + 1);
+    size_t count;
+    DBChange *changes;
+
+    for (guint i = 0; i < accounts->len; i++) {
+        kept[i] = g_array_index(accounts, SteamAccount, i).steam_id;
+    }
+    if (db_config.db && db_forget_steam_accounts(db_config.db, kept, accounts->len)) {
+        changes = db_change_log_take(db_changes, &count);
+        apply_game_changes(widgets, changes, count);
+        free(changes);
+    }
+    g_free(kept);
+}
+
+// Makes accounts the saved ones, forgetting the library of any left out
+static void save_accounts(AppWidgets *widgets, GArray *accounts)
+{
     char config_path[PATH_MAX];
     get_config_path(config_path);
     strcat(config_path, "/config.txt");
 
-    write_config(config_path, api_key, steam_id);
+    write_config(config_path, (const SteamAccount *)accounts->data, accounts->len);
+    forget_removed_accounts(widgets, accounts);
+}
+
+static void on_sync_finished(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+    SyncRequest *request = (SyncRequest *)data;
+    AppWidgets *widgets = request->widgets;
+    GPtrArray *rejected = widgets->sync_rejected;
+    GError *error = NULL;
+    SyncOutcome outcome;
+
+    steam_sync_finish(result, &error);
+    outcome = MAX(widgets->sync_outcome, sync_error_outcome(error));
+
+    g_clear_object(&widgets->sync_cancellable);
+    widgets->sync_rejected = NULL;
+    gtk_widget_set_sensitive(widgets->save_settings_button, TRUE);
+    gtk_widget_hide(widgets->sync_progress_bar);
+    gtk_widget_hide(widgets->sync_cancel_button);
+
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_print("Steam sync cancelled\n");
+    } else if (!request->manual) {
+        // Scheduled syncs use the saved accounts; only the settings page changes them
+        if (error && !g_error_matches(error, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_INVALID_CREDENTIALS)) {
+            fprintf(stderr, "Steam sync failed: %s\n", error->message);
+        }
+        for (guint i = 0; i < rejected->len; i++) {
+            fprintf(stderr, "Invalid Steam API Key or Steam ID for %s\n", (const char *)g_ptr_array_index(rejected, i));
+        }
+    } else {
+        if (error && !g_error_matches(error, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_INVALID_CREDENTIALS)) {
+            fprintf(stderr, "Steam sync failed: %s\n", error->message);
+        }
+
+        // Keep every account whose credentials weren't refused
+        GArray *accepted = steam_account_array_new();
+        for (guint i = 0; i < request->accounts->len; i++) {
+            const SteamAccount *account = &g_array_index(request->accounts, SteamAccount, i);
+            if (!is_rejected(rejected, account->steam_id)) {
+                steam_account_array_add(accepted, account->api_key, account->steam_id);
+            }
+        }
+        if (accepted->len > 0 || rejected->len == 0) {
+            save_accounts(widgets, accepted);
+        }
+        g_array_unref(accepted);
+
+        if (rejected->len > 0) {
+            // If validation fails, show an error message
+            g_ptr_array_add(rejected, NULL);
+            char *ids = g_strjoinv(", ", (char **)rejected->pdata);
+            GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(widgets->window),
+                                                       GTK_DIALOG_DESTROY_WITH_PARENT,
+                                                       GTK_MESSAGE_ERROR,
+                                                       GTK_BUTTONS_CLOSE,
+                                                       "Invalid Steam API Key or Steam ID for %s. Please check your input.", ids);
+            gtk_dialog_run(GTK_DIALOG(dialog));
+            gtk_widget_destroy(dialog);
+            g_free(ids);
+        }
+    }
+
+    g_ptr_array_unref(rejected);
+    g_clear_error(&error);
+    g_array_unref(request->accounts);
+    g_free(request);
+    sync_scheduler_finished(sync_scheduler, outcome);
+    if (outcome == SYNC_OUTCOME_OK) {
+        schedule_store_sync(widgets, 0);  // New games have no store details yet
+    }
+}
+
+static void on_store_synced(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GError *error = NULL;
+    gboolean more = FALSE;
+    gssize stored = store_sync_finish(result, &more, &error);
+
+    g_clear_object(&store_sync_cancellable);
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        g_error_free(error);
+        return;
+    }
+    if (error) {
+        fprintf(stderr, "Fetching store details failed: %s\n", error->message);
+        g_error_free(error);
+        schedule_store_sync(widgets, STORE_SYNC_RETRY);
+        return;
+    }
+
+    if (stored > 0) {
+        const gchar *search_text = gtk_entry_get_text(GTK_ENTRY(widgets->search_entry));
 
-    fetch_data_from_steam_api(api_key, steam_id, db_config.db);
+        // Searches and the details pane may have more to show now
+        if (*search_text) {
+            ListPosition pos;
 
-    // Clear the existing list of games
-    clear_game_list(widgets->game_list_box);
+            save_list_position(widgets, &pos);
+            apply_game_filter(widgets);
+            restore_list_position(widgets, &pos);
+        }
+        GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(widgets->game_list_view));
+        GameRecord record;
+        GtkTreeIter iter;
 
-    // Fetch games with new API key and Steam ID and repopulate the list
-    db_fetch_all_games(db_config.db_path, create_game_row, widgets->game_list_box);
-    gtk_widget_show_all(widgets->window);
+        if (gtk_tree_selection_get_selected(selection, NULL, &iter) &&
+            game_list_model_get_record(widgets->game_list_model, &iter, &record) && !record.install_path) {
+            db_fetch_store_details(db_config.db, record.game_id, show_store_details, widgets);
+        }
+    }
+    if (more) {
+        schedule_store_sync(widgets, STORE_SYNC_PAUSE);
+    }
+}
+
+static gboolean start_store_sync(gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+
+    store_sync_source = 0;
+    if (store_sync_cancellable) {
+        return G_SOURCE_REMOVE;  // Already running; it schedules the next batch itself
+    }
+    if (!store_client) {
+        store_client = http_client_new();
+    }
+    store_sync_cancellable = g_cancellable_new();
+    store_sync_started = g_get_monotonic_time();
+    store_sync_async(store_client, http_cache, db_config.db_path, STORE_SYNC_BATCH, store_sync_cancellable,
+                     on_store_synced, widgets);
+    return G_SOURCE_REMOVE;
+}
+
+// Fetches the next batch of store details in delay seconds, but never
+// sooner than STORE_SYNC_PAUSE after the last batch started
+static void schedule_store_sync(AppWidgets *widgets, guint delay)
+{
+    if (store_sync_source || store_sync_cancellable) {
+        return;
+    }
+    if (store_sync_started) {
+        gint64 since = (g_get_monotonic_time() - store_sync_started) / G_USEC_PER_SEC;
+        delay = MAX(delay, (guint)MAX(STORE_SYNC_PAUSE - since, 0));
+    }
+    store_sync_source = g_timeout_add_seconds(delay, start_store_sync, widgets);
+}
+
+// The accounts filled in on the settings page; rows without both fields are skipped
+static GArray *get_settings_accounts(AppWidgets *widgets)
+{
+    GArray *accounts = steam_account_array_new();
+    GList *rows = gtk_container_get_children(GTK_CONTAINER(widgets->accounts_box));
+
+    for (GList *row = rows; row; row = row->next) {
+        GtkWidget *api_key_entry = g_object_get_data(G_OBJECT(row->data), "api-key-entry");
+        GtkWidget *steam_id_entry = g_object_get_data(G_OBJECT(row->data), "steam-id-entry");
+        const char *api_key = gtk_entry_get_text(GTK_ENTRY(api_key_entry));
+        const char *steam_id = gtk_entry_get_text(GTK_ENTRY(steam_id_entry));
+
+        if (*api_key && *steam_id) {
+            steam_account_array_add(accounts, api_key, steam_id);
+        }
+    }
+    g_list_free(rows);
+    return accounts;
+}
+
+// Starts the sync the scheduler decided on. Returns the number of Steam API
+// requests it makes: a player summary and the owned games per account.
+static guint start_scheduled_sync(gboolean manual, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    SyncRequest *request;
+
+    if (widgets->sync_cancellable) {
+        return 0;  // A sync is already running
+    }
+
+    request = g_new(SyncRequest, 1);
+    request->widgets = widgets;
+    request->manual = manual;
+    request->accounts = manual ? get_settings_accounts(widgets) : read_saved_accounts();
+    if (request->accounts->len == 0) {
+        if (manual) {
+            fprintf(stderr, "No Steam account to sync\n");
+        }
+        g_array_unref(request->accounts);
+        g_free(request);
+        return 0;
+    }
+
+    widgets->sync_cancellable = g_cancellable_new();
+    widgets->sync_rejected = g_ptr_array_new_with_free_func(g_free);
+    widgets->sync_outcome = SYNC_OUTCOME_OK;
+    gtk_widget_set_sensitive(widgets->save_settings_button, FALSE);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(widgets->sync_progress_bar), 0.0);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(widgets->sync_progress_bar), "Validating credentials...");
+    gtk_widget_show(widgets->sync_progress_bar);
+    gtk_widget_show(widgets->sync_cancel_button);
+
+    // Validation, download and import all happen off the GTK thread, for
+    // every account at once
+    steam_sync_async(http_client, http_cache, db_config.db_path,
+                     (const SteamAccount *)request->accounts->data, request->accounts->len, widgets->sync_cancellable,
+                     on_sync_progress, on_sync_account_done, widgets, on_sync_finished, request);
+    return request->accounts->len * 2;
+}
+
+void on_save_settings_clicked(GtkWidget *widget, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GArray *accounts;
+
+    if (widgets->sync_cancellable) {
+        return;  // A sync is already running
+    }
+    if (!sync_scheduler) {
+        fprintf(stderr, "The database isn't open yet\n");
+        return;
+    }
+
+    // With every account removed there is nothing to sync, only to forget
+    accounts = get_settings_accounts(widgets);
+    if (accounts->len == 0) {
+        save_accounts(widgets, accounts);
+        g_array_unref(accounts);
+        return;
+    }
+    g_array_unref(accounts);
+
+    // Runs right away unless the Steam API rate limit is used up
+    sync_scheduler_request(sync_scheduler);
+}
+
+void on_cancel_sync_clicked(GtkWidget *widget, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+
+    if (widgets->sync_cancellable) {
+        g_cancellable_cancel(widgets->sync_cancellable);
+    }
 }
 
 void on_add_game_clicked(GtkWidget *widget, gpointer data)
@@ -304,6 +1274,11 @@ void on_add_game_clicked(GtkWidget *widget, gpointer data)
         return;
     }
 
+    if (!db_config.db) {
+        fprintf(stderr, "The database isn't open yet\n");
+        return;
+    }
+
     int playtime = atoi(playtime_str);
 
     // Call to insert into database
@@ -311,15 +1286,11 @@ void on_add_game_clicked(GtkWidget *widget, gpointer data)
 
     printf("added game: %s\n", game_name);
 
-    // Clear the existing list of games
-    clear_game_list(widgets->game_list_box);
-
-    printf("cleared game list\n");
-
-    db_fetch_all_games(db_config.db_path, create_game_row, widgets->game_list_box);
-    printf("fetched games\n");
-    gtk_widget_show_all(widgets->game_list_box);
-    printf("showed games\n");
+    // Only the new game is added to the list, in sorted position
+    size_t count;
+    DBChange *changes = db_change_log_take(db_changes, &count);
+    apply_game_changes(widgets, changes, count);
+    free(changes);
 }
 
 // Initialize GTK and configure widgets
@@ -380,26 +1351,74 @@ GtkWidget* create_about_page()
     return vbox;
 }
 
-GtkWidget* create_settings_page(AppWidgets *appWidgets)
+static void on_remove_account_clicked(GtkWidget *widget, gpointer data)
 {
-    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_widget_destroy(GTK_WIDGET(data));
+}
+
+// Add a row of entries for one Steam account to the settings page
+static void add_account_row(AppWidgets *appWidgets, const char *api_key, const char *steam_id)
+{
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
 
     GtkWidget *api_key_entry = gtk_entry_new();
     gtk_entry_set_placeholder_text(GTK_ENTRY(api_key_entry), "Enter Steam API Key");
-    gtk_box_pack_start(GTK_BOX(vbox), api_key_entry, FALSE, FALSE, 0);
+    gtk_entry_set_text(GTK_ENTRY(api_key_entry), api_key ? api_key : "");
+    gtk_box_pack_start(GTK_BOX(row), api_key_entry, TRUE, TRUE, 0);
 
     GtkWidget *steam_id_entry = gtk_entry_new();
     gtk_entry_set_placeholder_text(GTK_ENTRY(steam_id_entry), "Enter Steam ID");
-    gtk_box_pack_start(GTK_BOX(vbox), steam_id_entry, FALSE, FALSE, 0);
+    gtk_entry_set_text(GTK_ENTRY(steam_id_entry), steam_id ? steam_id : "");
+    gtk_box_pack_start(GTK_BOX(row), steam_id_entry, TRUE, TRUE, 0);
+
+    GtkWidget *remove_button = gtk_button_new_with_label("Remove");
+    gtk_box_pack_start(GTK_BOX(row), remove_button, FALSE, FALSE, 0);
+    g_signal_connect(remove_button, "clicked", G_CALLBACK(on_remove_account_clicked), row);
+
+    g_object_set_data(G_OBJECT(row), "api-key-entry", api_key_entry);
+    g_object_set_data(G_OBJECT(row), "steam-id-entry", steam_id_entry);
+    gtk_box_pack_start(GTK_BOX(appWidgets->accounts_box), row, FALSE, FALSE, 0);
+    gtk_widget_show_all(row);
+}
+
+static void on_add_account_clicked(GtkWidget *widget, gpointer data)
+{
+    add_account_row((AppWidgets *)data, NULL, NULL);
+}
+
+GtkWidget* create_settings_page(AppWidgets *appWidgets)
+{
+    GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+
+    // Steam accounts, all synced together
+    GtkWidget *accounts_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), accounts_box, FALSE, FALSE, 0);
+    appWidgets->accounts_box = accounts_box;
+
+    GtkWidget *add_account_button = gtk_button_new_with_label("Add Steam Account");
+    gtk_box_pack_start(GTK_BOX(vbox), add_account_button, FALSE, FALSE, 0);
+    g_signal_connect(add_account_button, "clicked", G_CALLBACK(on_add_account_clicked), appWidgets);
 
     GtkWidget *save_button = gtk_button_new_with_label("Save Steam Settings");
     gtk_box_pack_start(GTK_BOX(vbox), save_button, FALSE, FALSE, 0);
 
+    // Sync progress and cancellation, only shown while a sync is running
+    GtkWidget *sync_progress_bar = gtk_progress_bar_new();
+    gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(sync_progress_bar), TRUE);
+    gtk_widget_set_no_show_all(sync_progress_bar, TRUE);
+    gtk_box_pack_start(GTK_BOX(vbox), sync_progress_bar, FALSE, FALSE, 0);
+
+    GtkWidget *sync_cancel_button = gtk_button_new_with_label("Cancel Sync");
+    gtk_widget_set_no_show_all(sync_cancel_button, TRUE);
+    gtk_box_pack_start(GTK_BOX(vbox), sync_cancel_button, FALSE, FALSE, 0);
+
     // Save callback
     g_signal_connect(save_button, "clicked", G_CALLBACK(on_save_settings_clicked), appWidgets);
+    g_signal_connect(sync_cancel_button, "clicked", G_CALLBACK(on_cancel_sync_clicked), appWidgets);
 
-    appWidgets->api_key_entry = api_key_entry;
-    appWidgets->steam_id_entry = steam_id_entry;
+    appWidgets->save_settings_button = save_button;
+    appWidgets->sync_progress_bar = sync_progress_bar;
+    appWidgets->sync_cancel_button = sync_cancel_button;
 
     // Entry for game name
     GtkWidget *game_name_entry = gtk_entry_new();
@@ -430,6 +1449,20 @@ GtkWidget* create_settings_page(AppWidgets *appWidgets)
     return vbox;
 }
 
+// Icons are only asked for here, so only the rows being drawn load theirs
+static void render_game_icon(GtkTreeViewColumn *column, GtkCellRenderer *cell, GtkTreeModel *model,
+                             GtkTreeIter *iter, gpointer data)
+{
+    AppWidgets *widgets = (AppWidgets *)data;
+    GameRecord record;
+    GdkPixbuf *icon = NULL;
+
+    if (game_list_model_get_record(widgets->game_list_model, iter, &record) && !record.install_path) {
+        icon = artwork_cache_get(artwork, record.game_id, ARTWORK_ICON);
+    }
+    g_object_set(cell, "pixbuf", icon, NULL);
+}
+
 GtkWidget* create_library_page(AppWidgets *appWidgets)
 {
     // Create the main vertical box for this page
@@ -441,16 +1474,52 @@ GtkWidget* create_library_page(AppWidgets *appWidgets)
     // Create a vertical box to hold the search entry and the game list
     GtkWidget *vbox_list = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
 
-    // Create and set up the search entry
+    // Create and set up the search entry, with the sort order beside it
+    GtkWidget *hbox_search = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
     appWidgets->search_entry = gtk_search_entry_new();
-    gtk_box_pack_start(GTK_BOX(vbox_list), appWidgets->search_entry, FALSE, FALSE, 0);
-    g_signal_connect(appWidgets->search_entry, "changed", G_CALLBACK(on_search_entry_text_changed), appWidgets);
+    gtk_box_pack_start(GTK_BOX(hbox_search), appWidgets->search_entry, TRUE, TRUE, 0);
+    // search-changed is debounced, so fast typing filters once rather than per key
+    g_signal_connect(appWidgets->search_entry, "search-changed", G_CALLBACK(on_search_entry_text_changed), appWidgets);
+
+    // In CatalogSort order
+    appWidgets->sort_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(appWidgets->sort_combo), "Name");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(appWidgets->sort_combo), "Playtime");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(appWidgets->sort_combo), "Last played");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(appWidgets->sort_combo), "Source");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(appWidgets->sort_combo), CATALOG_SORT_NAME);
+    g_signal_connect(appWidgets->sort_combo, "changed", G_CALLBACK(on_sort_changed), appWidgets);
+    gtk_box_pack_start(GTK_BOX(hbox_search), appWidgets->sort_combo, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox_list), hbox_search, FALSE, FALSE, 0);
+
+    // Create the game list and a scrolled window for it. Rows all have the
+    // same height, so the view only measures and draws the visible ones.
+    appWidgets->game_list_model = game_list_model_new();
+    appWidgets->game_list_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(appWidgets->game_list_model));
+    gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(appWidgets->game_list_view), FALSE);
+    gtk_tree_view_set_enable_search(GTK_TREE_VIEW(appWidgets->game_list_view), FALSE);
+
+    // Icon renderer with a fixed size, so rows keep one height with or without art
+    GtkCellRenderer *icon_renderer = gtk_cell_renderer_pixbuf_new();
+    gtk_cell_renderer_set_fixed_size(icon_renderer, ARTWORK_ICON_SIZE, ARTWORK_ICON_SIZE);
+    GtkTreeViewColumn *icon_column = gtk_tree_view_column_new();
+    gtk_tree_view_column_pack_start(icon_column, icon_renderer, FALSE);
+    gtk_tree_view_column_set_cell_data_func(icon_column, icon_renderer, render_game_icon, appWidgets, NULL);
+    gtk_tree_view_column_set_sizing(icon_column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(icon_column, ARTWORK_ICON_SIZE + 8);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(appWidgets->game_list_view), icon_column);
+
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+    g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_END, NULL); // Ellipsize text at the end if it does not fit
+    GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes("Name", renderer, "text", GAME_LIST_COLUMN_NAME, NULL);
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_expand(column, TRUE);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(appWidgets->game_list_view), column);
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(appWidgets->game_list_view), TRUE);
 
-    // Create the game list box and a scrolled window for it
-    appWidgets->game_list_box = gtk_list_box_new();
     GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    gtk_container_add(GTK_CONTAINER(scrolled_window), appWidgets->game_list_box);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), appWidgets->game_list_view);
     gtk_box_pack_start(GTK_BOX(vbox_list), scrolled_window, TRUE, TRUE, 0);
 
     // Add the box that contains the search entry and the list box to the first pane
@@ -460,12 +1529,29 @@ GtkWidget* create_library_page(AppWidgets *appWidgets)
     GtkWidget *info_vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
     gtk_container_set_border_width(GTK_CONTAINER(info_vbox), 10);
 
-    // Game information labels
+    // Capsule art, then the game information labels
+    appWidgets->game_art_image = gtk_image_new();
+    gtk_widget_set_size_request(appWidgets->game_art_image, ARTWORK_CAPSULE_WIDTH, ARTWORK_CAPSULE_HEIGHT);
+    gtk_box_pack_start(GTK_BOX(info_vbox), appWidgets->game_art_image, FALSE, FALSE, 0);
     appWidgets->game_title_label = gtk_label_new(NULL);
     gtk_label_set_markup(GTK_LABEL(appWidgets->game_title_label), "<span font='16'>Select a game</span>");
     gtk_box_pack_start(GTK_BOX(info_vbox), appWidgets->game_title_label, FALSE, FALSE, 0);
     appWidgets->playtime_label = gtk_label_new(NULL);
     gtk_box_pack_start(GTK_BOX(info_vbox), appWidgets->playtime_label, FALSE, FALSE, 0);
+    appWidgets->install_label = gtk_label_new(NULL);
+    gtk_label_set_line_wrap(GTK_LABEL(appWidgets->install_label), TRUE);
+    gtk_label_set_selectable(GTK_LABEL(appWidgets->install_label), TRUE);
+    gtk_box_pack_start(GTK_BOX(info_vbox), appWidgets->install_label, FALSE, FALSE, 0);
+    appWidgets->store_label = gtk_label_new(NULL);
+    gtk_label_set_line_wrap(GTK_LABEL(appWidgets->store_label), TRUE);
+    gtk_label_set_xalign(GTK_LABEL(appWidgets->store_label), 0.0);
+    gtk_box_pack_start(GTK_BOX(info_vbox), appWidgets->store_label, FALSE, FALSE, 0);
+    appWidgets->launch_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(appWidgets->launch_label), 0.0);
+    gtk_box_pack_start(GTK_BOX(info_vbox), appWidgets->launch_label, FALSE, FALSE, 0);
+    appWidgets->resource_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(appWidgets->resource_label), 0.0);
+    gtk_box_pack_start(GTK_BOX(info_vbox), appWidgets->resource_label, FALSE, FALSE, 0);
 
     // Spacer to push the button to the bottom
     GtkWidget *spacer = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
@@ -481,7 +1567,8 @@ GtkWidget* create_library_page(AppWidgets *appWidgets)
     gtk_box_pack_start(GTK_BOX(vbox_main), paned, TRUE, TRUE, 0);
 
     // Connect signals
-    g_signal_connect(appWidgets->game_list_box, "row-selected", G_CALLBACK(on_game_selected), appWidgets);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(appWidgets->game_list_view));
+    g_signal_connect(selection, "changed", G_CALLBACK(on_game_selected), appWidgets);
     g_signal_connect(appWidgets->run_command_button, "clicked", G_CALLBACK(on_run_command_clicked), appWidgets);
 
     return vbox_main;
@@ -506,11 +1593,52 @@ GtkWidget* create_stack_with_pages(AppWidgets *appWidgets)
     return stack;
 }
 
+// LVL_SAMPLE_INTERVAL_MS sets how often running games are sampled; 0 turns
+// sampling off
+static int get_sample_interval(void)
+{
+    const char *value = getenv("LVL_SAMPLE_INTERVAL_MS");
+    char *end;
+    long interval;
+
+    if (!value || !*value) {
+        return SESSION_SAMPLER_DEFAULT_INTERVAL_MS;
+    }
+    interval = strtol(value, &end, 10);
+    if (*end || interval < 0 || interval > 60 * 60 * 1000) {
+        fprintf(stderr, "Ignoring LVL_SAMPLE_INTERVAL_MS=%s\n", value);
+        return SESSION_SAMPLER_DEFAULT_INTERVAL_MS;
+    }
+    // Much more often would cost more than the sampler is meant to
+    return interval == 0 ? 0 : MAX(interval, 100);
+}
+
+static gboolean on_first_frame(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+    TRACE_INSTANT("first frame");
+    g_signal_handlers_disconnect_by_func(widget, on_first_frame, data);
+    return FALSE;
+}
+
 int main(int argc, char *argv[])
 {
+    trace_init_from_args(&argc, argv);
+    TraceSpan startup = TRACE_BEGIN("startup");
+    TraceSpan phase = TRACE_BEGIN("gtk_init");
     gtk_init(&argc, &argv);
-
-    AppWidgets appWidgets;
+    TRACE_END(phase);
+    // Must happen before any worker thread touches curl
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    http_client = http_client_new();
+
+    phase = TRACE_BEGIN("create widgets");
+    AppWidgets appWidgets = {0};
+    launcher = launcher_new(on_game_exited, &appWidgets);
+    launch_timer = launch_timer_new(on_launch_started, on_launch_timed, &appWidgets);
+    int sample_interval = get_sample_interval();
+    if (sample_interval > 0) {
+        session_sampler = session_sampler_new(sample_interval, on_resource_samples, &appWidgets);
+    }
     appWidgets.window = create_main_window();
     GtkWidget *stack = create_stack_with_pages(&appWidgets);
     GtkWidget *hbox = create_navigation_buttons(stack);
@@ -520,19 +1648,88 @@ int main(int argc, char *argv[])
     gtk_box_pack_start(GTK_BOX(vbox), stack, TRUE, TRUE, 0);
 
     gtk_container_add(GTK_CONTAINER(appWidgets.window), vbox);
-    
-    char api_key[256], steam_id[256];
+    TRACE_END(phase);
+
     char config_path[PATH_MAX];
     get_config_path(config_path);
-    sprintf(db_config.db_path, "%s/games.db", config_path);
 
-    init_database(&db_config);
-    db_fetch_all_games(db_config.db_path, create_game_row, appWidgets.game_list_box);
+    char account_config_path[PATH_MAX];
+    snprintf(account_config_path, sizeof(account_config_path), "%s/config.txt", config_path);
+    GArray *accounts = steam_account_array_new();
+    read_config(account_config_path, accounts);
+    for (guint i = 0; i < accounts->len; i++) {
+        const SteamAccount *account = &g_array_index(accounts, SteamAccount, i);
+        add_account_row(&appWidgets, account->api_key, account->steam_id);
+    }
+    if (accounts->len == 0) {
+        add_account_row(&appWidgets, NULL, NULL);
+    }
+    g_array_unref(accounts);
+    sprintf(db_config.db_path, "%s/games.db", config_path);
+    sprintf(db_config.snapshot_path, "%s/games.snapshot", config_path);
+
+    char cache_path[PATH_MAX];
+    snprintf(cache_path, sizeof(cache_path), "%s/cache/http", config_path);
+    mkdir_p(cache_path, 0700);
+    http_cache = http_cache_new(cache_path);
+
+    char art_path[PATH_MAX];
+    snprintf(art_path, sizeof(art_path), "%s/cache/art", config_path);
+    mkdir_p(art_path, 0700);
+    artwork = artwork_cache_new(art_path, ARTWORK_MEMORY_LIMIT, on_artwork_ready, &appWidgets);
+
+    // Draw the first frame from the snapshot and reconcile it with the
+    // database once that is open
+    phase = TRACE_BEGIN("snapshot_open");
+    Snapshot *snapshot = snapshot_open(db_config.snapshot_path);
+    TRACE_END(phase);
+    if (snapshot) {
+        load_game_list_snapshot(&appWidgets, snapshot);
+    }
+    open_database_async(&appWidgets);
 
+    phase = TRACE_BEGIN("gtk_widget_show_all");
     gtk_widget_show_all(appWidgets.window);
+    TRACE_END(phase);
+    if (trace_enabled) {
+        g_signal_connect_after(appWidgets.window, "draw", G_CALLBACK(on_first_frame), NULL);
+    }
+    TRACE_END(startup);
     gtk_main();
 
-    sqlite3_close(db_config.db);
+    sync_scheduler_free(sync_scheduler);
+    // Stores what was sampled of games still running
+    session_sampler_free(session_sampler);
+    if (db_config.db) {
+        if (snapshot_stale) {
+            write_snapshot(db_config.db, db_config.snapshot_path);
+        }
+        db_change_log_detach(db_changes);
+        db_close(db_config.db);
+    }
+    steam_watch_free(steam_watch);
+    launch_timer_free(launch_timer);
+    launcher_free(launcher);
+    artwork_cache_free(artwork);
+    g_object_unref(appWidgets.game_list_model);
+    snapshot_close(library_snapshot);
+    if (store_sync_source) {
+        g_source_remove(store_sync_source);
+    }
+    if (appWidgets.sync_cancellable || store_sync_cancellable) {
+        // Workers still own an HTTP client and the cache; process exit reclaims them
+        if (appWidgets.sync_cancellable) {
+            g_cancellable_cancel(appWidgets.sync_cancellable);
+        }
+        if (store_sync_cancellable) {
+            g_cancellable_cancel(store_sync_cancellable);
+        }
+    } else {
+        http_client_free(http_client);
+        http_client_free(store_client);
+        http_cache_free(http_cache);
+        curl_global_cleanup();
+    }
 
     return 0;
 }
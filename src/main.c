@@ -0,0 +1,55 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cli.h"
+#include "trace.h"
+
+#define GUI_BIN "lvl-gui"
+
+// Replaces the process with the GUI, looked for next to this binary first so
+// a build runs its own GUI, then on PATH. Returns only if neither started.
+static void exec_gui(char **argv)
+{
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    char *slash;
+
+    if (len > 0) {
+        path[len] = '\0';
+        if ((slash = strrchr(path, '/')) && (size_t)(slash + 1 - path) + strlen(GUI_BIN) < sizeof(path)) {
+            strcpy(slash + 1, GUI_BIN);
+            argv[0] = path;
+            execv(path, argv);
+        }
+    }
+    argv[0] = GUI_BIN;
+    execvp(GUI_BIN, argv);
+}
+
+// lvl is linked without GTK, so the subcommands start without loading it;
+// the library window is lvl-gui, which lvl hands over to without a command
+int main(int argc, char *argv[])
+{
+    char **gui_argv = malloc((size_t)(argc + 1) * sizeof(char *));
+    int status;
+
+    if (!gui_argv) {
+        return 1;
+    }
+    // The GUI reads the tracing options itself
+    memcpy(gui_argv, argv, (size_t)(argc + 1) * sizeof(char *));
+    trace_init_from_args(&argc, argv);
+    if (cli_run(argc, argv, &status)) {
+        free(gui_argv);
+        return status;
+    }
+
+    exec_gui(gui_argv);
+    fprintf(stderr, "Failed to start %s: %s\n", GUI_BIN, strerror(errno));
+    free(gui_argv);
+    return 1;
+}
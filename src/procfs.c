@@ -0,0 +1,125 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "procfs.h"
+
+// How far up the process tree proc_descends_from looks
+#define PROC_MAX_DEPTH 64
+
+ssize_t proc_read_file(pid_t pid, const char *name, char *buf, size_t size)
+{
+    char path[64];
+    ssize_t len;
+    int fd;
+
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        return -1;
+    }
+    len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// comm is in parentheses and may hold spaces and parentheses itself, so the
+// fields after it are found from the last ')'
+int proc_read_stat(pid_t pid, ProcStat *stat)
+{
+    char buf[1024];
+    char *open_paren, *close_paren;
+    size_t comm_len;
+    int ppid, pgrp;
+
+    if (proc_read_file(pid, "stat", buf, sizeof(buf)) < 0) {
+        return 0;
+    }
+    open_paren = strchr(buf, '(');
+    close_paren = strrchr(buf, ')');
+    if (!open_paren || !close_paren || close_paren < open_paren ||
+        sscanf(close_paren + 1, " %c %d %d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %llu %llu %*d %*d %ld %*d %llu %*u %ld",
+               &stat->state, &ppid, &pgrp, &stat->utime, &stat->stime, &stat->cutime, &stat->cstime,
+               &stat->num_threads, &stat->starttime, &stat->rss) != 10) {
+        return 0;
+    }
+    comm_len = (size_t)(close_paren - open_paren - 1);
+    if (comm_len >= sizeof(stat->comm)) {
+        comm_len = sizeof(stat->comm) - 1;
+    }
+    memcpy(stat->comm, open_paren + 1, comm_len);
+    stat->comm[comm_len] = '\0';
+    stat->ppid = ppid;
+    stat->pgrp = pgrp;
+    return 1;
+}
+
+long proc_read_peak_rss(pid_t pid)
+{
+    char buf[4096];
+    const char *line;
+    long kb;
+
+    if (proc_read_file(pid, "status", buf, sizeof(buf)) < 0 || !(line = strstr(buf, "\nVmHWM:")) ||
+        sscanf(line, "\nVmHWM: %ld", &kb) != 1) {
+        return -1;  // Gone, or a kernel thread
+    }
+    return kb;
+}
+
+int proc_read_io(pid_t pid, ProcIO *io)
+{
+    char buf[512];
+    const char *read_line, *write_line;
+
+    if (proc_read_file(pid, "io", buf, sizeof(buf)) < 0 ||
+        !(read_line = strstr(buf, "\nread_bytes:")) || !(write_line = strstr(buf, "\nwrite_bytes:"))) {
+        return 0;
+    }
+    return sscanf(read_line, "\nread_bytes: %llu", &io->read_bytes) == 1 &&
+           sscanf(write_line, "\nwrite_bytes: %llu", &io->write_bytes) == 1;
+}
+
+int proc_descends_from(pid_t pid, pid_t ancestor)
+{
+    ProcStat stat;
+    int depth;
+
+    for (depth = 0; pid > 1 && depth < PROC_MAX_DEPTH; depth++) {
+        if (pid == ancestor) {
+            return 1;
+        }
+        if (!proc_read_stat(pid, &stat)) {
+            return 0;
+        }
+        pid = stat.ppid;
+    }
+    return 0;
+}
+
+pid_t proc_find(ProcMatch match, void *user_data)
+{
+    DIR *dir = opendir("/proc");
+    struct dirent *entry;
+    pid_t found = 0;
+
+    if (!dir) {
+        return 0;
+    }
+    while (!found && (entry = readdir(dir))) {
+        char *end;
+        long pid = strtol(entry->d_name, &end, 10);
+
+        if (pid > 0 && *end == '\0' && match((pid_t)pid, user_data)) {
+            found = (pid_t)pid;
+        }
+    }
+    closedir(dir);
+    return found;
+}
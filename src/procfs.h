@@ -0,0 +1,47 @@
+#ifndef __PROCFS_H__
+#define __PROCFS_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// The fields of /proc/<pid>/stat that LVL uses. Times are in clock ticks,
+// sysconf(_SC_CLK_TCK) to the second.
+typedef struct {
+    char comm[16];  // the executable's name, cut to 15 characters
+    char state;     // R, S, D, Z for a zombie and so on
+    pid_t ppid;
+    pid_t pgrp;
+    unsigned long long utime;
+    unsigned long long stime;
+    unsigned long long cutime;   // of the children it waited for
+    unsigned long long cstime;
+    long num_threads;
+    unsigned long long starttime;  // after boot; tells a reused pid apart
+    long rss;                      // pages
+} ProcStat;
+
+// From /proc/<pid>/io: what the process caused to be read from and
+// written to storage
+typedef struct {
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+} ProcIO;
+
+typedef int (*ProcMatch)(pid_t pid, void *user_data);
+
+// Reads /proc/<pid>/<name> into buf, NUL terminated and cut to size - 1
+// bytes. Returns the length, or -1 if the process is gone.
+ssize_t proc_read_file(pid_t pid, const char *name, char *buf, size_t size);
+int proc_read_stat(pid_t pid, ProcStat *stat);
+// VmHWM from /proc/<pid>/status, the most memory it ever had resident, in
+// KiB; -1 if unknown
+long proc_read_peak_rss(pid_t pid);
+// Fails for another user's processes
+int proc_read_io(pid_t pid, ProcIO *io);
+// Whether pid is ancestor or was started under it
+int proc_descends_from(pid_t pid, pid_t ancestor);
+// Calls match with every process until it returns non-zero. Returns that
+// process, or 0 once all were seen.
+pid_t proc_find(ProcMatch match, void *user_data);
+
+#endif /* __PROCFS_H__ */
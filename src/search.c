@@ -0,0 +1,399 @@
+#include <string.h>
+
+#include <glib.h>
+
+#include "search.h"
+
+#define SEARCH_MAX_TOKENS 8
+#define SEARCH_MAX_TOKEN_LEN 32
+// Titles longer than this are only matched on their beginning
+#define SEARCH_MAX_TITLE_LEN 256
+// Shorter words have to be typed correctly, or nearly everything would match
+#define SEARCH_TYPO_MIN_LEN 4
+
+#define SCORE_WORD_PREFIX 100
+#define SCORE_TITLE_PREFIX 120
+#define SCORE_INITIALS 80
+#define SCORE_SUBSTRING 60
+#define SCORE_TYPO 40
+#define SCORE_SUBSEQUENCE 30
+
+// Field names a query may use, and the store_search columns they stand for
+static const struct {
+    const char *name;
+    const char *column;
+} search_fields[] = {
+    { "name", "name" },
+    { "genre", "genres" },
+    { "tag", "categories" },
+    { "dev", "developers" },
+    { "developer", "developers" },
+    { "publisher", "publishers" },
+    { "desc", "description" },
+    { "description", "description" },
+};
+
+typedef struct {
+    gunichar chars[SEARCH_MAX_TOKEN_LEN];
+    guint len;
+    guint64 mask;
+    gboolean typos;  // whether one typo is tolerated
+} SearchToken;
+
+struct SearchQuery {
+    char *folded;
+    SearchToken tokens[SEARCH_MAX_TOKENS];
+    guint n_tokens;
+};
+
+// The title being scored, decoded once for all tokens of a query
+typedef struct {
+    gunichar chars[SEARCH_MAX_TITLE_LEN];
+    guint8 word_start[SEARCH_MAX_TITLE_LEN];
+    guint len;
+} SearchTitle;
+
+char *search_fold(const char *text)
+{
+    gchar *decomposed = g_utf8_normalize(text ? text : "", -1, G_NORMALIZE_NFKD);
+    GString *out;
+    const gchar *p;
+    gboolean separated = TRUE;  // drops leading and repeated separators
+
+    if (!decomposed) {
+        return g_strdup("");  // not valid UTF-8
+    }
+
+    out = g_string_sized_new(strlen(decomposed));
+    for (p = decomposed; *p; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+
+        if (g_unichar_ismark(c)) {
+            continue;
+        }
+        if (!g_unichar_isalnum(c)) {
+            if (!separated) {
+                g_string_append_c(out, ' ');
+                separated = TRUE;
+            }
+            continue;
+        }
+        g_string_append_unichar(out, g_unichar_tolower(c));
+        separated = FALSE;
+    }
+    if (out->len > 0 && out->str[out->len - 1] == ' ') {
+        g_string_truncate(out, out->len - 1);
+    }
+
+    g_free(decomposed);
+    return g_string_free(out, FALSE);
+}
+
+static guint64 char_bit(gunichar c)
+{
+    if (c >= 'a' && c <= 'z') {
+        return G_GUINT64_CONSTANT(1) << (c - 'a');
+    }
+    if (c >= '0' && c <= '9') {
+        return G_GUINT64_CONSTANT(1) << (26 + c - '0');
+    }
+    return G_GUINT64_CONSTANT(1) << (36 + c % 28);
+}
+
+// One bit per letter or digit the text contains, so titles lacking letters of
+// the query are rejected without looking at them
+guint64 search_mask(const char *folded)
+{
+    guint64 mask = 0;
+    const gchar *p;
+
+    for (p = folded; *p; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+        if (c != ' ') {
+            mask |= char_bit(c);
+        }
+    }
+    return mask;
+}
+
+SearchQuery *search_query_new(const char *text)
+{
+    SearchQuery *query = g_new0(SearchQuery, 1);
+    SearchToken *token = NULL;
+    const gchar *p;
+
+    query->folded = search_fold(text);
+    for (p = query->folded; *p; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+
+        if (c == ' ') {
+            token = NULL;
+            continue;
+        }
+        if (!token) {
+            if (query->n_tokens == SEARCH_MAX_TOKENS) {
+                break;
+            }
+            token = &query->tokens[query->n_tokens++];
+        }
+        if (token->len < SEARCH_MAX_TOKEN_LEN) {
+            token->chars[token->len++] = c;
+            token->mask |= char_bit(c);
+            token->typos = token->len >= SEARCH_TYPO_MIN_LEN;
+        }
+    }
+
+    if (query->n_tokens == 0) {
+        search_query_free(query);
+        return NULL;
+    }
+    return query;
+}
+
+void search_query_free(SearchQuery *query)
+{
+    if (query) {
+        g_free(query->folded);
+        g_free(query);
+    }
+}
+
+gboolean search_query_narrows(const SearchQuery *query, const SearchQuery *previous)
+{
+    guint i;
+
+    if (!g_str_has_prefix(query->folded, previous->folded)) {
+        return FALSE;
+    }
+    // Lengthening a word past SEARCH_TYPO_MIN_LEN starts accepting typos,
+    // which can match titles the shorter word didn't
+    for (i = 0; i < previous->n_tokens; i++) {
+        if (query->tokens[i].typos != previous->tokens[i].typos) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void decode_title(SearchTitle *title, const char *folded)
+{
+    const gchar *p;
+    gboolean word_start = TRUE;
+
+    title->len = 0;
+    for (p = folded; *p && title->len < SEARCH_MAX_TITLE_LEN; p = g_utf8_next_char(p)) {
+        gunichar c = g_utf8_get_char(p);
+
+        title->chars[title->len] = c;
+        title->word_start[title->len] = word_start && c != ' ';
+        word_start = c == ' ';
+        title->len++;
+    }
+}
+
+static gboolean token_equal(const SearchToken *token, guint from, const SearchTitle *title, guint at)
+{
+    guint n = token->len - from;
+
+    if (from >= token->len) {
+        return TRUE;
+    }
+    if (at + n > title->len) {
+        return FALSE;
+    }
+    return memcmp(&token->chars[from], &title->chars[at], n * sizeof(gunichar)) == 0;
+}
+
+// Whether the token is one substitution, insertion, deletion or swap of
+// adjacent characters away from the text at a word start. The first
+// character has to be right.
+static gboolean typo_at(const SearchToken *token, const SearchTitle *title, guint at)
+{
+    guint k = 0;
+
+    while (k < token->len && at + k < title->len && token->chars[k] == title->chars[at + k]) {
+        k++;
+    }
+    if (k == 0 || k == token->len) {
+        return FALSE;
+    }
+    return token_equal(token, k + 1, title, at + k + 1) ||
+           token_equal(token, k + 1, title, at + k) ||
+           token_equal(token, k, title, at + k + 1) ||
+           (k + 1 < token->len && at + k + 1 < title->len &&
+            token->chars[k] == title->chars[at + k + 1] && token->chars[k + 1] == title->chars[at + k] &&
+            token_equal(token, k + 2, title, at + k + 2));
+}
+
+static gint score_token(const SearchToken *token, const SearchTitle *title, guint64 title_mask)
+{
+    guint64 missing = token->mask & ~title_mask;
+    guint i;
+    guint k;
+
+    if (missing == 0) {
+        gboolean substring = FALSE;
+
+        for (i = 0; i + token->len <= title->len; i++) {
+            if (token_equal(token, 0, title, i)) {
+                if (title->word_start[i]) {
+                    return i == 0 ? SCORE_TITLE_PREFIX : SCORE_WORD_PREFIX;
+                }
+                substring = TRUE;
+            }
+        }
+
+        // Initials, e.g. "gta" for "grand theft auto"
+        for (i = 0, k = 0; i < title->len && k < token->len; i++) {
+            if (title->word_start[i] && title->chars[i] == token->chars[k]) {
+                k++;
+            }
+        }
+        if (k == token->len) {
+            return SCORE_INITIALS;
+        }
+        if (substring) {
+            return SCORE_SUBSTRING;
+        }
+    }
+
+    // One typo brings in at most one character the title doesn't have
+    if (token->typos && (missing & (missing - 1)) == 0) {
+        for (i = 0; i < title->len; i++) {
+            if (title->word_start[i] && typo_at(token, title, i)) {
+                return SCORE_TYPO;
+            }
+        }
+    }
+
+    if (missing == 0) {
+        guint first = 0;
+
+        for (i = 0, k = 0; i < title->len && k < token->len; i++) {
+            if (title->chars[i] == token->chars[k]) {
+                if (k++ == 0) {
+                    first = i;
+                }
+            }
+        }
+        if (k == token->len) {
+            // The tighter the characters, the better
+            guint gaps = i - first - token->len;
+            return SCORE_SUBSEQUENCE - (gint)MIN(gaps, 20);
+        }
+    }
+
+    return -1;
+}
+
+gint search_query_score(const SearchQuery *query, const char *folded, guint64 mask)
+{
+    SearchTitle title;
+    gint total = 0;
+    guint i;
+
+    // Rejects most titles before decoding them
+    for (i = 0; i < query->n_tokens; i++) {
+        guint64 missing = query->tokens[i].mask & ~mask;
+        if (missing && (!query->tokens[i].typos || (missing & (missing - 1)) != 0)) {
+            return -1;
+        }
+    }
+
+    decode_title(&title, folded);
+    for (i = 0; i < query->n_tokens; i++) {
+        gint score = score_token(&query->tokens[i], &title, mask);
+        if (score < 0) {
+            return -1;
+        }
+        total += score;
+    }
+
+    // Among equally good matches, prefer shorter titles
+    return total * 16 - (gint)(title.len / 2);
+}
+
+static const char *find_field(const char *name, gsize len)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(search_fields); i++) {
+        if (strlen(search_fields[i].name) == len && g_ascii_strncasecmp(name, search_fields[i].name, len) == 0) {
+            return search_fields[i].column;
+        }
+    }
+    return NULL;
+}
+
+// Folded text only holds letters, digits and single spaces, so it can be
+// quoted as a phrase as it is. The last word of the phrase is a prefix.
+static void append_phrase(GString *query, const char *column, const char *folded)
+{
+    if (query->len > 0) {
+        g_string_append_c(query, ' ');
+    }
+    if (column) {
+        g_string_append_printf(query, "%s : ", column);
+    }
+    g_string_append_printf(query, "\"%s\"*", folded);
+}
+
+static char *free_unless_empty(GString *string)
+{
+    return g_string_free(string, string->len == 0);
+}
+
+void search_terms_parse(SearchTerms *terms, const char *text)
+{
+    gchar **words = g_strsplit_set(text ? text : "", " \t", -1);
+    GString *title = g_string_new(NULL);
+    GString *match = g_string_new(NULL);
+    GString *filter = g_string_new(NULL);
+    gchar **word;
+
+    for (word = words; *word; word++) {
+        const char *colon = strchr(*word, ':');
+        const char *column = colon ? find_field(*word, colon - *word) : NULL;
+        char *folded;
+
+        if (!**word) {
+            continue;
+        }
+        if (column) {
+            // A field still waiting for its word matches nothing yet
+            folded = search_fold(colon + 1);
+            if (*folded) {
+                append_phrase(match, column, folded);
+                append_phrase(filter, column, folded);
+            }
+        } else {
+            folded = search_fold(*word);
+            if (title->len > 0) {
+                g_string_append_c(title, ' ');
+            }
+            g_string_append(title, *word);
+            if (*folded) {
+                append_phrase(match, NULL, folded);
+            }
+        }
+        g_free(folded);
+    }
+
+    terms->title = free_unless_empty(title);
+    terms->match = free_unless_empty(match);
+    terms->filter = free_unless_empty(filter);
+    g_strfreev(words);
+}
+
+void search_terms_clear(SearchTerms *terms)
+{
+    g_free(terms->title);
+    g_free(terms->match);
+    g_free(terms->filter);
+    memset(terms, 0, sizeof(SearchTerms));
+}
+
+gboolean search_terms_extend(const char *text, const char *previous)
+{
+    return g_str_has_prefix(text, previous) && text[strlen(previous)] != ':';
+}
@@ -0,0 +1,43 @@
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+#include <glib.h>
+
+// Titles and queries are compared in a folded form: compatibility decomposed,
+// accents stripped, lower cased, with every run of punctuation or whitespace
+// collapsed into a single space. Fold each title once and keep the result
+// together with its mask.
+char *search_fold(const char *text);
+guint64 search_mask(const char *folded);
+
+// A parsed query. Every word of the query has to match the title, either as
+// the start of a word, a substring, the initials of the title, a
+// subsequence of it, or the start of a word with one typo.
+typedef struct SearchQuery SearchQuery;
+
+SearchQuery *search_query_new(const char *text);  // NULL for a blank query
+void search_query_free(SearchQuery *query);
+// Higher is a better match; negative means the title doesn't match
+gint search_query_score(const SearchQuery *query, const char *folded, guint64 mask);
+// TRUE when everything query matches is also matched by previous, so only
+// the previous results need to be searched again
+gboolean search_query_narrows(const SearchQuery *query, const SearchQuery *previous);
+
+// A query split for the title search and the store details' FTS5 index.
+// A word of the form field:word only matches that field of the store
+// details: name, genre, tag, dev, publisher or desc. The other words go to
+// the title search, and also match any field of the store details. Every
+// word matches as a prefix.
+typedef struct {
+    char *title;     // the plain words, for search_query_new; NULL if none
+    char *match;     // FTS5 query over every word; NULL if none
+    char *filter;    // FTS5 query over the field:word ones; NULL if none
+} SearchTerms;
+
+void search_terms_parse(SearchTerms *terms, const char *text);
+void search_terms_clear(SearchTerms *terms);
+// TRUE when text adds to previous without turning a plain word into a
+// field:word one, so its store matches are a subset of the previous ones
+gboolean search_terms_extend(const char *text, const char *previous);
+
+#endif /* __SEARCH_H__ */
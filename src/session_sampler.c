@@ -0,0 +1,336 @@
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "procfs.h"
+#include "session_sampler.h"
+#include "trace.h"
+
+// How far up the process tree a process is followed to find its game
+#define SESSION_SAMPLER_MAX_DEPTH 64
+
+typedef enum {
+    MEMBER_UNKNOWN,
+    MEMBER_YES,
+    MEMBER_NO
+} Membership;
+
+// A process as the current tick read it
+typedef struct {
+    pid_t pid;
+    ProcStat stat;
+    Membership member;  // of the session being sampled
+} ProcEntry;
+
+// A game's process as of the last tick
+typedef struct {
+    unsigned long long starttime;
+    pid_t ppid;
+    unsigned long long cpu_ticks;  // its own and its waited for children's
+    ProcIO io;
+} Member;
+
+typedef struct {
+    SessionSampler *sampler;
+    ResourceSession session;
+    gint64 started_monotonic;
+    pid_t root;
+    unsigned long long root_starttime;
+    GPid pgid;
+    GHashTable *members;           // pid -> Member
+    // What processes that are gone had used. The kernel adds a process's
+    // CPU time and I/O to its parent's once that waits for it, so only
+    // processes whose parent wasn't the game's count here.
+    unsigned long long departed_cpu_ticks;
+    unsigned long long departed_read_bytes;
+    unsigned long long departed_write_bytes;
+    GArray *samples;               // ResourceSample not handed over yet
+    guint sampled;
+    gint64 flushed_at;             // monotonic
+    gint64 cost_us;                // spent on ticks while it ran
+} Session;
+
+struct SessionSampler {
+    int interval_ms;
+    SessionSamplerCallback callback;
+    gpointer user_data;
+    GPtrArray *sessions;           // Session
+    GArray *processes;             // ProcEntry, every process this tick
+    GHashTable *by_pid;            // pid -> index into processes
+    guint tick;
+    long ticks_per_s;
+    long page_kb;
+};
+
+static void session_free(gpointer p)
+{
+    Session *session = (Session *)p;
+
+    g_hash_table_destroy(session->members);
+    g_array_unref(session->samples);
+    g_free(session);
+}
+
+SessionSampler *session_sampler_new(int interval_ms, SessionSamplerCallback callback, gpointer user_data)
+{
+    SessionSampler *sampler = g_new0(SessionSampler, 1);
+
+    sampler->interval_ms = interval_ms;
+    sampler->callback = callback;
+    sampler->user_data = user_data;
+    sampler->sessions = g_ptr_array_new_with_free_func(session_free);
+    sampler->processes = g_array_new(FALSE, FALSE, sizeof(ProcEntry));
+    sampler->by_pid = g_hash_table_new(g_direct_hash, g_direct_equal);
+    sampler->ticks_per_s = sysconf(_SC_CLK_TCK);
+    sampler->page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    return sampler;
+}
+
+static void flush_session(Session *session, gboolean ended)
+{
+    SessionSampler *sampler = session->sampler;
+
+    if (session->sampled > 0) {
+        sampler->callback(&session->session, (const ResourceSample *)session->samples->data, session->samples->len,
+                          ended, sampler->user_data);
+    }
+    g_array_set_size(session->samples, 0);
+    session->flushed_at = g_get_monotonic_time();
+}
+
+static void end_session(Session *session)
+{
+    SessionSampler *sampler = session->sampler;
+    gint64 elapsed_us = g_get_monotonic_time() - session->started_monotonic;
+
+    // Microseconds of sampling per second of the session, for traces
+    if (session->sampled > 0 && elapsed_us > 0) {
+        TRACE_COUNTER("sampler cost us/s", session->cost_us * G_USEC_PER_SEC / elapsed_us);
+    }
+    flush_session(session, TRUE);
+    g_ptr_array_remove(sampler->sessions, session);
+}
+
+void session_sampler_free(SessionSampler *sampler)
+{
+    if (!sampler) {
+        return;
+    }
+    while (sampler->sessions->len > 0) {
+        end_session((Session *)g_ptr_array_index(sampler->sessions, sampler->sessions->len - 1));
+    }
+    if (sampler->tick) {
+        g_source_remove(sampler->tick);
+    }
+    g_ptr_array_unref(sampler->sessions);
+    g_array_unref(sampler->processes);
+    g_hash_table_destroy(sampler->by_pid);
+    g_free(sampler);
+}
+
+static int collect_process(pid_t pid, void *user_data)
+{
+    SessionSampler *sampler = (SessionSampler *)user_data;
+    ProcEntry entry;
+
+    entry.pid = pid;
+    entry.member = MEMBER_UNKNOWN;
+    // A zombie is done with its resources and has no children of its own,
+    // only its parent still has to wait for it
+    if (proc_read_stat(pid, &entry.stat) && entry.stat.state != 'Z') {
+        g_array_append_val(sampler->processes, entry);
+    }
+    return 0;  // On to the next one
+}
+
+// The game's processes: its first one, a non-Steam game's process group,
+// those that were the game's at the last tick and whatever was started
+// under any of them
+static Membership get_membership(Session *session, SessionSampler *sampler, ProcEntry *entry, int depth)
+{
+    Member *member;
+    gpointer parent;
+
+    if (entry->member != MEMBER_UNKNOWN) {
+        return entry->member;
+    }
+    if ((entry->pid == session->root && entry->stat.starttime == session->root_starttime) ||
+        (session->pgid && entry->stat.pgrp == session->pgid)) {
+        entry->member = MEMBER_YES;
+    } else if ((member = g_hash_table_lookup(session->members, GINT_TO_POINTER(entry->pid))) &&
+               member->starttime == entry->stat.starttime) {
+        entry->member = MEMBER_YES;
+    } else if (depth < SESSION_SAMPLER_MAX_DEPTH && entry->stat.ppid > 1 &&
+               g_hash_table_lookup_extended(sampler->by_pid, GINT_TO_POINTER(entry->stat.ppid), NULL, &parent)) {
+        ProcEntry *parent_entry = &g_array_index(sampler->processes, ProcEntry, GPOINTER_TO_UINT(parent));
+        entry->member = get_membership(session, sampler, parent_entry, depth + 1);
+    } else {
+        entry->member = MEMBER_NO;
+    }
+    return entry->member;
+}
+
+// Counts what the processes that are gone from members used, where nothing
+// else will
+static void count_departed(Session *session, GHashTable *members)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, session->members);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const Member *gone = (const Member *)value;
+
+        if (g_hash_table_contains(members, key) || g_hash_table_contains(members, GINT_TO_POINTER(gone->ppid))) {
+            continue;
+        }
+        session->departed_cpu_ticks += gone->cpu_ticks;
+        session->departed_read_bytes += gone->io.read_bytes;
+        session->departed_write_bytes += gone->io.write_bytes;
+    }
+}
+
+// Returns FALSE once none of the game's processes are left
+static gboolean sample_session(SessionSampler *sampler, Session *session, gint64 now)
+{
+    ResourceSession *totals = &session->session;
+    GHashTable *members = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    unsigned long long cpu_ticks = 0, read_bytes = 0, write_bytes = 0;
+    ResourceSample sample = {0};
+    long rss_pages = 0;
+    guint i;
+
+    for (i = 0; i < sampler->processes->len; i++) {
+        g_array_index(sampler->processes, ProcEntry, i).member = MEMBER_UNKNOWN;
+    }
+    for (i = 0; i < sampler->processes->len; i++) {
+        ProcEntry *entry = &g_array_index(sampler->processes, ProcEntry, i);
+        Member *member;
+        long peak_rss_kb;
+
+        if (get_membership(session, sampler, entry, 0) != MEMBER_YES) {
+            continue;
+        }
+        member = g_new0(Member, 1);
+        member->starttime = entry->stat.starttime;
+        member->ppid = entry->stat.ppid;
+        member->cpu_ticks = entry->stat.utime + entry->stat.stime + entry->stat.cutime + entry->stat.cstime;
+        proc_read_io(entry->pid, &member->io);
+        g_hash_table_insert(members, GINT_TO_POINTER(entry->pid), member);
+
+        cpu_ticks += member->cpu_ticks;
+        read_bytes += member->io.read_bytes;
+        write_bytes += member->io.write_bytes;
+        rss_pages += entry->stat.rss;
+        sample.threads += (int)entry->stat.num_threads;
+        // Catches what one process had resident between ticks
+        if ((peak_rss_kb = proc_read_peak_rss(entry->pid)) > totals->peak_rss_kb) {
+            totals->peak_rss_kb = peak_rss_kb;
+        }
+    }
+    count_departed(session, members);
+    g_hash_table_destroy(session->members);
+    session->members = members;
+    if (g_hash_table_size(members) == 0) {
+        return FALSE;
+    }
+
+    cpu_ticks += session->departed_cpu_ticks;
+    read_bytes += session->departed_read_bytes;
+    write_bytes += session->departed_write_bytes;
+
+    // A process that wasn't waited for takes its children's CPU time with
+    // it, so the totals are kept from going back
+    sample.at_ms = (int)((now - session->started_monotonic) / 1000);
+    sample.cpu_ms = MAX(totals->cpu_ms, (sqlite3_int64)(cpu_ticks * 1000 / sampler->ticks_per_s));
+    sample.rss_kb = (sqlite3_int64)rss_pages * sampler->page_kb;
+    sample.read_kb = MAX(totals->read_kb, (sqlite3_int64)(read_bytes / 1024));
+    sample.write_kb = MAX(totals->write_kb, (sqlite3_int64)(write_bytes / 1024));
+    g_array_append_val(session->samples, sample);
+    session->sampled++;
+
+    totals->ended_at = totals->started_at + sample.at_ms / 1000;
+    totals->cpu_ms = sample.cpu_ms;
+    totals->peak_rss_kb = MAX(totals->peak_rss_kb, sample.rss_kb);
+    totals->peak_threads = MAX(totals->peak_threads, sample.threads);
+    totals->read_kb = sample.read_kb;
+    totals->write_kb = sample.write_kb;
+    return TRUE;
+}
+
+static gboolean on_tick(gpointer data)
+{
+    TRACE_SCOPE("session_sampler_tick");
+    SessionSampler *sampler = (SessionSampler *)data;
+    gint64 now = g_get_monotonic_time();
+    gint64 cost_us;
+    guint i;
+
+    g_array_set_size(sampler->processes, 0);
+    g_hash_table_remove_all(sampler->by_pid);
+    proc_find(collect_process, sampler);
+    for (i = 0; i < sampler->processes->len; i++) {
+        g_hash_table_insert(sampler->by_pid, GINT_TO_POINTER(g_array_index(sampler->processes, ProcEntry, i).pid),
+                            GUINT_TO_POINTER(i));
+    }
+
+    for (i = sampler->sessions->len; i-- > 0; ) {
+        Session *session = (Session *)g_ptr_array_index(sampler->sessions, i);
+
+        if (!sample_session(sampler, session, now)) {
+            end_session(session);
+        }
+    }
+    cost_us = g_get_monotonic_time() - now;
+    for (i = 0; i < sampler->sessions->len; i++) {
+        Session *session = (Session *)g_ptr_array_index(sampler->sessions, i);
+
+        session->cost_us += cost_us;
+        if (now - session->flushed_at >= SESSION_SAMPLER_FLUSH_S * G_USEC_PER_SEC) {
+            flush_session(session, FALSE);
+        }
+    }
+
+    if (sampler->sessions->len == 0) {
+        sampler->tick = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void session_sampler_start(SessionSampler *sampler, DBGameSource source, int game_id, GPid pid, GPid pgid)
+{
+    Session *session;
+    ProcStat root;
+    guint i;
+
+    for (i = 0; i < sampler->sessions->len; i++) {
+        session = (Session *)g_ptr_array_index(sampler->sessions, i);
+        if (session->session.source == source && session->session.game_id == game_id) {
+            return;
+        }
+    }
+
+    session = g_new0(Session, 1);
+    session->sampler = sampler;
+    session->session.source = source;
+    session->session.game_id = game_id;
+    session->session.started_at = g_get_real_time() / G_USEC_PER_SEC;
+    session->session.ended_at = session->session.started_at;
+    session->session.interval_ms = sampler->interval_ms;
+    session->started_monotonic = g_get_monotonic_time();
+    session->flushed_at = session->started_monotonic;
+    // A pid that is reused once the game's first process is gone isn't the game
+    if (proc_read_stat(pid, &root)) {
+        session->root = pid;
+        session->root_starttime = root.starttime;
+    }
+    session->pgid = pgid;
+    session->members = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    session->samples = g_array_new(FALSE, FALSE, sizeof(ResourceSample));
+    g_ptr_array_add(sampler->sessions, session);
+
+    if (!sampler->tick) {
+        sampler->tick = g_timeout_add(sampler->interval_ms, on_tick, sampler);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef __SESSION_SAMPLER_H__
+#define __SESSION_SAMPLER_H__
+
+#include <glib.h>
+
+#include "db.h"
+
+#define SESSION_SAMPLER_DEFAULT_INTERVAL_MS 2000
+// Samples are handed over a batch at a time, this often
+#define SESSION_SAMPLER_FLUSH_S 60
+
+// Samples what the processes of running games use, from the main loop: CPU
+// time, resident memory, threads and storage I/O, as /proc/<pid>/stat,
+// status and io report them. A game's processes are the one it started as
+// and every process started under it, and for a non-Steam game everything
+// in its process group.
+//
+// Each tick reads the stat of every process once, however many games run,
+// and then status and io of the games' processes only. That is a few
+// microseconds per process, so at the default interval sampling costs
+// around a tenth of a percent of one core.
+typedef struct SessionSampler SessionSampler;
+
+// Invoked on the main context with a session's samples since the last call:
+// every SESSION_SAMPLER_FLUSH_S while it runs, and once more after it
+// ended. session holds the totals up to the latest sample and may be
+// written to, as db_add_resource_samples does. Sessions too short to be
+// sampled once aren't reported.
+typedef void (*SessionSamplerCallback)(ResourceSession *session, const ResourceSample *samples, size_t count,
+                                       gboolean ended, gpointer user_data);
+
+SessionSampler *session_sampler_new(int interval_ms, SessionSamplerCallback callback, gpointer user_data);
+// Sessions still running are handed over as ended
+void session_sampler_free(SessionSampler *sampler);
+// pid is the game's first process, and pgid a non-Steam game's process group
+// or 0. Does nothing if the game is being sampled already.
+void session_sampler_start(SessionSampler *sampler, DBGameSource source, int game_id, GPid pid, GPid pgid);
+
+#endif /* __SESSION_SAMPLER_H__ */
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC "LVLSNAP"
+// Bump whenever the layout below changes; older files are then ignored
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_NO_STRING UINT32_MAX
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;     // guards against a struct layout change without a version bump
+    uint64_t count;
+    uint64_t strings_size;
+    uint64_t hash;            // of the records and strings
+} SnapshotHeader;
+
+typedef struct {
+    int32_t game_id;
+    int32_t playtime;
+    uint32_t name;            // offsets into the string blob
+    uint32_t install_path;    // SNAPSHOT_NO_STRING for Steam games
+} SnapshotRecord;
+
+struct Snapshot {
+    void *map;
+    size_t size;
+    const SnapshotHeader *header;
+    const SnapshotRecord *records;
+    const char *strings;
+};
+
+struct SnapshotWriter {
+    SnapshotRecord *records;
+    size_t count;
+    size_t cap;
+    char *strings;
+    size_t strings_size;
+    size_t strings_cap;
+    int failed;
+};
+
+static uint64_t fnv1a_update(uint64_t state, const void *data, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        state ^= bytes[i];
+        state *= FNV_PRIME;
+    }
+    return state;
+}
+
+static int valid_string(const Snapshot *snapshot, uint32_t offset, int optional)
+{
+    if (offset == SNAPSHOT_NO_STRING) {
+        return optional;
+    }
+    return offset < snapshot->header->strings_size;
+}
+
+Snapshot *snapshot_open(const char *path)
+{
+    Snapshot *snapshot;
+    struct stat st;
+    const SnapshotHeader *header;
+    size_t i;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    snapshot = calloc(1, sizeof(Snapshot));
+    snapshot->size = (size_t)st.st_size;
+    snapshot->map = mmap(NULL, snapshot->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (snapshot->map == MAP_FAILED) {
+        free(snapshot);
+        return NULL;
+    }
+
+    header = (const SnapshotHeader *)snapshot->map;
+    snapshot->header = header;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->record_size != sizeof(SnapshotRecord) ||
+        header->count > (snapshot->size - sizeof(SnapshotHeader)) / sizeof(SnapshotRecord) ||
+        header->strings_size != snapshot->size - sizeof(SnapshotHeader) - header->count * sizeof(SnapshotRecord)) {
+        fprintf(stderr, "Ignoring invalid library snapshot %s\n", path);
+        snapshot_close(snapshot);
+        return NULL;
+    }
+
+    snapshot->records = (const SnapshotRecord *)(header + 1);
+    snapshot->strings = (const char *)(snapshot->records + header->count);
+    if (header->strings_size > 0 && snapshot->strings[header->strings_size - 1] != '\0') {
+        fprintf(stderr, "Ignoring invalid library snapshot %s\n", path);
+        snapshot_close(snapshot);
+        return NULL;
+    }
+    // With the blob ending in NUL, in-range offsets always give terminated strings
+    for (i = 0; i < header->count; i++) {
+        if (!valid_string(snapshot, snapshot->records[i].name, 0) ||
+            !valid_string(snapshot, snapshot->records[i].install_path, 1)) {
+            fprintf(stderr, "Ignoring invalid library snapshot %s\n", path);
+            snapshot_close(snapshot);
+            return NULL;
+        }
+    }
+
+    return snapshot;
+}
+
+size_t snapshot_count(const Snapshot *snapshot)
+{
+    return (size_t)snapshot->header->count;
+}
+
+uint64_t snapshot_hash(const Snapshot *snapshot)
+{
+    return snapshot->header->hash;
+}
+
+void snapshot_foreach(const Snapshot *snapshot, DBRowCallback callback, void *user_data)
+{
+    size_t i;
+
+    for (i = 0; i < snapshot->header->count; i++) {
+        const SnapshotRecord *record = &snapshot->records[i];
+        const char *install_path = record->install_path == SNAPSHOT_NO_STRING ? NULL : snapshot->strings + record->install_path;
+
+        callback(record->game_id, snapshot->strings + record->name, install_path, record->playtime, user_data);
+    }
+}
+
+void snapshot_close(Snapshot *snapshot)
+{
+    if (snapshot) {
+        munmap(snapshot->map, snapshot->size);
+        free(snapshot);
+    }
+}
+
+SnapshotWriter *snapshot_writer_new(void)
+{
+    return calloc(1, sizeof(SnapshotWriter));
+}
+
+static uint32_t add_string(SnapshotWriter *writer, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    size_t offset = writer->strings_size;
+
+    if (offset + len >= SNAPSHOT_NO_STRING) {
+        writer->failed = 1;
+        return SNAPSHOT_NO_STRING;
+    }
+    if (offset + len > writer->strings_cap) {
+        size_t new_cap = writer->strings_cap ? writer->strings_cap * 2 : 64 * 1024;
+        char *ptr;
+
+        while (new_cap < offset + len) {
+            new_cap *= 2;
+        }
+        ptr = realloc(writer->strings, new_cap);
+        if (!ptr) {
+            writer->failed = 1;
+            return SNAPSHOT_NO_STRING;
+        }
+        writer->strings = ptr;
+        writer->strings_cap = new_cap;
+    }
+    memcpy(writer->strings + offset, str, len);
+    writer->strings_size += len;
+    return (uint32_t)offset;
+}
+
+void snapshot_writer_add(int game_id, const char *game_name, const char *install_path, int playtime, void *user_data)
+{
+    SnapshotWriter *writer = (SnapshotWriter *)user_data;
+    SnapshotRecord *record;
+
+    if (writer->failed) {
+        return;
+    }
+    if (writer->count == writer->cap) {
+        size_t new_cap = writer->cap ? writer->cap * 2 : 1024;
+        SnapshotRecord *ptr = realloc(writer->records, new_cap * sizeof(SnapshotRecord));
+        if (!ptr) {
+            writer->failed = 1;
+            return;
+        }
+        writer->records = ptr;
+        writer->cap = new_cap;
+    }
+
+    record = &writer->records[writer->count];
+    memset(record, 0, sizeof(SnapshotRecord));
+    record->game_id = game_id;
+    record->playtime = playtime;
+    record->name = add_string(writer, game_name ? game_name : "");
+    record->install_path = install_path ? add_string(writer, install_path) : SNAPSHOT_NO_STRING;
+    if (!writer->failed) {
+        writer->count++;
+    }
+}
+
+uint64_t snapshot_writer_hash(SnapshotWriter *writer)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    hash = fnv1a_update(hash, writer->records, writer->count * sizeof(SnapshotRecord));
+    hash = fnv1a_update(hash, writer->strings, writer->strings_size);
+    return hash;
+}
+
+// Writes to a temporary file and renames it over the old snapshot, so a
+// crash never leaves a half written one behind
+int snapshot_writer_commit(SnapshotWriter *writer, const char *path)
+{
+    SnapshotHeader header;
+    char tmp_path[PATH_MAX];
+    FILE *file;
+    int ok;
+
+    if (writer->failed) {
+        fprintf(stderr, "Can't build the library snapshot\n");
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.record_size = sizeof(SnapshotRecord);
+    header.count = writer->count;
+    header.strings_size = writer->strings_size;
+    header.hash = snapshot_writer_hash(writer);
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    file = fopen(tmp_path, "wb");
+    if (!file) {
+        fprintf(stderr, "Can't write library snapshot %s\n", tmp_path);
+        return 0;
+    }
+    ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && writer->count > 0) {
+        ok = fwrite(writer->records, sizeof(SnapshotRecord), writer->count, file) == writer->count;
+    }
+    if (ok && writer->strings_size > 0) {
+        ok = fwrite(writer->strings, 1, writer->strings_size, file) == writer->strings_size;
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Can't write library snapshot %s\n", path);
+        remove(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+void snapshot_writer_free(SnapshotWriter *writer)
+{
+    if (writer) {
+        free(writer->records);
+        free(writer->strings);
+        free(writer);
+    }
+}
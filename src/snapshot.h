@@ -0,0 +1,32 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "db.h"
+
+// A copy of the library as the list shows it, kept next to games.db so the
+// first frame can be drawn from it without waiting for SQLite. The file is a
+// header, a packed array of fixed-size records in list order and one blob of
+// NUL terminated strings; it is memory mapped rather than parsed.
+typedef struct Snapshot Snapshot;
+typedef struct SnapshotWriter SnapshotWriter;
+
+// NULL when the file is missing, from another version or damaged
+Snapshot *snapshot_open(const char *path);
+size_t snapshot_count(const Snapshot *snapshot);
+uint64_t snapshot_hash(const Snapshot *snapshot);
+// Strings point into the mapping and stay valid until snapshot_close
+void snapshot_foreach(const Snapshot *snapshot, DBRowCallback callback, void *user_data);
+void snapshot_close(Snapshot *snapshot);
+
+SnapshotWriter *snapshot_writer_new(void);
+// A DBRowCallback, so a writer can be filled by db_fetch_all_games
+void snapshot_writer_add(int game_id, const char *game_name, const char *install_path, int playtime, void *writer);
+// Identifies the content; equal to snapshot_hash() of the file it would write
+uint64_t snapshot_writer_hash(SnapshotWriter *writer);
+int snapshot_writer_commit(SnapshotWriter *writer, const char *path);
+void snapshot_writer_free(SnapshotWriter *writer);
+
+#endif /* __SNAPSHOT_H__ */
@@ -1,74 +1,586 @@
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <curl/curl.h>
-#include <cjson/cJSON.h>
 #include <sqlite3.h>
 
 #include "steam.h"
 #include "db.h"
+#include "http_cache.h"
+#include "json_stream.h"
+#include "trace.h"
+#include "validation.h"
 
-size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
+#define STEAM_API_BASE "https://api.steampowered.com"
+
+typedef enum {
+    FIELD_OTHER,
+    FIELD_APPID,
+    FIELD_NAME,
+    FIELD_PLAYTIME,
+    FIELD_PLAYTIME_2WEEKS,
+    FIELD_LAST_PLAYED,
+    FIELD_ICON
+} GameField;
+
+// State for streaming GetOwnedGames out of curl. Games are parsed as they
+// arrive and collected until the response is complete, so several accounts
+// can download at once and still be committed one transaction each.
+typedef struct {
+    int response_key;   // the last root key was "response"
+    int in_response;
+    int games_key;      // the last key inside "response" was "games"
+    int count_key;      // ... or "game_count"
+    int in_games;
+    int games_seen;     // the response listed the games, even if none
+    int in_game;
+    GameField field;
+    int game_id;
+    int playtime;
+    int playtime_2weeks;
+    long long last_played;
+    int has_name;
+    char *name;
+    size_t name_cap;
+    char icon_hash[64];  // empty when the game has no icon
+    size_t game_count;
+    SteamGame *games;
+    size_t count;
+    size_t cap;
+    int failed;         // out of memory
+} OwnedGamesParser;
+
+static int store_game_name(OwnedGamesParser *p, const char *text, size_t len)
 {
-    size_t real_size = size * nmemb;
-    MemoryStruct *mem = (MemoryStruct *)userp;
+    if (len + 1 > p->name_cap) {
+        char *name = realloc(p->name, len + 1);
+        if (!name) {
+            printf("not enough memory (realloc returned NULL)\n");
+            return 0;
+        }
+        p->name = name;
+        p->name_cap = len + 1;
+    }
+    memcpy(p->name, text, len + 1);
+    p->has_name = 1;
+    return 1;
+}
+
+static int finish_game(OwnedGamesParser *p)
+{
+    SteamGame *game;
 
-    char *ptr = realloc(mem->memory, mem->size + real_size + 1);
-    if(ptr == NULL) {
-        printf("not enough memory (realloc returned NULL)\n");
+    if (p->count == p->cap) {
+        size_t new_cap = p->cap ? p->cap * 2 : (p->game_count > 0 ? p->game_count : 256);
+        SteamGame *games = realloc(p->games, new_cap * sizeof(SteamGame));
+        if (!games) {
+            printf("not enough memory (realloc returned NULL)\n");
+            return 0;
+        }
+        p->games = games;
+        p->cap = new_cap;
+    }
+
+    game = &p->games[p->count];
+    game->game_id = p->game_id;
+    game->playtime = p->playtime;
+    game->playtime_2weeks = p->playtime_2weeks;
+    game->last_played = p->last_played;
+    game->game_name = strdup(p->has_name ? p->name : "Unknown");
+    game->icon_hash = p->icon_hash[0] ? strdup(p->icon_hash) : NULL;
+    if (!game->game_name || (p->icon_hash[0] && !game->icon_hash)) {
+        free((char *)game->game_name);
+        free((char *)game->icon_hash);
         return 0;
     }
+    p->count++;
+    return 1;
+}
 
-    mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), contents, real_size);
-    mem->size += real_size;
-    mem->memory[mem->size] = 0;
+static void owned_games_clear(OwnedGamesParser *p)
+{
+    size_t i;
 
-    return real_size;
+    for (i = 0; i < p->count; i++) {
+        free((char *)p->games[i].game_name);
+        free((char *)p->games[i].icon_hash);
+    }
+    free(p->games);
+    free(p->name);
+    memset(p, 0, sizeof(OwnedGamesParser));
 }
 
-void fetch_data_from_steam_api(const char *api_key, const char *steam_id, sqlite3 *db)
+// Picks the fields we store out of response.games[] while the rest of the
+// response is still downloading
+static int owned_games_event(JsonEvent event, const char *text, size_t len, int depth, void *user_data)
 {
-    CURL *curl;
-    CURLcode res;
+    OwnedGamesParser *p = (OwnedGamesParser *)user_data;
+
+    switch (event) {
+    case JSON_EVENT_KEY:
+        if (depth == 1) {
+            p->response_key = strcmp(text, "response") == 0;
+        } else if (depth == 2 && p->in_response) {
+            p->games_key = strcmp(text, "games") == 0;
+            p->count_key = strcmp(text, "game_count") == 0;
+        } else if (depth == 4 && p->in_game) {
+            if (strcmp(text, "appid") == 0) {
+                p->field = FIELD_APPID;
+            } else if (strcmp(text, "name") == 0) {
+                p->field = FIELD_NAME;
+            } else if (strcmp(text, "playtime_forever") == 0) {  // In minutes
+                p->field = FIELD_PLAYTIME;
+            } else if (strcmp(text, "playtime_2weeks") == 0) {  // Only there if played lately
+                p->field = FIELD_PLAYTIME_2WEEKS;
+            } else if (strcmp(text, "rtime_last_played") == 0) {  // Unix seconds, 0 if never
+                p->field = FIELD_LAST_PLAYED;
+            } else if (strcmp(text, "img_icon_url") == 0) {  // The icon file's hash
+                p->field = FIELD_ICON;
+            } else {
+                p->field = FIELD_OTHER;
+            }
+        }
+        break;
+    case JSON_EVENT_OBJECT_START:
+        if (depth == 1 && p->response_key) {
+            p->in_response = 1;
+        } else if (depth == 3 && p->in_games) {
+            p->in_game = 1;
+            p->field = FIELD_OTHER;
+            p->game_id = -1;
+            p->playtime = 0;
+            p->playtime_2weeks = 0;
+            p->last_played = 0;
+            p->has_name = 0;
+            p->icon_hash[0] = '\0';
+        }
+        break;
+    case JSON_EVENT_OBJECT_END:
+        if (depth == 1) {
+            p->in_response = 0;
+        } else if (depth == 3 && p->in_game) {
+            p->in_game = 0;
+            if (!finish_game(p)) {
+                p->failed = 1;
+                return 1;
+            }
+        }
+        break;
+    case JSON_EVENT_ARRAY_START:
+        if (depth == 2 && p->in_response && p->games_key) {
+            p->in_games = 1;
+            p->games_seen = 1;
+        }
+        break;
+    case JSON_EVENT_ARRAY_END:
+        if (depth == 2) {
+            p->in_games = 0;
+        }
+        break;
+    case JSON_EVENT_NUMBER:
+        if (depth == 2 && p->in_response && p->count_key) {
+            p->game_count = strtoul(text, NULL, 10);
+            p->games_seen = 1;  // An account without games gets no array
+        } else if (depth == 4 && p->in_game) {
+            if (p->field == FIELD_APPID) {
+                p->game_id = (int)strtol(text, NULL, 10);
+            } else if (p->field == FIELD_PLAYTIME) {
+                p->playtime = (int)strtol(text, NULL, 10);
+            } else if (p->field == FIELD_PLAYTIME_2WEEKS) {
+                p->playtime_2weeks = (int)strtol(text, NULL, 10);
+            } else if (p->field == FIELD_LAST_PLAYED) {
+                p->last_played = strtoll(text, NULL, 10);
+            }
+        }
+        break;
+    case JSON_EVENT_STRING:
+        if (depth == 4 && p->in_game && p->field == FIELD_NAME && !store_game_name(p, text, len)) {
+            p->failed = 1;
+            return 1;
+        }
+        // It names a file, so only take what looks like a hash
+        if (depth == 4 && p->in_game && p->field == FIELD_ICON &&
+            len < sizeof(p->icon_hash) && strspn(text, "0123456789abcdef") == len) {
+            memcpy(p->icon_hash, text, len + 1);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+typedef struct SteamFetch SteamFetch;
+
+// One account's requests and what came back for them
+typedef struct {
+    SteamFetch *fetch;
+    const SteamAccount *account;
+    size_t index;
     char player_summary_url[512];
     char owned_games_url[512];
-    sprintf(player_summary_url, "http://api.steampowered.com/ISteamUser/GetPlayerSummaries/v0002/?key=%s&steamids=%s", api_key, steam_id);
-    sprintf(owned_games_url, "http://api.steampowered.com/IPlayerService/GetOwnedGames/v0001/?key=%s&steamid=%s&format=json&include_appinfo=true", api_key, steam_id);
-
-    curl = curl_easy_init();
-    if(curl) {
-        MemoryStruct chunk;
-        chunk.memory = malloc(1);  // will be grown as needed by the realloc above
-        chunk.size = 0;    // no data at this point
-
-        curl_easy_setopt(curl, CURLOPT_URL, owned_games_url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-
-        res = curl_easy_perform(curl);
-        if(res != CURLE_OK) {
-            fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+    char applied_hash[HTTP_CACHE_HASH_SIZE];
+    HttpCacheEntry entry;
+    int cached;
+    HttpRequest player_summary;
+    HttpRequest owned_games;
+    OwnedGamesParser parser;
+    JsonStream *json;
+    HttpCacheWriter *cache_writer;
+    int running;        // requests still in flight
+    int http_error;     // the body is an error page, not JSON
+    int finished;
+    SteamFetchResult result;
+    SteamSyncDelta delta;   // what the import changed
+} AccountFetch;
+
+struct SteamFetch {
+    HttpCache *cache;
+    sqlite3 *db;
+    SteamProgressCallback progress;
+    SteamAccountCallback account_done;
+    void *user_data;
+    AccountFetch *accounts;
+    size_t count;
+    int aborted;        // the progress callback asked to stop
+};
+
+static size_t owned_games_write_callback(char *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t real_size = size * nmemb;
+    AccountFetch *account = (AccountFetch *)userp;
+    long status = 0;
+
+    curl_easy_getinfo(account->owned_games.handle, CURLINFO_RESPONSE_CODE, &status);
+    if (status != 200) {
+        account->http_error = status != 304;
+        return real_size;  // Drain error pages without parsing them
+    }
+
+    if (account->cache_writer) {
+        http_cache_writer_write(account->cache_writer, contents, real_size);
+    }
+    if (!json_stream_feed(account->json, contents, real_size)) {
+        return 0;  // Makes curl abort the transfer
+    }
+    return real_size;
+}
+
+// Download progress summed over every account still downloading
+static int fetch_tick(void *user_data)
+{
+    SteamFetch *fetch = (SteamFetch *)user_data;
+    size_t received_total = 0, expected_total = 0;
+    size_t i;
+
+    if (!fetch->progress) {
+        return 0;
+    }
+    for (i = 0; i < fetch->count; i++) {
+        size_t received, expected;
+
+        if (http_request_progress(&fetch->accounts[i].owned_games, &received, &expected)) {
+            received_total += received;
+            expected_total += expected;
+        }
+    }
+    if (fetch->progress(STEAM_STAGE_DOWNLOAD, received_total, expected_total, fetch->user_data)) {
+        fetch->aborted = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Parses a previously cached GetOwnedGames body, for when the database
+// doesn't reflect it yet but the server says it hasn't changed
+static int parse_cached_body(HttpCache *cache, const HttpCacheEntry *entry, OwnedGamesParser *parser)
+{
+    TRACE_SCOPE("parse_cached_body");
+    FILE *file = http_cache_open_body(cache, entry);
+    JsonStream *json;
+    char buffer[64 * 1024];
+    size_t len;
+    int ok = 1;
+
+    if (!file) {
+        fprintf(stderr, "Cached Steam response is missing\n");
+        return 0;
+    }
+    json = json_stream_new(owned_games_event, parser);
+    while (ok && (len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        ok = json_stream_feed(json, buffer, len);
+    }
+    ok = ok && json_stream_finish(json);
+    if (!ok && !parser->failed) {
+        fprintf(stderr, "Failed to parse cached Steam response: %s\n", json_stream_error(json));
+    }
+
+    json_stream_free(json);
+    fclose(file);
+    return ok;
+}
+
+// Writes one account's games in their own transaction, together with the
+// hash of the body they came from so the next sync can skip it
+static SteamFetchResult import_account(AccountFetch *account, const char *body_hash)
+{
+    TRACE_SCOPE("import_account");
+    SteamFetch *fetch = account->fetch;
+    const OwnedGamesParser *p = &account->parser;
+    SteamGameWriter *writer;
+    SteamFetchResult result = STEAM_FETCH_OK;
+    size_t i;
+
+    // A private profile gets an empty response, which says nothing about the
+    // games; importing it as an empty library would drop them all
+    if (!p->games_seen) {
+        fprintf(stderr, "Steam returned no games for %s\n", account->account->steam_id);
+        return STEAM_FETCH_FAILED;
+    }
+    writer = steam_game_writer_begin(fetch->db, account->account->steam_id);
+    if (!writer) {
+        return STEAM_FETCH_FAILED;
+    }
+    for (i = 0; i < p->count && result == STEAM_FETCH_OK; i++) {
+        if (!steam_game_writer_add(writer, &p->games[i])) {
+            result = STEAM_FETCH_FAILED;
+        } else if (fetch->progress && fetch->progress(STEAM_STAGE_IMPORT, i + 1, p->count, fetch->user_data)) {
+            fetch->aborted = 1;
+            result = STEAM_FETCH_ABORTED;
+        }
+    }
+    if (result == STEAM_FETCH_OK && body_hash && !db_set_applied_hash(fetch->db, account->entry.key, body_hash)) {
+        result = STEAM_FETCH_FAILED;
+    }
+    if (!steam_game_writer_end(writer, result == STEAM_FETCH_OK, &account->delta) && result == STEAM_FETCH_OK) {
+        result = STEAM_FETCH_FAILED;
+    }
+    return result;
+}
+
+// Imports the body the cache entry holds unless the database already has it
+static SteamFetchResult import_cached_account(AccountFetch *account)
+{
+    if (strcmp(account->entry.body_hash, account->applied_hash) == 0) {
+        return STEAM_FETCH_UNCHANGED;
+    }
+    if (!parse_cached_body(account->fetch->cache, &account->entry, &account->parser)) {
+        return STEAM_FETCH_FAILED;
+    }
+    return import_account(account, account->entry.body_hash);
+}
+
+// Decides what the responses amount to and commits the account's import.
+// Runs inside http_client_run as soon as the account's last request is done.
+static void finish_account(AccountFetch *account)
+{
+    SteamFetch *fetch = account->fetch;
+    SteamFetchResult result = STEAM_FETCH_FAILED;
+    // A 304 usually comes without a body, so the write callback never sees it
+    int not_modified = account->owned_games.status == 304;
+    const char *body_hash;
+
+    if (fetch->aborted) {
+        result = STEAM_FETCH_ABORTED;
+    } else if (account->parser.failed) {
+        fprintf(stderr, "Failed to store the Steam library\n");
+    } else if (account->player_summary.result != CURLE_OK || account->owned_games.result != CURLE_OK) {
+        if (account->owned_games.result == CURLE_WRITE_ERROR) {
+            fprintf(stderr, "Failed to parse Steam response: %s\n", json_stream_error(account->json));
         } else {
-            cJSON *json = cJSON_Parse(chunk.memory);
-            cJSON *response = cJSON_GetObjectItemCaseSensitive(json, "response");
-            cJSON *games = cJSON_GetObjectItemCaseSensitive(response, "games");
-            cJSON *game;
+            result = STEAM_FETCH_UNAVAILABLE;
+        }
+    } else if (account->player_summary.status == 401 || account->player_summary.status == 403 ||
+               (account->player_summary.status == 200 && !validate_player_summary(account->player_summary.body.memory))) {
+        result = STEAM_FETCH_INVALID_CREDENTIALS;
+    } else if (account->player_summary.status != 200 || account->http_error || (not_modified && !account->cached)) {
+        long status = account->player_summary.status != 200 ? account->player_summary.status : account->owned_games.status;
+
+        fprintf(stderr, "Steam API returned HTTP %ld\n", status);
+        if (status == 429) {
+            result = STEAM_FETCH_RATE_LIMITED;
+        } else if (status >= 500) {
+            result = STEAM_FETCH_UNAVAILABLE;
+        }
+    } else if (not_modified) {
+        http_cache_touch(fetch->cache, &account->entry, &account->owned_games);
+        result = import_cached_account(account);
+    } else if (!json_stream_finish(account->json)) {
+        fprintf(stderr, "Failed to parse Steam response: %s\n", json_stream_error(account->json));
+    } else {
+        // Identical bytes to what the database already holds: nothing to commit
+        body_hash = account->cache_writer ? http_cache_writer_hash(account->cache_writer) : NULL;
+        if (body_hash && strcmp(body_hash, account->applied_hash) == 0) {
+            result = STEAM_FETCH_UNCHANGED;
+        } else {
+            result = import_account(account, body_hash);
+        }
+    }
+
+    // Keep the new body and validators once it is known to be good
+    if (account->cache_writer) {
+        if ((result == STEAM_FETCH_OK || result == STEAM_FETCH_UNCHANGED) && !not_modified) {
+            http_cache_writer_commit(account->cache_writer, &account->owned_games);
+        } else {
+            http_cache_writer_discard(account->cache_writer);
+        }
+        account->cache_writer = NULL;
+    }
+
+    account->result = result;
+    account->finished = 1;
+    owned_games_clear(&account->parser);
+    if (fetch->account_done) {
+        fetch->account_done(account->index, result, &account->delta, fetch->user_data);
+    }
+}
+
+static void on_account_request_done(HttpRequest *request, void *user_data)
+{
+    AccountFetch *account = (AccountFetch *)user_data;
+
+    if (--account->running == 0) {
+        finish_account(account);
+    }
+}
+
+// LVL_STEAM_API_BASE points the client at another server, such as the
+// stub the benchmarks run against
+static const char *steam_api_base(void)
+{
+    const char *base = getenv("LVL_STEAM_API_BASE");
+    return base && *base ? base : STEAM_API_BASE;
+}
 
-            cJSON_ArrayForEach(game, games) {
-                cJSON *name = cJSON_GetObjectItemCaseSensitive(game, "name");
-                cJSON *appid = cJSON_GetObjectItemCaseSensitive(game, "appid");
-                cJSON *playtime = cJSON_GetObjectItemCaseSensitive(game, "playtime_forever");  // In minutes
+// Answers from the cache or queues the account's requests on the client
+static void start_account(HttpClient *client, AccountFetch *account)
+{
+    SteamFetch *fetch = account->fetch;
+    const SteamAccount *credentials = account->account;
 
-                int game_id = appid ? appid->valueint : -1;
-                const char *game_name = name ? name->valuestring : "Unknown";
-                int game_playtime = playtime ? playtime->valueint : 0;
+    http_request_init(&account->player_summary, account->player_summary_url);
+    http_request_init(&account->owned_games, account->owned_games_url);
 
-                insert_game(db, game_id, game_name, game_playtime);
+    if (!validate_steam_credentials_format(credentials->api_key, credentials->steam_id)) {
+        account->result = STEAM_FETCH_INVALID_CREDENTIALS;
+        account->finished = 1;
+        if (fetch->account_done) {
+            fetch->account_done(account->index, account->result, &account->delta, fetch->user_data);
+        }
+        return;
+    }
+
+    snprintf(account->player_summary_url, sizeof(account->player_summary_url),
+             "%s/ISteamUser/GetPlayerSummaries/v0002/?key=%s&steamids=%s", steam_api_base(), credentials->api_key, credentials->steam_id);
+    snprintf(account->owned_games_url, sizeof(account->owned_games_url),
+             "%s/IPlayerService/GetOwnedGames/v0001/?key=%s&steamid=%s&format=json&include_appinfo=true", steam_api_base(), credentials->api_key, credentials->steam_id);
+
+    if (fetch->cache) {
+        account->cached = http_cache_lookup(fetch->cache, account->owned_games_url, &account->entry);
+        db_get_applied_hash(fetch->db, account->entry.key, account->applied_hash, sizeof(account->applied_hash));
+
+        // A fresh entry was fetched with these very credentials, so it needs
+        // neither revalidation nor another look at the player summary
+        if (account->cached && http_cache_is_fresh(&account->entry, time(NULL))) {
+            account->result = import_cached_account(account);
+            account->finished = 1;
+            owned_games_clear(&account->parser);
+            if (fetch->account_done) {
+                fetch->account_done(account->index, account->result, &account->delta, fetch->user_data);
             }
-            cJSON_Delete(json);
+            return;
         }
-        free(chunk.memory);
-        curl_easy_cleanup(curl);
+        account->cache_writer = http_cache_writer_new(fetch->cache, account->owned_games_url);
     }
+
+    account->json = json_stream_new(owned_games_event, &account->parser);
+    account->owned_games.write = owned_games_write_callback;
+    account->owned_games.write_data = account;
+    if (account->cached) {
+        http_cache_add_validators(&account->entry, &account->owned_games);
+    }
+    account->player_summary.done = on_account_request_done;
+    account->player_summary.done_data = account;
+    account->owned_games.done = on_account_request_done;
+    account->owned_games.done_data = account;
+
+    // All requests share the client's connection to the API host
+    if (http_client_add(client, &account->player_summary)) {
+        account->running++;
+        if (http_client_add(client, &account->owned_games)) {
+            account->running++;
+            return;
+        }
+    }
+    fprintf(stderr, "Failed to start Steam API requests\n");
+    // Let the request that did start finish the account, failing it
+    account->owned_games.result = CURLE_FAILED_INIT;
+    if (account->running == 0) {
+        finish_account(account);
+    }
+}
+
+void fetch_steam_accounts(HttpClient *client, HttpCache *cache, const SteamAccount *accounts, size_t count,
+                          sqlite3 *db, SteamProgressCallback progress, SteamAccountCallback account_done, void *user_data,
+                          SteamFetchResult *results)
+{
+    TRACE_SCOPE("fetch_steam_accounts");
+    SteamFetch fetch = {0};
+    size_t i;
+
+    fetch.cache = cache;
+    fetch.db = db;
+    fetch.progress = progress;
+    fetch.account_done = account_done;
+    fetch.user_data = user_data;
+    fetch.accounts = calloc(count, sizeof(AccountFetch));
+    fetch.count = count;
+    if (count > 0 && !fetch.accounts) {
+        for (i = 0; i < count; i++) {
+            results[i] = STEAM_FETCH_FAILED;
+        }
+        return;
+    }
+
+    for (i = 0; i < count; i++) {
+        fetch.accounts[i].fetch = &fetch;
+        fetch.accounts[i].account = &accounts[i];
+        fetch.accounts[i].index = i;
+        start_account(client, &fetch.accounts[i]);
+    }
+
+    {
+        TRACE_SCOPE("steam download");
+        // Returns early only when aborting, after finishing every account
+        if (!http_client_run(client, fetch_tick, &fetch)) {
+            fetch.aborted = 1;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        AccountFetch *account = &fetch.accounts[i];
+
+        results[i] = account->finished ? account->result : STEAM_FETCH_ABORTED;
+        if (account->cache_writer) {
+            http_cache_writer_discard(account->cache_writer);
+        }
+        owned_games_clear(&account->parser);
+        json_stream_free(account->json);
+        http_request_clear(&account->player_summary);
+        http_request_clear(&account->owned_games);
+        http_cache_entry_clear(&account->entry);
+    }
+    free(fetch.accounts);
+}
+
+SteamFetchResult fetch_data_from_steam_api(HttpClient *client, HttpCache *cache, const char *api_key, const char *steam_id,
+                                           sqlite3 *db, SteamProgressCallback progress, void *user_data)
+{
+    SteamAccount account = { (char *)api_key, (char *)steam_id };
+    SteamFetchResult result;
+
+    fetch_steam_accounts(client, cache, &account, 1, db, progress, NULL, user_data, &result);
+    return result;
 }
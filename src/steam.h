@@ -7,12 +7,52 @@
 #include <curl/curl.h>
 #include <sqlite3.h>
 
+#include "db.h"
+#include "http.h"
+#include "http_cache.h"
+
+typedef enum {
+    STEAM_STAGE_DOWNLOAD,  // done/total are bytes received/expected (total may be 0)
+    STEAM_STAGE_IMPORT     // done/total are games written/games in the account's response
+} SteamStage;
+
+// Return non-zero from the callback to abort the fetch
+typedef int (*SteamProgressCallback)(SteamStage stage, size_t done, size_t total, void *user_data);
+
+typedef enum {
+    STEAM_FETCH_OK,
+    STEAM_FETCH_UNCHANGED,  // the stored library already matches the response
+    STEAM_FETCH_INVALID_CREDENTIALS,
+    STEAM_FETCH_ABORTED,
+    STEAM_FETCH_RATE_LIMITED,  // HTTP 429
+    STEAM_FETCH_UNAVAILABLE,   // a network error or HTTP 5xx; worth another try later
+    STEAM_FETCH_FAILED
+} SteamFetchResult;
+
 typedef struct {
-    char *memory;
-    size_t size;
-} MemoryStruct;
+    char *api_key;
+    char *steam_id;
+} SteamAccount;
+
+// Called as soon as one account's import is committed or has failed, while
+// the other accounts may still be downloading. delta is all zeroes unless
+// the import committed.
+typedef void (*SteamAccountCallback)(size_t index, SteamFetchResult result, const SteamSyncDelta *delta, void *user_data);
 
-size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp);
-void fetch_data_from_steam_api(const char *api_key, const char *steam_id, sqlite3 *db);
+// Validates the credentials and imports the owned games of every account in
+// a single round: all GetPlayerSummaries and GetOwnedGames requests run
+// concurrently on the client, and each account's games are committed in their
+// own transaction as soon as its responses are in and its player summary
+// checks out, so a slow account holds up nobody else. Games owned by several
+// accounts are stored once (see SteamGameWriter).
+// With a cache, fresh responses skip the network entirely and stale ones are
+// revalidated; nothing is parsed or written when a response is unchanged.
+// results receives one entry per account.
+void fetch_steam_accounts(HttpClient *client, HttpCache *cache, const SteamAccount *accounts, size_t count,
+                          sqlite3 *db, SteamProgressCallback progress, SteamAccountCallback account_done, void *user_data,
+                          SteamFetchResult *results);
+// The same for a single account
+SteamFetchResult fetch_data_from_steam_api(HttpClient *client, HttpCache *cache, const char *api_key, const char *steam_id,
+                                           sqlite3 *db, SteamProgressCallback progress, void *user_data);
 
 #endif /* __STEAM_H__ */
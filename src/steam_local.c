@@ -0,0 +1,590 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "steam_local.h"
+#include "trace.h"
+#include "vdf.h"
+
+#define STEAM_LOCAL_MAX_THREADS 8
+// Manifests are small; a thread only pays off for a batch of them
+#define MANIFESTS_PER_THREAD 32
+// StateFlags bit set once a game is completely downloaded
+#define STATE_FULLY_INSTALLED 4
+
+// Runtimes and compatibility tools install like games, but aren't ones
+static const char *const tool_prefixes[] = {
+    "Proton ",
+    "Steam Linux Runtime",
+    "Steamworks Common Redistributables",
+};
+
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t cap;
+} PathList;
+
+typedef struct {
+    PathList *folders;
+    int in_folder;
+} FoldersParser;
+
+typedef struct {
+    const char *library;     // the folder holding the manifest
+    char *path;
+    SteamInstall install;    // game_id stays 0 unless it's a game
+    char *installdir;
+} Manifest;
+
+typedef struct {
+    Manifest *manifests;
+    size_t count;
+    size_t next;
+    pthread_mutex_t lock;
+} ScanQueue;
+
+static int path_list_add(PathList *list, char *path)
+{
+    if (!path) {
+        return 0;
+    }
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 16;
+        char **paths = realloc(list->paths, cap * sizeof(char *));
+        if (!paths) {
+            free(path);
+            return 0;
+        }
+        list->paths = paths;
+        list->cap = cap;
+    }
+    list->paths[list->count++] = path;
+    return 1;
+}
+
+static void path_list_clear(PathList *list)
+{
+    size_t i;
+
+    for (i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    memset(list, 0, sizeof(PathList));
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+    FILE *file = fopen(path, "rb");
+    struct stat st;
+    char *data;
+
+    if (!file) {
+        return NULL;
+    }
+    if (fstat(fileno(file), &st) != 0 || !(data = malloc((size_t)st.st_size + 1))) {
+        fclose(file);
+        return NULL;
+    }
+    *len = fread(data, 1, (size_t)st.st_size, file);
+    data[*len] = '\0';
+    fclose(file);
+    return data;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = malloc(len);
+
+    if (path) {
+        snprintf(path, len, "%s/%s", dir, name);
+    }
+    return path;
+}
+
+static int is_number(const char *text)
+{
+    return *text && strspn(text, "0123456789") == strlen(text);
+}
+
+// Adds a library folder once, however it is spelled
+static void add_library_folder(PathList *folders, const char *path)
+{
+    char resolved[PATH_MAX];
+    size_t i;
+
+    if (!realpath(path, resolved)) {
+        return;  // Removed, or on a drive that isn't mounted
+    }
+    for (i = 0; i < folders->count; i++) {
+        if (strcmp(folders->paths[i], resolved) == 0) {
+            return;
+        }
+    }
+    path_list_add(folders, strdup(resolved));
+}
+
+// "libraryfolders" { "0" { "path" "..." ... } ... }, or in the format from
+// before 2021, "LibraryFolders" { "1" "..." }
+static int library_folders_event(VdfEvent event, const char *key, const char *value, int depth, void *user_data)
+{
+    FoldersParser *p = (FoldersParser *)user_data;
+
+    switch (event) {
+    case VDF_EVENT_OBJECT_START:
+        // Not touched by objects inside a folder, like its "apps"
+        if (depth == 1) {
+            p->in_folder = is_number(key);
+        }
+        break;
+    case VDF_EVENT_OBJECT_END:
+        if (depth == 1) {
+            p->in_folder = 0;
+        }
+        break;
+    case VDF_EVENT_VALUE:
+        if (depth == 2 && p->in_folder && strcmp(key, "path") == 0) {
+            add_library_folder(p->folders, value);
+        } else if (depth == 1 && is_number(key)) {
+            add_library_folder(p->folders, value);
+        }
+        break;
+    }
+    return 0;
+}
+
+static int read_library_folders(const char *steam_root, PathList *folders)
+{
+    TRACE_SCOPE("read_library_folders");
+    FoldersParser parser = { folders, 0 };
+    char *path = join_path(steam_root, "steamapps/libraryfolders.vdf");
+    const char *error;
+    size_t len;
+    char *data = path ? read_file(path, &len) : NULL;
+    int ok;
+
+    if (!data) {
+        free(path);
+        return 0;
+    }
+    // The Steam directory is a library of its own, listed or not
+    add_library_folder(folders, steam_root);
+    ok = vdf_parse(data, len, library_folders_event, &parser, &error);
+    if (!ok) {
+        fprintf(stderr, "Failed to parse %s: %s\n", path, error);
+    }
+    free(data);
+    free(path);
+    return ok;
+}
+
+static int is_tool(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(tool_prefixes) / sizeof(tool_prefixes[0]); i++) {
+        if (strncmp(name, tool_prefixes[i], strlen(tool_prefixes[i])) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// "AppState" { "appid" "..." "name" "..." "StateFlags" "..." ... }
+static int manifest_event(VdfEvent event, const char *key, const char *value, int depth, void *user_data)
+{
+    Manifest *manifest = (Manifest *)user_data;
+    SteamInstall *install = &manifest->install;
+
+    if (event != VDF_EVENT_VALUE || depth != 1) {
+        return 0;
+    }
+    if (strcmp(key, "appid") == 0) {
+        install->game_id = (int)strtol(value, NULL, 10);
+    } else if (strcmp(key, "name") == 0 && !install->game_name) {
+        install->game_name = strdup(value);
+    } else if (strcmp(key, "StateFlags") == 0) {
+        install->installed = (strtol(value, NULL, 10) & STATE_FULLY_INSTALLED) != 0;
+    } else if (strcmp(key, "installdir") == 0 && !manifest->installdir) {
+        manifest->installdir = strdup(value);
+    } else if (strcmp(key, "SizeOnDisk") == 0) {
+        install->size_on_disk = strtoll(value, NULL, 10);
+    }
+    return 0;
+}
+
+static void manifest_clear(Manifest *manifest)
+{
+    free(manifest->path);
+    free(manifest->installdir);
+    free((char *)manifest->install.game_name);
+    free((char *)manifest->install.install_dir);
+    memset(manifest, 0, sizeof(Manifest));
+}
+
+static void parse_manifest(Manifest *manifest)
+{
+    SteamInstall *install = &manifest->install;
+    const char *error;
+    size_t len;
+    char *data = read_file(manifest->path, &len);
+
+    if (!data) {
+        return;  // Deleted since the folder was listed
+    }
+    if (!vdf_parse(data, len, manifest_event, manifest, &error)) {
+        fprintf(stderr, "Failed to parse %s: %s\n", manifest->path, error);
+        install->game_id = 0;
+    }
+    free(data);
+
+    if (install->game_id <= 0 || !install->game_name || !manifest->installdir || is_tool(install->game_name)) {
+        install->game_id = 0;
+        return;
+    }
+    len = strlen(manifest->library) + strlen("/steamapps/common/") + strlen(manifest->installdir) + 1;
+    if ((install->install_dir = malloc(len))) {
+        snprintf((char *)install->install_dir, len, "%s/steamapps/common/%s", manifest->library, manifest->installdir);
+    } else {
+        install->game_id = 0;
+    }
+}
+
+static void *scan_worker(void *data)
+{
+    ScanQueue *queue = (ScanQueue *)data;
+
+    for (;;) {
+        size_t i;
+
+        pthread_mutex_lock(&queue->lock);
+        i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= queue->count) {
+            break;
+        }
+        parse_manifest(&queue->manifests[i]);
+    }
+    return NULL;
+}
+
+int steam_local_is_manifest(const char *name)
+{
+    size_t len = strlen(name);
+
+    return strncmp(name, "appmanifest_", strlen("appmanifest_")) == 0 &&
+           len > strlen(".acf") && strcmp(name + len - strlen(".acf"), ".acf") == 0;
+}
+
+// Lists the manifests of every library folder
+static void list_manifests(const PathList *folders, Manifest **out, size_t *out_count)
+{
+    Manifest *manifests = NULL;
+    size_t count = 0, cap = 0, i;
+
+    for (i = 0; i < folders->count; i++) {
+        char *steamapps = join_path(folders->paths[i], "steamapps");
+        DIR *dir = steamapps ? opendir(steamapps) : NULL;
+        struct dirent *entry;
+
+        while (dir && (entry = readdir(dir))) {
+            if (!steam_local_is_manifest(entry->d_name)) {
+                continue;
+            }
+            if (count == cap) {
+                Manifest *ptr = realloc(manifests, (cap = cap ? cap * 2 : 64) * sizeof(Manifest));
+                if (!ptr) {
+                    break;
+                }
+                manifests = ptr;
+            }
+            memset(&manifests[count], 0, sizeof(Manifest));
+            manifests[count].library = folders->paths[i];
+            manifests[count].path = join_path(steamapps, entry->d_name);
+            if (manifests[count].path) {
+                count++;
+            }
+        }
+        if (dir) {
+            closedir(dir);
+        }
+        free(steamapps);
+    }
+
+    *out = manifests;
+    *out_count = count;
+}
+
+static int compare_installs(const void *a, const void *b)
+{
+    const SteamInstall *install_a = (const SteamInstall *)a;
+    const SteamInstall *install_b = (const SteamInstall *)b;
+
+    if (install_a->game_id != install_b->game_id) {
+        return install_a->game_id < install_b->game_id ? -1 : 1;
+    }
+    // A complete install first, for when a game sits in two libraries
+    return install_b->installed - install_a->installed;
+}
+
+int steam_local_scan(const char *steam_root, SteamLocalLibrary *library)
+{
+    TRACE_SCOPE("steam_local_scan");
+    PathList folders = {0};
+    ScanQueue queue = {0};
+    pthread_t threads[STEAM_LOCAL_MAX_THREADS];
+    size_t thread_count = 0, i, j;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    memset(library, 0, sizeof(SteamLocalLibrary));
+    if (!read_library_folders(steam_root, &folders)) {
+        path_list_clear(&folders);
+        return 0;
+    }
+    list_manifests(&folders, &queue.manifests, &queue.count);
+    TRACE_COUNTER("steam manifests", queue.count);
+
+    // The calling thread works through the queue too
+    pthread_mutex_init(&queue.lock, NULL);
+    if (cpus > 1) {
+        size_t wanted = queue.count / MANIFESTS_PER_THREAD;
+        size_t max = (size_t)cpus - 1 < STEAM_LOCAL_MAX_THREADS ? (size_t)cpus - 1 : STEAM_LOCAL_MAX_THREADS;
+
+        while (thread_count < wanted && thread_count < max &&
+               pthread_create(&threads[thread_count], NULL, scan_worker, &queue) == 0) {
+            thread_count++;
+        }
+    }
+    scan_worker(&queue);
+    for (i = 0; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+
+    // Keep one install per game; the strings move into the library
+    library->installs = malloc((queue.count ? queue.count : 1) * sizeof(SteamInstall));
+    for (i = 0; library->installs && i < queue.count; i++) {
+        Manifest *manifest = &queue.manifests[i];
+
+        if (manifest->install.game_id > 0) {
+            library->installs[library->count++] = manifest->install;
+            memset(&manifest->install, 0, sizeof(SteamInstall));
+        }
+    }
+    if (library->installs) {
+        qsort(library->installs, library->count, sizeof(SteamInstall), compare_installs);
+        for (i = 0, j = 0; i < library->count; i++) {
+            if (j > 0 && library->installs[j - 1].game_id == library->installs[i].game_id) {
+                free((char *)library->installs[i].game_name);
+                free((char *)library->installs[i].install_dir);
+            } else {
+                library->installs[j++] = library->installs[i];
+            }
+        }
+        library->count = j;
+    }
+
+    for (i = 0; i < queue.count; i++) {
+        manifest_clear(&queue.manifests[i]);
+    }
+    free(queue.manifests);
+    path_list_clear(&folders);
+    return library->installs != NULL;
+}
+
+void steam_local_library_clear(SteamLocalLibrary *library)
+{
+    size_t i;
+
+    for (i = 0; i < library->count; i++) {
+        steam_install_clear(&library->installs[i]);
+    }
+    free(library->installs);
+    memset(library, 0, sizeof(SteamLocalLibrary));
+}
+
+void steam_install_clear(SteamInstall *install)
+{
+    free((char *)install->game_name);
+    free((char *)install->install_dir);
+    memset(install, 0, sizeof(SteamInstall));
+}
+
+char **steam_local_library_folders(const char *steam_root, size_t *count)
+{
+    PathList folders = {0};
+
+    if (!read_library_folders(steam_root, &folders)) {
+        path_list_clear(&folders);
+        *count = 0;
+        return NULL;
+    }
+    *count = folders.count;
+    return folders.paths;
+}
+
+void steam_local_free_folders(char **folders, size_t count)
+{
+    PathList list = { folders, count, count };
+    path_list_clear(&list);
+}
+
+// The manifest sits in <library>/steamapps/
+int steam_local_read_manifest(const char *path, SteamInstall *install)
+{
+    Manifest manifest = {0};
+    const char *steamapps = strstr(path, "/steamapps/");
+    const char *next;
+    char *library;
+    int found;
+
+    memset(install, 0, sizeof(SteamInstall));
+    if (!steamapps) {
+        return 0;
+    }
+    while ((next = strstr(steamapps + 1, "/steamapps/"))) {
+        steamapps = next;
+    }
+    if (!(library = strndup(path, (size_t)(steamapps - path))) || !(manifest.path = strdup(path))) {
+        free(library);
+        return 0;
+    }
+    manifest.library = library;
+
+    parse_manifest(&manifest);
+    found = manifest.install.game_id > 0;
+    if (found) {
+        *install = manifest.install;
+        memset(&manifest.install, 0, sizeof(SteamInstall));
+    }
+    manifest_clear(&manifest);
+    free(library);
+    return found;
+}
+
+// Keys are matched without case: Steam writes both "apps" and "Apps"
+typedef struct {
+    char keys[6][32];      // the objects enclosing the current value
+    SteamPlaytime *playtimes;
+    size_t count;
+    size_t cap;
+    int failed;
+} PlaytimeParser;
+
+// UserLocalConfigStore > Software > Valve > Steam > apps > <appid> > Playtime
+static int local_config_event(VdfEvent event, const char *key, const char *value, int depth, void *user_data)
+{
+    PlaytimeParser *p = (PlaytimeParser *)user_data;
+
+    if (event == VDF_EVENT_OBJECT_START && depth < 6) {
+        snprintf(p->keys[depth], sizeof(p->keys[depth]), "%s", key);
+    } else if (event == VDF_EVENT_VALUE && depth == 6 && strcasecmp(key, "Playtime") == 0 &&
+               strcasecmp(p->keys[1], "Software") == 0 && strcasecmp(p->keys[2], "Valve") == 0 &&
+               strcasecmp(p->keys[3], "Steam") == 0 && strcasecmp(p->keys[4], "apps") == 0 &&
+               is_number(p->keys[5])) {
+        if (p->count == p->cap) {
+            size_t cap = p->cap ? p->cap * 2 : 256;
+            SteamPlaytime *playtimes = realloc(p->playtimes, cap * sizeof(SteamPlaytime));
+            if (!playtimes) {
+                p->failed = 1;
+                return 1;
+            }
+            p->playtimes = playtimes;
+            p->cap = cap;
+        }
+        p->playtimes[p->count].game_id = (int)strtol(p->keys[5], NULL, 10);
+        p->playtimes[p->count].playtime = (int)strtol(value, NULL, 10);
+        p->count++;
+    }
+    return 0;
+}
+
+int steam_local_read_playtimes(const char *path, SteamPlaytime **playtimes, size_t *count)
+{
+    TRACE_SCOPE("steam_local_read_playtimes");
+    PlaytimeParser parser;
+    const char *error;
+    size_t len;
+    char *data = read_file(path, &len);
+    int ok;
+
+    *playtimes = NULL;
+    *count = 0;
+    if (!data) {
+        return 0;
+    }
+    memset(&parser, 0, sizeof(PlaytimeParser));
+    ok = vdf_parse(data, len, local_config_event, &parser, &error) && !parser.failed;
+    if (!ok) {
+        fprintf(stderr, "Failed to parse %s: %s\n", path, parser.failed ? "out of memory" : error);
+        free(parser.playtimes);
+    } else {
+        *playtimes = parser.playtimes;
+        *count = parser.count;
+    }
+    free(data);
+    return ok;
+}
+
+// LVL_STEAM_ROOT points the scanner at another Steam directory
+int steam_local_find_root(char *out, size_t out_size)
+{
+    const char *candidates[] = {
+        ".steam/steam",
+        ".local/share/Steam",
+        ".var/app/com.valvesoftware.Steam/.local/share/Steam",
+    };
+    const char *root = getenv("LVL_STEAM_ROOT");
+    const char *home = getenv("HOME");
+    struct stat st;
+    size_t i;
+
+    if (root && *root) {
+        snprintf(out, out_size, "%s", root);
+        return 1;
+    }
+    if (!home || !*home) {
+        struct passwd *pw = getpwuid(getuid());
+        home = pw ? pw->pw_dir : NULL;
+    }
+    if (!home) {
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        char path[PATH_MAX];
+
+        snprintf(path, sizeof(path), "%s/%s/steamapps/libraryfolders.vdf", home, candidates[i]);
+        if (stat(path, &st) == 0) {
+            snprintf(out, out_size, "%s/%s", home, candidates[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int steam_local_import(sqlite3 *db, const char *steam_root)
+{
+    TRACE_SCOPE("steam_local_import");
+    SteamLocalLibrary library;
+    int ok;
+
+    if (!steam_local_scan(steam_root, &library)) {
+        return 0;
+    }
+    ok = db_replace_steam_installs(db, library.installs, library.count);
+    if (ok) {
+        fprintf(stdout, "Found %zu Steam games in local libraries\n", library.count);
+    }
+    steam_local_library_clear(&library);
+    return ok;
+}
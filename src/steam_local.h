@@ -0,0 +1,40 @@
+#ifndef __STEAM_LOCAL_H__
+#define __STEAM_LOCAL_H__
+
+#include <stddef.h>
+
+#include <sqlite3.h>
+
+#include "db.h"
+
+// The games installed by the local Steam client, read straight from its
+// library folders, so they are known without a network or an API key
+typedef struct {
+    SteamInstall *installs;  // one per game, strings owned by the library
+    size_t count;
+} SteamLocalLibrary;
+
+// Finds the Steam client's data directory: ~/.steam/steam, then
+// ~/.local/share/Steam, then the Flatpak's. Returns 0 if there is none.
+int steam_local_find_root(char *out, size_t out_size);
+// Reads libraryfolders.vdf and every library folder's appmanifest_*.acf,
+// parsing the manifests on several threads. Returns 0 if the library
+// folders can't be read.
+int steam_local_scan(const char *steam_root, SteamLocalLibrary *library);
+void steam_local_library_clear(SteamLocalLibrary *library);
+void steam_install_clear(SteamInstall *install);
+// The library folders libraryfolders.vdf lists, the Steam directory first;
+// free with steam_local_free_folders
+char **steam_local_library_folders(const char *steam_root, size_t *count);
+void steam_local_free_folders(char **folders, size_t count);
+// Whether a file name is that of an app manifest
+int steam_local_is_manifest(const char *name);
+// Reads a single appmanifest_*.acf; returns 0 unless it describes a game
+int steam_local_read_manifest(const char *path, SteamInstall *install);
+// Reads the playtime of every app from a userdata/<account>/config/localconfig.vdf
+int steam_local_read_playtimes(const char *path, SteamPlaytime **playtimes, size_t *count);
+// Scans the library at steam_root and stores what it holds in steam_games
+// and steam_installs
+int steam_local_import(sqlite3 *db, const char *steam_root);
+
+#endif /* __STEAM_LOCAL_H__ */
@@ -0,0 +1,406 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <sqlite3.h>
+
+#include "steam_local.h"
+#include "steam_watch.h"
+#include "trace.h"
+
+// How long changes are collected before they are written
+#define STEAM_WATCH_DELAY_MS 250
+// A userdata directory is named by the account's 32-bit id
+#define STEAM_ID64_BASE G_GUINT64_CONSTANT(76561197960265728)
+
+#define DIR_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR)
+
+typedef enum {
+    WATCH_LIBRARY,      // <library>/steamapps
+    WATCH_USERDATA,     // <root>/userdata, for accounts that log in later
+    WATCH_USER_CONFIG   // <root>/userdata/<account>/config
+} WatchKind;
+
+typedef struct {
+    WatchKind kind;
+    char *dir;
+    char *steam_id;     // the account, for WATCH_USER_CONFIG
+} WatchedDir;
+
+struct SteamWatch {
+    int fd;
+    guint source;
+    guint flush_source;
+    char *steam_root;
+    char *db_path;
+    SteamWatchCallback callback;
+    gpointer user_data;
+    GHashTable *dirs;       // watch descriptor -> WatchedDir
+    GHashTable *manifests;  // paths of changed manifests
+    GHashTable *configs;    // path of a changed localconfig.vdf -> Steam ID
+    gboolean rescan;        // the library folders changed, or events were lost
+    gboolean busy;          // a batch is being written
+    gboolean closing;       // freed while busy
+};
+
+typedef struct {
+    char *steam_root;
+    char *db_path;
+    gboolean rescan;
+    GPtrArray *manifests;
+    GPtrArray *config_paths;
+    GPtrArray *config_ids;
+    DBChange *changes;
+    size_t count;
+} Batch;
+
+static void watched_dir_free(gpointer p)
+{
+    WatchedDir *dir = (WatchedDir *)p;
+    g_free(dir->dir);
+    g_free(dir->steam_id);
+    g_free(dir);
+}
+
+static void batch_free(gpointer p)
+{
+    Batch *batch = (Batch *)p;
+
+    g_free(batch->steam_root);
+    g_free(batch->db_path);
+    g_ptr_array_unref(batch->manifests);
+    g_ptr_array_unref(batch->config_paths);
+    g_ptr_array_unref(batch->config_ids);
+    free(batch->changes);
+    g_free(batch);
+}
+
+static void add_watch(SteamWatch *watch, WatchKind kind, const char *dir, guint32 mask, const char *steam_id)
+{
+    int wd = inotify_add_watch(watch->fd, dir, mask);
+    WatchedDir *watched;
+
+    if (wd < 0) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "Can't watch %s: %s\n", dir, strerror(errno));
+        }
+        return;
+    }
+    // Watching a directory again returns the same descriptor
+    watched = g_new0(WatchedDir, 1);
+    watched->kind = kind;
+    watched->dir = g_strdup(dir);
+    watched->steam_id = g_strdup(steam_id);
+    g_hash_table_replace(watch->dirs, GINT_TO_POINTER(wd), watched);
+}
+
+static void watch_library_folders(SteamWatch *watch)
+{
+    size_t count, i;
+    char **folders = steam_local_library_folders(watch->steam_root, &count);
+
+    for (i = 0; i < count; i++) {
+        char *steamapps = g_build_filename(folders[i], "steamapps", NULL);
+        add_watch(watch, WATCH_LIBRARY, steamapps, DIR_EVENTS, NULL);
+        g_free(steamapps);
+    }
+    steam_local_free_folders(folders, count);
+}
+
+static void watch_user_configs(SteamWatch *watch)
+{
+    char *userdata = g_build_filename(watch->steam_root, "userdata", NULL);
+    GDir *dir = g_dir_open(userdata, 0, NULL);
+    const char *name;
+
+    add_watch(watch, WATCH_USERDATA, userdata, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR, NULL);
+    while (dir && (name = g_dir_read_name(dir))) {
+        guint64 account_id = g_ascii_strtoull(name, NULL, 10);
+
+        if (account_id > 0) {
+            char *config = g_build_filename(userdata, name, "config", NULL);
+            char *steam_id = g_strdup_printf("%" G_GUINT64_FORMAT, STEAM_ID64_BASE + account_id);
+            add_watch(watch, WATCH_USER_CONFIG, config, DIR_EVENTS, steam_id);
+            g_free(steam_id);
+            g_free(config);
+        }
+    }
+    if (dir) {
+        g_dir_close(dir);
+    }
+    g_free(userdata);
+}
+
+// Reads one manifest again. A manifest that is gone means the game was
+// uninstalled; one that can't be read is likely still being written.
+static void apply_manifest(sqlite3 *db, const char *path)
+{
+    SteamInstall install;
+    char *name;
+
+    if (steam_local_read_manifest(path, &install)) {
+        db_set_steam_install(db, &install);
+        steam_install_clear(&install);
+    } else if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+        name = g_path_get_basename(path);
+        db_remove_steam_install(db, (int)strtol(name + strlen("appmanifest_"), NULL, 10));
+        g_free(name);
+    }
+}
+
+static void write_batch(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    TRACE_SCOPE("steam_watch write_batch");
+    Batch *batch = (Batch *)task_data;
+    sqlite3 *db = db_open(batch->db_path);
+    DBChangeLog *log;
+    guint i;
+
+    if (!db) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "Can't open database %s", batch->db_path);
+        return;
+    }
+    log = db_change_log_attach(db);
+
+    if (batch->rescan) {
+        steam_local_import(db, batch->steam_root);
+    } else {
+        for (i = 0; i < batch->manifests->len; i++) {
+            apply_manifest(db, g_ptr_array_index(batch->manifests, i));
+        }
+    }
+    for (i = 0; i < batch->config_paths->len; i++) {
+        SteamPlaytime *playtimes;
+        size_t count;
+
+        if (steam_local_read_playtimes(g_ptr_array_index(batch->config_paths, i), &playtimes, &count)) {
+            db_update_steam_playtimes(db, g_ptr_array_index(batch->config_ids, i), playtimes, count);
+            free(playtimes);
+        }
+    }
+
+    batch->changes = db_change_log_take(log, &batch->count);
+    db_change_log_detach(log);
+    db_close(db);
+    g_task_return_boolean(task, TRUE);
+}
+
+static void steam_watch_destroy(SteamWatch *watch)
+{
+    g_hash_table_destroy(watch->dirs);
+    g_hash_table_destroy(watch->manifests);
+    g_hash_table_destroy(watch->configs);
+    g_free(watch->steam_root);
+    g_free(watch->db_path);
+    g_free(watch);
+}
+
+static gboolean flush_changes(gpointer data);
+
+static void schedule_flush(SteamWatch *watch)
+{
+    if (!watch->flush_source && !watch->busy) {
+        watch->flush_source = g_timeout_add(STEAM_WATCH_DELAY_MS, flush_changes, watch);
+    }
+}
+
+static void on_batch_written(GObject *source_object, GAsyncResult *result, gpointer data)
+{
+    SteamWatch *watch = (SteamWatch *)data;
+    Batch *batch = g_task_get_task_data(G_TASK(result));
+    GError *error = NULL;
+
+    watch->busy = FALSE;
+    if (watch->closing) {
+        steam_watch_destroy(watch);
+        return;
+    }
+
+    if (!g_task_propagate_boolean(G_TASK(result), &error)) {
+        fprintf(stderr, "Failed to store Steam client changes: %s\n", error->message);
+        g_error_free(error);
+    } else if (batch->count > 0) {
+        watch->callback(batch->changes, batch->count, watch->user_data);
+    }
+
+    // Files that changed while the batch was written
+    if (watch->rescan || g_hash_table_size(watch->manifests) > 0 || g_hash_table_size(watch->configs) > 0) {
+        schedule_flush(watch);
+    }
+}
+
+static gboolean flush_changes(gpointer data)
+{
+    SteamWatch *watch = (SteamWatch *)data;
+    Batch *batch = g_new0(Batch, 1);
+    GHashTableIter iter;
+    gpointer key, value;
+    GTask *task;
+
+    watch->flush_source = 0;
+    batch->steam_root = g_strdup(watch->steam_root);
+    batch->db_path = g_strdup(watch->db_path);
+    batch->rescan = watch->rescan;
+    batch->manifests = g_ptr_array_new_with_free_func(g_free);
+    batch->config_paths = g_ptr_array_new_with_free_func(g_free);
+    batch->config_ids = g_ptr_array_new_with_free_func(g_free);
+
+    // A rescan reads every manifest anyway
+    g_hash_table_iter_init(&iter, watch->manifests);
+    while (!watch->rescan && g_hash_table_iter_next(&iter, &key, NULL)) {
+        g_ptr_array_add(batch->manifests, g_strdup(key));
+    }
+    g_hash_table_iter_init(&iter, watch->configs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_ptr_array_add(batch->config_paths, g_strdup(key));
+        g_ptr_array_add(batch->config_ids, g_strdup(value));
+    }
+    g_hash_table_remove_all(watch->manifests);
+    g_hash_table_remove_all(watch->configs);
+    watch->rescan = FALSE;
+
+    watch->busy = TRUE;
+    task = g_task_new(NULL, NULL, on_batch_written, watch);
+    g_task_set_task_data(task, batch, batch_free);
+    g_task_run_in_thread(task, write_batch);
+    g_object_unref(task);
+    return G_SOURCE_REMOVE;
+}
+
+// Every account's playtime, for when events were lost
+static void reread_user_configs(SteamWatch *watch)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, watch->dirs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        WatchedDir *dir = (WatchedDir *)value;
+
+        if (dir->kind == WATCH_USER_CONFIG) {
+            g_hash_table_replace(watch->configs, g_build_filename(dir->dir, "localconfig.vdf", NULL), g_strdup(dir->steam_id));
+        }
+    }
+}
+
+static void handle_event(SteamWatch *watch, const struct inotify_event *event)
+{
+    WatchedDir *dir;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+        watch->rescan = TRUE;
+        reread_user_configs(watch);
+        schedule_flush(watch);
+        return;
+    }
+    dir = g_hash_table_lookup(watch->dirs, GINT_TO_POINTER(event->wd));
+    if (!dir) {
+        return;
+    }
+    if (event->mask & IN_IGNORED) {
+        // The directory is gone, or its drive was unmounted
+        g_hash_table_remove(watch->dirs, GINT_TO_POINTER(event->wd));
+        return;
+    }
+    if (event->len == 0) {
+        return;
+    }
+
+    switch (dir->kind) {
+    case WATCH_LIBRARY:
+        if (strcmp(event->name, "libraryfolders.vdf") == 0) {
+            watch_library_folders(watch);
+            watch->rescan = TRUE;
+        } else if (steam_local_is_manifest(event->name)) {
+            g_hash_table_add(watch->manifests, g_build_filename(dir->dir, event->name, NULL));
+        } else {
+            return;
+        }
+        break;
+    case WATCH_USERDATA:
+        watch_user_configs(watch);
+        return;
+    case WATCH_USER_CONFIG:
+        if (strcmp(event->name, "localconfig.vdf") != 0) {
+            return;
+        }
+        g_hash_table_replace(watch->configs, g_build_filename(dir->dir, event->name, NULL), g_strdup(dir->steam_id));
+        break;
+    }
+    schedule_flush(watch);
+}
+
+static gboolean on_inotify_readable(gint fd, GIOCondition condition, gpointer data)
+{
+    SteamWatch *watch = (SteamWatch *)data;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        const char *p = buffer;
+
+        while (p < buffer + len) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            handle_event(watch, event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    if (len < 0 && errno != EAGAIN && errno != EINTR) {
+        fprintf(stderr, "Stopped watching the Steam client: %s\n", strerror(errno));
+        watch->source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+SteamWatch *steam_watch_new(const char *steam_root, const char *db_path, SteamWatchCallback callback, gpointer user_data)
+{
+    TRACE_SCOPE("steam_watch_new");
+    SteamWatch *watch;
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0) {
+        fprintf(stderr, "Can't watch the Steam client: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    watch = g_new0(SteamWatch, 1);
+    watch->fd = fd;
+    watch->steam_root = g_strdup(steam_root);
+    watch->db_path = g_strdup(db_path);
+    watch->callback = callback;
+    watch->user_data = user_data;
+    watch->dirs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, watched_dir_free);
+    watch->manifests = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    watch->configs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    watch_library_folders(watch);
+    watch_user_configs(watch);
+    watch->source = g_unix_fd_add(fd, G_IO_IN, on_inotify_readable, watch);
+    return watch;
+}
+
+void steam_watch_free(SteamWatch *watch)
+{
+    if (!watch) {
+        return;
+    }
+    if (watch->source) {
+        g_source_remove(watch->source);
+    }
+    if (watch->flush_source) {
+        g_source_remove(watch->flush_source);
+    }
+    close(watch->fd);
+
+    if (watch->busy) {
+        watch->closing = TRUE;  // on_batch_written finishes the job
+        return;
+    }
+    steam_watch_destroy(watch);
+}
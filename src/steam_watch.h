@@ -0,0 +1,28 @@
+#ifndef __STEAM_WATCH_H__
+#define __STEAM_WATCH_H__
+
+#include <glib.h>
+
+#include "db.h"
+
+// Follows the Steam client's files with inotify from the main loop, so
+// installs, uninstalls and playtime show up without a sync:
+//
+// - appmanifest_*.acf in every library folder, one game's install each
+// - libraryfolders.vdf, when library folders come or go
+// - userdata/<account>/config/localconfig.vdf, every app's playtime
+//
+// Changes are collected for a moment, since Steam rewrites a manifest many
+// times during a download, then only the files that changed are read again
+// and written to the database on a worker thread with its own connection.
+typedef struct SteamWatch SteamWatch;
+
+// Invoked on the main context with what a batch of file changes committed
+typedef void (*SteamWatchCallback)(const DBChange *changes, size_t count, gpointer user_data);
+
+// Returns NULL if inotify isn't available
+SteamWatch *steam_watch_new(const char *steam_root, const char *db_path, SteamWatchCallback callback, gpointer user_data);
+// A batch that is being written still finishes, but isn't reported
+void steam_watch_free(SteamWatch *watch);
+
+#endif /* __STEAM_WATCH_H__ */
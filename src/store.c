@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cjson/cJSON.h>
+#include <curl/curl.h>
+#include <sqlite3.h>
+
+#include "store.h"
+#include "trace.h"
+
+#define STORE_BASE "https://store.steampowered.com"
+
+typedef struct StoreFetch StoreFetch;
+
+// One request slot, reused for app after app
+typedef struct {
+    StoreFetch *fetch;
+    int game_id;
+    char url[256];
+    HttpCacheEntry entry;
+    int cached;
+    HttpRequest request;
+} AppFetch;
+
+struct StoreFetch {
+    HttpClient *client;
+    HttpCache *cache;
+    sqlite3 *db;
+    const int *app_ids;
+    size_t count;
+    size_t next;        // the next app to start
+    size_t done;
+    size_t stored;
+    StoreProgressCallback progress;
+    void *user_data;
+    StoreFetchResult result;
+    int stopped;        // rate limited or aborted; nothing more is started
+    AppFetch slots[STORE_MAX_IN_FLIGHT];
+};
+
+// LVL_STEAM_STORE_BASE points the client at another server, like
+// LVL_STEAM_API_BASE does for the Web API
+static const char *store_base(void)
+{
+    const char *base = getenv("LVL_STEAM_STORE_BASE");
+    return base && *base ? base : STORE_BASE;
+}
+
+// Joins the strings of an array, or the given member of each of its
+// objects, with ", ". NULL if there are none.
+static char *join_array(const cJSON *array, const char *member)
+{
+    const cJSON *item;
+    size_t len = 0;
+    char *out;
+
+    cJSON_ArrayForEach(item, array) {
+        const cJSON *value = member ? cJSON_GetObjectItemCaseSensitive(item, member) : item;
+        if (cJSON_IsString(value)) {
+            len += strlen(value->valuestring) + 2;
+        }
+    }
+    if (len == 0 || !(out = malloc(len))) {
+        return NULL;
+    }
+    out[0] = '\0';
+    cJSON_ArrayForEach(item, array) {
+        const cJSON *value = member ? cJSON_GetObjectItemCaseSensitive(item, member) : item;
+        if (cJSON_IsString(value)) {
+            if (out[0]) {
+                strcat(out, ", ");
+            }
+            strcat(out, value->valuestring);
+        }
+    }
+    return out;
+}
+
+static const char *get_string(const cJSON *object, const char *member)
+{
+    const cJSON *value = cJSON_GetObjectItemCaseSensitive(object, member);
+    return cJSON_IsString(value) ? value->valuestring : NULL;
+}
+
+// short_description comes HTML escaped. Decodes the entities it uses in
+// place, so neither the details pane nor the search index sees them.
+static char *unescape_html(char *text)
+{
+    static const struct {
+        const char *entity;
+        char c;
+    } entities[] = { { "&amp;", '&' }, { "&quot;", '"' }, { "&lt;", '<' }, { "&gt;", '>' },
+                     { "&#39;", '\'' }, { "&apos;", '\'' } };
+    char *in, *out;
+    size_t i;
+
+    if (!text) {
+        return NULL;
+    }
+    for (in = out = text; *in; ) {
+        int decoded = 0;
+
+        for (i = 0; *in == '&' && !decoded && i < sizeof(entities) / sizeof(entities[0]); i++) {
+            size_t len = strlen(entities[i].entity);
+            if (strncmp(in, entities[i].entity, len) == 0) {
+                *out++ = entities[i].c;
+                in += len;
+                decoded = 1;
+            }
+        }
+        if (!decoded) {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+    return text;
+}
+
+// Stores what an appdetails response says about the app: its page, or that
+// it has none. When throttling, the store answers with null or without the
+// app, which says nothing about the app and isn't stored.
+static StoreFetchResult store_response(StoreFetch *fetch, int game_id, const char *body)
+{
+    TRACE_SCOPE("store_response");
+    cJSON *json = cJSON_Parse(body);
+    char key[16];
+    const cJSON *app, *success, *data;
+    StoreDetails details = {0};
+    StoreFetchResult result = STORE_FETCH_OK;
+
+    if (!json) {
+        fprintf(stderr, "Failed to parse store details of %d\n", game_id);
+        return STORE_FETCH_FAILED;
+    }
+    snprintf(key, sizeof(key), "%d", game_id);
+    app = cJSON_GetObjectItemCaseSensitive(json, key);
+    success = cJSON_GetObjectItemCaseSensitive(app, "success");
+    data = cJSON_GetObjectItemCaseSensitive(app, "data");
+    if (!cJSON_IsObject(app) || !cJSON_IsBool(success)) {
+        fprintf(stderr, "Store details of %d are missing from the response\n", game_id);
+        cJSON_Delete(json);
+        return STORE_FETCH_RATE_LIMITED;
+    }
+    if (cJSON_IsTrue(success) && !cJSON_IsObject(data)) {
+        fprintf(stderr, "Store details of %d have no data\n", game_id);
+        cJSON_Delete(json);
+        return STORE_FETCH_FAILED;
+    }
+
+    details.game_id = game_id;
+    if (cJSON_IsTrue(success)) {
+        details.name = get_string(data, "name");
+        details.genres = join_array(cJSON_GetObjectItemCaseSensitive(data, "genres"), "description");
+        details.categories = join_array(cJSON_GetObjectItemCaseSensitive(data, "categories"), "description");
+        details.developers = join_array(cJSON_GetObjectItemCaseSensitive(data, "developers"), NULL);
+        details.publishers = join_array(cJSON_GetObjectItemCaseSensitive(data, "publishers"), NULL);
+        details.release_date = get_string(cJSON_GetObjectItemCaseSensitive(data, "release_date"), "date");
+        details.description = unescape_html((char *)get_string(data, "short_description"));
+    }
+    if (db_set_store_details(fetch->db, &details, (sqlite3_int64)time(NULL))) {
+        fetch->stored++;
+    } else {
+        result = STORE_FETCH_FAILED;
+    }
+
+    free((char *)details.genres);
+    free((char *)details.categories);
+    free((char *)details.developers);
+    free((char *)details.publishers);
+    cJSON_Delete(json);
+    return result;
+}
+
+static char *read_cached_body(HttpCache *cache, const HttpCacheEntry *entry)
+{
+    FILE *file = http_cache_open_body(cache, entry);
+    char *body = NULL;
+    size_t len = 0, cap = 0, n;
+
+    if (!file) {
+        return NULL;
+    }
+    do {
+        if (len + 4096 + 1 > cap) {
+            char *grown = realloc(body, cap = cap ? cap * 2 : 16 * 1024);
+            if (!grown) {
+                free(body);
+                fclose(file);
+                return NULL;
+            }
+            body = grown;
+        }
+        n = fread(body + len, 1, cap - len - 1, file);
+        len += n;
+    } while (n > 0);
+    body[len] = '\0';
+    fclose(file);
+    return body;
+}
+
+static int store_cached_response(StoreFetch *fetch, AppFetch *slot)
+{
+    char *body = read_cached_body(fetch->cache, &slot->entry);
+    int ok;
+
+    if (!body) {
+        fprintf(stderr, "Cached store details of %d are missing\n", slot->game_id);
+        return 0;
+    }
+    ok = store_response(fetch, slot->game_id, body) == STORE_FETCH_OK;
+    free(body);
+    return ok;
+}
+
+// Keeps the first failure, except that running into the rate limit or
+// aborting stops the fetch
+static void fail(StoreFetch *fetch, StoreFetchResult result)
+{
+    if (result == STORE_FETCH_RATE_LIMITED || result == STORE_FETCH_ABORTED) {
+        fetch->stopped = 1;
+        if (fetch->result != STORE_FETCH_ABORTED) {
+            fetch->result = result;
+        }
+    } else if (fetch->result == STORE_FETCH_OK) {
+        fetch->result = result;
+    }
+}
+
+static void finish_app(StoreFetch *fetch, AppFetch *slot)
+{
+    http_request_clear(&slot->request);
+    http_cache_entry_clear(&slot->entry);
+    fetch->done++;
+    if (fetch->progress && fetch->progress(fetch->done, fetch->count, fetch->user_data)) {
+        fail(fetch, STORE_FETCH_ABORTED);
+    }
+}
+
+static void on_app_request_done(HttpRequest *request, void *user_data);
+
+// Starts the next app on a free slot. Apps the cache has fresh answers for
+// are stored right away, so this keeps going until one needs the network.
+static void start_next(StoreFetch *fetch, AppFetch *slot)
+{
+    while (!fetch->stopped && fetch->next < fetch->count) {
+        slot->game_id = fetch->app_ids[fetch->next++];
+        snprintf(slot->url, sizeof(slot->url), "%s/api/appdetails?appids=%d&l=english", store_base(), slot->game_id);
+        http_request_init(&slot->request, slot->url);
+        slot->cached = fetch->cache && http_cache_lookup(fetch->cache, slot->url, &slot->entry);
+
+        if (slot->cached && http_cache_is_fresh(&slot->entry, time(NULL))) {
+            if (!store_cached_response(fetch, slot)) {
+                fail(fetch, STORE_FETCH_FAILED);
+            }
+            finish_app(fetch, slot);
+            continue;
+        }
+        if (slot->cached) {
+            http_cache_add_validators(&slot->entry, &slot->request);
+        }
+        slot->request.done = on_app_request_done;
+        slot->request.done_data = slot;
+        if (http_client_add(fetch->client, &slot->request)) {
+            return;
+        }
+        fprintf(stderr, "Failed to start a store request\n");
+        fail(fetch, STORE_FETCH_FAILED);
+        finish_app(fetch, slot);
+    }
+}
+
+// Runs inside http_client_run as each response comes in, and hands the slot
+// to the next app
+static void on_app_request_done(HttpRequest *request, void *user_data)
+{
+    AppFetch *slot = (AppFetch *)user_data;
+    StoreFetch *fetch = slot->fetch;
+
+    if (request->result == CURLE_ABORTED_BY_CALLBACK) {
+        fail(fetch, STORE_FETCH_ABORTED);
+    } else if (request->result != CURLE_OK) {
+        fail(fetch, STORE_FETCH_UNAVAILABLE);
+    } else if (request->status == 304 && slot->cached) {
+        http_cache_touch(fetch->cache, &slot->entry, request);
+        if (!store_cached_response(fetch, slot)) {
+            fail(fetch, STORE_FETCH_FAILED);
+        }
+    } else if (request->status == 200) {
+        StoreFetchResult result = store_response(fetch, slot->game_id, request->body.memory);
+
+        if (result == STORE_FETCH_OK) {
+            if (fetch->cache) {
+                HttpCacheWriter *writer = http_cache_writer_new(fetch->cache, slot->url);
+                if (writer && http_cache_writer_write(writer, request->body.memory, request->body.size)) {
+                    http_cache_writer_commit(writer, request);
+                } else {
+                    http_cache_writer_discard(writer);
+                }
+            }
+        } else {
+            fail(fetch, result);
+        }
+    } else {
+        fprintf(stderr, "Steam store returned HTTP %ld for %d\n", request->status, slot->game_id);
+        if (request->status == 429 || request->status == 403) {
+            fail(fetch, STORE_FETCH_RATE_LIMITED);
+        } else if (request->status >= 500) {
+            fail(fetch, STORE_FETCH_UNAVAILABLE);
+        } else {
+            fail(fetch, STORE_FETCH_FAILED);
+        }
+    }
+
+    finish_app(fetch, slot);
+    start_next(fetch, slot);
+}
+
+static int store_tick(void *user_data)
+{
+    StoreFetch *fetch = (StoreFetch *)user_data;
+
+    if (fetch->progress && fetch->progress(fetch->done, fetch->count, fetch->user_data)) {
+        fail(fetch, STORE_FETCH_ABORTED);
+        return 1;
+    }
+    return 0;
+}
+
+StoreFetchResult fetch_store_details(HttpClient *client, HttpCache *cache, sqlite3 *db, const int *app_ids, size_t count,
+                                     StoreProgressCallback progress, void *user_data, size_t *stored)
+{
+    TRACE_SCOPE("fetch_store_details");
+    StoreFetch fetch = {0};
+    size_t i;
+
+    fetch.client = client;
+    fetch.cache = cache;
+    fetch.db = db;
+    fetch.app_ids = app_ids;
+    fetch.count = count;
+    fetch.progress = progress;
+    fetch.user_data = user_data;
+    fetch.result = STORE_FETCH_OK;
+
+    for (i = 0; i < STORE_MAX_IN_FLIGHT; i++) {
+        fetch.slots[i].fetch = &fetch;
+        start_next(&fetch, &fetch.slots[i]);
+    }
+    if (!http_client_run(client, store_tick, &fetch)) {
+        fail(&fetch, STORE_FETCH_ABORTED);
+    }
+
+    if (stored) {
+        *stored = fetch.stored;
+    }
+    return fetch.result;
+}
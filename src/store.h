@@ -0,0 +1,39 @@
+#ifndef __STORE_H__
+#define __STORE_H__
+
+#include <stddef.h>
+
+#include <sqlite3.h>
+
+#include "db.h"
+#include "http.h"
+#include "http_cache.h"
+
+// Store requests in flight at once. The store API allows about 200 requests
+// per five minutes, so a few at a time keep it busy without bursting.
+#define STORE_MAX_IN_FLIGHT 4
+// Store details older than this are fetched again
+#define STORE_MAX_AGE (30 * 24 * 60 * 60)
+
+typedef enum {
+    STORE_FETCH_OK,
+    STORE_FETCH_ABORTED,
+    STORE_FETCH_RATE_LIMITED,  // HTTP 429, or the 403 the store answers with instead
+    STORE_FETCH_UNAVAILABLE,   // a network error or HTTP 5xx
+    STORE_FETCH_FAILED
+} StoreFetchResult;
+
+// done/total are apps finished/apps asked for. Return non-zero to abort.
+typedef int (*StoreProgressCallback)(size_t done, size_t total, void *user_data);
+
+// Fetches the store details of Steam apps from appdetails and stores each
+// as soon as it arrives (see db_set_store_details). At most
+// STORE_MAX_IN_FLIGHT requests run on the client at a time; as one finishes
+// the next app starts. With a cache, fresh responses skip the network and
+// stale ones are revalidated. Once the store says too many requests were
+// made, or answers without the app as it does when throttling, no more are
+// started, and the apps left over stay pending for the next run. stored receives how many apps were written.
+StoreFetchResult fetch_store_details(HttpClient *client, HttpCache *cache, sqlite3 *db, const int *app_ids, size_t count,
+                                     StoreProgressCallback progress, void *user_data, size_t *stored);
+
+#endif /* __STORE_H__ */
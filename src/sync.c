@@ -0,0 +1,342 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <gio/gio.h>
+#include <sqlite3.h>
+
+#include "db.h"
+#include "sync.h"
+#include "steam.h"
+#include "trace.h"
+
+#define PROGRESS_INTERVAL_US (100 * 1000)
+
+G_DEFINE_QUARK(steam-sync-error-quark, steam_sync_error)
+
+typedef struct {
+    HttpClient *client;
+    HttpCache *cache;
+    char *db_path;
+    SteamAccount *accounts;
+    size_t count;
+    GError **errors;            // per account, NULL once it synced
+    DBChangeLog *log;
+    GMainContext *context;
+    GCancellable *cancellable;
+    SteamSyncProgressCallback progress;
+    SteamSyncAccountCallback account_done;
+    gpointer callback_data;
+    SteamStage last_stage;
+    gint64 last_report;
+} SyncData;
+
+typedef struct {
+    HttpClient *client;
+    HttpCache *cache;
+    char *db_path;
+    int limit;
+    GCancellable *cancellable;
+    gboolean more;              // the run took its full limit
+} StoreSyncData;
+
+typedef struct {
+    SteamSyncProgressCallback progress;
+    gpointer progress_data;
+    SteamStage stage;
+    size_t done;
+    size_t total;
+} ProgressUpdate;
+
+typedef struct {
+    SyncData *data;
+    GTask *task;                // keeps data alive until the update ran
+    size_t index;
+    SteamSyncDelta delta;
+    DBChange *changes;
+    size_t count;
+} AccountUpdate;
+
+static void sync_data_free(gpointer p)
+{
+    SyncData *data = (SyncData *)p;
+    size_t i;
+
+    for (i = 0; i < data->count; i++) {
+        g_free(data->accounts[i].api_key);
+        g_free(data->accounts[i].steam_id);
+        g_clear_error(&data->errors[i]);
+    }
+    g_free(data->accounts);
+    g_free(data->errors);
+    g_free(data->db_path);
+    g_main_context_unref(data->context);
+    g_free(data);
+}
+
+static gboolean dispatch_progress(gpointer p)
+{
+    ProgressUpdate *update = (ProgressUpdate *)p;
+    update->progress(update->stage, update->done, update->total, update->progress_data);
+    return G_SOURCE_REMOVE;
+}
+
+// Runs on the worker thread; forwards throttled progress to the main context
+// and turns cancellation into an abort request for the Steam fetch.
+static int sync_progress(SteamStage stage, size_t done, size_t total, void *user_data)
+{
+    SyncData *data = g_task_get_task_data(G_TASK(user_data));
+
+    if (g_cancellable_is_cancelled(data->cancellable)) {
+        return 1;
+    }
+
+    if (data->progress) {
+        gint64 now = g_get_monotonic_time();
+        gboolean finished = total > 0 && done >= total;
+
+        if (stage != data->last_stage || finished || now - data->last_report >= PROGRESS_INTERVAL_US) {
+            ProgressUpdate *update = g_new(ProgressUpdate, 1);
+            update->progress = data->progress;
+            update->progress_data = data->callback_data;
+            update->stage = stage;
+            update->done = done;
+            update->total = total;
+
+            data->last_stage = stage;
+            data->last_report = now;
+            g_main_context_invoke_full(data->context, G_PRIORITY_DEFAULT, dispatch_progress, update, g_free);
+        }
+    }
+
+    return 0;
+}
+
+static GError *account_error(SteamFetchResult result)
+{
+    switch (result) {
+    case STEAM_FETCH_OK:
+    case STEAM_FETCH_UNCHANGED:
+        return NULL;
+    case STEAM_FETCH_INVALID_CREDENTIALS:
+        return g_error_new(STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_INVALID_CREDENTIALS, "Invalid Steam API Key or Steam ID");
+    case STEAM_FETCH_ABORTED:
+        return g_error_new(G_IO_ERROR, G_IO_ERROR_CANCELLED, "The Steam sync was cancelled");
+    case STEAM_FETCH_RATE_LIMITED:
+        return g_error_new(STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_RATE_LIMITED, "Too many requests to the Steam API");
+    case STEAM_FETCH_UNAVAILABLE:
+        return g_error_new(STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_UNAVAILABLE, "The Steam API can't be reached");
+    default:
+        return g_error_new(STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_FETCH, "Failed to fetch the Steam library");
+    }
+}
+
+static gboolean dispatch_account(gpointer p)
+{
+    AccountUpdate *update = (AccountUpdate *)p;
+    SyncData *data = update->data;
+
+    data->account_done(&data->accounts[update->index], data->errors[update->index], &update->delta,
+                       update->changes, update->count, data->callback_data);
+    return G_SOURCE_REMOVE;
+}
+
+static void account_update_free(gpointer p)
+{
+    AccountUpdate *update = (AccountUpdate *)p;
+
+    g_object_unref(update->task);
+    free(update->changes);
+    g_free(update);
+}
+
+// Runs on the worker thread right after an account committed or failed, so
+// its changes reach the caller without waiting for the other accounts
+static void sync_account_done(size_t index, SteamFetchResult result, const SteamSyncDelta *delta, void *user_data)
+{
+    GTask *task = G_TASK(user_data);
+    SyncData *data = g_task_get_task_data(task);
+    AccountUpdate *update;
+
+    data->errors[index] = account_error(result);
+    if (!data->account_done) {
+        return;
+    }
+
+    update = g_new0(AccountUpdate, 1);
+    update->data = data;
+    update->task = g_object_ref(task);
+    update->index = index;
+    update->delta = *delta;
+    update->changes = data->log ? db_change_log_take(data->log, &update->count) : NULL;
+    g_main_context_invoke_full(data->context, G_PRIORITY_DEFAULT, dispatch_account, update, account_update_free);
+}
+
+static void sync_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    TRACE_SCOPE("steam sync");
+    SyncData *data = (SyncData *)task_data;
+    SteamFetchResult *results;
+    size_t i;
+    sqlite3 *db;
+
+    // The UI thread keeps its own connection, which WAL lets it read from
+    // while this one writes
+    db = db_open(data->db_path);
+    if (!db) {
+        g_task_return_new_error(task, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_DATABASE,
+                                "Can't open database %s", data->db_path);
+        return;
+    }
+    data->log = db_change_log_attach(db);
+
+    results = g_new(SteamFetchResult, data->count);
+    fetch_steam_accounts(data->client, data->cache, data->accounts, data->count, db,
+                         sync_progress, sync_account_done, task, results);
+    db_change_log_detach(data->log);
+    data->log = NULL;
+    db_close(db);
+
+    // The results, not the errors sync_account_done saw, as an account can
+    // fail without being reported
+    if (g_task_return_error_if_cancelled(task)) {
+        g_free(results);
+        return;
+    }
+    for (i = 0; i < data->count; i++) {
+        if (results[i] == STEAM_FETCH_OK || results[i] == STEAM_FETCH_UNCHANGED) {
+            g_free(results);
+            g_task_return_boolean(task, TRUE);
+            return;
+        }
+    }
+    g_task_return_error(task, data->count > 0 ? account_error(results[0])
+                                              : g_error_new(STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_FETCH, "No Steam account to sync"));
+    g_free(results);
+}
+
+void steam_sync_async(HttpClient *client, HttpCache *cache, const char *db_path, const SteamAccount *accounts, size_t count,
+                      GCancellable *cancellable,
+                      SteamSyncProgressCallback progress, SteamSyncAccountCallback account_done, gpointer callback_data,
+                      GAsyncReadyCallback callback, gpointer user_data)
+{
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    SyncData *data = g_new0(SyncData, 1);
+    size_t i;
+
+    data->client = client;
+    data->cache = cache;
+    data->db_path = g_strdup(db_path);
+    data->accounts = g_new0(SteamAccount, count);
+    data->errors = g_new0(GError *, count);
+    data->count = count;
+    for (i = 0; i < count; i++) {
+        data->accounts[i].api_key = g_strdup(accounts[i].api_key);
+        data->accounts[i].steam_id = g_strdup(accounts[i].steam_id);
+    }
+    data->context = g_main_context_ref_thread_default();
+    data->cancellable = cancellable;
+    data->progress = progress;
+    data->account_done = account_done;
+    data->callback_data = callback_data;
+    data->last_stage = STEAM_STAGE_DOWNLOAD;
+
+    g_task_set_source_tag(task, steam_sync_async);
+    g_task_set_task_data(task, data, sync_data_free);
+    g_task_run_in_thread(task, sync_thread);
+    g_object_unref(task);
+}
+
+gboolean steam_sync_finish(GAsyncResult *result, GError **error)
+{
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+static void store_sync_data_free(gpointer p)
+{
+    StoreSyncData *data = (StoreSyncData *)p;
+
+    g_free(data->db_path);
+    g_free(data);
+}
+
+static int store_sync_progress(size_t done, size_t total, void *user_data)
+{
+    StoreSyncData *data = (StoreSyncData *)user_data;
+    return g_cancellable_is_cancelled(data->cancellable);
+}
+
+static void collect_app_id(int game_id, void *user_data)
+{
+    g_array_append_val((GArray *)user_data, game_id);
+}
+
+static void store_sync_thread(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+    TRACE_SCOPE("store sync");
+    StoreSyncData *data = (StoreSyncData *)task_data;
+    GArray *app_ids = g_array_new(FALSE, FALSE, sizeof(int));
+    StoreFetchResult result;
+    size_t stored = 0;
+    sqlite3 *db;
+
+    db = db_open(data->db_path);
+    if (!db) {
+        g_array_unref(app_ids);
+        g_task_return_new_error(task, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_DATABASE,
+                                "Can't open database %s", data->db_path);
+        return;
+    }
+    db_fetch_store_pending(db, (sqlite3_int64)time(NULL) - STORE_MAX_AGE, data->limit, collect_app_id, app_ids);
+    data->more = (int)app_ids->len == data->limit;
+    result = fetch_store_details(data->client, data->cache, db, (const int *)app_ids->data, app_ids->len,
+                                 store_sync_progress, data, &stored);
+    g_array_unref(app_ids);
+    db_close(db);
+
+    if (g_task_return_error_if_cancelled(task)) {
+        return;
+    }
+    switch (result) {
+    case STORE_FETCH_OK:
+        g_task_return_int(task, (gssize)stored);
+        break;
+    case STORE_FETCH_RATE_LIMITED:
+        g_task_return_new_error(task, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_RATE_LIMITED, "Too many requests to the Steam store");
+        break;
+    case STORE_FETCH_UNAVAILABLE:
+        g_task_return_new_error(task, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_UNAVAILABLE, "The Steam store can't be reached");
+        break;
+    default:
+        g_task_return_new_error(task, STEAM_SYNC_ERROR, STEAM_SYNC_ERROR_FETCH, "Failed to fetch store details");
+        break;
+    }
+}
+
+void store_sync_async(HttpClient *client, HttpCache *cache, const char *db_path, int limit, GCancellable *cancellable,
+                      GAsyncReadyCallback callback, gpointer user_data)
+{
+    GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+    StoreSyncData *data = g_new0(StoreSyncData, 1);
+
+    data->client = client;
+    data->cache = cache;
+    data->db_path = g_strdup(db_path);
+    data->limit = limit;
+    data->cancellable = cancellable;
+
+    g_task_set_source_tag(task, store_sync_async);
+    g_task_set_task_data(task, data, store_sync_data_free);
+    g_task_run_in_thread(task, store_sync_thread);
+    g_object_unref(task);
+}
+
+gssize store_sync_finish(GAsyncResult *result, gboolean *more, GError **error)
+{
+    StoreSyncData *data = g_task_get_task_data(G_TASK(result));
+
+    if (more) {
+        *more = data->more;
+    }
+    return g_task_propagate_int(G_TASK(result), error);
+}
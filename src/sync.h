@@ -0,0 +1,59 @@
+#ifndef __SYNC_H__
+#define __SYNC_H__
+
+#include <gio/gio.h>
+
+#include "db.h"
+#include "http.h"
+#include "http_cache.h"
+#include "steam.h"
+#include "store.h"
+
+#define STEAM_SYNC_ERROR (steam_sync_error_quark())
+
+typedef enum {
+    STEAM_SYNC_ERROR_INVALID_CREDENTIALS,
+    STEAM_SYNC_ERROR_DATABASE,
+    STEAM_SYNC_ERROR_RATE_LIMITED,
+    STEAM_SYNC_ERROR_UNAVAILABLE,
+    STEAM_SYNC_ERROR_FETCH
+} SteamSyncError;
+
+// Invoked on the caller's main context while the sync is running
+typedef void (*SteamSyncProgressCallback)(SteamStage stage, size_t done, size_t total, gpointer user_data);
+// Invoked on the caller's main context as soon as one account is done, before
+// the sync as a whole completes. error is NULL when the account synced;
+// changes are the DBChanges its import committed and delta counts them by
+// what happened to the account's rows.
+typedef void (*SteamSyncAccountCallback)(const SteamAccount *account, const GError *error, const SteamSyncDelta *delta,
+                                         const DBChange *changes, size_t count, gpointer user_data);
+
+GQuark steam_sync_error_quark(void);
+
+// Validates the credentials and imports the owned games of every account into
+// the database at db_path on a worker thread, all accounts at once (see
+// fetch_steam_accounts). The worker uses its own SQLite connection, so the
+// caller's connection stays usable while the sync runs. The HTTP client keeps
+// its connections between syncs and must not be used elsewhere meanwhile; the
+// cache may be NULL. The accounts are copied.
+void steam_sync_async(HttpClient *client, HttpCache *cache, const char *db_path, const SteamAccount *accounts, size_t count,
+                      GCancellable *cancellable,
+                      SteamSyncProgressCallback progress, SteamSyncAccountCallback account_done, gpointer callback_data,
+                      GAsyncReadyCallback callback, gpointer user_data);
+// Fails when the sync was cancelled, the database couldn't be opened or no
+// account synced, with the error of the first account in the last case
+gboolean steam_sync_finish(GAsyncResult *result, GError **error);
+
+// Fetches the store details the library's Steam games lack, or that are
+// older than STORE_MAX_AGE, on a worker thread with its own SQLite
+// connection: at most limit apps, those without details first (see
+// fetch_store_details). The HTTP client must not be used elsewhere
+// meanwhile; the cache may be NULL.
+void store_sync_async(HttpClient *client, HttpCache *cache, const char *db_path, int limit, GCancellable *cancellable,
+                      GAsyncReadyCallback callback, gpointer user_data);
+// Returns how many apps were stored, or -1 with error set. more is set when
+// the run took its full limit, so there may be apps left to fetch. Apps
+// stored before an error stay stored.
+gssize store_sync_finish(GAsyncResult *result, gboolean *more, GError **error);
+
+#endif /* __SYNC_H__ */
@@ -0,0 +1,208 @@
+#include <stdio.h>
+
+#include <glib.h>
+#include <sqlite3.h>
+
+#include "db.h"
+#include "sync_scheduler.h"
+
+#define SYNC_SCHEDULE_NAME "steam"
+// How old the library may get before it is synced again, in seconds
+#define SYNC_INTERVAL (60 * 60)
+// The first retry after a failure waits this long, doubling with every
+// failure after it up to SYNC_INTERVAL. Steam asks for more patience when
+// it starts refusing requests.
+#define SYNC_RETRY_BASE 30
+#define SYNC_RATE_LIMITED_RETRY_BASE (5 * 60)
+// Steam allows 100,000 Web API requests a day per key. One every three
+// seconds stays far below that while still allowing short bursts.
+#define STEAM_API_BURST 20.0
+#define STEAM_API_RATE (1.0 / 3.0)  // requests per second
+
+struct SyncScheduler {
+    sqlite3 *db;
+    SyncStartFunc start;
+    gpointer user_data;
+    SyncSchedule schedule;
+    guint timer;
+    gboolean running;
+    gboolean requested;     // asked for while a sync was running
+    gboolean manual;        // the next sync is one the user asked for
+    double tokens;          // Steam API requests that may be made right now
+    gint64 refilled_at;     // monotonic time of the last refill
+};
+
+static gint64 now_seconds(void)
+{
+    return g_get_real_time() / G_USEC_PER_SEC;
+}
+
+static void refill_tokens(SyncScheduler *scheduler)
+{
+    gint64 now = g_get_monotonic_time();
+    double earned = (double)(now - scheduler->refilled_at) / G_USEC_PER_SEC * STEAM_API_RATE;
+
+    scheduler->tokens = MIN(STEAM_API_BURST, scheduler->tokens + earned);
+    scheduler->refilled_at = now;
+}
+
+// Exponential backoff with equal jitter: half the delay is fixed and the
+// rest random, so clients that failed together don't retry together
+static gint64 retry_delay(int failures, gboolean rate_limited)
+{
+    gint64 delay = rate_limited ? SYNC_RATE_LIMITED_RETRY_BASE : SYNC_RETRY_BASE;
+    int i;
+
+    for (i = 1; i < failures && delay < SYNC_INTERVAL; i++) {
+        delay *= 2;
+    }
+    delay = MIN(delay, SYNC_INTERVAL);
+    return delay / 2 + g_random_int_range(0, (gint32)(delay / 2) + 1);
+}
+
+static gboolean on_timer(gpointer data);
+
+static void schedule_at(SyncScheduler *scheduler, gint64 when)
+{
+    // Clamped, in case the clock went back since the schedule was stored
+    gint64 delay = CLAMP(when - now_seconds(), 0, SYNC_INTERVAL);
+
+    if (scheduler->timer) {
+        g_source_remove(scheduler->timer);
+    }
+    scheduler->timer = delay > 0 ? g_timeout_add_seconds((guint)delay, on_timer, scheduler)
+                                 : g_idle_add(on_timer, scheduler);
+}
+
+static void run_sync(SyncScheduler *scheduler)
+{
+    gboolean manual = scheduler->manual;
+    guint requests;
+
+    if (scheduler->running) {
+        scheduler->requested = TRUE;
+        return;
+    }
+
+    refill_tokens(scheduler);
+    if (scheduler->tokens < 1.0) {
+        gint64 wait = (gint64)((1.0 - scheduler->tokens) / STEAM_API_RATE) + 1;
+
+        g_print("Steam sync held back %" G_GINT64_FORMAT " s by the rate limit\n", wait);
+        schedule_at(scheduler, now_seconds() + wait);
+        return;
+    }
+
+    if (scheduler->timer) {
+        g_source_remove(scheduler->timer);
+        scheduler->timer = 0;
+    }
+    scheduler->manual = FALSE;
+    scheduler->requested = FALSE;
+    requests = scheduler->start(manual, scheduler->user_data);
+    if (requests == 0) {
+        schedule_at(scheduler, now_seconds() + SYNC_INTERVAL);
+        return;
+    }
+    // A sync larger than the bucket leaves it in debt, which the next one
+    // waits out
+    scheduler->tokens -= requests;
+    scheduler->running = TRUE;
+}
+
+static gboolean on_timer(gpointer data)
+{
+    SyncScheduler *scheduler = (SyncScheduler *)data;
+
+    scheduler->timer = 0;
+    run_sync(scheduler);
+    return G_SOURCE_REMOVE;
+}
+
+SyncScheduler *sync_scheduler_new(sqlite3 *db, SyncStartFunc start, gpointer user_data)
+{
+    SyncScheduler *scheduler = g_new0(SyncScheduler, 1);
+
+    scheduler->db = db;
+    scheduler->start = start;
+    scheduler->user_data = user_data;
+    scheduler->tokens = STEAM_API_BURST;
+    scheduler->refilled_at = g_get_monotonic_time();
+
+    // A library that was never synced, or not for SYNC_INTERVAL, is synced
+    // right away; a backoff from the last run still applies
+    db_get_sync_schedule(db, SYNC_SCHEDULE_NAME, &scheduler->schedule);
+    schedule_at(scheduler, scheduler->schedule.next_attempt);
+    return scheduler;
+}
+
+void sync_scheduler_free(SyncScheduler *scheduler)
+{
+    if (!scheduler) {
+        return;
+    }
+    if (scheduler->timer) {
+        g_source_remove(scheduler->timer);
+    }
+    g_free(scheduler);
+}
+
+void sync_scheduler_request(SyncScheduler *scheduler)
+{
+    // The user waits for the rate limit, but not for a backoff
+    scheduler->manual = TRUE;
+    run_sync(scheduler);
+}
+
+// Moves the schedule on by how a sync went
+static void record_outcome(SyncSchedule *schedule, SyncOutcome outcome)
+{
+    gint64 now = now_seconds();
+
+    switch (outcome) {
+    case SYNC_OUTCOME_OK:
+        schedule->last_success = now;
+        // fall through
+    case SYNC_OUTCOME_CANCELLED:
+    case SYNC_OUTCOME_REJECTED:
+        schedule->failures = 0;
+        schedule->next_attempt = now + SYNC_INTERVAL;
+        break;
+    default:
+        schedule->failures++;
+        schedule->next_attempt = now + retry_delay(schedule->failures, outcome == SYNC_OUTCOME_RATE_LIMITED);
+        g_print("Retrying the Steam sync in %" G_GINT64_FORMAT " s\n", schedule->next_attempt - now);
+        break;
+    }
+}
+
+void sync_scheduler_finished(SyncScheduler *scheduler, SyncOutcome outcome)
+{
+    scheduler->running = FALSE;
+    record_outcome(&scheduler->schedule, outcome);
+    db_set_sync_schedule(scheduler->db, SYNC_SCHEDULE_NAME, &scheduler->schedule);
+
+    // A request made during a failed sync waits for the retry
+    if (scheduler->requested && outcome <= SYNC_OUTCOME_REJECTED) {
+        run_sync(scheduler);
+    } else {
+        schedule_at(scheduler, scheduler->schedule.next_attempt);
+    }
+}
+
+void sync_schedule_record(sqlite3 *db, SyncOutcome outcome)
+{
+    SyncSchedule schedule;
+
+    db_get_sync_schedule(db, SYNC_SCHEDULE_NAME, &schedule);
+    record_outcome(&schedule, outcome);
+    db_set_sync_schedule(db, SYNC_SCHEDULE_NAME, &schedule);
+}
+
+gint64 sync_schedule_due_in(sqlite3 *db)
+{
+    SyncSchedule schedule;
+
+    db_get_sync_schedule(db, SYNC_SCHEDULE_NAME, &schedule);
+    return CLAMP(schedule.next_attempt - now_seconds(), 0, SYNC_INTERVAL);
+}
@@ -0,0 +1,50 @@
+#ifndef __SYNC_SCHEDULER_H__
+#define __SYNC_SCHEDULER_H__
+
+#include <glib.h>
+#include <sqlite3.h>
+
+// Decides when the Steam library is synced, on the main loop:
+//
+// - every SYNC_INTERVAL, and at startup once the last sync is that old
+// - right away when the user asks, unless the rate limit says otherwise
+// - after a failure that may pass (HTTP 429 or 5xx, network errors), with
+//   exponential backoff and jitter
+//
+// Requests made while a sync is waiting are merged into it. Those made while
+// one runs queue exactly one more sync after it, since the running one may
+// have started before what was asked for changed; after a failure that may
+// pass, it waits for the retry. A token bucket counts Steam API requests so
+// no amount of retrying or clicking gets near the daily quota. The schedule
+// is stored in the sync_schedule table, so a restart picks up where the last
+// run left off.
+typedef struct SyncScheduler SyncScheduler;
+
+typedef enum {
+    SYNC_OUTCOME_OK,
+    SYNC_OUTCOME_CANCELLED,
+    SYNC_OUTCOME_REJECTED,      // the credentials were refused; retrying won't help
+    SYNC_OUTCOME_FAILED,
+    SYNC_OUTCOME_UNAVAILABLE,   // a network error or HTTP 5xx
+    SYNC_OUTCOME_RATE_LIMITED   // HTTP 429
+} SyncOutcome;
+
+// Starts a sync and returns how many Steam API requests it makes, or 0 if
+// there was nothing to sync. manual is set when the user asked for it.
+// sync_scheduler_finished must follow once a started sync is done.
+typedef guint (*SyncStartFunc)(gboolean manual, gpointer user_data);
+
+// db is only used from the main thread
+SyncScheduler *sync_scheduler_new(sqlite3 *db, SyncStartFunc start, gpointer user_data);
+void sync_scheduler_free(SyncScheduler *scheduler);
+// The user asked for a sync
+void sync_scheduler_request(SyncScheduler *scheduler);
+void sync_scheduler_finished(SyncScheduler *scheduler, SyncOutcome outcome);
+// Records a sync that ran without a scheduler, such as from the command
+// line, so the next scheduled one counts from it
+void sync_schedule_record(sqlite3 *db, SyncOutcome outcome);
+// Seconds until the schedule allows the next sync, 0 if it is due, so a sync
+// without a scheduler keeps to its interval and backoff too
+gint64 sync_schedule_due_in(sqlite3 *db);
+
+#endif /* __SYNC_SCHEDULER_H__ */
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+typedef struct {
+    const char *name;
+    uint64_t ts;      // ns
+    uint64_t dur;     // ns, spans only
+    int64_t value;    // counters only
+    long tid;
+    char phase;       // Chrome trace phase: X span, C counter, i instant
+} TraceEvent;
+
+int trace_enabled;
+
+static char *trace_path;
+static uint64_t trace_origin;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceEvent *events;
+static size_t event_count;
+static size_t event_cap;
+
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_exit(void)
+{
+    trace_flush();
+}
+
+void trace_init(const char *path)
+{
+    if (trace_enabled) {
+        return;
+    }
+    trace_path = strdup(path);
+    trace_origin = trace_now();
+    trace_enabled = 1;
+    atexit(trace_exit);
+}
+
+void trace_init_from_args(int *argc, char **argv)
+{
+    const char *path = getenv("LVL_TRACE");
+    int i, j;
+
+    for (i = 1, j = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0) {
+            path = "lvl-trace.json";
+        } else if (strncmp(argv[i], "--trace=", strlen("--trace=")) == 0) {
+            path = argv[i] + strlen("--trace=");
+        } else {
+            argv[j++] = argv[i];
+        }
+    }
+    *argc = j;
+    argv[j] = NULL;
+
+    if (path && strcmp(path, "1") == 0) {
+        path = "lvl-trace.json";
+    }
+    if (path && *path) {
+        trace_init(path);
+    }
+}
+
+static void record(const char *name, char phase, uint64_t ts, uint64_t dur, int64_t value)
+{
+    long tid = syscall(SYS_gettid);
+    TraceEvent *event;
+
+    pthread_mutex_lock(&trace_lock);
+    if (event_count == event_cap) {
+        size_t new_cap = event_cap ? event_cap * 2 : 4096;
+        TraceEvent *ptr = realloc(events, new_cap * sizeof(TraceEvent));
+        if (!ptr) {
+            pthread_mutex_unlock(&trace_lock);
+            return;
+        }
+        events = ptr;
+        event_cap = new_cap;
+    }
+    event = &events[event_count++];
+    event->name = name;
+    event->phase = phase;
+    event->ts = ts;
+    event->dur = dur;
+    event->value = value;
+    event->tid = tid;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_span_end(TraceSpan *span)
+{
+    if (trace_enabled && span->start) {
+        record(span->name, 'X', span->start, trace_now() - span->start, 0);
+    }
+}
+
+void trace_counter(const char *name, int64_t value)
+{
+    record(name, 'C', trace_now(), 0, value);
+}
+
+void trace_instant(const char *name)
+{
+    record(name, 'i', trace_now(), 0, 0);
+}
+
+// Microseconds since trace_init, with the sub-microsecond part Chrome accepts
+static void write_time(FILE *file, const char *key, uint64_t ns)
+{
+    fprintf(file, "\"%s\":%llu.%03llu", key, (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+}
+
+void trace_flush(void)
+{
+    FILE *file;
+    size_t i;
+    int pid = (int)getpid();
+
+    if (!trace_enabled || !trace_path) {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    file = fopen(trace_path, "w");
+    if (!file) {
+        fprintf(stderr, "Can't write trace %s\n", trace_path);
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"lvl\"}}", pid);
+    for (i = 0; i < event_count; i++) {
+        const TraceEvent *event = &events[i];
+        uint64_t ts = event->ts > trace_origin ? event->ts - trace_origin : 0;
+
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":%ld,", event->name, event->phase, pid, event->tid);
+        write_time(file, "ts", ts);
+        switch (event->phase) {
+        case 'X':
+            fputc(',', file);
+            write_time(file, "dur", event->dur);
+            break;
+        case 'C':
+            fprintf(file, ",\"args\":{\"value\":%lld}", (long long)event->value);
+            break;
+        case 'i':
+            fprintf(file, ",\"s\":\"p\"");
+            break;
+        }
+        fputc('}', file);
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    pthread_mutex_unlock(&trace_lock);
+
+    fprintf(stderr, "Wrote trace to %s\n", trace_path);
+}
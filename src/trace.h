@@ -0,0 +1,51 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+// Scoped spans and counters written as a Chrome trace (chrome://tracing,
+// ui.perfetto.dev). Tracing is off unless trace_init is called; then a span
+// costs one branch on a global. Build with -DLVL_NO_TRACE to compile it out.
+//
+// Names must be string literals; only the pointer is kept.
+
+typedef struct {
+    const char *name;
+    uint64_t start;  // ns, 0 when tracing was off at the start of the scope
+} TraceSpan;
+
+extern int trace_enabled;
+
+// Enables tracing; the trace is written to path when the process exits
+void trace_init(const char *path);
+// Enables tracing for --trace[=FILE] or LVL_TRACE=1|FILE, removing the
+// option from argv
+void trace_init_from_args(int *argc, char **argv);
+uint64_t trace_now(void);
+void trace_span_end(TraceSpan *span);
+void trace_counter(const char *name, int64_t value);
+void trace_instant(const char *name);
+// Writes the trace now instead of at exit
+void trace_flush(void);
+
+#ifndef LVL_NO_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Times the rest of the enclosing block
+#define TRACE_SCOPE(name) \
+    TraceSpan TRACE_CONCAT(trace_span_, __LINE__) __attribute__((cleanup(trace_span_end))) = \
+        { (name), trace_enabled ? trace_now() : 0 }
+// For spans that don't line up with a block: TraceSpan s = TRACE_BEGIN("x"); ... TRACE_END(s);
+#define TRACE_BEGIN(name) ((TraceSpan){ (name), trace_enabled ? trace_now() : 0 })
+#define TRACE_END(span) trace_span_end(&(span))
+#define TRACE_COUNTER(name, value) do { if (trace_enabled) trace_counter((name), (int64_t)(value)); } while (0)
+#define TRACE_INSTANT(name) do { if (trace_enabled) trace_instant(name); } while (0)
+#else
+#define TRACE_SCOPE(name) do { } while (0)
+#define TRACE_BEGIN(name) ((TraceSpan){ (name), 0 })
+#define TRACE_END(span) ((void)(span))
+#define TRACE_COUNTER(name, value) do { } while (0)
+#define TRACE_INSTANT(name) do { } while (0)
+#endif
+
+#endif /* __TRACE_H__ */
@@ -3,6 +3,7 @@
 
 #include <glib.h>
 
-gboolean validate_steam_credentials(const char *api_key, const char *steam_id);
+gboolean validate_steam_credentials_format(const char *api_key, const char *steam_id);
+gboolean validate_player_summary(const char *json);
 
 #endif /* __VALIDATION_H__ */
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vdf.h"
+
+#define VDF_MAX_DEPTH 64
+
+typedef struct {
+    char *text;
+    size_t len;
+    size_t cap;
+} VdfToken;
+
+static int token_push(VdfToken *token, char c)
+{
+    if (token->len + 1 >= token->cap) {
+        size_t cap = token->cap ? token->cap * 2 : 64;
+        char *text = realloc(token->text, cap);
+        if (!text) {
+            return 0;
+        }
+        token->text = text;
+        token->cap = cap;
+    }
+    token->text[token->len++] = c;
+    token->text[token->len] = '\0';
+    return 1;
+}
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Reads a quoted or bare string starting at *p into token
+static int read_string(const char **p, const char *end, VdfToken *token, const char **error)
+{
+    const char *s = *p;
+
+    token->len = 0;
+    if (!token_push(token, '\0')) {
+        *error = "out of memory";
+        return 0;
+    }
+    token->len = 0;
+
+    if (*s == '"') {
+        for (s++; s < end && *s != '"'; s++) {
+            char c = *s;
+
+            if (c == '\\' && s + 1 < end) {
+                switch (s[1]) {
+                case 'n':  c = '\n'; s++; break;
+                case 't':  c = '\t'; s++; break;
+                case '\\': c = '\\'; s++; break;
+                case '"':  c = '"';  s++; break;
+                default:   break;  // Kept as is, as Steam does with Windows paths
+                }
+            }
+            if (!token_push(token, c)) {
+                *error = "out of memory";
+                return 0;
+            }
+        }
+        if (s == end) {
+            *error = "unterminated string";
+            return 0;
+        }
+        s++;
+    } else {
+        for (; s < end && !is_space(*s) && *s != '{' && *s != '}' && *s != '"'; s++) {
+            if (!token_push(token, *s)) {
+                *error = "out of memory";
+                return 0;
+            }
+        }
+    }
+
+    *p = s;
+    return 1;
+}
+
+int vdf_parse(const char *data, size_t len, VdfEventCallback callback, void *user_data, const char **error)
+{
+    const char *p = data;
+    const char *end = data + len;
+    VdfToken key = {0}, value = {0};
+    int has_key = 0;
+    int depth = 0;
+    int ok = 1;
+
+    *error = NULL;
+    // A UTF-8 byte order mark is allowed in front
+    if (len >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+        p += 3;
+    }
+
+    while (ok) {
+        while (p < end && is_space(*p)) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+
+        if (*p == '/' && p + 1 < end && p[1] == '/') {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+        } else if (*p == '[') {
+            // Platform conditionals such as [$WIN32] apply to the pair before
+            // them; they make no difference to what we read
+            while (p < end && *p != ']') {
+                p++;
+            }
+            p += p < end;
+        } else if (*p == '{') {
+            p++;
+            if (!has_key) {
+                *error = "object without a key";
+                ok = 0;
+            } else if (depth == VDF_MAX_DEPTH) {
+                *error = "nested too deeply";
+                ok = 0;
+            } else {
+                has_key = 0;
+                if (callback(VDF_EVENT_OBJECT_START, key.text, NULL, depth++, user_data)) {
+                    break;
+                }
+            }
+        } else if (*p == '}') {
+            p++;
+            if (has_key) {
+                *error = "key without a value";
+                ok = 0;
+            } else if (depth == 0) {
+                *error = "unbalanced }";
+                ok = 0;
+            } else if (callback(VDF_EVENT_OBJECT_END, NULL, NULL, --depth, user_data)) {
+                break;
+            }
+        } else if (!has_key) {
+            ok = read_string(&p, end, &key, error);
+            has_key = 1;
+        } else {
+            ok = read_string(&p, end, &value, error);
+            has_key = 0;
+            if (ok && callback(VDF_EVENT_VALUE, key.text, value.text, depth, user_data)) {
+                break;
+            }
+        }
+    }
+
+    if (ok && p == end && (depth > 0 || has_key)) {
+        *error = "unexpected end of input";
+        ok = 0;
+    }
+    free(key.text);
+    free(value.text);
+    return ok;
+}
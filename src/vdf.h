@@ -0,0 +1,24 @@
+#ifndef __VDF_H__
+#define __VDF_H__
+
+#include <stddef.h>
+
+typedef enum {
+    VDF_EVENT_VALUE,         // "key" "value"
+    VDF_EVENT_OBJECT_START,  // "key" {
+    VDF_EVENT_OBJECT_END     // }
+} VdfEvent;
+
+// key and value are NUL terminated and only valid for the duration of the
+// call; key is NULL for OBJECT_END and value is NULL unless the event is a
+// VALUE. depth is 0 for the pairs at the root, 1 inside the first object and
+// so on. Return non-zero to stop parsing.
+typedef int (*VdfEventCallback)(VdfEvent event, const char *key, const char *value, int depth, void *user_data);
+
+// Parses Valve's KeyValues text format, as used by libraryfolders.vdf and
+// appmanifest_*.acf, in a single pass without building a tree. Returns 1 on
+// success or when the callback stopped it, 0 on a syntax error, which *error
+// then describes.
+int vdf_parse(const char *data, size_t len, VdfEventCallback callback, void *user_data, const char **error);
+
+#endif /* __VDF_H__ */